@@ -12,6 +12,14 @@ define_property(TARGET PROPERTY INTERFACE_SHADER_INCLUDE_DIRECTORIES
 )
 
 find_program(glslang_validator glslangValidator)
+find_program(spirv_opt spirv-opt)
+
+option(OPTIMIZE_SHADERS "Run spirv-opt on all shaders and report how it changed them" ON)
+if(OPTIMIZE_SHADERS AND NOT spirv_opt)
+  message(WARNING "spirv-opt was not found, shaders won't be optimized")
+  set(OPTIMIZE_SHADERS OFF)
+endif()
+set(spirv_stats_script "${CMAKE_CURRENT_LIST_DIR}/spirv_stats.cmake")
 
 # Wokrs same way as target_include_directories, i.e. PUBLIC/PRIVATE/INTERFACE are supported
 function(target_shader_include_directories tgt)
@@ -36,6 +44,10 @@ function(target_shader_include_directories tgt)
   endforeach(arg)
 endfunction()
 
+# Every argument is either a shader or a FEATURES keyword followed by names of preprocessor
+# defines that the preceding shader can be compiled with. A SPIR-V binary is compiled for
+# every combination of features: <shader>.spv with none of them and <shader>.<mask>.spv,
+# where bit i of the mask stands for the i-th feature being defined.
 function(target_add_shaders tgt)
   list(POP_FRONT ${ARGN})
 
@@ -43,25 +55,114 @@ function(target_add_shaders tgt)
 
   set(incl_dirs "$<TARGET_GENEX_EVAL:${tgt},$<TARGET_PROPERTY:${tgt},SHADER_INCLUDE_DIRECTORIES>>")
 
-  foreach(glsl_path ${ARGN})
+  set(stats_list "")
+
+  set(shaders "")
+  set(parsing_features FALSE)
+  foreach(arg ${ARGN})
+    list(LENGTH shaders shader_count)
+    if("${arg}" STREQUAL "FEATURES")
+      set(parsing_features TRUE)
+    elseif(parsing_features AND "${arg}" MATCHES "^[A-Z_][A-Z0-9_]*$")
+      math(EXPR shader_index "${shader_count} - 1")
+      list(APPEND shader_features_${shader_index} ${arg})
+    else()
+      set(parsing_features FALSE)
+      list(APPEND shaders ${arg})
+    endif()
+  endforeach(arg)
+
+  # Lists sources and include directories for in-process recompilation, see ShaderHotReloader
+  set(hot_reload_manifest "$<$<BOOL:${incl_dirs}>:include $<JOIN:${incl_dirs},\ninclude >\n>")
+
+  set(shader_index 0)
+  foreach(glsl_path ${shaders})
+    set(features ${shader_features_${shader_index}})
+    math(EXPR shader_index "${shader_index} + 1")
+
+    list(LENGTH features feature_count)
+    if(feature_count GREATER 6)
+      message(FATAL_ERROR "${glsl_path} has ${feature_count} features, that's way too many permutations!")
+    endif()
+    math(EXPR last_mask "(1 << ${feature_count}) - 1")
+
     set(input_path "${CMAKE_CURRENT_LIST_DIR}/${glsl_path}")
-    set(output_path "${shader_binaries_dir}/$<PATH:GET_FILENAME,${glsl_path}>.spv")
-    add_custom_command(
-        OUTPUT ${output_path}
-        COMMAND ${CMAKE_COMMAND} -E make_directory ${shader_binaries_dir}
-        COMMAND ${glslang_validator}
-          "$<$<BOOL:${incl_dirs}>:-I$<JOIN:${incl_dirs},;-I>>"
-          "$<$<CONFIG:Debug>:-g>"
-          -V
-          ${input_path}
-          -o ${output_path}
-          --depfile "${output_path}.d"
-        VERBATIM
-        COMMAND_EXPAND_LISTS
-        DEPENDS ${input_path}
-        DEPFILE "${output_path}.d"
-      )
-    list(APPEND SPIRV_BINARY_FILES ${output_path})
+    get_filename_component(glsl_name ${glsl_path} NAME)
+    string(APPEND hot_reload_manifest "source ${input_path}\n")
+
+    foreach(mask RANGE ${last_mask})
+      set(defines "")
+      set(bit 0)
+      foreach(feature ${features})
+        math(EXPR feature_enabled "(${mask} >> ${bit}) & 1")
+        if(feature_enabled)
+          list(APPEND defines ${feature})
+        endif()
+        math(EXPR bit "${bit} + 1")
+      endforeach(feature)
+
+      if(mask EQUAL 0)
+        set(output_path "${shader_binaries_dir}/${glsl_name}.spv")
+      else()
+        set(output_path "${shader_binaries_dir}/${glsl_name}.${mask}.spv")
+        list(JOIN defines " " manifest_defines)
+        string(APPEND hot_reload_manifest "variant ${glsl_name}.${mask}.spv ${manifest_defines}\n")
+      endif()
+
+      list(TRANSFORM defines PREPEND "-D")
+
+      # With optimization, glslangValidator's output is kept separately for comparison
+      if(OPTIMIZE_SHADERS)
+        get_filename_component(binary_name ${output_path} NAME)
+        set(compiled_path "${shader_binaries_dir}/unoptimized/${binary_name}")
+      else()
+        set(compiled_path ${output_path})
+      endif()
+
+      get_filename_component(compiled_dir ${compiled_path} DIRECTORY)
+      add_custom_command(
+          OUTPUT ${compiled_path}
+          COMMAND ${CMAKE_COMMAND} -E make_directory ${compiled_dir}
+          COMMAND ${glslang_validator}
+            "$<$<BOOL:${incl_dirs}>:-I$<JOIN:${incl_dirs},;-I>>"
+            "$<$<CONFIG:Debug>:-g>"
+            ${defines}
+            -V
+            --target-env vulkan1.3
+            ${input_path}
+            -o ${compiled_path}
+            --depfile "${compiled_path}.d"
+          VERBATIM
+          COMMAND_EXPAND_LISTS
+          DEPENDS ${input_path}
+          DEPFILE "${compiled_path}.d"
+        )
+
+      if(OPTIMIZE_SHADERS)
+        add_custom_command(
+            OUTPUT ${output_path} "${output_path}.stats"
+            COMMAND ${spirv_opt}
+              -O
+              "$<$<CONFIG:Release>:--strip-debug>"
+              --target-env=vulkan1.3
+              ${compiled_path}
+              -o ${output_path}
+            COMMAND ${CMAKE_COMMAND}
+              -DMODE=stats
+              -DNAME=${binary_name}
+              -DBEFORE=${compiled_path}
+              -DAFTER=${output_path}
+              -DOUTPUT=${output_path}.stats
+              -P ${spirv_stats_script}
+            VERBATIM
+            COMMAND_EXPAND_LISTS
+            DEPENDS ${compiled_path} ${spirv_stats_script}
+          )
+        string(APPEND stats_list "${output_path}.stats\n")
+      endif()
+
+      list(APPEND SPIRV_BINARY_FILES ${output_path})
+    endforeach(mask)
   endforeach(glsl_path)
 
   set(custom_target_name "${tgt}_shaders")
@@ -73,6 +174,29 @@ function(target_add_shaders tgt)
       TRANSITIVE_COMPILE_PROPERTIES "SHADER_INCLUDE_DIRECTORIES"
     )
 
+    file(GENERATE
+      OUTPUT "${shader_binaries_dir}/hot_reload.txt"
+      CONTENT "${hot_reload_manifest}"
+    )
+
+    # Sizes and instruction counts before and after optimization, to keep an eye on them
+    if(OPTIMIZE_SHADERS)
+      set(report_path "${shader_binaries_dir}/spirv_report.txt")
+      file(WRITE "${shader_binaries_dir}/spirv_stats.txt" "${stats_list}")
+      add_custom_command(
+          OUTPUT ${report_path}
+          COMMAND ${CMAKE_COMMAND}
+            -DMODE=report
+            -DTARGET=${tgt}
+            -DSTATS_LIST=${shader_binaries_dir}/spirv_stats.txt
+            -DOUTPUT=${report_path}
+            -P ${spirv_stats_script}
+          VERBATIM
+          DEPENDS ${SPIRV_BINARY_FILES} ${spirv_stats_script}
+        )
+      list(APPEND SPIRV_BINARY_FILES ${report_path})
+    endif()
+
     add_custom_target(${custom_target_name} DEPENDS ${SPIRV_BINARY_FILES})
     add_dependencies(${tgt} ${custom_target_name})
     add_compile_definitions(${tgt}
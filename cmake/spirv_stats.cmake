@@ -0,0 +1,81 @@
+# Size and instruction count statistics of SPIR-V binaries, used by target_add_shaders.
+# Runs in script mode, so nothing but cmake itself is needed:
+#   cmake -DMODE=stats -DNAME=<shader> -DBEFORE=<spv> -DAFTER=<spv> -DOUTPUT=<file> -P spirv_stats.cmake
+#     writes a line of statistics for a shader before and after optimization
+#   cmake -DMODE=report -DTARGET=<name> -DSTATS_LIST=<file> -DOUTPUT=<file> -P spirv_stats.cmake
+#     gathers statistics from files listed in STATS_LIST, one per line, into a report
+
+cmake_minimum_required(VERSION 3.20)
+
+# Every instruction starts with a word which has the word count in its upper 16 bits
+function(count_spirv_instructions path out_var)
+  file(READ "${path}" hex HEX)
+  string(LENGTH "${hex}" hex_length)
+
+  # The header is 5 words long, 8 hex digits per word
+  set(offset 40)
+  set(count 0)
+  while(offset LESS hex_length)
+    # NOTE: words are little-endian, so the word count is in bytes 2 and 3
+    math(EXPR low_offset "${offset} + 4")
+    math(EXPR high_offset "${offset} + 6")
+    string(SUBSTRING "${hex}" ${low_offset} 2 low)
+    string(SUBSTRING "${hex}" ${high_offset} 2 high)
+    math(EXPR word_count "0x${high}${low}")
+    if(word_count EQUAL 0)
+      message(FATAL_ERROR "${path} is not a valid SPIR-V binary")
+    endif()
+    math(EXPR offset "${offset} + ${word_count} * 8")
+    math(EXPR count "${count} + 1")
+  endwhile()
+
+  set(${out_var} ${count} PARENT_SCOPE)
+endfunction()
+
+if(MODE STREQUAL "stats")
+  file(SIZE "${BEFORE}" size_before)
+  file(SIZE "${AFTER}" size_after)
+  count_spirv_instructions("${BEFORE}" instructions_before)
+  count_spirv_instructions("${AFTER}" instructions_after)
+  file(WRITE "${OUTPUT}"
+    "${NAME} ${size_before} ${size_after} ${instructions_before} ${instructions_after}\n")
+
+elseif(MODE STREQUAL "report")
+  file(STRINGS "${STATS_LIST}" stats_files)
+
+  set(report "SPIR-V of ${TARGET} before and after spirv-opt\n\n")
+  set(total_size_before 0)
+  set(total_size_after 0)
+  set(total_instructions_before 0)
+  set(total_instructions_after 0)
+
+  list(SORT stats_files)
+  foreach(stats_file ${stats_files})
+    file(STRINGS "${stats_file}" line LIMIT_COUNT 1)
+    string(REPLACE " " ";" fields "${line}")
+    list(GET fields 0 name)
+    list(GET fields 1 size_before)
+    list(GET fields 2 size_after)
+    list(GET fields 3 instructions_before)
+    list(GET fields 4 instructions_after)
+
+    math(EXPR total_size_before "${total_size_before} + ${size_before}")
+    math(EXPR total_size_after "${total_size_after} + ${size_after}")
+    math(EXPR total_instructions_before "${total_instructions_before} + ${instructions_before}")
+    math(EXPR total_instructions_after "${total_instructions_after} + ${instructions_after}")
+
+    string(APPEND report "${name}: ${size_before} -> ${size_after} bytes, "
+      "${instructions_before} -> ${instructions_after} instructions\n")
+  endforeach()
+
+  string(APPEND report
+    "\ntotal: ${total_size_before} -> ${total_size_after} bytes, "
+    "${total_instructions_before} -> ${total_instructions_after} instructions\n")
+
+  file(WRITE "${OUTPUT}" "${report}")
+  message(STATUS "${TARGET}: SPIR-V ${total_size_before} -> ${total_size_after} bytes, "
+    "${total_instructions_before} -> ${total_instructions_after} instructions")
+
+else()
+  message(FATAL_ERROR "Unknown MODE '${MODE}'")
+endif()
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+// Straightforward scalar implementations of GpuPrimitives,
+// used for validating GPU results and as a baseline in benchmarks.
+
+inline std::uint32_t reference_reduce(std::span<const std::uint32_t> input)
+{
+  return std::accumulate(input.begin(), input.end(), std::uint32_t{0});
+}
+
+inline void reference_exclusive_scan(
+  std::span<const std::uint32_t> input, std::span<std::uint32_t> output)
+{
+  std::uint32_t sum = 0;
+  for (std::size_t i = 0; i < input.size(); ++i)
+  {
+    output[i] = sum;
+    sum += input[i];
+  }
+}
+
+// Returns the amount of elements written to output
+inline std::size_t reference_compact(
+  std::span<const std::uint32_t> input,
+  std::span<const std::uint32_t> flags,
+  std::span<std::uint32_t> output)
+{
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < input.size(); ++i)
+    if (flags[i] != 0)
+      output[count++] = input[i];
+  return count;
+}
+
+inline void reference_sort_pairs(std::span<std::uint32_t> keys, std::span<std::uint32_t> values)
+{
+  std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs(keys.size());
+  for (std::size_t i = 0; i < keys.size(); ++i)
+    pairs[i] = {keys[i], values[i]};
+
+  std::stable_sort(
+    pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  for (std::size_t i = 0; i < keys.size(); ++i)
+  {
+    keys[i] = pairs[i].first;
+    values[i] = pairs[i].second;
+  }
+}
@@ -0,0 +1,357 @@
+#include "GpuPrimitives.hpp"
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Etna.hpp>
+#include <etna/PipelineManager.hpp>
+#include <etna/DescriptorSet.hpp>
+#include <etna/Profiling.hpp>
+
+#include "GpuPrimitivesParams.h"
+
+
+static constexpr std::uint32_t LOOKBACK_MAX_COUNT = 1u << 30;
+
+static std::uint32_t tile_count(std::uint32_t count)
+{
+  return (count + GPU_PRIMITIVES_TILE_SIZE - 1) / GPU_PRIMITIVES_TILE_SIZE;
+}
+
+// NOTE: primitives are chains of dependent dispatches, a global barrier is
+// much simpler and no slower than per-buffer ones here.
+static void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+static void transfer_to_compute_barrier(vk::CommandBuffer cmd_buf)
+{
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+}
+
+static void compute_to_compute_barrier(vk::CommandBuffer cmd_buf)
+{
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+}
+
+static void compute_to_transfer_barrier(vk::CommandBuffer cmd_buf)
+{
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite);
+}
+
+static void bind_compute(
+  vk::CommandBuffer cmd_buf,
+  const etna::ComputePipeline& pipeline,
+  const char* program_name,
+  std::vector<etna::Binding> bindings)
+{
+  auto programInfo = etna::get_shader_program(program_name);
+  auto set =
+    etna::create_descriptor_set(programInfo.getDescriptorLayoutId(0), cmd_buf, std::move(bindings));
+  vk::DescriptorSet vkSet = set.getVkSet();
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
+}
+
+template <class T>
+static void push_constants(
+  vk::CommandBuffer cmd_buf, const etna::ComputePipeline& pipeline, const T& value)
+{
+  cmd_buf.pushConstants(
+    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(value), &value);
+}
+
+GpuPrimitives::GpuPrimitives(std::uint32_t max_count)
+  : maxCount{max_count}
+{
+  auto& ctx = etna::get_context();
+
+  ETNA_VERIFYF(
+    maxCount < LOOKBACK_MAX_COUNT,
+    "GPU primitives support at most {} elements, {} requested",
+    LOOKBACK_MAX_COUNT - 1,
+    maxCount);
+
+  {
+    auto propsChain = ctx.getPhysicalDevice()
+                        .getProperties2<
+                          vk::PhysicalDeviceProperties2,
+                          vk::PhysicalDeviceSubgroupProperties>();
+    const auto& props = propsChain.get<vk::PhysicalDeviceSubgroupProperties>();
+    ETNA_VERIFYF(
+      (props.supportedStages & vk::ShaderStageFlagBits::eCompute) &&
+        (props.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic),
+      "GPU primitives require subgroup arithmetic in compute shaders!");
+  }
+
+  maxGroupsX = ctx.getPhysicalDevice().getProperties().limits.maxComputeWorkGroupCount[0];
+
+  const std::array<const char*, 6> shaders{
+    "reduce",
+    "scan",
+    "compact",
+    "radix_histogram",
+    "radix_scan_histogram",
+    "radix_onesweep",
+  };
+  for (const char* shader : shaders)
+  {
+    const std::string name = std::string("gpu_primitives_") + shader;
+    if (etna::get_program_id(name.c_str()) == etna::ShaderProgramId::Invalid)
+      etna::create_program(
+        name.c_str(), {std::string(GPU_PRIMITIVES_SHADERS_ROOT) + shader + ".comp.spv"});
+  }
+
+  auto& pipelineManager = ctx.getPipelineManager();
+  reducePipeline = pipelineManager.createComputePipeline("gpu_primitives_reduce", {});
+  scanPipeline = pipelineManager.createComputePipeline("gpu_primitives_scan", {});
+  compactPipeline = pipelineManager.createComputePipeline("gpu_primitives_compact", {});
+  radixHistogramPipeline =
+    pipelineManager.createComputePipeline("gpu_primitives_radix_histogram", {});
+  radixScanHistogramPipeline =
+    pipelineManager.createComputePipeline("gpu_primitives_radix_scan_histogram", {});
+  radixOnesweepPipeline =
+    pipelineManager.createComputePipeline("gpu_primitives_radix_onesweep", {});
+
+  const vk::BufferUsageFlags scratchUsage =
+    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst;
+  const vk::DeviceSize elements = std::max(maxCount, 1u);
+
+  // Radix sort needs a separate look-back per digit, scan and compaction reuse a part of it
+  tileStates = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) *
+      (1 + vk::DeviceSize{tile_count(maxCount)} * GPU_PRIMITIVES_RADIX_BINS),
+    .bufferUsage = scratchUsage,
+    .name = "gpu_primitives_tile_states",
+  });
+  radixHistograms = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * GPU_PRIMITIVES_RADIX_PASSES * GPU_PRIMITIVES_RADIX_BINS,
+    .bufferUsage = scratchUsage,
+    .name = "gpu_primitives_radix_histograms",
+  });
+  tmpKeys = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * elements,
+    .bufferUsage = scratchUsage,
+    .name = "gpu_primitives_tmp_keys",
+  });
+  tmpValues = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = sizeof(std::uint32_t) * elements,
+    .bufferUsage = scratchUsage,
+    .name = "gpu_primitives_tmp_values",
+  });
+}
+
+void GpuPrimitives::clearTileStates(vk::CommandBuffer cmd_buf, std::uint32_t states)
+{
+  // The previous dispatch, or the previous call sharing tileStates, may still be doing its
+  // look-back through them
+  compute_to_transfer_barrier(cmd_buf);
+  cmd_buf.fillBuffer(
+    tileStates.get(), 0, sizeof(std::uint32_t) * (1 + vk::DeviceSize{states}), 0);
+}
+
+void GpuPrimitives::dispatchTiles(vk::CommandBuffer cmd_buf, std::uint32_t count)
+{
+  // Tiles are handed out by an atomic counter, so the shape of the grid doesn't matter
+  // and excess workgroups exit right away.
+  const std::uint32_t groups = tile_count(count);
+  const std::uint32_t groupsX = std::min(groups, maxGroupsX);
+  const std::uint32_t groupsY = (groups + groupsX - 1) / groupsX;
+  cmd_buf.dispatch(groupsX, groupsY, 1);
+}
+
+void GpuPrimitives::reduce(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  std::uint32_t count,
+  const etna::Buffer& result)
+{
+  ETNA_VERIFY(count <= maxCount);
+  ETNA_PROFILE_GPU(cmd_buf, gpuPrimitivesReduce);
+
+  cmd_buf.fillBuffer(result.get(), 0, sizeof(std::uint32_t), 0);
+  transfer_to_compute_barrier(cmd_buf);
+
+  if (count == 0)
+    return;
+
+  bind_compute(
+    cmd_buf,
+    reducePipeline,
+    "gpu_primitives_reduce",
+    {etna::Binding{0, input.genBinding()}, etna::Binding{1, result.genBinding()}});
+  push_constants(cmd_buf, reducePipeline, count);
+
+  const std::uint32_t groups = std::min<std::uint32_t>(
+    (count + GPU_PRIMITIVES_WORKGROUP_SIZE - 1) / GPU_PRIMITIVES_WORKGROUP_SIZE,
+    GPU_PRIMITIVES_REDUCE_MAX_GROUPS);
+  cmd_buf.dispatch(groups, 1, 1);
+}
+
+void GpuPrimitives::exclusiveScan(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& output,
+  std::uint32_t count)
+{
+  ETNA_VERIFY(count <= maxCount);
+  ETNA_PROFILE_GPU(cmd_buf, gpuPrimitivesExclusiveScan);
+
+  if (count == 0)
+    return;
+
+  clearTileStates(cmd_buf, tile_count(count));
+  transfer_to_compute_barrier(cmd_buf);
+
+  bind_compute(
+    cmd_buf,
+    scanPipeline,
+    "gpu_primitives_scan",
+    {
+      etna::Binding{0, input.genBinding()},
+      etna::Binding{1, output.genBinding()},
+      etna::Binding{2, tileStates.genBinding()},
+    });
+  push_constants(cmd_buf, scanPipeline, count);
+  dispatchTiles(cmd_buf, count);
+}
+
+void GpuPrimitives::compact(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& input,
+  const etna::Buffer& flags,
+  std::uint32_t count,
+  const etna::Buffer& output,
+  const etna::Buffer& output_count)
+{
+  ETNA_VERIFY(count <= maxCount);
+  ETNA_PROFILE_GPU(cmd_buf, gpuPrimitivesCompact);
+
+  // The shader only writes the count when there is at least one tile
+  cmd_buf.fillBuffer(output_count.get(), 0, sizeof(std::uint32_t), 0);
+  clearTileStates(cmd_buf, tile_count(count));
+  transfer_to_compute_barrier(cmd_buf);
+
+  if (count == 0)
+    return;
+
+  bind_compute(
+    cmd_buf,
+    compactPipeline,
+    "gpu_primitives_compact",
+    {
+      etna::Binding{0, input.genBinding()},
+      etna::Binding{1, flags.genBinding()},
+      etna::Binding{2, output.genBinding()},
+      etna::Binding{3, output_count.genBinding()},
+      etna::Binding{4, tileStates.genBinding()},
+    });
+  push_constants(cmd_buf, compactPipeline, count);
+  dispatchTiles(cmd_buf, count);
+}
+
+void GpuPrimitives::sortPairs(
+  vk::CommandBuffer cmd_buf,
+  const etna::Buffer& keys,
+  const etna::Buffer& values,
+  std::uint32_t count)
+{
+  ETNA_VERIFY(count <= maxCount);
+  ETNA_PROFILE_GPU(cmd_buf, gpuPrimitivesSortPairs);
+
+  if (count <= 1)
+    return;
+
+  // Histograms of all digits are gathered in a single read of the keys
+  cmd_buf.fillBuffer(radixHistograms.get(), 0, vk::WholeSize, 0);
+  transfer_to_compute_barrier(cmd_buf);
+
+  bind_compute(
+    cmd_buf,
+    radixHistogramPipeline,
+    "gpu_primitives_radix_histogram",
+    {etna::Binding{0, keys.genBinding()}, etna::Binding{1, radixHistograms.genBinding()}});
+  push_constants(cmd_buf, radixHistogramPipeline, count);
+  cmd_buf.dispatch(
+    std::min<std::uint32_t>(
+      (count + GPU_PRIMITIVES_WORKGROUP_SIZE - 1) / GPU_PRIMITIVES_WORKGROUP_SIZE,
+      GPU_PRIMITIVES_REDUCE_MAX_GROUPS),
+    1,
+    1);
+  compute_to_compute_barrier(cmd_buf);
+
+  bind_compute(
+    cmd_buf,
+    radixScanHistogramPipeline,
+    "gpu_primitives_radix_scan_histogram",
+    {etna::Binding{0, radixHistograms.genBinding()}});
+  cmd_buf.dispatch(GPU_PRIMITIVES_RADIX_PASSES, 1, 1);
+  compute_to_compute_barrier(cmd_buf);
+
+  // Even amount of passes, so the result ends up back in the user's buffers
+  static_assert(GPU_PRIMITIVES_RADIX_PASSES % 2 == 0);
+  const std::array<const etna::Buffer*, 2> keyBuffers{&keys, &tmpKeys};
+  const std::array<const etna::Buffer*, 2> valueBuffers{&values, &tmpValues};
+
+  for (std::uint32_t pass = 0; pass < GPU_PRIMITIVES_RADIX_PASSES; ++pass)
+  {
+    const std::uint32_t src = pass % 2;
+    const std::uint32_t dst = 1 - src;
+
+    clearTileStates(cmd_buf, tile_count(count) * GPU_PRIMITIVES_RADIX_BINS);
+    transfer_to_compute_barrier(cmd_buf);
+
+    bind_compute(
+      cmd_buf,
+      radixOnesweepPipeline,
+      "gpu_primitives_radix_onesweep",
+      {
+        etna::Binding{0, keyBuffers[src]->genBinding()},
+        etna::Binding{1, valueBuffers[src]->genBinding()},
+        etna::Binding{2, keyBuffers[dst]->genBinding()},
+        etna::Binding{3, valueBuffers[dst]->genBinding()},
+        etna::Binding{4, radixHistograms.genBinding()},
+        etna::Binding{5, tileStates.genBinding()},
+      });
+    push_constants(cmd_buf, radixOnesweepPipeline, std::array{count, pass});
+    dispatchTiles(cmd_buf, count);
+
+    if (pass + 1 < GPU_PRIMITIVES_RADIX_PASSES)
+      compute_to_compute_barrier(cmd_buf);
+  }
+}
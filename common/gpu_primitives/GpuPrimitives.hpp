@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+#include <etna/Vulkan.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/ComputePipeline.hpp>
+
+
+/**
+ * Basic data-parallel building blocks on uint32 data: reduction, exclusive scan,
+ * stream compaction and key-value radix sort. Everything is recorded into a user-provided
+ * command buffer, so the primitives can be freely mixed with other GPU work.
+ *
+ * Scan and compaction are single-pass (decoupled look-back), sort is a "onesweep"-like
+ * LSD radix sort: one histogram pass for all digits plus a single pass per digit.
+ *
+ * NOTE: the caller is responsible for making inputs visible to compute shaders before
+ * calling a primitive, and for syncing with the outputs after it. Descriptor sets are
+ * allocated from etna's per-frame pool, so the usual begin_frame/end_frame rules apply.
+ *
+ * Limitations:
+ *  - At most `max_count` elements, which must be below 2^30.
+ *  - Scan results must fit into 30 bits, the look-back packs flags into the top 2 bits.
+ *  - Buffers that are written by the primitives must have eStorageBuffer and eTransferDst usage.
+ */
+class GpuPrimitives
+{
+public:
+  explicit GpuPrimitives(std::uint32_t max_count);
+
+  GpuPrimitives(const GpuPrimitives&) = delete;
+  GpuPrimitives& operator=(const GpuPrimitives&) = delete;
+
+  // result[0] = sum of input[0..count)
+  void reduce(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    std::uint32_t count,
+    const etna::Buffer& result);
+
+  // output[i] = sum of input[0..i), input and output must not alias
+  void exclusiveScan(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& output,
+    std::uint32_t count);
+
+  // Writes input[i] for which flags[i] != 0 to output preserving order,
+  // output_count[0] receives the amount of elements written.
+  void compact(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& input,
+    const etna::Buffer& flags,
+    std::uint32_t count,
+    const etna::Buffer& output,
+    const etna::Buffer& output_count);
+
+  // Stable sort of (key, value) pairs by key, in place.
+  void sortPairs(
+    vk::CommandBuffer cmd_buf,
+    const etna::Buffer& keys,
+    const etna::Buffer& values,
+    std::uint32_t count);
+
+  std::uint32_t getMaxCount() const { return maxCount; }
+
+private:
+  void clearTileStates(vk::CommandBuffer cmd_buf, std::uint32_t states);
+  void dispatchTiles(vk::CommandBuffer cmd_buf, std::uint32_t count);
+
+private:
+  std::uint32_t maxCount;
+  std::uint32_t maxGroupsX;
+
+  etna::ComputePipeline reducePipeline;
+  etna::ComputePipeline scanPipeline;
+  etna::ComputePipeline compactPipeline;
+  etna::ComputePipeline radixHistogramPipeline;
+  etna::ComputePipeline radixScanHistogramPipeline;
+  etna::ComputePipeline radixOnesweepPipeline;
+
+  // Look-back states for scan-like primitives, a counter for handing out tiles goes first
+  etna::Buffer tileStates;
+  etna::Buffer radixHistograms;
+  etna::Buffer tmpKeys;
+  etna::Buffer tmpValues;
+};
@@ -0,0 +1,18 @@
+#ifndef GPU_PRIMITIVES_PARAMS_H_INCLUDED
+#define GPU_PRIMITIVES_PARAMS_H_INCLUDED
+
+// NOTE: included both into C++ and GLSL
+
+#define GPU_PRIMITIVES_WORKGROUP_SIZE 256
+#define GPU_PRIMITIVES_ITEMS_PER_THREAD 4
+// Amount of elements processed by a single workgroup in tiled (scan-like) primitives
+#define GPU_PRIMITIVES_TILE_SIZE (GPU_PRIMITIVES_WORKGROUP_SIZE * GPU_PRIMITIVES_ITEMS_PER_THREAD)
+
+// Reduction is done with a grid-stride loop over at most this many workgroups
+#define GPU_PRIMITIVES_REDUCE_MAX_GROUPS 1024
+
+#define GPU_PRIMITIVES_RADIX_BITS 8
+#define GPU_PRIMITIVES_RADIX_BINS 256
+#define GPU_PRIMITIVES_RADIX_PASSES 4
+
+#endif // GPU_PRIMITIVES_PARAMS_H_INCLUDED
@@ -0,0 +1,58 @@
+#ifndef DECOUPLED_LOOKBACK_GLSL_INCLUDED
+#define DECOUPLED_LOOKBACK_GLSL_INCLUDED
+
+// NOTE: the including shader must declare a coherent `tileStates` uint array
+// which is zeroed before the dispatch.
+
+// Tile states pack a 2-bit flag and a 30-bit value into a single word so that both
+// are published atomically. Hence, all (partial) sums must fit into 30 bits.
+#define LOOKBACK_FLAG_NOT_READY 0u
+#define LOOKBACK_FLAG_AGGREGATE (1u << 30)
+#define LOOKBACK_FLAG_PREFIX (2u << 30)
+#define LOOKBACK_FLAG_MASK (3u << 30)
+#define LOOKBACK_VALUE_MASK (~LOOKBACK_FLAG_MASK)
+
+// Single-pass prefix sum over tiles, see "Single-pass Parallel Prefix Scan with
+// Decoupled Look-back" by Merrill and Garland. Publishes the aggregate of this tile,
+// then walks back over the states of preceding tiles until an inclusive prefix is found.
+// State of tile `t` lives at `tileStates[first_state + t * state_stride]`,
+// which allows running independent look-backs for several counters (e.g. radix digits).
+// Returns the exclusive prefix of the tile.
+uint decoupled_lookback(uint first_state, uint state_stride, uint tile, uint aggregate)
+{
+  if (tile == 0)
+  {
+    atomicExchange(tileStates[first_state], LOOKBACK_FLAG_PREFIX | aggregate);
+    return 0;
+  }
+
+  atomicExchange(
+    tileStates[first_state + tile * state_stride], LOOKBACK_FLAG_AGGREGATE | aggregate);
+
+  uint exclusive = 0;
+  uint lookAt = tile - 1;
+  while (true)
+  {
+    // Atomic read, the state is being concurrently written by another workgroup
+    const uint state = atomicOr(tileStates[first_state + lookAt * state_stride], 0);
+    const uint flag = state & LOOKBACK_FLAG_MASK;
+
+    // Tile indices are handed out in launch order, so the preceding tile
+    // is guaranteed to be running and will publish something eventually.
+    if (flag == LOOKBACK_FLAG_NOT_READY)
+      continue;
+
+    exclusive += state & LOOKBACK_VALUE_MASK;
+    if (flag == LOOKBACK_FLAG_PREFIX)
+      break;
+
+    --lookAt;
+  }
+
+  atomicExchange(
+    tileStates[first_state + tile * state_stride], LOOKBACK_FLAG_PREFIX | (exclusive + aggregate));
+
+  return exclusive;
+}
+
+#endif // DECOUPLED_LOOKBACK_GLSL_INCLUDED
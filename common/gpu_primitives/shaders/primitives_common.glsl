@@ -0,0 +1,57 @@
+#ifndef PRIMITIVES_COMMON_GLSL_INCLUDED
+#define PRIMITIVES_COMMON_GLSL_INCLUDED
+
+// NOTE: requires GL_KHR_shader_subgroup_basic and GL_KHR_shader_subgroup_arithmetic
+
+#include "GpuPrimitivesParams.h"
+
+#define WORKGROUP_SIZE GPU_PRIMITIVES_WORKGROUP_SIZE
+#define ITEMS_PER_THREAD GPU_PRIMITIVES_ITEMS_PER_THREAD
+#define TILE_SIZE GPU_PRIMITIVES_TILE_SIZE
+
+// Assuming that no GPU has subgroups smaller than 4 invocations
+#define MAX_SUBGROUPS (WORKGROUP_SIZE / 4)
+
+shared uint sSubgroupSums[MAX_SUBGROUPS];
+
+// Must be called from uniform control flow by the whole workgroup.
+// Returns the exclusive prefix sum of `value` over the workgroup
+// in the order of gl_LocalInvocationIndex and writes the workgroup total.
+uint workgroup_exclusive_add(uint value, out uint total)
+{
+  const uint subgroupExclusive = subgroupExclusiveAdd(value);
+  const uint subgroupTotal = subgroupAdd(value);
+  if (subgroupElect())
+    sSubgroupSums[gl_SubgroupID] = subgroupTotal;
+  barrier();
+
+  uint prefix = 0;
+  total = 0;
+  for (uint i = 0; i < gl_NumSubgroups; ++i)
+  {
+    const uint sum = sSubgroupSums[i];
+    prefix += i < gl_SubgroupID ? sum : 0;
+    total += sum;
+  }
+  // Allows calling this again right away
+  barrier();
+
+  return prefix + subgroupExclusive;
+}
+
+uint workgroup_add(uint value)
+{
+  const uint subgroupTotal = subgroupAdd(value);
+  if (subgroupElect())
+    sSubgroupSums[gl_SubgroupID] = subgroupTotal;
+  barrier();
+
+  uint total = 0;
+  for (uint i = 0; i < gl_NumSubgroups; ++i)
+    total += sSubgroupSums[i];
+  barrier();
+
+  return total;
+}
+
+#endif // PRIMITIVES_COMMON_GLSL_INCLUDED
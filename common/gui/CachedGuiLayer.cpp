@@ -0,0 +1,180 @@
+#include "CachedGuiLayer.hpp"
+
+#include <imgui.h>
+#include <etna/GlobalContext.hpp>
+#include <etna/Profiling.hpp>
+
+#include "hashing/Hasher.hpp"
+
+
+CachedGuiLayer::CachedGuiLayer(CreateInfo info)
+  : format{info.format}
+  , resolution{info.resolution}
+  , imguiRenderer{std::make_unique<ImGuiRenderer>(info.format)}
+  , overlaySampler{etna::Sampler::CreateInfo{
+      .filter = vk::Filter::eNearest,
+      .name = "gui_overlay_sampler",
+    }}
+{
+  allocateOverlay();
+}
+
+void CachedGuiLayer::resize(glm::uvec2 res)
+{
+  resolution = res;
+  allocateOverlay();
+}
+
+void CachedGuiLayer::allocateOverlay()
+{
+  overlay = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{resolution.x, resolution.y, 1},
+    .name = "gui_overlay",
+    .format = format,
+    .imageUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled,
+  });
+
+  compositor = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
+    .format = format,
+    .rect = {{0, 0}, {resolution.x, resolution.y}},
+    .premultipliedAlphaBlend = true,
+  });
+
+  overlayDirty = true;
+}
+
+void CachedGuiLayer::setHidden(bool hide)
+{
+  hidden = hide;
+}
+
+bool CachedGuiLayer::beginFrame()
+{
+  if (hidden)
+  {
+    // ImGui's GLFW callbacks keep queueing input while we are not running frames,
+    // drop it so that it doesn't all get replayed when the GUI is shown again.
+    std::scoped_lock lock{imguiMutex};
+    ImGui::GetIO().ClearEventsQueue();
+    return false;
+  }
+
+  buildingLock = std::unique_lock{imguiMutex};
+  imguiRenderer->nextFrame();
+  ImGui::NewFrame();
+  return true;
+}
+
+CachedGuiLayer::Frame CachedGuiLayer::endFrame()
+{
+  ZoneScoped;
+
+  ImGui::Render();
+
+  // NOTE: hover highlights, text cursors and whatnot all end up in the draw data,
+  // so hashing it captures all input-driven changes and nothing more.
+  const ImDrawData* drawData = ImGui::GetDrawData();
+  const std::uint64_t hash = hashDrawData(drawData);
+  Frame frame = lastFrame;
+  if (frame.drawData == nullptr || hash != frame.hash)
+    frame = Frame{
+      .drawData = cloneDrawData(drawData),
+      .hash = hash,
+    };
+  buildingLock.unlock();
+
+  // NOTE: this may free the previous frame, which takes the lock again
+  lastFrame = frame;
+  return lastFrame;
+}
+
+void CachedGuiLayer::render(
+  vk::CommandBuffer cmd_buf,
+  vk::Image target_image,
+  vk::ImageView target_image_view,
+  const Frame& frame)
+{
+  if (frame.drawData == nullptr)
+  {
+    // The overlay is stale by the time the GUI is shown again
+    overlayDirty = true;
+    return;
+  }
+
+  if (resolution.x == 0 || resolution.y == 0)
+    return;
+
+  ++stats.framesRendered;
+
+  const bool overlayEmpty = frame.drawData->TotalVtxCount == 0;
+
+  if ((overlayDirty || frame.hash != overlayHash) && !overlayEmpty)
+  {
+    ZoneScopedN("rerenderGuiOverlay");
+    ++stats.overlayRerenders;
+
+    std::scoped_lock lock{imguiMutex};
+    imguiRenderer->render(
+      cmd_buf,
+      {{0, 0}, {resolution.x, resolution.y}},
+      overlay.get(),
+      overlay.getView({}),
+      frame.drawData.get(),
+      vk::AttachmentLoadOp::eClear);
+  }
+  overlayDirty = false;
+  overlayHash = frame.hash;
+
+  if (overlayEmpty)
+    return;
+
+  ETNA_PROFILE_GPU(cmd_buf, compositeGui);
+  compositor->render(cmd_buf, target_image, target_image_view, overlay, overlaySampler);
+}
+
+std::uint64_t CachedGuiLayer::hashDrawData(const ImDrawData* draw_data)
+{
+  if (draw_data == nullptr)
+    return 0;
+
+  Hasher hasher;
+  hasher.value(draw_data->DisplayPos);
+  hasher.value(draw_data->DisplaySize);
+  hasher.value(draw_data->FramebufferScale);
+
+  for (const ImDrawList* list : draw_data->CmdLists)
+  {
+    hasher.bytes(list->VtxBuffer.Data, list->VtxBuffer.size_in_bytes());
+    hasher.bytes(list->IdxBuffer.Data, list->IdxBuffer.size_in_bytes());
+
+    // Hash fields one by one, ImDrawCmd has padding with garbage in it
+    for (const ImDrawCmd& cmd : list->CmdBuffer)
+    {
+      hasher.value(cmd.ClipRect);
+      hasher.value(cmd.TextureId);
+      hasher.value(cmd.VtxOffset);
+      hasher.value(cmd.IdxOffset);
+      hasher.value(cmd.ElemCount);
+      hasher.value(cmd.UserCallback);
+    }
+  }
+
+  return hasher.state;
+}
+
+std::shared_ptr<ImDrawData> CachedGuiLayer::cloneDrawData(const ImDrawData* draw_data)
+{
+  // NOTE: copying ImDrawData only copies pointers to the draw lists, which ImGui
+  // reuses for the next frame, so the lists themselves are cloned as well.
+  auto* copy = draw_data != nullptr ? new ImDrawData(*draw_data) : new ImDrawData();
+  for (ImDrawList*& list : copy->CmdLists)
+    list = list->CloneOutput();
+
+  // Frames may be released by the thread rendering them while another one is being built
+  return std::shared_ptr<ImDrawData>(copy, [this](ImDrawData* data) {
+    std::scoped_lock lock{imguiMutex};
+    for (ImDrawList* list : data->CmdLists)
+      IM_DELETE(list);
+    delete data;
+  });
+}
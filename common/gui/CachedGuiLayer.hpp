@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <etna/Image.hpp>
+#include <etna/Sampler.hpp>
+#include <glm/glm.hpp>
+
+#include "gui/ImGuiRenderer.hpp"
+#include "render_utils/QuadRenderer.hpp"
+
+
+/**
+ * Renders ImGui into an offscreen overlay image which is only re-rendered when the GUI
+ * actually changes visually, and is simply composited over the frame otherwise.
+ * Uploading fresh vertex data and drawing the GUI every frame is wasteful on weak GPUs,
+ * while a single fullscreen blend is nearly free.
+ *
+ * Usage per frame:
+ *   CachedGuiLayer::Frame frame;
+ *   if (layer.beginFrame()) { <ImGui calls>; frame = layer.endFrame(); }
+ *   ...
+ *   layer.render(cmd_buf, swapchain_image, swapchain_view, frame);
+ *
+ * Frames are detached from ImGui, so the GUI may be built on one thread while
+ * a previous frame is rendered on another one. beginFrame, endFrame and setHidden
+ * belong to the thread building the GUI, the rest to the one rendering it.
+ * The ImGui backend still uses the global ImGui context while rendering, so building
+ * a GUI frame and re-rendering the overlay exclude each other. The overlay is only
+ * re-rendered when the GUI changes, so they rarely wait.
+ */
+class CachedGuiLayer
+{
+public:
+  struct CreateInfo
+  {
+    vk::Format format = vk::Format::eUndefined;
+    glm::uvec2 resolution = {0, 0};
+  };
+
+  // Copy of the draw data of a single GUI frame, which stays valid and unchanged
+  // while ImGui is already busy with the next frames.
+  struct Frame
+  {
+    // Null if the GUI is hidden
+    std::shared_ptr<ImDrawData> drawData;
+    std::uint64_t hash = 0;
+  };
+
+  explicit CachedGuiLayer(CreateInfo info);
+
+  CachedGuiLayer(const CachedGuiLayer&) = delete;
+  CachedGuiLayer& operator=(const CachedGuiLayer&) = delete;
+
+  // Must be called whenever the target gets resized.
+  void resize(glm::uvec2 resolution);
+
+  // Returns false if the GUI is hidden, in which case no ImGui calls
+  // must be made this frame and endFrame must not be called.
+  bool beginFrame();
+  Frame endFrame();
+
+  // Draws the GUI over the target image, re-rendering the overlay if needed.
+  void render(
+    vk::CommandBuffer cmd_buf,
+    vk::Image target_image,
+    vk::ImageView target_image_view,
+    const Frame& frame);
+
+  // Forces the overlay to be re-rendered on the next frame.
+  void invalidate() { overlayDirty = true; }
+
+  // A hidden GUI costs nothing: no ImGui frame, no overlay rendering and no compositing.
+  void setHidden(bool hidden);
+  bool isHidden() const { return hidden; }
+
+  struct Stats
+  {
+    std::uint64_t framesRendered = 0;
+    std::uint64_t overlayRerenders = 0;
+  };
+
+  const Stats& getStats() const { return stats; }
+
+private:
+  void allocateOverlay();
+  static std::uint64_t hashDrawData(const ImDrawData* draw_data);
+  std::shared_ptr<ImDrawData> cloneDrawData(const ImDrawData* draw_data);
+
+private:
+  vk::Format format;
+  glm::uvec2 resolution;
+
+  std::unique_ptr<ImGuiRenderer> imguiRenderer;
+  std::unique_ptr<QuadRenderer> compositor;
+
+  etna::Image overlay;
+  etna::Sampler overlaySampler;
+
+  // Held from beginFrame to endFrame, while the backend renders the overlay and while
+  // frames are freed, as ImGui counts its allocations in the global context
+  std::mutex imguiMutex;
+  std::unique_lock<std::mutex> buildingLock;
+
+  // State of the thread building the GUI. Unchanged draw data is shared
+  // between frames instead of being copied again.
+  Frame lastFrame;
+  bool hidden = false;
+
+  // State of the thread rendering the GUI
+  std::uint64_t overlayHash = 0;
+  bool overlayDirty = true;
+
+  Stats stats;
+};
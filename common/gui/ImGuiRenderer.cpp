@@ -115,14 +115,20 @@ void ImGuiRenderer::render(
   vk::Rect2D rect,
   vk::Image image,
   vk::ImageView image_view,
-  ImDrawData* im_draw_data)
+  ImDrawData* im_draw_data,
+  vk::AttachmentLoadOp load_op)
 {
   ETNA_PROFILE_GPU(cmd_buf, renderGui)
 
   etna::RenderTargetState renderTargets(
     cmd_buf,
     rect,
-    {{.image = image, .view = image_view, .loadOp = vk::AttachmentLoadOp::eLoad}},
+    {{
+      .image = image,
+      .view = image_view,
+      .loadOp = load_op,
+      .clearColorValue = std::array{0.0f, 0.0f, 0.0f, 0.0f},
+    }},
     {});
 
   ImGui_ImplVulkan_RenderDrawData(im_draw_data, cmd_buf);
@@ -18,12 +18,15 @@ public:
 
   void nextFrame();
 
+  // With eClear, the target is cleared to transparent black before drawing,
+  // which is what you want when rendering into an offscreen overlay.
   void render(
     vk::CommandBuffer cmd_buf,
     vk::Rect2D rect,
     vk::Image image,
     vk::ImageView image_view,
-    ImDrawData* im_draw_data);
+    ImDrawData* im_draw_data,
+    vk::AttachmentLoadOp load_op = vk::AttachmentLoadOp::eLoad);
 
   ~ImGuiRenderer();
 
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+
+/**
+ * Incremental 64-bit hash of words and byte ranges: FNV-1a constants with an extra shift,
+ * so that inputs which only differ in their low bits, like handles and pointers, still
+ * spread over the whole state. Not meant to be stable across versions of this file.
+ */
+struct Hasher
+{
+  std::uint64_t state = 0xcbf29ce484222325ull;
+
+  void mix(std::uint64_t word)
+  {
+    state ^= word;
+    state *= 0x100000001b3ull;
+    state ^= state >> 29;
+  }
+
+  // The size is mixed in as well, so that ranges which are split differently differ
+  void bytes(const void* data, std::size_t size)
+  {
+    mix(size);
+    const auto* ptr = static_cast<const std::byte*>(data);
+    std::uint64_t word;
+    for (; size >= sizeof(word); size -= sizeof(word), ptr += sizeof(word))
+    {
+      std::memcpy(&word, ptr, sizeof(word));
+      mix(word);
+    }
+    word = 0;
+    std::memcpy(&word, ptr, size);
+    mix(word);
+  }
+
+  void string(std::string_view str) { bytes(str.data(), str.size()); }
+
+  // Only for types without padding, which would be hashed as garbage
+  template <class T>
+  void value(const T& val)
+  {
+    bytes(&val, sizeof(val));
+  }
+};
@@ -0,0 +1,290 @@
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include <tracy/Tracy.hpp>
+
+
+struct JobSystem::Job
+{
+  const char* name;
+  Function func;
+
+  // Dependencies that are not done yet, plus one while the job is being scheduled
+  std::atomic<std::uint32_t> pendingDependencies{1};
+
+  std::atomic<bool> done{false};
+  // Guards the continuations and the transition into done
+  std::mutex mutex;
+  std::vector<std::shared_ptr<Job>> continuations;
+};
+
+// Several job systems may exist at once, so the pool a worker belongs to is remembered too
+static thread_local const JobSystem* current_system = nullptr;
+static thread_local std::size_t current_worker = 0;
+
+bool JobSystem::Handle::isDone() const
+{
+  return job == nullptr || job->done.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(std::size_t worker_count)
+{
+  if (worker_count == 0)
+    worker_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+  workers.reserve(worker_count);
+  for (std::size_t i = 0; i < worker_count; ++i)
+    workers.emplace_back(std::make_unique<Worker>());
+
+  // NOTE: threads are started only once all of the deques exist, as they steal from each other
+  for (std::size_t i = 0; i < worker_count; ++i)
+    workers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    std::unique_lock lock{sleepMutex};
+    stopping = true;
+  }
+  wakeUp.notify_all();
+
+  for (auto& worker : workers)
+    worker->thread.join();
+}
+
+JobSystem::Handle JobSystem::schedule(
+  const char* name, Function func, std::span<const Handle> dependencies)
+{
+  auto job = std::make_shared<Job>();
+  job->name = name;
+  job->func = std::move(func);
+
+  for (const auto& dependency : dependencies)
+  {
+    if (dependency.job == nullptr)
+      continue;
+
+    std::unique_lock lock{dependency.job->mutex};
+    if (dependency.job->done.load(std::memory_order_relaxed))
+      continue;
+    job->pendingDependencies.fetch_add(1, std::memory_order_relaxed);
+    dependency.job->continuations.push_back(job);
+  }
+
+  Handle handle{job};
+  release(std::move(job));
+  return handle;
+}
+
+void JobSystem::wait(const Handle& handle)
+{
+  wait(std::span{&handle, 1});
+}
+
+void JobSystem::wait(std::span<const Handle> handles)
+{
+  ZoneScoped;
+
+  const bool isWorker = current_system == this;
+
+  for (const auto& handle : handles)
+  {
+    while (!handle.isDone())
+    {
+      if (auto job = tryPop())
+      {
+        execute(std::move(job));
+        continue;
+      }
+
+      // NOTE: workers must keep looking for jobs, as the awaited job may depend on ones
+      // that only get pushed into a deque later. Other threads aren't needed for progress
+      // as long as there are workers, so they may sleep until the job is done.
+      if (isWorker || workers.empty())
+        std::this_thread::yield();
+      else
+        handle.job->done.wait(false, std::memory_order_acquire);
+    }
+  }
+}
+
+void JobSystem::parallelFor(
+  const char* name, std::size_t count, std::size_t grain, RangeFunction func)
+{
+  grain = std::max<std::size_t>(grain, 1);
+  const std::size_t rangeCount = (count + grain - 1) / grain;
+
+  // Scheduling helpers costs more than doing a single range ourselves
+  if (rangeCount <= 1 || workers.empty())
+  {
+    if (count > 0)
+      func(0, count);
+    return;
+  }
+
+  // Ranges are handed out dynamically instead of being split into a job each,
+  // so that fine-grained loops don't pay for an allocation per range.
+  std::atomic<std::size_t> nextBegin{0};
+  auto runRanges = [&nextBegin, count, grain, func]() {
+    while (true)
+    {
+      const std::size_t begin = nextBegin.fetch_add(grain, std::memory_order_relaxed);
+      if (begin >= count)
+        break;
+      func(begin, std::min(begin + grain, count));
+    }
+  };
+
+  const std::size_t helperCount = std::min(workers.size(), rangeCount - 1);
+  std::vector<Handle> helpers;
+  helpers.reserve(helperCount);
+  for (std::size_t i = 0; i < helperCount; ++i)
+    helpers.push_back(schedule(name, runRanges));
+
+  {
+    ZoneScopedN("Job");
+    ZoneName(name, std::strlen(name));
+    runRanges();
+  }
+
+  // Helpers that start after all ranges were taken exit right away
+  wait(helpers);
+}
+
+void JobSystem::workerLoop(std::size_t index)
+{
+  current_system = this;
+  current_worker = index;
+
+  const std::string threadName = "Job worker " + std::to_string(index);
+  tracy::SetThreadName(threadName.c_str());
+
+  while (true)
+  {
+    if (auto job = tryPop())
+    {
+      execute(std::move(job));
+      continue;
+    }
+
+    std::unique_lock lock{sleepMutex};
+    // NOTE: push() increments queuedJobs before checking sleepingWorkers, and we do
+    // the opposite, so at least one of the sides is guaranteed to notice the other.
+    sleepingWorkers.fetch_add(1);
+    wakeUp.wait(lock, [this]() { return stopping || queuedJobs.load() > 0; });
+    sleepingWorkers.fetch_sub(1);
+
+    if (stopping && queuedJobs.load() == 0)
+      return;
+  }
+}
+
+void JobSystem::push(std::shared_ptr<Job> job)
+{
+  if (current_system == this)
+  {
+    auto& worker = *workers[current_worker];
+    std::unique_lock lock{worker.mutex};
+    worker.jobs.push_back(std::move(job));
+  }
+  else
+  {
+    std::unique_lock lock{injectedMutex};
+    injected.push_back(std::move(job));
+  }
+
+  queuedJobs.fetch_add(1);
+  if (sleepingWorkers.load() > 0)
+  {
+    // Makes sure the worker we saw is actually waiting and not in between
+    // checking the condition and going to sleep, otherwise the wakeup is lost.
+    {
+      std::unique_lock lock{sleepMutex};
+    }
+    wakeUp.notify_one();
+  }
+}
+
+std::shared_ptr<JobSystem::Job> JobSystem::tryPop()
+{
+  auto take = [this](std::mutex& mutex, std::deque<std::shared_ptr<Job>>& jobs, bool newest) {
+    std::shared_ptr<Job> job;
+    std::unique_lock lock{mutex};
+    if (jobs.empty())
+      return job;
+    if (newest)
+    {
+      job = std::move(jobs.back());
+      jobs.pop_back();
+    }
+    else
+    {
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    queuedJobs.fetch_sub(1);
+    return job;
+  };
+
+  const bool isWorker = current_system == this;
+
+  // Our own newest job is the one most likely to still be in cache
+  if (isWorker)
+    if (auto job = take(workers[current_worker]->mutex, workers[current_worker]->jobs, true))
+      return job;
+
+  if (auto job = take(injectedMutex, injected, false))
+    return job;
+
+  // Victims are visited starting from the next worker, so that thieves spread out
+  const std::size_t first = isWorker ? current_worker + 1 : 0;
+  for (std::size_t i = 0; i < workers.size(); ++i)
+  {
+    const std::size_t victim = (first + i) % workers.size();
+    if (isWorker && victim == current_worker)
+      continue;
+    if (auto job = take(workers[victim]->mutex, workers[victim]->jobs, false))
+      return job;
+  }
+
+  return nullptr;
+}
+
+void JobSystem::execute(std::shared_ptr<Job> job)
+{
+  {
+    ZoneScopedN("Job");
+    ZoneName(job->name, std::strlen(job->name));
+    job->func();
+  }
+
+  // Captured state is released right away, the handles might live much longer
+  job->func = nullptr;
+
+  std::vector<std::shared_ptr<Job>> continuations;
+  {
+    std::unique_lock lock{job->mutex};
+    job->done.store(true, std::memory_order_release);
+    continuations.swap(job->continuations);
+  }
+  job->done.notify_all();
+
+  for (auto& continuation : continuations)
+    release(std::move(continuation));
+}
+
+void JobSystem::release(std::shared_ptr<Job> job)
+{
+  if (job->pendingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    push(std::move(job));
+}
+
+JobSystem& get_job_system()
+{
+  static JobSystem system;
+  return system;
+}
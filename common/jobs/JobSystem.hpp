@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * Work-stealing job scheduler. Every worker thread owns a deque: jobs spawned by
+ * a worker are pushed to and popped from the back of its own deque, while idle
+ * workers steal the oldest ones from the front of others'. Jobs scheduled from
+ * threads outside of the pool go to a shared injection queue.
+ *
+ * Threads waiting on a job run other queued jobs in the meantime, so waiting
+ * from inside of a job is fine and never deadlocks the pool.
+ */
+class JobSystem
+{
+  struct Job;
+
+public:
+  using Function = fu2::unique_function<void()>;
+  using RangeFunction = fu2::function_view<void(std::size_t, std::size_t)>;
+
+  // Reference to a scheduled job, for waiting on it and for using it as a dependency.
+  // A default-constructed handle refers to no job and is always done.
+  class Handle
+  {
+  public:
+    Handle() = default;
+
+    bool isValid() const { return job != nullptr; }
+    bool isDone() const;
+
+  private:
+    friend class JobSystem;
+
+    explicit Handle(std::shared_ptr<Job> job_)
+      : job{std::move(job_)}
+    {
+    }
+
+    std::shared_ptr<Job> job;
+  };
+
+  // 0 means one worker per hardware thread, minus one for the calling thread
+  explicit JobSystem(std::size_t worker_count = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  std::size_t getWorkerCount() const { return workers.size(); }
+
+  // The job starts once all of the dependencies are done. `name` is what the job is
+  // shown as in the profiler, so it must outlive the job, string literals are best.
+  Handle schedule(const char* name, Function func, std::span<const Handle> dependencies = {});
+
+  // Runs other jobs until the awaited ones are done
+  void wait(const Handle& handle);
+  void wait(std::span<const Handle> handles);
+
+  // Calls func(begin, end) for consecutive ranges of at most `grain` elements covering
+  // [0, count) on the workers and the calling thread, returns once all of them are done.
+  void parallelFor(const char* name, std::size_t count, std::size_t grain, RangeFunction func);
+
+private:
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  std::mutex injectedMutex;
+  std::deque<std::shared_ptr<Job>> injected;
+
+  // Amount of jobs sitting in any of the queues, workers sleep while it is 0
+  std::atomic<std::size_t> queuedJobs{0};
+  std::atomic<std::size_t> sleepingWorkers{0};
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+
+  void workerLoop(std::size_t index);
+  void push(std::shared_ptr<Job> job);
+  std::shared_ptr<Job> tryPop();
+  void execute(std::shared_ptr<Job> job);
+  void release(std::shared_ptr<Job> job);
+};
+
+// Shared pool for everything that doesn't need a dedicated one,
+// created with the default amount of workers on first use.
+JobSystem& get_job_system();
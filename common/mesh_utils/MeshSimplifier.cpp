@@ -0,0 +1,340 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <tuple>
+
+#include <tracy/Tracy.hpp>
+
+
+// Planes along open edges weigh this much more than the triangles around them, which keeps
+// borders and seams in place unless collapsing along them costs next to nothing
+static constexpr double OPEN_EDGE_WEIGHT = 10.0;
+
+// More than two open edges meeting at a vertex, or a single one, lock it in place
+static constexpr std::uint32_t LOCKED_OPEN_COUNT = 3;
+
+static std::uint64_t edge_key(std::uint32_t from, std::uint32_t to)
+{
+  return (std::uint64_t{from} << 32) | to;
+}
+
+static bool has_edge(
+  std::span<const std::uint64_t> sorted_edges, std::uint32_t from, std::uint32_t to)
+{
+  return std::binary_search(sorted_edges.begin(), sorted_edges.end(), edge_key(from, to));
+}
+
+void MeshSimplifier::Quadric::addPlane(glm::dvec3 normal, double distance, double plane_weight)
+{
+  xx += plane_weight * normal.x * normal.x;
+  xy += plane_weight * normal.x * normal.y;
+  xz += plane_weight * normal.x * normal.z;
+  yy += plane_weight * normal.y * normal.y;
+  yz += plane_weight * normal.y * normal.z;
+  zz += plane_weight * normal.z * normal.z;
+  dx += plane_weight * normal.x * distance;
+  dy += plane_weight * normal.y * distance;
+  dz += plane_weight * normal.z * distance;
+  dd += plane_weight * distance * distance;
+  weight += plane_weight;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other)
+{
+  xx += other.xx;
+  xy += other.xy;
+  xz += other.xz;
+  yy += other.yy;
+  yz += other.yz;
+  zz += other.zz;
+  dx += other.dx;
+  dy += other.dy;
+  dz += other.dz;
+  dd += other.dd;
+  weight += other.weight;
+}
+
+double MeshSimplifier::Quadric::error(glm::dvec3 point) const
+{
+  const double sum = xx * point.x * point.x + yy * point.y * point.y + zz * point.z * point.z +
+    2.0 * (xy * point.x * point.y + xz * point.x * point.z + yz * point.y * point.z) +
+    2.0 * (dx * point.x + dy * point.y + dz * point.z) + dd;
+  return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+}
+
+void MeshSimplifier::weldPositions(std::span<const glm::vec3> positions)
+{
+  order.resize(positions.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [&positions](std::uint32_t a, std::uint32_t b) {
+    return std::tie(positions[a].x, positions[a].y, positions[a].z) <
+      std::tie(positions[b].x, positions[b].y, positions[b].z);
+  });
+
+  positionIds.resize(positions.size());
+  points.clear();
+  for (std::size_t i = 0; i < order.size(); ++i)
+  {
+    if (i == 0 || positions[order[i]] != points.back())
+      points.push_back(positions[order[i]]);
+    positionIds[order[i]] = static_cast<std::uint32_t>(points.size() - 1);
+  }
+}
+
+void MeshSimplifier::findOpenEdges(std::span<const std::uint32_t> triangles)
+{
+  directedEdges.clear();
+  for (std::size_t i = 0; i < triangles.size(); i += 3)
+    for (std::size_t k = 0; k < 3; ++k)
+      directedEdges.push_back(edge_key(triangles[i + k], triangles[i + (k + 1) % 3]));
+  std::sort(directedEdges.begin(), directedEdges.end());
+
+  openNeighbors.assign(points.size() * 2, 0);
+  openNeighborCounts.assign(points.size(), 0);
+  auto link = [this](std::uint32_t position, std::uint32_t neighbor) {
+    auto& count = openNeighborCounts[position];
+    const auto* known = &openNeighbors[position * 2];
+    if (count >= LOCKED_OPEN_COUNT || std::find(known, known + count, neighbor) != known + count)
+      return;
+    if (count < 2)
+      openNeighbors[position * 2 + count] = neighbor;
+    ++count;
+  };
+
+  for (std::size_t i = 0; i < triangles.size(); i += 3)
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const std::uint32_t from = triangles[i + k];
+      const std::uint32_t to = triangles[i + (k + 1) % 3];
+      if (has_edge(directedEdges, to, from))
+        continue;
+      link(positionIds[from], positionIds[to]);
+      link(positionIds[to], positionIds[from]);
+    }
+}
+
+void MeshSimplifier::computeQuadrics(std::span<const std::uint32_t> triangles)
+{
+  quadrics.assign(points.size(), Quadric{});
+  for (std::size_t i = 0; i < triangles.size(); i += 3)
+  {
+    const std::array<std::uint32_t, 3> ids{
+      positionIds[triangles[i]], positionIds[triangles[i + 1]], positionIds[triangles[i + 2]]};
+    const glm::dvec3 p0 = points[ids[0]];
+    const glm::dvec3 p1 = points[ids[1]];
+    const glm::dvec3 p2 = points[ids[2]];
+    const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+    const double length = glm::length(cross);
+    if (length == 0.0)
+      continue;
+
+    const glm::dvec3 normal = cross / length;
+    for (const auto id : ids)
+      quadrics[id].addPlane(normal, -glm::dot(normal, p0), 0.5 * length);
+
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      if (has_edge(directedEdges, triangles[i + (k + 1) % 3], triangles[i + k]))
+        continue;
+      const glm::dvec3 from = points[ids[k]];
+      const glm::dvec3 edge = glm::dvec3(points[ids[(k + 1) % 3]]) - from;
+      const glm::dvec3 sideways = glm::cross(edge, normal);
+      const double edgeLength = glm::length(sideways);
+      if (edgeLength == 0.0)
+        continue;
+      const glm::dvec3 planeNormal = sideways / edgeLength;
+      const double planeWeight = OPEN_EDGE_WEIGHT * edgeLength * edgeLength;
+      quadrics[ids[k]].addPlane(planeNormal, -glm::dot(planeNormal, from), planeWeight);
+      quadrics[ids[(k + 1) % 3]].addPlane(planeNormal, -glm::dot(planeNormal, from), planeWeight);
+    }
+  }
+}
+
+void MeshSimplifier::buildAdjacency(std::span<const std::uint32_t> triangles)
+{
+  adjacencyOffsets.assign(points.size() + 1, 0);
+  for (const auto vertex : triangles)
+    ++adjacencyOffsets[positionIds[vertex] + 1];
+  std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+
+  adjacency.resize(triangles.size());
+  order.assign(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+  for (std::size_t i = 0; i < triangles.size(); ++i)
+    adjacency[order[positionIds[triangles[i]]]++] = static_cast<std::uint32_t>(i / 3);
+}
+
+bool MeshSimplifier::canCollapse(std::uint32_t from, std::uint32_t to) const
+{
+  const auto count = openNeighborCounts[from];
+  if (count == 0)
+    return true;
+  // Vertices on borders and seams only slide along them
+  return count == 2 && (openNeighbors[from * 2] == to || openNeighbors[from * 2 + 1] == to);
+}
+
+bool MeshSimplifier::flipsTriangles(
+  std::span<const std::uint32_t> triangles, std::uint32_t from, std::uint32_t to) const
+{
+  for (std::uint32_t i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; ++i)
+  {
+    const auto* triangle = &triangles[std::size_t{adjacency[i]} * 3];
+    std::array<std::uint32_t, 3> ids{
+      positionIds[triangle[0]], positionIds[triangle[1]], positionIds[triangle[2]]};
+    if (std::ranges::find(ids, to) != ids.end())
+      continue;
+
+    const glm::vec3 before =
+      glm::cross(points[ids[1]] - points[ids[0]], points[ids[2]] - points[ids[0]]);
+    std::ranges::replace(ids, from, to);
+    const glm::vec3 after =
+      glm::cross(points[ids[1]] - points[ids[0]], points[ids[2]] - points[ids[0]]);
+    if (glm::dot(before, after) <= 0.0f)
+      return true;
+  }
+  return false;
+}
+
+float MeshSimplifier::simplify(
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices,
+  std::size_t target_index_count,
+  float max_error,
+  std::vector<std::uint32_t>& result)
+{
+  ZoneScoped;
+
+  result.assign(indices.begin(), indices.end() - indices.size() % 3);
+  if (positions.empty() || result.size() <= target_index_count)
+    return 0.0f;
+
+  weldPositions(positions);
+  glm::vec3 min = points.front();
+  glm::vec3 max = points.front();
+  for (const auto& point : points)
+  {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+  const float extent = std::max({max.x - min.x, max.y - min.y, max.z - min.z});
+  if (extent <= 0.0f)
+    return 0.0f;
+  const double maxSquaredError =
+    static_cast<double>(max_error) * max_error * static_cast<double>(extent) * extent;
+
+  findOpenEdges(result);
+  computeQuadrics(result);
+
+  // NOTE: every pass collapses a set of edges which don't share any triangles, so that
+  // the costs and flip checks from the start of the pass stay valid throughout it
+  double reachedError = 0.0;
+  while (result.size() > target_index_count)
+  {
+    buildAdjacency(result);
+
+    collapses.clear();
+    for (std::size_t i = 0; i < result.size(); i += 3)
+      for (std::size_t k = 0; k < 3; ++k)
+      {
+        const std::uint32_t a = positionIds[result[i + k]];
+        const std::uint32_t b = positionIds[result[i + (k + 1) % 3]];
+        Quadric sum = quadrics[a];
+        sum.add(quadrics[b]);
+        constexpr double NONE = std::numeric_limits<double>::infinity();
+        const double toB = canCollapse(a, b) ? sum.error(points[b]) : NONE;
+        const double toA = canCollapse(b, a) ? sum.error(points[a]) : NONE;
+        if (toB == NONE && toA == NONE)
+          continue;
+        collapses.push_back(toB <= toA ? Collapse{a, b, toB} : Collapse{b, a, toA});
+      }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) {
+      return x.error < y.error;
+    });
+
+    lockedThisPass.assign(points.size(), 0);
+    vertexRemap.resize(positions.size());
+    std::iota(vertexRemap.begin(), vertexRemap.end(), 0u);
+    std::size_t indexCount = result.size();
+    std::size_t applied = 0;
+    for (const auto& collapse : collapses)
+    {
+      if (indexCount <= target_index_count || collapse.error > maxSquaredError)
+        break;
+      if (lockedThisPass[collapse.from] != 0 || lockedThisPass[collapse.to] != 0)
+        continue;
+      if (flipsTriangles(result, collapse.from, collapse.to))
+        continue;
+
+      const auto begin = adjacency.begin() + adjacencyOffsets[collapse.from];
+      const auto end = adjacency.begin() + adjacencyOffsets[collapse.from + 1];
+
+      // Vertices of the collapsed position move to the vertex across the edge on their side
+      // of a seam, which is the one they share a triangle with
+      std::uint32_t anyTarget = std::numeric_limits<std::uint32_t>::max();
+      for (auto it = begin; it != end; ++it)
+      {
+        const auto* triangle = &result[std::size_t{*it} * 3];
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+          if (positionIds[triangle[k]] != collapse.to)
+            continue;
+          anyTarget = triangle[k];
+          for (std::size_t m = 0; m < 3; ++m)
+            if (positionIds[triangle[m]] == collapse.from)
+              vertexRemap[triangle[m]] = triangle[k];
+        }
+      }
+      for (auto it = begin; it != end; ++it)
+      {
+        const auto* triangle = &result[std::size_t{*it} * 3];
+        for (std::size_t k = 0; k < 3; ++k)
+        {
+          lockedThisPass[positionIds[triangle[k]]] = 1;
+          if (positionIds[triangle[k]] == collapse.from && vertexRemap[triangle[k]] == triangle[k])
+            vertexRemap[triangle[k]] = anyTarget;
+          if (positionIds[triangle[k]] == collapse.to)
+            indexCount -= 3;
+        }
+      }
+
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      reachedError = std::max(reachedError, collapse.error);
+      ++applied;
+    }
+    if (applied == 0)
+      break;
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < result.size(); i += 3)
+    {
+      const std::uint32_t a = vertexRemap[result[i]];
+      const std::uint32_t b = vertexRemap[result[i + 1]];
+      const std::uint32_t c = vertexRemap[result[i + 2]];
+      if (
+        positionIds[a] == positionIds[b] || positionIds[b] == positionIds[c] ||
+        positionIds[c] == positionIds[a])
+        continue;
+      result[kept++] = a;
+      result[kept++] = b;
+      result[kept++] = c;
+    }
+    result.resize(kept);
+    findOpenEdges(result);
+  }
+
+  return static_cast<float>(std::sqrt(reachedError)) / extent;
+}
+
+std::size_t MeshSimplifier::getScratchBytes() const
+{
+  return (positionIds.capacity() + vertexRemap.capacity() + openNeighbors.capacity() +
+          openNeighborCounts.capacity() + adjacencyOffsets.capacity() + adjacency.capacity() +
+          order.capacity()) *
+    sizeof(std::uint32_t) +
+    points.capacity() * sizeof(glm::vec3) + quadrics.capacity() * sizeof(Quadric) +
+    lockedThisPass.capacity() + directedEdges.capacity() * sizeof(std::uint64_t) +
+    collapses.capacity() * sizeof(Collapse);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+/**
+ * Simplifies triangle meshes with quadric error metrics (Garland & Heckbert). Edges are
+ * collapsed into one of their ends, so the result indexes the same vertices as the source
+ * does and LODs of a mesh can all share its vertex range.
+ *
+ * Vertices with the same position are simplified together. Edges which only have a triangle
+ * on one side, either a border of the mesh or a seam between vertices with the same position
+ * but different attributes, can only collapse along themselves, and the vertices where more
+ * than two of them meet never move. Scratch memory is kept between calls.
+ */
+class MeshSimplifier
+{
+public:
+  // Collapses edges until at most target_index_count indices are left, or until the next
+  // collapse would move the surface by more than max_error, both errors are relative to
+  // the largest extent of the mesh. Returns the error that was reached.
+  float simplify(
+    std::span<const glm::vec3> positions,
+    std::span<const std::uint32_t> indices,
+    std::size_t target_index_count,
+    float max_error,
+    std::vector<std::uint32_t>& result);
+
+  // Memory the scratch takes, it only grows
+  std::size_t getScratchBytes() const;
+
+private:
+  // Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+  struct Quadric
+  {
+    double xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0;
+    double dx = 0, dy = 0, dz = 0, dd = 0;
+    // Total weight of the planes, so that the error is an average of squared distances
+    double weight = 0;
+
+    void addPlane(glm::dvec3 normal, double distance, double plane_weight);
+    void add(const Quadric& other);
+    double error(glm::dvec3 point) const;
+  };
+
+  struct Collapse
+  {
+    std::uint32_t from;
+    std::uint32_t to;
+    double error;
+  };
+
+  void weldPositions(std::span<const glm::vec3> positions);
+  void computeQuadrics(std::span<const std::uint32_t> triangles);
+  void findOpenEdges(std::span<const std::uint32_t> triangles);
+  void buildAdjacency(std::span<const std::uint32_t> triangles);
+  bool canCollapse(std::uint32_t from, std::uint32_t to) const;
+  bool flipsTriangles(
+    std::span<const std::uint32_t> triangles, std::uint32_t from, std::uint32_t to) const;
+
+private:
+  // Per vertex
+  std::vector<std::uint32_t> positionIds;
+  std::vector<std::uint32_t> vertexRemap;
+  // Per welded position
+  std::vector<glm::vec3> points;
+  std::vector<Quadric> quadrics;
+  std::vector<std::uint32_t> openNeighbors;
+  std::vector<std::uint32_t> openNeighborCounts;
+  std::vector<std::uint32_t> adjacencyOffsets;
+  std::vector<std::uint32_t> adjacency;
+  std::vector<std::uint8_t> lockedThisPass;
+  // Scratch of the passes
+  std::vector<std::uint32_t> order;
+  std::vector<std::uint64_t> directedEdges;
+  std::vector<Collapse> collapses;
+};
@@ -0,0 +1,427 @@
+#include "MaskedOcclusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <tracy/Tracy.hpp>
+
+#include "jobs/JobSystem.hpp"
+
+// NOTE: SSE2 is a part of x86-64, so no special flags or runtime checks are needed for it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MASKED_OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+// Farther than any pixel, but small enough for the math on it to stay finite
+static constexpr float BIG = 1e30f;
+
+// Triangles smaller than this in pixels get a flat depth, their gradients are too imprecise
+static constexpr float MIN_PLANE_AREA = 1.0f;
+
+static std::uint32_t span_mask(std::int32_t begin, std::int32_t end)
+{
+  constexpr std::int32_t WIDTH = MaskedOcclusion::TILE_WIDTH;
+  begin = std::clamp(begin, 0, WIDTH);
+  end = std::clamp(end, 0, WIDTH);
+  if (end <= begin)
+    return 0;
+  const std::uint32_t upToEnd = end == WIDTH ? ~0u : (1u << end) - 1;
+  return upToEnd & ~((1u << begin) - 1);
+}
+
+static void for_range(
+  JobSystem* jobs, const char* name, std::size_t count, JobSystem::RangeFunction func)
+{
+  if (jobs != nullptr)
+    jobs->parallelFor(name, count, 1, func);
+  else
+    func(0, count);
+}
+
+MaskedOcclusion::MaskedOcclusion(glm::uvec2 resolution_)
+  : tileCount{
+      (resolution_.x + TILE_WIDTH - 1) / TILE_WIDTH,
+      (resolution_.y + TILE_HEIGHT - 1) / TILE_HEIGHT,
+    }
+{
+  tileCount = glm::max(tileCount, glm::uvec2(1));
+  resolution = tileCount * glm::uvec2(TILE_WIDTH, TILE_HEIGHT);
+  tiles.resize(tileCount.x * tileCount.y);
+  clear();
+}
+
+void MaskedOcclusion::clear()
+{
+  for (auto& tile : tiles)
+    tile = Tile{.mask = {}, .zMax0 = 1.0f, .zMax1 = 0.0f};
+  occluderCount = 0;
+  triangleCount = 0;
+}
+
+void MaskedOcclusion::addOccluder(
+  std::span<const glm::vec3> positions,
+  std::span<const std::uint32_t> indices,
+  const glm::mat4x4& model_view_proj)
+{
+  if (occluderCount == occluders.size())
+    occluders.emplace_back();
+
+  auto& occluder = occluders[occluderCount++];
+  occluder.positions = positions;
+  occluder.indices = indices;
+  occluder.modelViewProj = model_view_proj;
+  occluder.triangles.clear();
+}
+
+void MaskedOcclusion::setupTriangles(Occluder& occluder) const
+{
+  ZoneScoped;
+
+  const glm::vec2 size = glm::vec2(resolution);
+
+  for (std::size_t first = 0; first + 3 <= occluder.indices.size(); first += 3)
+  {
+    std::array<glm::vec2, 3> p;
+    std::array<float, 3> z;
+    bool clipped = false;
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const glm::vec4 clip =
+        occluder.modelViewProj * glm::vec4(occluder.positions[occluder.indices[first + k]], 1.0f);
+      // NOTE: negative z means in front of the near plane for a [0, 1] projection
+      if (!(clip.w > 0.0f && clip.z >= 0.0f))
+      {
+        clipped = true;
+        break;
+      }
+      p[k] = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * size;
+      z[k] = clip.z / clip.w;
+    }
+    if (clipped)
+      continue;
+
+    const float zMax = std::max({z[0], z[1], z[2]});
+    if (std::min({z[0], z[1], z[2]}) > 1.0f)
+      continue;
+
+    // Pixels are sampled at their centers
+    const glm::vec2 min = glm::min(glm::min(p[0], p[1]), p[2]);
+    const glm::vec2 max = glm::max(glm::max(p[0], p[1]), p[2]);
+    const glm::vec2 firstPixel = glm::max(glm::ceil(min - 0.5f), glm::vec2(0.0f));
+    const glm::vec2 lastPixel = glm::min(glm::floor(max - 0.5f), size - 1.0f);
+    if (firstPixel.x > lastPixel.x || firstPixel.y > lastPixel.y)
+      continue;
+
+    const glm::vec2 e1 = p[1] - p[0];
+    const glm::vec2 e2 = p[2] - p[0];
+    const float area = e1.x * e2.y - e2.x * e1.y;
+    if (area == 0.0f)
+      continue;
+    const float side = area > 0.0f ? 1.0f : -1.0f;
+
+    Triangle tri{
+      .leftX = {-BIG, -BIG},
+      .leftSlope = {0.0f, 0.0f},
+      .leftY = {0.0f, 0.0f},
+      .rightX = {BIG, BIG},
+      .rightSlope = {0.0f, 0.0f},
+      .rightY = {0.0f, 0.0f},
+      .min = min,
+      .max = max,
+      .depthPlane = {zMax, 0.0f, 0.0f},
+      .zMax = zMax,
+      .firstTile = glm::uvec2(firstPixel) / glm::uvec2(TILE_WIDTH, TILE_HEIGHT),
+      .lastTile = glm::uvec2(lastPixel) / glm::uvec2(TILE_WIDTH, TILE_HEIGHT),
+    };
+
+    // Inside of an edge a -> b is where side * cross(b - a, p - a) >= 0, which bounds
+    // x of a row from the left or from the right. Horizontal edges only bound rows, which
+    // min and max take care of.
+    std::size_t lefts = 0;
+    std::size_t rights = 0;
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const glm::vec2 a = p[k];
+      const glm::vec2 d = p[(k + 1) % 3] - a;
+      if (std::abs(d.y) < 1e-6f)
+        continue;
+      const float slope = d.x / d.y;
+      if (-side * d.y > 0.0f && lefts < 2)
+      {
+        tri.leftX[lefts] = a.x;
+        tri.leftY[lefts] = a.y;
+        tri.leftSlope[lefts++] = slope;
+      }
+      else if (-side * d.y < 0.0f && rights < 2)
+      {
+        tri.rightX[rights] = a.x;
+        tri.rightY[rights] = a.y;
+        tri.rightSlope[rights++] = slope;
+      }
+    }
+
+    if (std::abs(area) >= MIN_PLANE_AREA)
+    {
+      const float dz1 = z[1] - z[0];
+      const float dz2 = z[2] - z[0];
+      const float dzdx = (dz1 * e2.y - dz2 * e1.y) / area;
+      const float dzdy = (dz2 * e1.x - dz1 * e2.x) / area;
+      tri.depthPlane = {z[0] - dzdx * p[0].x - dzdy * p[0].y, dzdx, dzdy};
+    }
+
+    occluder.triangles.push_back(tri);
+  }
+
+  // Rows of tiles only go through the triangles touching them, which is a lot less
+  // memory traffic than skipping all of the others
+  auto& offsets = occluder.rowOffsets;
+  offsets.assign(tileCount.y + 1, 0);
+  for (const auto& tri : occluder.triangles)
+    for (std::uint32_t row = tri.firstTile.y; row <= tri.lastTile.y; ++row)
+      ++offsets[row + 1];
+  for (std::uint32_t row = 0; row < tileCount.y; ++row)
+    offsets[row + 1] += offsets[row];
+
+  occluder.rowTriangles.resize(offsets.back());
+  std::vector<std::uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+  for (std::uint32_t i = 0; i < occluder.triangles.size(); ++i)
+    for (std::uint32_t row = occluder.triangles[i].firstTile.y;
+         row <= occluder.triangles[i].lastTile.y;
+         ++row)
+      occluder.rowTriangles[cursors[row]++] = i;
+}
+
+void MaskedOcclusion::computeRowSpans(
+  const Triangle& tri, float row_y, float width, RowSpans& starts, RowSpans& ends)
+{
+#if MASKED_OCCLUSION_SSE2
+  const __m128 minY = _mm_set1_ps(tri.min.y);
+  const __m128 maxY = _mm_set1_ps(tri.max.y);
+  const __m128 lowest = _mm_set1_ps(-1.0f);
+  const __m128 highest = _mm_set1_ps(width + 1.0f);
+
+  auto edgeX = [](float x, float y0, float slope, __m128 y) {
+    return _mm_add_ps(
+      _mm_set1_ps(x), _mm_mul_ps(_mm_set1_ps(slope), _mm_sub_ps(y, _mm_set1_ps(y0))));
+  };
+
+  for (std::uint32_t row = 0; row < TILE_HEIGHT; row += 4)
+  {
+    const float y0 = row_y + static_cast<float>(row) + 0.5f;
+    const __m128 y = _mm_setr_ps(y0, y0 + 1.0f, y0 + 2.0f, y0 + 3.0f);
+
+    __m128 left = _mm_max_ps(
+      edgeX(tri.leftX[0], tri.leftY[0], tri.leftSlope[0], y),
+      edgeX(tri.leftX[1], tri.leftY[1], tri.leftSlope[1], y));
+    const __m128 right = _mm_min_ps(
+      edgeX(tri.rightX[0], tri.rightY[0], tri.rightSlope[0], y),
+      edgeX(tri.rightX[1], tri.rightY[1], tri.rightSlope[1], y));
+
+    // Rows past the vertices are empty
+    const __m128 outside = _mm_or_ps(_mm_cmplt_ps(y, minY), _mm_cmpgt_ps(y, maxY));
+    left = _mm_or_ps(_mm_and_ps(outside, highest), _mm_andnot_ps(outside, left));
+
+    // Pixel x is covered if left <= x + 0.5 <= right, i.e. for x in [round(left), round(right))
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i*>(starts.data() + row),
+      _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(left, lowest), highest)));
+    _mm_storeu_si128(
+      reinterpret_cast<__m128i*>(ends.data() + row),
+      _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(right, lowest), highest)));
+  }
+#else
+  for (std::uint32_t row = 0; row < TILE_HEIGHT; ++row)
+  {
+    const float y = row_y + static_cast<float>(row) + 0.5f;
+    float left = std::max(
+      tri.leftX[0] + tri.leftSlope[0] * (y - tri.leftY[0]),
+      tri.leftX[1] + tri.leftSlope[1] * (y - tri.leftY[1]));
+    const float right = std::min(
+      tri.rightX[0] + tri.rightSlope[0] * (y - tri.rightY[0]),
+      tri.rightX[1] + tri.rightSlope[1] * (y - tri.rightY[1]));
+    if (y < tri.min.y || y > tri.max.y)
+      left = width + 1.0f;
+    // NOTE: nearbyint rounds to even like the SSE2 conversion does
+    starts[row] = static_cast<std::int32_t>(std::nearbyint(std::clamp(left, -1.0f, width + 1.0f)));
+    ends[row] = static_cast<std::int32_t>(std::nearbyint(std::clamp(right, -1.0f, width + 1.0f)));
+  }
+#endif
+}
+
+void MaskedOcclusion::updateTile(Tile& tile, const RowMasks& coverage, float z)
+{
+  // A triangle much closer than the working layer makes it not worth keeping, starting over
+  // from the triangle gives a closer layer once the mask gets full
+  if (tile.zMax1 - z > tile.zMax0 - tile.zMax1)
+  {
+    tile.mask = {};
+    tile.zMax1 = 0.0f;
+  }
+
+  bool full = true;
+  for (std::uint32_t row = 0; row < TILE_HEIGHT; ++row)
+  {
+    tile.mask[row] |= coverage[row];
+    full = full && tile.mask[row] == ~0u;
+  }
+  tile.zMax1 = std::max(tile.zMax1, z);
+
+  if (full)
+  {
+    tile.zMax0 = std::min(tile.zMax0, tile.zMax1);
+    tile.mask = {};
+    tile.zMax1 = 0.0f;
+  }
+}
+
+void MaskedOcclusion::rasterizeTileRow(std::uint32_t tile_row)
+{
+  const float width = static_cast<float>(resolution.x);
+  const auto rowY = static_cast<float>(tile_row * TILE_HEIGHT);
+
+  RowSpans starts;
+  RowSpans ends;
+  RowMasks coverage;
+
+  for (std::size_t occluderIdx = 0; occluderIdx < occluderCount; ++occluderIdx)
+  {
+    const auto& occluder = occluders[occluderIdx];
+    const std::uint32_t first = occluder.rowOffsets[tile_row];
+    const std::uint32_t last = occluder.rowOffsets[tile_row + 1];
+    for (std::uint32_t binIdx = first; binIdx < last; ++binIdx)
+    {
+      const auto& tri = occluder.triangles[occluder.rowTriangles[binIdx]];
+
+      computeRowSpans(tri, rowY, width, starts, ends);
+
+      // Farthest sample of the triangle within the row, the plane is linear so it's at a corner
+      const float yMin = std::max(rowY + 0.5f, tri.min.y);
+      const float yMax = std::min(rowY + TILE_HEIGHT - 0.5f, tri.max.y);
+      const glm::vec3& plane = tri.depthPlane;
+
+      for (std::uint32_t tileX = tri.firstTile.x; tileX <= tri.lastTile.x; ++tileX)
+      {
+        const auto x0 = static_cast<std::int32_t>(tileX * TILE_WIDTH);
+
+        const float x = plane.y > 0.0f
+          ? std::min(static_cast<float>(x0) + TILE_WIDTH - 0.5f, tri.max.x)
+          : std::max(static_cast<float>(x0) + 0.5f, tri.min.x);
+        const float y = plane.z > 0.0f ? yMax : yMin;
+        const float z = std::min(tri.zMax, plane.x + plane.y * x + plane.z * y);
+
+        // Whatever is behind everything already is of no use, which is the common case
+        // for occluders drawn front to back
+        Tile& tile = tiles[tile_row * tileCount.x + tileX];
+        if (z >= tile.zMax0)
+          continue;
+
+        std::uint32_t any = 0;
+        for (std::uint32_t row = 0; row < TILE_HEIGHT; ++row)
+        {
+          coverage[row] = span_mask(starts[row] - x0, ends[row] - x0);
+          any |= coverage[row];
+        }
+        if (any != 0)
+          updateTile(tile, coverage, z);
+      }
+    }
+  }
+}
+
+void MaskedOcclusion::rasterize(JobSystem* jobs)
+{
+  ZoneScoped;
+
+  for_range(jobs, "setupOccluders", occluderCount, [this](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+      setupTriangles(occluders[i]);
+  });
+
+  for (std::size_t i = 0; i < occluderCount; ++i)
+    triangleCount += occluders[i].triangles.size();
+
+  // Every row of tiles is only ever touched by a single thread, so no locking is needed
+  for_range(jobs, "rasterizeOccluders", tileCount.y, [this](std::size_t begin, std::size_t end) {
+    for (std::size_t row = begin; row < end; ++row)
+      rasterizeTileRow(static_cast<std::uint32_t>(row));
+  });
+
+  occluderCount = 0;
+}
+
+OcclusionResult MaskedOcclusion::testBox(
+  glm::vec3 min, glm::vec3 max, const glm::mat4x4& view_proj) const
+{
+  glm::vec3 ndcMin{BIG};
+  glm::vec3 ndcMax{-BIG};
+  std::uint32_t behind = 0;
+  for (std::uint32_t corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 pos{
+      (corner & 1) != 0 ? max.x : min.x,
+      (corner & 2) != 0 ? max.y : min.y,
+      (corner & 4) != 0 ? max.z : min.z,
+    };
+    const glm::vec4 clip = view_proj * glm::vec4(pos, 1.0f);
+    if (clip.w <= 0.0f)
+    {
+      ++behind;
+      continue;
+    }
+    ndcMin = glm::min(ndcMin, glm::vec3(clip) / clip.w);
+    ndcMax = glm::max(ndcMax, glm::vec3(clip) / clip.w);
+  }
+
+  if (behind == 8)
+    return OcclusionResult::OUTSIDE;
+  // Crosses the camera plane, the projection of the box is meaningless then
+  if (behind != 0)
+    return OcclusionResult::VISIBLE;
+
+  if (
+    ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f || ndcMin.z > 1.0f
+    || ndcMax.z < 0.0f)
+    return OcclusionResult::OUTSIDE;
+  if (ndcMin.z < 0.0f)
+    return OcclusionResult::VISIBLE;
+
+  // Every pixel the box touches, not just the ones whose centers it covers
+  const glm::vec2 size = glm::vec2(resolution);
+  auto toPixel = [&size](glm::vec2 ndc) {
+    const glm::vec2 pixel = glm::floor((ndc * 0.5f + 0.5f) * size);
+    return glm::ivec2(glm::clamp(pixel, glm::vec2(0.0f), size - 1.0f));
+  };
+  const glm::ivec2 first = toPixel(glm::vec2(ndcMin));
+  const glm::ivec2 last = toPixel(glm::vec2(ndcMax));
+  const float zNear = ndcMin.z;
+
+  const glm::ivec2 tileSize{TILE_WIDTH, TILE_HEIGHT};
+  const glm::ivec2 firstTile = first / tileSize;
+  const glm::ivec2 lastTile = last / tileSize;
+  for (std::int32_t tileY = firstTile.y; tileY <= lastTile.y; ++tileY)
+  {
+    const std::int32_t y0 = tileY * tileSize.y;
+    const std::int32_t firstRow = std::max(first.y - y0, 0);
+    const std::int32_t lastRow = std::min(last.y - y0, tileSize.y - 1);
+
+    for (std::int32_t tileX = firstTile.x; tileX <= lastTile.x; ++tileX)
+    {
+      const Tile& tile = tiles[tileY * tileCount.x + tileX];
+      if (zNear > tile.zMax0)
+        continue;
+      if (zNear <= tile.zMax1)
+        return OcclusionResult::VISIBLE;
+
+      // Only the pixels covered by the working layer are guaranteed to be closer than it
+      const std::int32_t x0 = tileX * tileSize.x;
+      const std::uint32_t columns = span_mask(first.x - x0, last.x + 1 - x0);
+      for (std::int32_t row = firstRow; row <= lastRow; ++row)
+        if ((columns & ~tile.mask[row]) != 0)
+          return OcclusionResult::VISIBLE;
+    }
+  }
+
+  return OcclusionResult::OCCLUDED;
+}
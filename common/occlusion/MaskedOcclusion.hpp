@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+class JobSystem;
+
+enum class OcclusionResult : std::uint8_t
+{
+  VISIBLE,
+  // Outside of the view frustum
+  OUTSIDE,
+  OCCLUDED,
+};
+
+/**
+ * Depth-only software rasterizer for occlusion culling on the CPU, in the spirit of
+ * masked occlusion culling. The buffer is made of 32x8 pixel tiles, a tile stores a
+ * coverage bit per pixel and two conservative depths instead of per-pixel depths:
+ * every pixel of the tile is no farther than the first one, and every pixel covered
+ * by the mask is no farther than the second one as well. Once the mask gets full the
+ * layers are merged, so a tile covered by several triangles still ends up occluding.
+ *
+ * A row of a tile is a single 32-bit word, so coverage of a triangle is computed for
+ * 32 pixels at a time, and rows are set up 4 at a time with SSE2 where it is available.
+ *
+ * Depth is NDC depth of a [0, 1] projection, 0 being the closest. Occluders should be
+ * added front to back, the merging heuristic works best then.
+ */
+class MaskedOcclusion
+{
+public:
+  static constexpr std::uint32_t TILE_WIDTH = 32;
+  static constexpr std::uint32_t TILE_HEIGHT = 8;
+
+  // Resolution is rounded up to whole tiles
+  explicit MaskedOcclusion(glm::uvec2 resolution);
+
+  glm::uvec2 getResolution() const { return resolution; }
+
+  // Forgets all occluders and the depth rasterized from them
+  void clear();
+
+  // Queues triangles of a mesh to be rasterized by the next rasterize() call. Indices point
+  // into positions, everything must stay alive until then. Triangles crossing the near
+  // plane are skipped rather than clipped, which only makes the result less occluded.
+  void addOccluder(
+    std::span<const glm::vec3> positions,
+    std::span<const std::uint32_t> indices,
+    const glm::mat4x4& model_view_proj);
+
+  // Rasterizes every occluder queued since the last call on top of what's already there.
+  // Triangles are set up in parallel over occluders and rasterized in parallel over rows
+  // of tiles, on the calling thread only if jobs is null.
+  void rasterize(JobSystem* jobs);
+
+  // Tests screen-space bounds of a world-space box against the rasterized depth
+  OcclusionResult testBox(glm::vec3 min, glm::vec3 max, const glm::mat4x4& view_proj) const;
+
+  std::size_t getTriangleCount() const { return triangleCount; }
+
+private:
+  struct Tile
+  {
+    std::array<std::uint32_t, TILE_HEIGHT> mask;
+    float zMax0;
+    float zMax1;
+  };
+
+  // Triangle set up for rasterization in pixel space. Covered pixels of a row lie between
+  // the farthest of the two left edges and the closest of the two right ones.
+  struct Triangle
+  {
+    // x = x0 + slope * (y - y0)
+    std::array<float, 2> leftX;
+    std::array<float, 2> leftSlope;
+    std::array<float, 2> leftY;
+    std::array<float, 2> rightX;
+    std::array<float, 2> rightSlope;
+    std::array<float, 2> rightY;
+    glm::vec2 min;
+    glm::vec2 max;
+    // z = z0 + dzdx * x + dzdy * y
+    glm::vec3 depthPlane;
+    float zMax;
+    glm::uvec2 firstTile;
+    glm::uvec2 lastTile;
+  };
+
+  struct Occluder
+  {
+    std::span<const glm::vec3> positions;
+    std::span<const std::uint32_t> indices;
+    glm::mat4x4 modelViewProj;
+    std::vector<Triangle> triangles;
+    // Triangles binned by the rows of tiles they touch, those of row r are
+    // rowTriangles[rowOffsets[r], rowOffsets[r + 1])
+    std::vector<std::uint32_t> rowOffsets;
+    std::vector<std::uint32_t> rowTriangles;
+  };
+
+  using RowSpans = std::array<std::int32_t, TILE_HEIGHT>;
+  using RowMasks = std::array<std::uint32_t, TILE_HEIGHT>;
+
+  // Covered pixel columns [starts, ends) of the rows of a row of tiles
+  static void computeRowSpans(
+    const Triangle& tri, float row_y, float width, RowSpans& starts, RowSpans& ends);
+  static void updateTile(Tile& tile, const RowMasks& coverage, float z);
+
+  void setupTriangles(Occluder& occluder) const;
+  void rasterizeTileRow(std::uint32_t tile_row);
+
+private:
+  glm::uvec2 resolution;
+  glm::uvec2 tileCount;
+  std::vector<Tile> tiles;
+
+  // NOTE: occluders stay around between frames so that their triangle storage is reused
+  std::vector<Occluder> occluders;
+  std::size_t occluderCount = 0;
+  std::size_t triangleCount = 0;
+};
@@ -0,0 +1,171 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <tracy/Tracy.hpp>
+
+#include "jobs/JobSystem.hpp"
+
+
+static double ms_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+OcclusionCuller::OcclusionCuller(glm::uvec2 resolution)
+  : rasterizer{resolution}
+{
+}
+
+void OcclusionCuller::selectOccluders(
+  SceneManager& scene, const glm::mat4x4& view_proj, const Settings& settings)
+{
+  ZoneScoped;
+
+  auto instanceBounds = scene.getInstanceBounds();
+  auto instanceMatrices = scene.getInstanceMatrices();
+  auto instanceMeshes = scene.getInstanceMeshes();
+  auto meshes = scene.getMeshes();
+  auto relems = scene.getRenderElements();
+
+  candidates.clear();
+  for (std::uint32_t instIdx = 0; instIdx < instanceBounds.size(); ++instIdx)
+  {
+    const auto& bounds = instanceBounds[instIdx];
+    if (glm::any(glm::greaterThan(bounds.min, bounds.max)))
+      continue;
+
+    glm::vec3 ndcMin{std::numeric_limits<float>::max()};
+    glm::vec3 ndcMax{std::numeric_limits<float>::lowest()};
+    bool crossesCamera = false;
+    for (std::uint32_t corner = 0; corner < 8 && !crossesCamera; ++corner)
+    {
+      const glm::vec3 pos{
+        (corner & 1) != 0 ? bounds.max.x : bounds.min.x,
+        (corner & 2) != 0 ? bounds.max.y : bounds.min.y,
+        (corner & 4) != 0 ? bounds.max.z : bounds.min.z,
+      };
+      const glm::vec4 clip = view_proj * glm::vec4(pos, 1.0f);
+      crossesCamera = clip.w <= 0.0f;
+      ndcMin = glm::min(ndcMin, glm::vec3(clip) / clip.w);
+      ndcMax = glm::max(ndcMax, glm::vec3(clip) / clip.w);
+    }
+
+    // NOTE: instances the camera is next to are the best occluders there are, even though
+    // their triangles crossing the near plane are skipped
+    float area = 1.0f;
+    float depth = 0.0f;
+    if (!crossesCamera)
+    {
+      const glm::vec2 onScreenMin = glm::max(glm::vec2(ndcMin), glm::vec2(-1.0f));
+      const glm::vec2 onScreenMax = glm::min(glm::vec2(ndcMax), glm::vec2(1.0f));
+      if (
+        onScreenMin.x >= onScreenMax.x || onScreenMin.y >= onScreenMax.y || ndcMin.z > 1.0f
+        || ndcMax.z < 0.0f)
+        continue;
+      const glm::vec2 extent = onScreenMax - onScreenMin;
+      area = extent.x * extent.y / 4.0f;
+      depth = std::max(ndcMin.z, 0.0f);
+    }
+    if (area < settings.minOccluderArea)
+      continue;
+
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    std::uint32_t triangles = 0;
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+      triangles += relems[mesh.firstRelem + j].indexCount / 3;
+
+    candidates.push_back(Candidate{
+      .instance = instIdx,
+      .triangles = triangles,
+      .area = area,
+      .depth = depth,
+    });
+  }
+
+  // The biggest ones go first, for as long as the budgets allow
+  std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+    return a.area > b.area;
+  });
+  std::size_t selected = 0;
+  std::uint32_t trianglesLeft = settings.maxOccluderTriangles;
+  for (const auto& candidate : candidates)
+  {
+    if (selected == settings.maxOccluders)
+      break;
+    if (candidate.triangles > trianglesLeft)
+      continue;
+    trianglesLeft -= candidate.triangles;
+    candidates[selected++] = candidate;
+  }
+  candidates.resize(selected);
+
+  // Closest first, which is what the rasterizer works best with
+  std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+    return a.depth < b.depth;
+  });
+
+  auto positions = scene.getPositions();
+  auto indices = scene.getIndices();
+  for (const auto& candidate : candidates)
+  {
+    const glm::mat4x4 modelViewProj = view_proj * instanceMatrices[candidate.instance];
+    const auto& mesh = meshes[instanceMeshes[candidate.instance]];
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+    {
+      const auto& relem = relems[mesh.firstRelem + j];
+      rasterizer.addOccluder(
+        positions.subspan(relem.vertexOffset),
+        indices.subspan(relem.indexOffset, relem.indexCount),
+        modelViewProj);
+    }
+  }
+
+  stats.occluders = static_cast<std::uint32_t>(candidates.size());
+}
+
+void OcclusionCuller::cull(
+  SceneManager& scene, const glm::mat4x4& view_proj, const Settings& settings, JobSystem* jobs)
+{
+  ZoneScoped;
+
+  auto instanceBounds = scene.getInstanceBounds();
+  stats = Stats{.instances = static_cast<std::uint32_t>(instanceBounds.size())};
+
+  auto start = std::chrono::steady_clock::now();
+  rasterizer.clear();
+  selectOccluders(scene, view_proj, settings);
+  stats.selectMs = ms_since(start);
+
+  start = std::chrono::steady_clock::now();
+  rasterizer.rasterize(jobs);
+  stats.occluderTriangles = rasterizer.getTriangleCount();
+  stats.rasterizeMs = ms_since(start);
+
+  start = std::chrono::steady_clock::now();
+  results.resize(instanceBounds.size());
+  auto test = [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+    {
+      const auto& bounds = instanceBounds[i];
+      // Meshes without triangles have inverted bounds and nothing to draw
+      results[i] = glm::any(glm::greaterThan(bounds.min, bounds.max))
+        ? OcclusionResult::OUTSIDE
+        : rasterizer.testBox(bounds.min, bounds.max, view_proj);
+    }
+  };
+  if (jobs != nullptr)
+    jobs->parallelFor("testOccludees", results.size(), 256, test);
+  else
+    test(0, results.size());
+
+  for (const auto result : results)
+  {
+    stats.outside += result == OcclusionResult::OUTSIDE ? 1 : 0;
+    stats.occluded += result == OcclusionResult::OCCLUDED ? 1 : 0;
+  }
+  stats.testMs = ms_since(start);
+}
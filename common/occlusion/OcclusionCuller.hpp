@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "occlusion/MaskedOcclusion.hpp"
+#include "scene/SceneManager.hpp"
+
+
+/**
+ * CPU occlusion culling of scene instances for a single view. Instances covering the most
+ * of the screen are picked as occluders and rasterized with MaskedOcclusion, then bounds
+ * of every instance are tested against the result. Nothing depends on previous frames,
+ * so this works for the very first frame and for any view, e.g. that of a shadow map.
+ */
+class OcclusionCuller
+{
+public:
+  struct Settings
+  {
+    std::uint32_t maxOccluders = 16;
+    std::uint32_t maxOccluderTriangles = 64'000;
+    // Fraction of the screen the bounds of an instance must cover for it to be an occluder
+    float minOccluderArea = 0.02f;
+  };
+
+  struct Stats
+  {
+    std::uint32_t instances = 0;
+    std::uint32_t occluders = 0;
+    std::size_t occluderTriangles = 0;
+    std::uint32_t outside = 0;
+    std::uint32_t occluded = 0;
+    double selectMs = 0;
+    double rasterizeMs = 0;
+    double testMs = 0;
+  };
+
+  explicit OcclusionCuller(glm::uvec2 resolution);
+
+  // Culls every instance of the scene, runs on the calling thread only if jobs is null
+  void cull(
+    SceneManager& scene, const glm::mat4x4& view_proj, const Settings& settings, JobSystem* jobs);
+
+  // Indexed by instance, valid until the next cull() call
+  std::span<const OcclusionResult> getResults() const { return results; }
+  const Stats& getStats() const { return stats; }
+
+private:
+  void selectOccluders(SceneManager& scene, const glm::mat4x4& view_proj, const Settings& settings);
+
+private:
+  struct Candidate
+  {
+    std::uint32_t instance;
+    std::uint32_t triangles;
+    float area;
+    float depth;
+  };
+
+  MaskedOcclusion rasterizer;
+  std::vector<Candidate> candidates;
+  std::vector<OcclusionResult> results;
+  Stats stats;
+};
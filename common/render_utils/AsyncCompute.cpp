@@ -0,0 +1,197 @@
+#include "AsyncCompute.hpp"
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Profiling.hpp>
+#include <spdlog/spdlog.h>
+
+
+static vk::UniqueCommandPool create_pool(vk::Device device, std::uint32_t family)
+{
+  return etna::unwrap_vk_result(device.createCommandPoolUnique(vk::CommandPoolCreateInfo{
+    .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+    .queueFamilyIndex = family,
+  }));
+}
+
+static vk::UniqueCommandBuffer allocate_cmd_buf(vk::Device device, vk::CommandPool pool)
+{
+  auto cmdBufs = etna::unwrap_vk_result(device.allocateCommandBuffersUnique(
+    vk::CommandBufferAllocateInfo{
+      .commandPool = pool,
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = 1,
+    }));
+  return std::move(cmdBufs[0]);
+}
+
+AsyncCompute::AsyncCompute(std::uint32_t frames_in_flight)
+{
+  auto& ctx = etna::get_context();
+  device = ctx.getDevice();
+
+  graphicsFamily = ctx.getQueueFamilyIdx();
+  graphicsQueue = ctx.getQueue();
+
+  const auto families = ctx.getPhysicalDevice().getQueueFamilyProperties();
+  for (std::uint32_t i = 0; i < families.size(); ++i)
+  {
+    const auto flags = families[i].queueFlags;
+    if ((flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics))
+    {
+      dedicatedFamily = i;
+      break;
+    }
+  }
+
+  // NOTE: etna, which is fetched as a dependency (see cmake/thirdparty.cmake), creates the
+  // device with a single universal queue, so a queue from the dedicated family can't be
+  // retrieved here. The paths for different families below are unused until it does.
+  computeFamily = graphicsFamily;
+  computeQueue = graphicsQueue;
+
+  if (dedicatedFamily.has_value())
+    spdlog::info(
+      "GPU has a dedicated compute queue family {}, but no queue from it is available, "
+      "async compute runs on the main queue",
+      *dedicatedFamily);
+  else
+    spdlog::info("GPU has no dedicated compute queue family, async compute runs on the main queue");
+
+  computePool = create_pool(device, computeFamily);
+  graphicsPool = create_pool(device, graphicsFamily);
+
+  slots.resize(frames_in_flight);
+  for (auto& slot : slots)
+  {
+    slot.computeCmdBuf = allocate_cmd_buf(device, computePool.get());
+    slot.joinCmdBuf = allocate_cmd_buf(device, graphicsPool.get());
+    slot.computeDone =
+      etna::unwrap_vk_result(device.createSemaphoreUnique(vk::SemaphoreCreateInfo{}));
+    slot.computeFence = etna::unwrap_vk_result(device.createFenceUnique(
+      vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}));
+    slot.joinFence = etna::unwrap_vk_result(device.createFenceUnique(
+      vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}));
+  }
+}
+
+AsyncCompute::~AsyncCompute()
+{
+  for (auto& slot : slots)
+    ETNA_CHECK_VK_RESULT(device.waitForFences(
+      {slot.computeFence.get(), slot.joinFence.get()}, vk::True, ~std::uint64_t{0}));
+}
+
+vk::CommandBuffer AsyncCompute::begin()
+{
+  ZoneScoped;
+
+  currentSlot = (currentSlot + 1) % static_cast<std::uint32_t>(slots.size());
+  auto& slot = slots[currentSlot];
+
+  ETNA_CHECK_VK_RESULT(device.waitForFences(
+    {slot.computeFence.get(), slot.joinFence.get()}, vk::True, ~std::uint64_t{0}));
+  ETNA_CHECK_VK_RESULT(device.resetFences({slot.computeFence.get(), slot.joinFence.get()}));
+
+  auto cmdBuf = slot.computeCmdBuf.get();
+  ETNA_CHECK_VK_RESULT(cmdBuf.reset());
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+  return cmdBuf;
+}
+
+void AsyncCompute::submit(vk::CommandBuffer cmd_buf, std::span<const SharedBuffer> shared_buffers)
+{
+  ZoneScoped;
+
+  auto& slot = slots[currentSlot];
+
+  // With separate families, buffers change owners through a release on the compute queue
+  // and a matching acquire on the graphics queue. With a single one, the acquire side
+  // is just a regular barrier and the release is not needed.
+  const bool transfer = isAsync();
+
+  std::vector<vk::BufferMemoryBarrier2> releases;
+  std::vector<vk::BufferMemoryBarrier2> acquires;
+  for (const auto& shared : shared_buffers)
+  {
+    if (transfer)
+      releases.push_back(vk::BufferMemoryBarrier2{
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .srcQueueFamilyIndex = computeFamily,
+        .dstQueueFamilyIndex = graphicsFamily,
+        .buffer = shared.buffer,
+        .size = vk::WholeSize,
+      });
+
+    // NOTE: the semaphore wait below already made compute writes available,
+    // src scope of this barrier only has to chain with it.
+    acquires.push_back(vk::BufferMemoryBarrier2{
+      .srcStageMask = transfer ? vk::PipelineStageFlagBits2::eNone
+                               : vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = transfer ? vk::AccessFlagBits2::eNone
+                                : vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = shared.dstStage,
+      .dstAccessMask = shared.dstAccess,
+      .srcQueueFamilyIndex = transfer ? computeFamily : vk::QueueFamilyIgnored,
+      .dstQueueFamilyIndex = transfer ? graphicsFamily : vk::QueueFamilyIgnored,
+      .buffer = shared.buffer,
+      .size = vk::WholeSize,
+    });
+  }
+
+  if (!releases.empty())
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .bufferMemoryBarrierCount = static_cast<std::uint32_t>(releases.size()),
+      .pBufferMemoryBarriers = releases.data(),
+    });
+  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+
+  {
+    vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = cmd_buf};
+    vk::SemaphoreSubmitInfo signalInfo{
+      .semaphore = slot.computeDone.get(),
+      .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    };
+    ETNA_CHECK_VK_RESULT(computeQueue.submit2(
+      {vk::SubmitInfo2{
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &cmdInfo,
+        .signalSemaphoreInfoCount = 1,
+        .pSignalSemaphoreInfos = &signalInfo,
+      }},
+      slot.computeFence.get()));
+  }
+
+  // A semaphore wait only covers commands of its own batch, so the barriers that make the
+  // results visible to graphics are submitted in a tiny batch of their own. Barriers do
+  // cover everything later in submission order, including the frame's main batch.
+  auto joinCmdBuf = slot.joinCmdBuf.get();
+  ETNA_CHECK_VK_RESULT(joinCmdBuf.reset());
+  ETNA_CHECK_VK_RESULT(joinCmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+  if (!acquires.empty())
+    joinCmdBuf.pipelineBarrier2(vk::DependencyInfo{
+      .bufferMemoryBarrierCount = static_cast<std::uint32_t>(acquires.size()),
+      .pBufferMemoryBarriers = acquires.data(),
+    });
+  ETNA_CHECK_VK_RESULT(joinCmdBuf.end());
+
+  {
+    vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = joinCmdBuf};
+    vk::SemaphoreSubmitInfo waitInfo{
+      .semaphore = slot.computeDone.get(),
+      .stageMask = vk::PipelineStageFlagBits2::eAllCommands,
+    };
+    ETNA_CHECK_VK_RESULT(graphicsQueue.submit2(
+      {vk::SubmitInfo2{
+        .waitSemaphoreInfoCount = 1,
+        .pWaitSemaphoreInfos = &waitInfo,
+        .commandBufferInfoCount = 1,
+        .pCommandBufferInfos = &cmdInfo,
+      }},
+      slot.joinFence.get()));
+  }
+}
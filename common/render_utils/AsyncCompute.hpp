@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Submits compute work separately from the frame's graphics work and hands its results
+ * over to the main queue through a semaphore. The work would go to a compute-only queue,
+ * but the device etna creates only has the main one, so for now it always runs there
+ * and doesn't overlap with rendering.
+ *
+ * Usage per frame, after the main per-frame command buffer has been acquired
+ * (which guarantees that graphics work from frames_in_flight frames ago is done):
+ *   auto cmd = asyncCompute.begin();
+ *   <record compute work>
+ *   asyncCompute.submit(cmd, {<buffers read by graphics afterwards>});
+ * Graphics work submitted to the main queue after submit() sees the results.
+ */
+class AsyncCompute
+{
+public:
+  // A buffer written by the compute work and read by graphics afterwards
+  struct SharedBuffer
+  {
+    vk::Buffer buffer;
+    vk::PipelineStageFlags2 dstStage;
+    vk::AccessFlags2 dstAccess;
+  };
+
+  explicit AsyncCompute(std::uint32_t frames_in_flight);
+  ~AsyncCompute();
+
+  AsyncCompute(const AsyncCompute&) = delete;
+  AsyncCompute& operator=(const AsyncCompute&) = delete;
+
+  // Whether the work actually goes to a separate queue
+  bool isAsync() const { return computeFamily != graphicsFamily; }
+  // A compute-only queue family of the GPU, if it has one, regardless of whether we use it
+  std::optional<std::uint32_t> getDedicatedFamily() const { return dedicatedFamily; }
+
+  // Waits until the work submitted frames_in_flight frames ago is done
+  // and starts recording a command buffer for the compute queue.
+  vk::CommandBuffer begin();
+  void submit(vk::CommandBuffer cmd_buf, std::span<const SharedBuffer> shared_buffers);
+
+private:
+  struct Slot
+  {
+    vk::UniqueCommandBuffer computeCmdBuf;
+    vk::UniqueCommandBuffer joinCmdBuf;
+    vk::UniqueSemaphore computeDone;
+    vk::UniqueFence computeFence;
+    vk::UniqueFence joinFence;
+  };
+
+  vk::Device device;
+
+  std::optional<std::uint32_t> dedicatedFamily;
+  std::uint32_t graphicsFamily;
+  std::uint32_t computeFamily;
+  vk::Queue graphicsQueue;
+  vk::Queue computeQueue;
+
+  vk::UniqueCommandPool computePool;
+  vk::UniqueCommandPool graphicsPool;
+
+  std::vector<Slot> slots;
+  std::uint32_t currentSlot = 0;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+/**
+ * Keeps GPU objects, e.g. pipelines replaced at runtime, alive until frames in flight
+ * which might still use them are done, so that replacing them never waits for the GPU.
+ *
+ * nextFrame() must be called once per frame after the GPU is done with the work from
+ * frames_in_flight frames ago. Objects pushed before it were used at most by the previous
+ * frame, so they are destroyed frames_in_flight calls of nextFrame later.
+ */
+class DeferredDestroyQueue
+{
+public:
+  explicit DeferredDestroyQueue(std::uint32_t frames_in_flight)
+    : framesInFlight{frames_in_flight}
+  {
+  }
+
+  template <class T>
+  void push(T&& object)
+  {
+    entries.push_back(Entry{
+      .frame = frame,
+      .object = std::make_shared<std::remove_cvref_t<T>>(std::forward<T>(object)),
+    });
+  }
+
+  void nextFrame()
+  {
+    ++frame;
+    while (!entries.empty() && frame - entries.front().frame >= framesInFlight)
+      entries.pop_front();
+  }
+
+private:
+  struct Entry
+  {
+    std::uint64_t frame;
+    // NOTE: shared_ptr<void> still calls the destructor of the actual type
+    std::shared_ptr<void> object;
+  };
+
+  std::uint32_t framesInFlight;
+  std::uint64_t frame = 0;
+  std::deque<Entry> entries;
+};
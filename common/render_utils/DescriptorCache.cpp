@@ -0,0 +1,81 @@
+#include "DescriptorCache.hpp"
+
+#include <variant>
+
+#include <tracy/Tracy.hpp>
+
+#include "hashing/Hasher.hpp"
+
+
+template <class Handle>
+static std::uint64_t handle_bits(Handle handle)
+{
+  return reinterpret_cast<std::uint64_t>(static_cast<typename Handle::CType>(handle));
+}
+
+void DescriptorCache::fillKey(
+  Key& key, etna::DescriptorLayoutId layout_id, const std::vector<etna::Binding>& bindings)
+{
+  key.layoutId = layout_id;
+  key.words.clear();
+  for (const auto& binding : bindings)
+  {
+    key.words.push_back(std::uint64_t{binding.binding} << 32 | binding.arrayElem);
+    if (const auto* buffer = std::get_if<etna::BufferBinding>(&binding.resources))
+    {
+      key.words.push_back(handle_bits(buffer->descriptor_info.buffer));
+      key.words.push_back(buffer->descriptor_info.offset);
+      key.words.push_back(buffer->descriptor_info.range);
+    }
+    else if (const auto* image = std::get_if<etna::ImageBinding>(&binding.resources))
+    {
+      key.words.push_back(handle_bits(image->descriptor_info.imageView));
+      key.words.push_back(handle_bits(image->descriptor_info.sampler));
+      key.words.push_back(static_cast<std::uint64_t>(image->descriptor_info.imageLayout));
+    }
+  }
+}
+
+std::size_t DescriptorCache::KeyHash::operator()(const Key& key) const
+{
+  // NOTE: handles are pointers, Hasher spreads their low bits
+  Hasher hasher;
+  hasher.mix(static_cast<std::uint64_t>(key.layoutId));
+  for (const auto word : key.words)
+    hasher.mix(word);
+  return static_cast<std::size_t>(hasher.state);
+}
+
+vk::DescriptorSet DescriptorCache::get(
+  etna::DescriptorLayoutId layout_id,
+  vk::CommandBuffer cmd_buf,
+  std::vector<etna::Binding> bindings)
+{
+  ZoneScoped;
+
+  fillKey(scratchKey, layout_id, bindings);
+
+  auto it = sets.find(scratchKey);
+  if (it != sets.end())
+    ++hits;
+  else
+  {
+    ++misses;
+    it = sets
+           .emplace(
+             scratchKey, etna::create_persistent_descriptor_set(layout_id, std::move(bindings)))
+           .first;
+  }
+
+  // NOTE: images bound to the set may have been used differently since it was written
+  it->second.processBarriers(cmd_buf);
+  return it->second.getVkSet();
+}
+
+void DescriptorCache::invalidate(DeferredDestroyQueue& queue)
+{
+  if (sets.empty())
+    return;
+  queue.push(std::move(sets));
+  sets.clear();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "render_utils/DeferredDestroyQueue.hpp"
+
+
+/**
+ * Persistent descriptor sets for bindings which stay the same frame after frame, e.g.
+ * constant buffers and render targets sampled by later passes. A set is written once and then
+ * found by its layout and the buffers, views and samplers bound to it, so nothing is allocated
+ * from etna's per-frame pool on the way.
+ *
+ * NOTE: handles of destroyed resources may be reused by new ones, and sets keep references to
+ * the bound etna objects, so invalidate() must be called whenever any of them is recreated.
+ */
+class DescriptorCache
+{
+public:
+  struct Stats
+  {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::size_t sets = 0;
+  };
+
+  // Requests barriers for the bound images on cmd_buf the way etna::create_descriptor_set
+  // does, they are flushed by the next render target state or etna::flush_barriers.
+  vk::DescriptorSet get(
+    etna::DescriptorLayoutId layout_id,
+    vk::CommandBuffer cmd_buf,
+    std::vector<etna::Binding> bindings);
+
+  // Hands all sets over to a queue which destroys them once frames in flight are done
+  void invalidate(DeferredDestroyQueue& queue);
+
+  Stats getStats() const
+  {
+    return Stats{.hits = hits, .misses = misses, .sets = sets.size()};
+  }
+
+private:
+  struct Key
+  {
+    etna::DescriptorLayoutId layoutId{};
+    // Binding slots and raw handles, offsets and layouts of whatever is bound to them
+    std::vector<std::uint64_t> words;
+
+    bool operator==(const Key&) const = default;
+  };
+
+  struct KeyHash
+  {
+    std::size_t operator()(const Key& key) const;
+  };
+
+  static void fillKey(
+    Key& key, etna::DescriptorLayoutId layout_id, const std::vector<etna::Binding>& bindings);
+
+private:
+  std::unordered_map<Key, etna::PersistentDescriptorSet, KeyHash> sets;
+  // Reused between lookups, so that hits don't allocate
+  Key scratchKey;
+
+  std::uint64_t hits = 0;
+  std::uint64_t misses = 0;
+};
@@ -0,0 +1,102 @@
+#include "DrawList.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <utility>
+
+#include <tracy/Tracy.hpp>
+
+
+static_assert(
+  DRAW_KEY_PIPELINE_BITS + DRAW_KEY_MATERIAL_BITS + DRAW_KEY_INDEX_TYPE_BITS +
+    DRAW_KEY_DEPTH_BITS ==
+  64);
+
+static std::uint64_t clamp_field(std::uint64_t value, std::uint32_t bits)
+{
+  return std::min(value, (std::uint64_t{1} << bits) - 1);
+}
+
+static std::uint64_t quantize_depth(float depth)
+{
+  constexpr float MAX_DEPTH = float((1u << DRAW_KEY_DEPTH_BITS) - 1);
+  // NOTE: also catches NaNs, which would otherwise be UB to convert
+  if (!(depth > 0.0f))
+    return 0;
+  return static_cast<std::uint64_t>(std::min(depth, 1.0f) * MAX_DEPTH);
+}
+
+std::uint64_t make_draw_sort_key(const DrawState& state, DrawOrder order)
+{
+  const std::uint64_t pipeline = clamp_field(state.pipeline, DRAW_KEY_PIPELINE_BITS);
+  const std::uint64_t material = clamp_field(state.material, DRAW_KEY_MATERIAL_BITS);
+  const std::uint64_t indexType = clamp_field(state.indexType, DRAW_KEY_INDEX_TYPE_BITS);
+  const std::uint64_t depth = quantize_depth(state.depth);
+
+  std::uint64_t key = pipeline;
+  switch (order)
+  {
+  case DrawOrder::FRONT_TO_BACK:
+    key = (key << DRAW_KEY_DEPTH_BITS) | depth;
+    key = (key << DRAW_KEY_MATERIAL_BITS) | material;
+    key = (key << DRAW_KEY_INDEX_TYPE_BITS) | indexType;
+    break;
+  case DrawOrder::STATE:
+    key = (key << DRAW_KEY_MATERIAL_BITS) | material;
+    key = (key << DRAW_KEY_INDEX_TYPE_BITS) | indexType;
+    key = (key << DRAW_KEY_DEPTH_BITS) | depth;
+    break;
+  }
+  return key;
+}
+
+void radix_sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch)
+{
+  ZoneScoped;
+
+  constexpr std::uint32_t PASSES = sizeof(std::uint64_t);
+  const std::size_t count = items.size();
+  if (count < 2)
+    return;
+
+  // Histograms of all passes are gathered in one go over the keys
+  std::array<std::array<std::uint32_t, 256>, PASSES> histograms{};
+  for (const auto& item : items)
+    for (std::uint32_t pass = 0; pass < PASSES; ++pass)
+      ++histograms[pass][(item.key >> (pass * 8)) & 0xFF];
+
+  scratch.resize(count);
+  DrawItem* from = items.data();
+  DrawItem* to = scratch.data();
+
+  for (std::uint32_t pass = 0; pass < PASSES; ++pass)
+  {
+    auto& histogram = histograms[pass];
+
+    // All keys have the same byte, the pass wouldn't move anything
+    if (histogram[(from[0].key >> (pass * 8)) & 0xFF] == count)
+      continue;
+
+    std::uint32_t offset = 0;
+    for (auto& bucket : histogram)
+      offset += std::exchange(bucket, offset);
+
+    for (std::size_t i = 0; i < count; ++i)
+      to[histogram[(from[i].key >> (pass * 8)) & 0xFF]++] = from[i];
+
+    std::swap(from, to);
+  }
+
+  // NOTE: an odd amount of passes leaves the result in scratch
+  if (from != items.data())
+    items.swap(scratch);
+}
+
+void DrawList::sort()
+{
+  const auto start = std::chrono::steady_clock::now();
+  radix_sort_draws(items, scratch);
+  sortMs =
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
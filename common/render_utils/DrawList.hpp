@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+// State a draw is submitted with, packed into a 64-bit key by one of the orders below
+struct DrawState
+{
+  // Indices into whatever tables of pipelines and materials the renderer has
+  std::uint32_t pipeline = 0;
+  std::uint32_t material = 0;
+  // 0 for 32-bit indices, 1 for 16-bit ones
+  std::uint32_t indexType = 0;
+  // View depth normalized to [0, 1], 0 being the closest
+  float depth = 0;
+};
+
+enum class DrawOrder : std::uint8_t
+{
+  // pipeline | depth | material | index type: closest draws go first for early-Z
+  FRONT_TO_BACK,
+  // pipeline | material | index type | depth: fewest state changes, e.g. for shadow passes
+  STATE,
+};
+
+// Widths of the key fields, values which don't fit are clamped
+inline constexpr std::uint32_t DRAW_KEY_PIPELINE_BITS = 8;
+inline constexpr std::uint32_t DRAW_KEY_MATERIAL_BITS = 31;
+inline constexpr std::uint32_t DRAW_KEY_INDEX_TYPE_BITS = 1;
+inline constexpr std::uint32_t DRAW_KEY_DEPTH_BITS = 24;
+
+std::uint64_t make_draw_sort_key(const DrawState& state, DrawOrder order);
+
+// A single draw of a relem of an instance
+struct DrawItem
+{
+  std::uint64_t key;
+  std::uint32_t instance;
+  std::uint32_t relem;
+};
+
+/**
+ * Draws of a view, which are sorted by their keys before being submitted. Meant to be
+ * rebuilt every frame, memory is reused between frames.
+ *
+ * Sorting is an LSD radix sort over bytes of the keys, passes over bytes which are the same
+ * for all keys (e.g. unused pipeline or material bits) are skipped.
+ */
+class DrawList
+{
+public:
+  void clear() { items.clear(); }
+  void reserve(std::size_t count) { items.reserve(count); }
+
+  void add(const DrawState& state, DrawOrder order, std::uint32_t instance, std::uint32_t relem)
+  {
+    items.push_back(DrawItem{
+      .key = make_draw_sort_key(state, order),
+      .instance = instance,
+      .relem = relem,
+    });
+  }
+
+  void sort();
+
+  std::span<const DrawItem> getItems() const { return items; }
+  std::size_t size() const { return items.size(); }
+
+  // CPU time of the latest sort() call
+  double getSortMs() const { return sortMs; }
+
+private:
+  std::vector<DrawItem> items;
+  std::vector<DrawItem> scratch;
+  double sortMs = 0;
+};
+
+// Sorts draws by their keys, stable. Exposed for benchmarking, scratch is resized as needed.
+void radix_sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch);
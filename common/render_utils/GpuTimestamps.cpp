@@ -0,0 +1,84 @@
+#include "GpuTimestamps.hpp"
+
+#include <array>
+
+#include <etna/GlobalContext.hpp>
+
+
+GpuTimestamps::GpuTimestamps(std::uint32_t frames_in_flight, std::uint32_t timestamps_per_frame)
+  : framesInFlight{frames_in_flight}
+  , perFrame{timestamps_per_frame}
+  , written(std::size_t{frames_in_flight} * timestamps_per_frame, false)
+  , results(timestamps_per_frame)
+{
+  auto& ctx = etna::get_context();
+
+  const auto limits = ctx.getPhysicalDevice().getProperties().limits;
+  periodNs = limits.timestampPeriod;
+  // NOTE: we only check the main queue family, dedicated compute families
+  // are required to support timestamps if timestampComputeAndGraphics is set.
+  const auto families = ctx.getPhysicalDevice().getQueueFamilyProperties();
+  supported = limits.timestampComputeAndGraphics &&
+    families[ctx.getQueueFamilyIdx()].timestampValidBits != 0;
+
+  pool = etna::unwrap_vk_result(ctx.getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+    .queryType = vk::QueryType::eTimestamp,
+    .queryCount = framesInFlight * perFrame,
+  }));
+}
+
+void GpuTimestamps::nextFrame()
+{
+  currentSlot = (currentSlot + 1) % framesInFlight;
+
+  const std::uint32_t first = currentSlot * perFrame;
+  for (std::uint32_t i = 0; i < perFrame; ++i)
+  {
+    results[i].reset();
+    if (!supported || !written[first + i])
+      continue;
+    written[first + i] = false;
+
+    // NOTE: with availability instead of waiting, a late frame just loses its timings
+    std::array<std::uint64_t, 2> valueAndAvailability{};
+    const auto res = etna::get_context().getDevice().getQueryPoolResults(
+      pool.get(),
+      first + i,
+      1,
+      sizeof(valueAndAvailability),
+      valueAndAvailability.data(),
+      sizeof(valueAndAvailability),
+      vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+    if ((res == vk::Result::eSuccess || res == vk::Result::eNotReady) &&
+        valueAndAvailability[1] != 0)
+      results[i] = valueAndAvailability[0];
+  }
+}
+
+void GpuTimestamps::write(
+  vk::CommandBuffer cmd_buf, std::uint32_t timestamp, vk::PipelineStageFlags2 stage)
+{
+  if (!supported)
+    return;
+
+  const std::uint32_t query = currentSlot * perFrame + timestamp;
+  cmd_buf.resetQueryPool(pool.get(), query, 1);
+  cmd_buf.writeTimestamp2(stage, pool.get(), query);
+  written[query] = true;
+}
+
+std::optional<double> GpuTimestamps::getAbsoluteMs(std::uint32_t timestamp) const
+{
+  if (!results[timestamp].has_value())
+    return std::nullopt;
+  return static_cast<double>(*results[timestamp]) * periodNs * 1e-6;
+}
+
+std::optional<double> GpuTimestamps::getMs(std::uint32_t from, std::uint32_t to) const
+{
+  const auto begin = getAbsoluteMs(from);
+  const auto end = getAbsoluteMs(to);
+  if (!begin.has_value() || !end.has_value())
+    return std::nullopt;
+  return *end - *begin;
+}
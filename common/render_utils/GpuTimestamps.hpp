@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <etna/Vulkan.hpp>
+
+
+/**
+ * Ring of timestamp queries for measuring GPU work of a frame, possibly spread over
+ * several queues. Results are read back when a frame slot gets reused, i.e. with
+ * a latency of frames_in_flight frames, so nothing ever waits for the GPU.
+ *
+ * NOTE: write() resets the query it writes, so it must not be called inside a render pass.
+ */
+class GpuTimestamps
+{
+public:
+  GpuTimestamps(std::uint32_t frames_in_flight, std::uint32_t timestamps_per_frame);
+
+  GpuTimestamps(const GpuTimestamps&) = delete;
+  GpuTimestamps& operator=(const GpuTimestamps&) = delete;
+
+  // Moves on to the next frame slot, collecting results previously recorded into it.
+  // Must be called once per frame, after the GPU is done with the work from
+  // frames_in_flight frames ago.
+  void nextFrame();
+
+  void write(vk::CommandBuffer cmd_buf, std::uint32_t timestamp, vk::PipelineStageFlags2 stage);
+
+  // Time in milliseconds between two timestamps of the latest completed frame,
+  // nullopt if any of them wasn't recorded or is not supported by the device.
+  std::optional<double> getMs(std::uint32_t from, std::uint32_t to) const;
+  // Raw value of a timestamp of the latest completed frame in milliseconds, only
+  // differences between these are meaningful.
+  std::optional<double> getAbsoluteMs(std::uint32_t timestamp) const;
+
+  bool isSupported() const { return supported; }
+
+private:
+  vk::UniqueQueryPool pool;
+  std::uint32_t framesInFlight;
+  std::uint32_t perFrame;
+  std::uint32_t currentSlot = 0;
+  double periodNs = 0;
+  bool supported = false;
+
+  // Whether each query of each slot has been written since the slot was last read
+  std::vector<bool> written;
+  std::vector<std::optional<std::uint64_t>> results;
+};
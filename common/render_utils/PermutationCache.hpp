@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <fmt/format.h>
+#include <function2/function2.hpp>
+
+#include "render_utils/DeferredDestroyQueue.hpp"
+
+
+// Name of the SPIR-V binary of a permutation of a shader's FEATURES declared in
+// target_add_shaders, bit i of the mask stands for the i-th feature being enabled.
+inline std::string shader_permutation_binary(std::string_view shader, std::uint32_t mask)
+{
+  return mask == 0 ? fmt::format("{}.spv", shader) : fmt::format("{}.{}.spv", shader, mask);
+}
+
+/**
+ * Objects made for permutations of shader features, e.g. programs or pipelines, which
+ * are created on first use and cached by the mask of features. So only the permutations
+ * that are actually used ever get created, and switching between them is a lookup.
+ */
+template <class T>
+class PermutationCache
+{
+public:
+  using Factory = fu2::unique_function<T(std::uint32_t mask)>;
+
+  PermutationCache() = default;
+  explicit PermutationCache(Factory create)
+    : factory{std::move(create)}
+  {
+  }
+
+  T& get(std::uint32_t mask)
+  {
+    auto it = cache.find(mask);
+    if (it == cache.end())
+      it = cache.emplace(mask, factory(mask)).first;
+    return it->second;
+  }
+
+  // Only safe to use when the GPU doesn't use any of the objects, see retire otherwise
+  void clear() { cache.clear(); }
+
+  // Hands all objects over to a queue which destroys them once frames in flight are done
+  void retire(DeferredDestroyQueue& queue)
+  {
+    for (auto& [_, object] : cache)
+      queue.push(std::move(object));
+    cache.clear();
+  }
+
+  std::size_t size() const { return cache.size(); }
+
+private:
+  Factory factory;
+  std::unordered_map<std::uint32_t, T> cache;
+};
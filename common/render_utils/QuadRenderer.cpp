@@ -10,6 +10,7 @@
 QuadRenderer::QuadRenderer(CreateInfo info)
 {
   rect = info.rect;
+  descriptorCache = info.descriptorCache;
 
   programId = etna::get_program_id("quad_renderer");
 
@@ -18,15 +19,28 @@ QuadRenderer::QuadRenderer(CreateInfo info)
       "quad_renderer",
       {RENDER_UTILS_SHADERS_ROOT "quad.vert.spv", RENDER_UTILS_SHADERS_ROOT "quad.frag.spv"});
 
+  etna::GraphicsPipeline::CreateInfo pipelineInfo{
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {info.format},
+      },
+  };
+
+  if (info.premultipliedAlphaBlend)
+    pipelineInfo.blendingConfig.attachments = {vk::PipelineColorBlendAttachmentState{
+      .blendEnable = vk::True,
+      .srcColorBlendFactor = vk::BlendFactor::eOne,
+      .dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+      .colorBlendOp = vk::BlendOp::eAdd,
+      .srcAlphaBlendFactor = vk::BlendFactor::eOne,
+      .dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha,
+      .alphaBlendOp = vk::BlendOp::eAdd,
+      .colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+        vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA,
+    }};
+
   auto& pipelineManager = etna::get_context().getPipelineManager();
-  pipeline = pipelineManager.createGraphicsPipeline(
-    "quad_renderer",
-    {
-      .fragmentShaderOutput =
-        {
-          .colorAttachmentFormats = {info.format},
-        },
-    });
+  pipeline = pipelineManager.createGraphicsPipeline("quad_renderer", std::move(pipelineInfo));
 }
 
 void QuadRenderer::render(
@@ -37,11 +51,13 @@ void QuadRenderer::render(
   const etna::Sampler& sampler)
 {
   auto programInfo = etna::get_shader_program(programId);
-  auto set = etna::create_descriptor_set(
-    programInfo.getDescriptorLayoutId(0),
-    cmd_buf,
-    {etna::Binding{
-      0, tex_to_draw.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+  std::vector<etna::Binding> bindings{etna::Binding{
+    0, tex_to_draw.genBinding(sampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}};
+
+  const auto layoutId = programInfo.getDescriptorLayoutId(0);
+  const vk::DescriptorSet vkSet = descriptorCache != nullptr
+    ? descriptorCache->get(layoutId, cmd_buf, std::move(bindings))
+    : etna::create_descriptor_set(layoutId, cmd_buf, std::move(bindings)).getVkSet();
 
   etna::RenderTargetState renderTargets(
     cmd_buf,
@@ -51,7 +67,7 @@ void QuadRenderer::render(
 
   cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline.getVkPipeline());
   cmd_buf.bindDescriptorSets(
-    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, {set.getVkSet()}, {});
+    vk::PipelineBindPoint::eGraphics, pipeline.getVkPipelineLayout(), 0, {vkSet}, {});
 
   cmd_buf.draw(3, 1, 0, 0);
 }
@@ -5,6 +5,8 @@
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 
+#include "render_utils/DescriptorCache.hpp"
+
 
 /**
  * Simple class for displaying a texture on the screen for debug purposes.
@@ -16,6 +18,12 @@ public:
   {
     vk::Format format = vk::Format::eUndefined;
     vk::Rect2D rect = {};
+    // Blend the texture over the target assuming it contains premultiplied alpha,
+    // e.g. for compositing overlays, instead of overwriting the target.
+    bool premultipliedAlphaBlend = false;
+    // Sets are taken from the cache if there is one, so it must be invalidated whenever
+    // a drawn texture is recreated. Otherwise they are allocated anew on every render.
+    DescriptorCache* descriptorCache = nullptr;
   };
 
   explicit QuadRenderer(CreateInfo info);
@@ -32,6 +40,7 @@ private:
   etna::GraphicsPipeline pipeline;
   etna::ShaderProgramId programId;
   vk::Rect2D rect{};
+  DescriptorCache* descriptorCache = nullptr;
 
   QuadRenderer(const QuadRenderer&) = delete;
   QuadRenderer& operator=(const QuadRenderer&) = delete;
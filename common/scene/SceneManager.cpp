@@ -1,19 +1,36 @@
 #include "SceneManager.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numeric>
 #include <stack>
 
 #include <spdlog/spdlog.h>
 #include <fmt/std.h>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/OneShotCmdMgr.hpp>
 
+#include "jobs/JobSystem.hpp"
+#include "mesh_utils/MeshSimplifier.hpp"
+#include "textures/BakedTexture.hpp"
+#include "textures/EncodedImages.hpp"
+#include "textures/TextureMips.hpp"
+
 
 SceneManager::SceneManager()
   : oneShotCommands{etna::get_context().createOneShotCmdMgr()}
   , transferHelper{etna::BlockingTransferHelper::CreateInfo{.stagingSize = 4096 * 4096 * 4}}
 {
+  // NOTE: images are decoded in parallel once the whole model is loaded, see decodeTextures
+  keep_images_encoded(loader, KeptImages::All);
 }
 
 std::optional<tinygltf::Model> SceneManager::loadModel(std::filesystem::path path)
@@ -185,12 +202,19 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
   }
 
   result.meshes.reserve(model.meshes.size());
+  result.meshBounds.reserve(model.meshes.size());
 
   for (const auto& mesh : model.meshes)
   {
     result.meshes.push_back(Mesh{
       .firstRelem = static_cast<std::uint32_t>(result.relems.size()),
       .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .lodCount = 1,
+    });
+    // NOTE: stays inverted (min > max) for meshes without any triangles
+    auto& bounds = result.meshBounds.emplace_back(BoundingBox{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
     });
 
     for (const auto& prim : mesh.primitives)
@@ -234,10 +258,14 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         hasTexcoord ? &model.bufferViews[accessors[4]->bufferView] : nullptr,
       };
 
+      // Material 0 is the default one, see processMaterials
+      const auto material = static_cast<std::uint32_t>(prim.material >= 0 ? prim.material + 1 : 0);
       result.relems.push_back(RenderElement{
         .vertexOffset = static_cast<std::uint32_t>(result.vertices.size()),
         .indexOffset = static_cast<std::uint32_t>(result.indices.size()),
         .indexCount = static_cast<std::uint32_t>(accessors[0]->count),
+        .material = material,
+        .lengthPerUv = 0.0f,
       });
 
       const std::size_t vertexCount = accessors[1]->count;
@@ -298,6 +326,8 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
         glm::vec3 tangent{0};
         glm::vec2 texcoord{0};
         std::memcpy(&pos, ptrs[1], sizeof(pos));
+        bounds.min = glm::min(bounds.min, pos);
+        bounds.max = glm::max(bounds.max, pos);
 
         // NOTE: it's faster to do a template here with specializations for all combinations than to
         // do ifs at runtime. Also, SIMD should be used. Try implementing this!
@@ -310,8 +340,10 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 
 
         vtx.positionAndNormal = glm::vec4(pos, std::bit_cast<float>(encode_normal(normal)));
-        vtx.texCoordAndTangentAndPadding =
-          glm::vec4(texcoord, std::bit_cast<float>(encode_normal(tangent)), 0);
+        vtx.texCoordAndTangentAndMaterial = glm::vec4(
+          texcoord,
+          std::bit_cast<float>(encode_normal(tangent)),
+          std::bit_cast<float>(material));
 
         ptrs[1] += strides[1];
         if (hasNormals)
@@ -344,6 +376,30 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
           ptrs[0],
           sizeof(result.indices[0]) * indexCount);
       }
+
+      // NOTE: indices of other types are not read at all
+      auto& relem = result.relems.back();
+      if (hasTexcoord && relem.indexOffset + relem.indexCount <= result.indices.size())
+      {
+        // Both areas are doubled, which cancels out
+        double area = 0;
+        double uvArea = 0;
+        for (std::size_t i = 0; i + 2 < relem.indexCount; i += 3)
+        {
+          const auto* triangle = &result.indices[relem.indexOffset + i];
+          const auto& v0 = result.vertices[relem.vertexOffset + triangle[0]];
+          const auto& v1 = result.vertices[relem.vertexOffset + triangle[1]];
+          const auto& v2 = result.vertices[relem.vertexOffset + triangle[2]];
+          const glm::vec3 p0{v0.positionAndNormal};
+          const glm::vec2 uv0{v0.texCoordAndTangentAndMaterial};
+          area += glm::length(glm::cross(
+            glm::vec3(v1.positionAndNormal) - p0, glm::vec3(v2.positionAndNormal) - p0));
+          const glm::vec2 duv1 = glm::vec2(v1.texCoordAndTangentAndMaterial) - uv0;
+          const glm::vec2 duv2 = glm::vec2(v2.texCoordAndTangentAndMaterial) - uv0;
+          uvArea += std::abs(duv1.x * duv2.y - duv1.y * duv2.x);
+        }
+        relem.lengthPerUv = uvArea > 0 ? static_cast<float>(std::sqrt(area / uvArea)) : 0.0f;
+      }
     }
   }
 
@@ -351,24 +407,426 @@ SceneManager::ProcessedMeshes SceneManager::processMeshes(const tinygltf::Model&
 }
 
 void SceneManager::uploadData(
-  std::span<const Vertex> vertices, std::span<const std::uint32_t> indices)
+  std::span<const std::byte> vertices,
+  std::span<const std::byte> indices,
+  std::span<const std::byte> extra_vertices,
+  std::span<const std::byte> extra_indices)
 {
   unifiedVbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = vertices.size_bytes(),
+    .size = vertices.size_bytes() + extra_vertices.size_bytes(),
     .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedVbuf",
   });
 
   unifiedIbuf = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
-    .size = indices.size_bytes(),
+    .size = indices.size_bytes() + extra_indices.size_bytes(),
     .bufferUsage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer,
     .memoryUsage = VMA_MEMORY_USAGE_GPU_ONLY,
     .name = "unifiedIbuf",
   });
 
-  transferHelper.uploadBuffer<Vertex>(*oneShotCommands, unifiedVbuf, 0, vertices);
-  transferHelper.uploadBuffer<std::uint32_t>(*oneShotCommands, unifiedIbuf, 0, indices);
+  transferHelper.uploadBuffer<std::byte>(*oneShotCommands, unifiedVbuf, 0, vertices);
+  transferHelper.uploadBuffer<std::byte>(*oneShotCommands, unifiedIbuf, 0, indices);
+  if (!extra_vertices.empty())
+    transferHelper.uploadBuffer<std::byte>(
+      *oneShotCommands,
+      unifiedVbuf,
+      static_cast<std::uint32_t>(vertices.size_bytes()),
+      extra_vertices);
+  if (!extra_indices.empty())
+    transferHelper.uploadBuffer<std::byte>(
+      *oneShotCommands,
+      unifiedIbuf,
+      static_cast<std::uint32_t>(indices.size_bytes()),
+      extra_indices);
+}
+
+SceneManager::ProcessedMaterials SceneManager::processMaterials(
+  const tinygltf::Model& model) const
+{
+  ProcessedMaterials result;
+  result.imageFormats.assign(model.images.size(), vk::Format::eUndefined);
+
+  auto textureIndex = [&model](int texture, std::uint32_t fallback) {
+    if (texture < 0 || model.textures[texture].source < 0)
+      return fallback;
+    return static_cast<std::uint32_t>(model.textures[texture].source) +
+      Material::DEFAULT_TEXTURE_COUNT;
+  };
+  auto useImage = [&result](std::uint32_t texture, vk::Format format) {
+    if (texture < Material::DEFAULT_TEXTURE_COUNT)
+      return;
+    // NOTE: an image used both as a base color and as data stays sRGB
+    auto& imageFormat = result.imageFormats[texture - Material::DEFAULT_TEXTURE_COUNT];
+    if (imageFormat != vk::Format::eR8G8B8A8Srgb)
+      imageFormat = format;
+  };
+
+  result.materials.reserve(model.materials.size() + 1);
+  result.materials.emplace_back();
+  for (const auto& material : model.materials)
+  {
+    const auto& pbr = material.pbrMetallicRoughness;
+    const auto& factor = pbr.baseColorFactor;
+    const auto& processed = result.materials.emplace_back(Material{
+      .baseColorFactor = glm::vec4(
+        static_cast<float>(factor[0]),
+        static_cast<float>(factor[1]),
+        static_cast<float>(factor[2]),
+        static_cast<float>(factor[3])),
+      .metallicFactor = static_cast<float>(pbr.metallicFactor),
+      .roughnessFactor = static_cast<float>(pbr.roughnessFactor),
+      .normalScale = static_cast<float>(material.normalTexture.scale),
+      .baseColorTexture = textureIndex(pbr.baseColorTexture.index, Material::WHITE_TEXTURE),
+      .normalTexture = textureIndex(material.normalTexture.index, Material::FLAT_NORMAL_TEXTURE),
+      .metallicRoughnessTexture =
+        textureIndex(pbr.metallicRoughnessTexture.index, Material::WHITE_TEXTURE),
+    });
+
+    useImage(processed.baseColorTexture, vk::Format::eR8G8B8A8Srgb);
+    useImage(processed.normalTexture, vk::Format::eR8G8B8A8Unorm);
+    useImage(processed.metallicRoughnessTexture, vk::Format::eR8G8B8A8Unorm);
+  }
+
+  return result;
+}
+
+SceneManager::TextureData SceneManager::solidTexture(
+  std::string name, vk::Format format, std::array<std::uint8_t, 4> color)
+{
+  return TextureData{
+    .name = std::move(name),
+    .size = {1, 1},
+    .format = format,
+    .mips = {std::vector<std::uint8_t>(color.begin(), color.end())},
+    .mipSizes = {color.size()},
+  };
+}
+
+SceneManager::TextureData SceneManager::decodeTexture(
+  const tinygltf::Image& image, std::size_t index, vk::Format format)
+{
+  auto name = fmt::format("texture{}_{}", index, image.name);
+  constexpr std::array<std::uint8_t, 4> WHITE{255, 255, 255, 255};
+
+  // Images no material uses only keep indices of the rest intact
+  if (format == vk::Format::eUndefined)
+    return solidTexture(std::move(name), vk::Format::eR8G8B8A8Unorm, WHITE);
+
+  auto decoded = decode_image_mips(image.image);
+  if (decoded.mips.empty())
+  {
+    spdlog::warn(
+      "glTF: Failed to decode image {} '{}': {}, using white instead",
+      index,
+      image.uri,
+      decoded.error);
+    return solidTexture(std::move(name), format, WHITE);
+  }
+
+  std::vector<std::size_t> mipSizes;
+  for (const auto& mip : decoded.mips)
+    mipSizes.push_back(mip.size());
+
+  return TextureData{
+    .name = std::move(name),
+    .size = decoded.size,
+    .format = format,
+    .mips = std::move(decoded.mips),
+    .mipSizes = std::move(mipSizes),
+  };
+}
+
+static vk::Format to_vk_format(TextureFormat format)
+{
+  switch (format)
+  {
+  case TextureFormat::RGBA8_UNORM:
+    return vk::Format::eR8G8B8A8Unorm;
+  case TextureFormat::RGBA8_SRGB:
+    return vk::Format::eR8G8B8A8Srgb;
+  case TextureFormat::BC1_UNORM:
+    return vk::Format::eBc1RgbaUnormBlock;
+  case TextureFormat::BC1_SRGB:
+    return vk::Format::eBc1RgbaSrgbBlock;
+  case TextureFormat::BC5_UNORM:
+    return vk::Format::eBc5UnormBlock;
+  case TextureFormat::BC7_UNORM:
+    return vk::Format::eBc7UnormBlock;
+  case TextureFormat::BC7_SRGB:
+    return vk::Format::eBc7SrgbBlock;
+  }
+  return vk::Format::eUndefined;
+}
+
+std::optional<SceneManager::TextureData> SceneManager::loadBakedTexture(
+  const std::filesystem::path& path,
+  const tinygltf::Image& image,
+  std::size_t index,
+  std::uint32_t resident_size)
+{
+  if (!std::filesystem::exists(path))
+    return std::nullopt;
+
+  auto baked = read_baked_texture(path, resident_size != 0 ? resident_size : ~0u);
+  if (!baked.has_value())
+    return std::nullopt;
+
+  // NOTE: the image has been edited or the images of the model reordered since the bake
+  if (baked->sourceHash != hash_source_image(image.image))
+  {
+    spdlog::warn("{} is out of date, decoding image {} instead", path.string(), index);
+    return std::nullopt;
+  }
+
+  std::vector<std::size_t> mipSizes;
+  for (std::uint32_t mip = 0; mip < baked->mips.size(); ++mip)
+    mipSizes.push_back(baked_mip_bytes(baked->format, mip_size(baked->size, mip)));
+
+  return TextureData{
+    .name = fmt::format("texture{}_{}", index, image.name),
+    .size = baked->size,
+    .format = to_vk_format(baked->format),
+    .mips = std::move(baked->mips),
+    .mipSizes = std::move(mipSizes),
+    .file = path,
+    .mipOffsets = std::move(baked->mipOffsets),
+  };
+}
+
+// Decoded textures are cached by the hash of their encoded image, so that a later run
+// which streams the same image doesn't have to decode it again
+static std::filesystem::path streaming_cache_path(std::uint64_t source_hash, vk::Format format)
+{
+  std::error_code ec;
+  auto directory = std::filesystem::temp_directory_path(ec);
+  if (ec)
+    return {};
+  return directory / "graphics_course_texture_cache" /
+    fmt::format("{:016x}_{}.btex", source_hash, static_cast<std::int32_t>(format));
+}
+
+void SceneManager::cacheStreamedTexture(
+  TextureData& texture,
+  const tinygltf::Image& image,
+  std::size_t index,
+  std::uint32_t resident_size)
+{
+  // Nothing to stream if everything is resident anyway
+  if (first_mip_fitting(texture.size, resident_size) == 0)
+    return;
+
+  const std::uint64_t sourceHash = hash_source_image(image.image);
+  const auto path = streaming_cache_path(sourceHash, texture.format);
+  if (path.empty())
+    return;
+
+  // NOTE: identical images of a model are decoded at the same time, so every one of them is
+  // written under a name of its own and only then takes the place of the cached one
+  auto written = path;
+  written += fmt::format(".{}", index);
+  BakedTexture baked{
+    .format = texture.format == vk::Format::eR8G8B8A8Srgb ? TextureFormat::RGBA8_SRGB
+                                                          : TextureFormat::RGBA8_UNORM,
+    .size = texture.size,
+    .sourceHash = sourceHash,
+    .mips = std::move(texture.mips),
+  };
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  const bool cached = write_baked_texture(written, baked);
+  if (cached)
+    std::filesystem::rename(written, path, ec);
+  else
+    std::filesystem::remove(written, ec);
+
+  if (cached && !ec)
+    if (auto streamed = loadBakedTexture(path, image, index, resident_size); streamed.has_value())
+    {
+      texture = std::move(*streamed);
+      return;
+    }
+
+  spdlog::warn(
+    "Couldn't cache image {} at {}, all of its mips are kept in memory", index, path.string());
+  texture.mips = std::move(baked.mips);
+}
+
+std::vector<SceneManager::TextureData> SceneManager::decodeTextures(
+  const tinygltf::Model& model,
+  std::span<const vk::Format> image_formats,
+  const std::filesystem::path& model_path,
+  std::uint32_t resident_size)
+{
+  std::vector<TextureData> result(model.images.size() + Material::DEFAULT_TEXTURE_COUNT);
+  result[Material::WHITE_TEXTURE] =
+    solidTexture("texture_white", vk::Format::eR8G8B8A8Unorm, {255, 255, 255, 255});
+  result[Material::FLAT_NORMAL_TEXTURE] =
+    solidTexture("texture_flat_normal", vk::Format::eR8G8B8A8Unorm, {128, 128, 255, 255});
+
+  // NOTE: images differ in size a lot, so each one is a job of its own
+  get_job_system().parallelFor(
+    "decodeTextures", model.images.size(), 1, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i)
+      {
+        auto& texture = result[i + Material::DEFAULT_TEXTURE_COUNT];
+        const auto& image = model.images[i];
+        const bool used = image_formats[i] != vk::Format::eUndefined;
+
+        std::optional<TextureData> loaded;
+        if (used && !model_path.empty())
+          loaded = loadBakedTexture(
+            baked_texture_path(model_path, static_cast<std::uint32_t>(i)),
+            image,
+            i,
+            resident_size);
+        if (!loaded.has_value() && used && resident_size != 0)
+          if (auto path = streaming_cache_path(hash_source_image(image.image), image_formats[i]);
+              !path.empty())
+            loaded = loadBakedTexture(path, image, i, resident_size);
+        if (loaded.has_value())
+        {
+          texture = std::move(*loaded);
+          continue;
+        }
+
+        texture = decodeTexture(image, i, image_formats[i]);
+        if (used && resident_size != 0)
+          cacheStreamedTexture(texture, image, i, resident_size);
+      }
+    });
+
+  return result;
+}
+
+std::size_t SceneManager::uploadTextures(std::span<const TextureData> decoded)
+{
+  auto& ctx = etna::get_context();
+
+  // Streamed textures start with their smallest mips, the streamer copies them over to
+  // images with more mips later on
+  std::vector<std::uint32_t> firstMips(decoded.size(), 0);
+  auto usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+  if (streamedTextureSize != 0)
+    usage |= vk::ImageUsageFlagBits::eTransferSrc;
+
+  textures.clear();
+  textures.reserve(decoded.size());
+  std::size_t largestMip = 0;
+  for (std::size_t i = 0; i < decoded.size(); ++i)
+  {
+    const auto& texture = decoded[i];
+    if (streamedTextureSize != 0)
+      firstMips[i] = first_mip_fitting(texture.size, streamedTextureSize);
+    const glm::uvec2 size = mip_size(texture.size, firstMips[i]);
+    textures.push_back(ctx.createImage(etna::Image::CreateInfo{
+      .extent = vk::Extent3D{size.x, size.y, 1},
+      .name = texture.name,
+      .format = texture.format,
+      .imageUsage = usage,
+      .mipLevels = static_cast<std::uint32_t>(texture.mips.size()) - firstMips[i],
+    }));
+    largestMip = std::max(largestMip, texture.mips[firstMips[i]].size());
+  }
+
+  // Mips go through the staging buffer in batches of as many as fit into it,
+  // with a single submit per batch instead of one per mip
+  const std::size_t stagingSize = std::max(TEXTURE_STAGING_SIZE, largestMip);
+  auto staging = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = stagingSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "texture_staging",
+  });
+  auto* stagingData = staging.map();
+
+  std::size_t batches = 0;
+  std::size_t stagingOffset = 0;
+  std::optional<vk::CommandBuffer> cmdBuf;
+  auto submit = [&]() {
+    ETNA_CHECK_VK_RESULT(cmdBuf->end());
+    oneShotCommands->submitAndWait(*cmdBuf);
+    cmdBuf.reset();
+    stagingOffset = 0;
+    ++batches;
+  };
+
+  for (std::size_t i = 0; i < decoded.size(); ++i)
+  {
+    const auto& mips = decoded[i].mips;
+    for (std::uint32_t mip = firstMips[i]; mip < mips.size(); ++mip)
+    {
+      // NOTE: copies need offsets aligned to texel blocks, 16 bytes covers all formats we use
+      stagingOffset = (stagingOffset + TEXTURE_STAGING_ALIGNMENT - 1) &
+        ~(TEXTURE_STAGING_ALIGNMENT - 1);
+      if (stagingOffset + mips[mip].size() > stagingSize)
+        submit();
+      if (!cmdBuf.has_value())
+      {
+        cmdBuf = oneShotCommands->start();
+        ETNA_CHECK_VK_RESULT(cmdBuf->begin(vk::CommandBufferBeginInfo{}));
+      }
+      if (mip == firstMips[i])
+      {
+        etna::set_state(
+          *cmdBuf,
+          textures[i].get(),
+          vk::PipelineStageFlagBits2::eTransfer,
+          vk::AccessFlagBits2::eTransferWrite,
+          vk::ImageLayout::eTransferDstOptimal,
+          vk::ImageAspectFlagBits::eColor);
+        etna::flush_barriers(*cmdBuf);
+      }
+
+      std::memcpy(stagingData + stagingOffset, mips[mip].data(), mips[mip].size());
+      const glm::uvec2 size = mip_size(decoded[i].size, mip);
+      cmdBuf->copyBufferToImage(
+        staging.get(),
+        textures[i].get(),
+        vk::ImageLayout::eTransferDstOptimal,
+        {vk::BufferImageCopy{
+          .bufferOffset = stagingOffset,
+          .imageSubresource =
+            {
+              .aspectMask = vk::ImageAspectFlagBits::eColor,
+              .mipLevel = mip - firstMips[i],
+              .baseArrayLayer = 0,
+              .layerCount = 1,
+            },
+          .imageExtent = vk::Extent3D{size.x, size.y, 1},
+        }});
+      stagingOffset += mips[mip].size();
+    }
+  }
+  if (cmdBuf.has_value())
+    submit();
+
+  staging.unmap();
+  return batches;
+}
+
+static BoundingBox transform_bounds(const BoundingBox& bounds, const glm::mat4x4& transform)
+{
+  if (glm::any(glm::greaterThan(bounds.min, bounds.max)))
+    return bounds;
+
+  BoundingBox result{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+  for (std::uint32_t corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 local{
+      (corner & 1) != 0 ? bounds.max.x : bounds.min.x,
+      (corner & 2) != 0 ? bounds.max.y : bounds.min.y,
+      (corner & 4) != 0 ? bounds.max.z : bounds.min.z,
+    };
+    const glm::vec3 world = transform * glm::vec4(local, 1.0f);
+    result.min = glm::min(result.min, world);
+    result.max = glm::max(result.max, world);
+  }
+  return result;
 }
 
 void SceneManager::selectScene(std::filesystem::path path)
@@ -388,12 +846,603 @@ void SceneManager::selectScene(std::filesystem::path path)
   instanceMatrices = std::move(instMats);
   instanceMeshes = std::move(instMeshes);
 
-  auto [verts, inds, relems, meshs] = processMeshes(model);
+  auto [verts, inds, relems, meshs, bounds] = processMeshes(model);
 
   renderElements = std::move(relems);
   meshes = std::move(meshs);
 
-  uploadData(verts, inds);
+  instanceBounds.clear();
+  instanceBounds.reserve(instanceMatrices.size());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+    instanceBounds.push_back(transform_bounds(bounds[instanceMeshes[i]], instanceMatrices[i]));
+
+  // NOTE: only baked scenes have the LODs proxies are merged from
+  hlodClusters.clear();
+  hlodInstances.clear();
+
+  uploadData(std::as_bytes(std::span(verts)), std::as_bytes(std::span(inds)));
+
+  auto [mats, imageFormats] = processMaterials(model);
+  materials = std::move(mats);
+  loadTextures(model, imageFormats, path);
+
+  positions.clear();
+  positions.reserve(verts.size());
+  for (const auto& vert : verts)
+    positions.emplace_back(vert.positionAndNormal);
+  indices = std::move(inds);
+}
+
+SceneManager::ProcessedBakedMeshes SceneManager::processBakedMeshes(
+  tinygltf::Model& model) const
+{
+  const auto& vertexView = model.bufferViews[BAKED_VERTEX_VIEW];
+  const auto& indexView = model.bufferViews[BAKED_INDEX_VIEW];
+  auto* data = reinterpret_cast<std::byte*>(model.buffers[0].data.data());
+  std::byte* vertexData = data + vertexView.byteOffset;
+  const std::byte* indexData = data + indexView.byteOffset;
+
+  ProcessedBakedMeshes result;
+
+  // CPU copies, the GPU gets the halves of the buffer as they are
+  result.positions.resize(vertexView.byteLength / sizeof(BakedVertex));
+  for (std::size_t i = 0; i < result.positions.size(); ++i)
+    std::memcpy(
+      &result.positions[i],
+      vertexData + i * sizeof(BakedVertex) + offsetof(BakedVertex, position),
+      sizeof(glm::vec3));
+  result.indices.resize(indexView.byteLength / sizeof(std::uint32_t));
+  std::memcpy(result.indices.data(), indexData, indexView.byteLength);
+
+  auto isBakedAttribute = [&model](
+                            const tinygltf::Primitive& prim,
+                            const char* name,
+                            std::size_t offset,
+                            int component_type,
+                            int type) {
+    const auto it = prim.attributes.find(name);
+    if (it == prim.attributes.end())
+      return false;
+    const auto& accessor = model.accessors[it->second];
+    const auto& position = model.accessors[prim.attributes.at("POSITION")];
+    return accessor.bufferView == BAKED_VERTEX_VIEW &&
+      accessor.byteOffset == position.byteOffset + offset &&
+      accessor.componentType == component_type && accessor.type == type &&
+      accessor.count == position.count;
+  };
+  auto bakedIndices = [&model, &indexView](int accessor_index) -> const tinygltf::Accessor& {
+    const auto& accessor = model.accessors[accessor_index];
+    ETNA_VERIFYF(
+      accessor.bufferView == BAKED_INDEX_VIEW &&
+        accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT &&
+        accessor.byteOffset % sizeof(std::uint32_t) == 0 &&
+        accessor.byteOffset + accessor.count * sizeof(std::uint32_t) <= indexView.byteLength,
+      "glTF: indices of a baked primitive aren't in the index half of the buffer");
+    return accessor;
+  };
+
+  result.meshes.reserve(model.meshes.size());
+  result.meshBounds.reserve(model.meshes.size());
+  for (const auto& mesh : model.meshes)
+  {
+    // Primitives with fewer LODs than others of the mesh repeat their last one
+    std::uint32_t lodCount = 1;
+    for (const auto& prim : mesh.primitives)
+      if (prim.extras.Has("lods"))
+        lodCount =
+          std::max(lodCount, static_cast<std::uint32_t>(prim.extras.Get("lods").ArrayLen() + 1));
+
+    const auto firstRelem = static_cast<std::uint32_t>(result.relems.size());
+    result.meshes.push_back(Mesh{
+      .firstRelem = firstRelem,
+      .relemCount = static_cast<std::uint32_t>(mesh.primitives.size()),
+      .lodCount = lodCount,
+    });
+    auto& bounds = result.meshBounds.emplace_back(BoundingBox{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    });
+
+    for (std::uint32_t lod = 0; lod < lodCount; ++lod)
+      for (std::size_t i = 0; i < mesh.primitives.size(); ++i)
+      {
+        const auto& prim = mesh.primitives[i];
+        const auto& position = model.accessors[prim.attributes.at("POSITION")];
+
+        int indicesAccessor = prim.indices;
+        if (lod > 0 && prim.extras.Has("lods"))
+        {
+          const auto& lods = prim.extras.Get("lods");
+          const auto last = static_cast<std::uint32_t>(lods.ArrayLen());
+          if (last > 0)
+            indicesAccessor = lods.Get(static_cast<int>(std::min(lod, last) - 1)).GetNumberAsInt();
+        }
+        const auto& primIndices = bakedIndices(indicesAccessor);
+
+        const auto material =
+          static_cast<std::uint32_t>(prim.material >= 0 ? prim.material + 1 : 0);
+        auto& relem = result.relems.emplace_back(RenderElement{
+          .vertexOffset = static_cast<std::uint32_t>(position.byteOffset / sizeof(BakedVertex)),
+          .indexOffset = static_cast<std::uint32_t>(primIndices.byteOffset / sizeof(std::uint32_t)),
+          .indexCount = static_cast<std::uint32_t>(primIndices.count),
+          .material = material,
+          .lengthPerUv = 0.0f,
+        });
+        if (lod > 0)
+        {
+          relem.lengthPerUv = result.relems[firstRelem + i].lengthPerUv;
+          continue;
+        }
+
+        ETNA_VERIFYF(
+          prim.mode == TINYGLTF_MODE_TRIANGLES && position.bufferView == BAKED_VERTEX_VIEW &&
+            position.byteOffset % sizeof(BakedVertex) == 0 &&
+            position.byteOffset + position.count * sizeof(BakedVertex) <= vertexView.byteLength &&
+            isBakedAttribute(
+              prim, "POSITION", 0, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3) &&
+            isBakedAttribute(
+              prim,
+              "NORMAL",
+              offsetof(BakedVertex, normal),
+              TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+              TINYGLTF_TYPE_VEC3) &&
+            isBakedAttribute(
+              prim,
+              "TEXCOORD_0",
+              offsetof(BakedVertex, texCoord),
+              TINYGLTF_COMPONENT_TYPE_FLOAT,
+              TINYGLTF_TYPE_VEC2) &&
+            isBakedAttribute(
+              prim,
+              "TANGENT",
+              offsetof(BakedVertex, tangent),
+              TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+              TINYGLTF_TYPE_VEC4) &&
+            position.minValues.size() == 3 && position.maxValues.size() == 3,
+          "glTF: a primitive of mesh '{}' isn't in the baked vertex format",
+          mesh.name);
+        bounds.min = glm::min(
+          bounds.min,
+          glm::vec3(position.minValues[0], position.minValues[1], position.minValues[2]));
+        bounds.max = glm::max(
+          bounds.max,
+          glm::vec3(position.maxValues[0], position.maxValues[1], position.maxValues[2]));
+
+        // Same as processMeshes does, so that shaders know the material of merged draws
+        for (std::size_t j = 0; j < position.count; ++j)
+          std::memcpy(
+            vertexData + (relem.vertexOffset + j) * sizeof(BakedVertex) +
+              offsetof(BakedVertex, padding),
+            &material,
+            sizeof(material));
+
+        // Both areas are doubled, which cancels out, same as in processMeshes
+        auto texCoord = [vertexData, &relem](std::uint32_t index) {
+          glm::vec2 uv;
+          std::memcpy(
+            &uv,
+            vertexData + (relem.vertexOffset + std::size_t{index}) * sizeof(BakedVertex) +
+              offsetof(BakedVertex, texCoord),
+            sizeof(uv));
+          return uv;
+        };
+        double area = 0;
+        double uvArea = 0;
+        for (std::size_t j = 0; j + 2 < relem.indexCount; j += 3)
+        {
+          const auto* triangle = &result.indices[relem.indexOffset + j];
+          const auto* p = &result.positions[relem.vertexOffset];
+          area += glm::length(
+            glm::cross(p[triangle[1]] - p[triangle[0]], p[triangle[2]] - p[triangle[0]]));
+          const glm::vec2 uv0 = texCoord(triangle[0]);
+          const glm::vec2 duv1 = texCoord(triangle[1]) - uv0;
+          const glm::vec2 duv2 = texCoord(triangle[2]) - uv0;
+          uvArea += std::abs(duv1.x * duv2.y - duv1.y * duv2.x);
+        }
+        relem.lengthPerUv = uvArea > 0 ? static_cast<float>(std::sqrt(area / uvArea)) : 0.0f;
+      }
+  }
+
+  return result;
+}
+
+// Splits instances in halves at the median of their centers along the longest extent until
+// there are at most max_size in every cluster, and reorders them so that each cluster is
+// a range. Clusters are in breadth-first order, so every level of the tree is a range of
+// them too, the returned offsets are where levels start followed by the end of the last one.
+static std::vector<std::uint32_t> split_instances(
+  std::span<const BoundingBox> bounds,
+  std::span<std::uint32_t> order,
+  std::uint32_t max_size,
+  std::vector<HlodCluster>& clusters)
+{
+  auto center = [bounds](std::uint32_t instance) {
+    return 0.5f * (bounds[instance].min + bounds[instance].max);
+  };
+  auto makeCluster = [](std::uint32_t begin, std::uint32_t end) {
+    return HlodCluster{
+      .firstInstance = begin,
+      .instanceCount = end - begin,
+      .firstChild = 0,
+      .childCount = 0,
+      .proxyMesh = 0,
+      .bounds = {},
+    };
+  };
+
+  clusters.clear();
+  std::vector<std::uint32_t> levels;
+  if (order.empty())
+    return levels;
+
+  clusters.push_back(makeCluster(0, static_cast<std::uint32_t>(order.size())));
+  levels.push_back(0);
+  for (std::uint32_t levelBegin = 0; levelBegin < clusters.size();)
+  {
+    const auto levelEnd = static_cast<std::uint32_t>(clusters.size());
+    for (std::uint32_t i = levelBegin; i < levelEnd; ++i)
+    {
+      const auto begin = clusters[i].firstInstance;
+      const auto end = begin + clusters[i].instanceCount;
+      if (end - begin <= max_size)
+        continue;
+
+      glm::vec3 min(std::numeric_limits<float>::max());
+      glm::vec3 max(std::numeric_limits<float>::lowest());
+      for (std::uint32_t j = begin; j < end; ++j)
+      {
+        min = glm::min(min, center(order[j]));
+        max = glm::max(max, center(order[j]));
+      }
+      const glm::vec3 extent = max - min;
+      int axis = extent.y > extent.x ? 1 : 0;
+      if (extent.z > extent[axis])
+        axis = 2;
+
+      const auto middle = begin + (end - begin) / 2;
+      std::nth_element(
+        order.begin() + begin,
+        order.begin() + middle,
+        order.begin() + end,
+        [&center, axis](std::uint32_t a, std::uint32_t b) {
+          return center(a)[axis] < center(b)[axis];
+        });
+      clusters[i].firstChild = static_cast<std::uint32_t>(clusters.size());
+      clusters[i].childCount = 2;
+      clusters.push_back(makeCluster(begin, middle));
+      clusters.push_back(makeCluster(middle, end));
+    }
+    levels.push_back(levelEnd);
+    levelBegin = levelEnd;
+  }
+  return levels;
+}
+
+// Same grid of 256 points on [-1, 1] as model_bakery_baker quantizes normals and tangents to
+static glm::vec3 dequantize_unit(const std::array<std::uint8_t, 4>& value)
+{
+  return glm::vec3(value[0], value[1], value[2]) / 127.5f - glm::vec3(1.0f);
+}
+
+static std::uint8_t quantize_unit(float value)
+{
+  return static_cast<std::uint8_t>(std::lround(127.5f * (std::clamp(value, -1.0f, 1.0f) + 1.0f)));
+}
+
+// The 4th byte is left as it is
+static std::array<std::uint8_t, 4> transform_unit(
+  const std::array<std::uint8_t, 4>& value, const glm::mat3& transform)
+{
+  const glm::vec3 transformed = transform * dequantize_unit(value);
+  const float length = glm::length(transformed);
+  const glm::vec3 unit = length > 0.0f ? transformed / length : transformed;
+  return {quantize_unit(unit.x), quantize_unit(unit.y), quantize_unit(unit.z), value[3]};
+}
+
+SceneManager::ProcessedHlods SceneManager::buildHlods(
+  const tinygltf::Model& model, const ProcessedBakedMeshes& baked) const
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  const auto& vertexView = model.bufferViews[BAKED_VERTEX_VIEW];
+  const auto* vertexData =
+    reinterpret_cast<const std::byte*>(model.buffers[0].data.data()) + vertexView.byteOffset;
+
+  ProcessedHlods result;
+  result.instances.resize(instanceMeshes.size());
+  std::iota(result.instances.begin(), result.instances.end(), 0);
+  const auto levels =
+    split_instances(instanceBounds, result.instances, HLOD_CLUSTER_SIZE, result.clusters);
+
+  // Proxy geometry in world space, the vertices keep the materials processBakedMeshes wrote
+  struct Proxy
+  {
+    std::vector<BakedVertex> vertices;
+    std::vector<std::uint32_t> indices;
+    float lengthPerUv = 0.0f;
+  };
+  std::vector<Proxy> proxies(result.clusters.size());
+  std::vector<std::size_t> mergedIndexCounts(result.clusters.size(), 0);
+
+  // Parents are merged from the proxies of their children, so the deepest level goes first
+  for (std::size_t level = levels.size() - 1; level > 0; --level)
+  {
+    const std::size_t first = levels[level - 1];
+    get_job_system().parallelFor(
+      "buildHlods", levels[level] - first, 1, [&](std::size_t begin, std::size_t end) {
+        static constexpr auto NO_VERTEX = std::numeric_limits<std::uint32_t>::max();
+
+        MeshSimplifier simplifier;
+        std::vector<std::uint32_t> remap;
+        std::vector<glm::vec3> points;
+        std::vector<std::uint32_t> simplified;
+        std::vector<BakedVertex> compacted;
+
+        for (std::size_t cluster = first + begin; cluster < first + end; ++cluster)
+        {
+          const auto& hlod = result.clusters[cluster];
+          auto& proxy = proxies[cluster];
+
+          for (std::uint32_t i = 0; i < hlod.childCount; ++i)
+          {
+            const auto& child = proxies[hlod.firstChild + i];
+            const auto base = static_cast<std::uint32_t>(proxy.vertices.size());
+            proxy.vertices.insert(
+              proxy.vertices.end(), child.vertices.begin(), child.vertices.end());
+            for (const auto index : child.indices)
+              proxy.indices.push_back(base + index);
+          }
+
+          for (std::uint32_t i = 0; i < hlod.instanceCount && hlod.childCount == 0; ++i)
+          {
+            const auto instance = result.instances[hlod.firstInstance + i];
+            const auto& mesh = baked.meshes[instanceMeshes[instance]];
+            const glm::mat4x4& transform = instanceMatrices[instance];
+            const glm::mat3 tangentTransform(transform);
+            const glm::mat3 normalTransform = glm::transpose(glm::inverse(tangentTransform));
+            // Mirroring turns triangles inside out and flips the handedness of tangent frames
+            const bool mirrored = glm::determinant(tangentTransform) < 0.0f;
+
+            const auto coarsest = mesh.firstRelem + (mesh.lodCount - 1) * mesh.relemCount;
+            for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+            {
+              const auto& relem = baked.relems[coarsest + j];
+              const auto relemIndices =
+                std::span(baked.indices).subspan(relem.indexOffset, relem.indexCount);
+              remap.assign(
+                relemIndices.empty() ? 0 : std::size_t{std::ranges::max(relemIndices)} + 1,
+                NO_VERTEX);
+              for (std::size_t t = 0; t + 2 < relemIndices.size(); t += 3)
+                for (std::size_t corner = 0; corner < 3; ++corner)
+                {
+                  const auto index =
+                    relemIndices[t + (mirrored && corner > 0 ? 3 - corner : corner)];
+                  if (remap[index] == NO_VERTEX)
+                  {
+                    remap[index] = static_cast<std::uint32_t>(proxy.vertices.size());
+                    auto& vertex = proxy.vertices.emplace_back();
+                    std::memcpy(
+                      &vertex,
+                      vertexData + (relem.vertexOffset + std::size_t{index}) * sizeof(BakedVertex),
+                      sizeof(BakedVertex));
+                    vertex.position = transform * glm::vec4(vertex.position, 1.0f);
+                    vertex.normal = transform_unit(vertex.normal, normalTransform);
+                    vertex.tangent = transform_unit(vertex.tangent, tangentTransform);
+                    // NOTE: 255 - q is -x on the grid of quantize_unit
+                    if (mirrored)
+                      vertex.tangent[3] = static_cast<std::uint8_t>(255 - vertex.tangent[3]);
+                  }
+                  proxy.indices.push_back(remap[index]);
+                }
+            }
+          }
+          if (hlod.childCount == 0)
+            mergedIndexCounts[cluster] = proxy.indices.size();
+
+          // NOTE: vertices of different materials are never welded, so the borders between
+          // materials are kept the same way seams are
+          const std::size_t reduction =
+            hlod.childCount == 0 ? HLOD_LEAF_REDUCTION : HLOD_PARENT_REDUCTION;
+          points.resize(proxy.vertices.size());
+          for (std::size_t i = 0; i < points.size(); ++i)
+            points[i] = proxy.vertices[i].position;
+          simplifier.simplify(
+            points,
+            proxy.indices,
+            proxy.indices.size() / 3 / reduction * 3,
+            HLOD_MAX_ERROR,
+            simplified);
+
+          // Only the vertices the simplified triangles use are kept
+          remap.assign(proxy.vertices.size(), NO_VERTEX);
+          compacted.clear();
+          for (auto& index : simplified)
+          {
+            if (remap[index] == NO_VERTEX)
+            {
+              remap[index] = static_cast<std::uint32_t>(compacted.size());
+              compacted.push_back(proxy.vertices[index]);
+            }
+            index = remap[index];
+          }
+          std::swap(proxy.vertices, compacted);
+          std::swap(proxy.indices, simplified);
+
+          // Both areas are doubled, which cancels out, same as in processMeshes
+          double area = 0;
+          double uvArea = 0;
+          for (std::size_t t = 0; t + 2 < proxy.indices.size(); t += 3)
+          {
+            const auto& v0 = proxy.vertices[proxy.indices[t]];
+            const auto& v1 = proxy.vertices[proxy.indices[t + 1]];
+            const auto& v2 = proxy.vertices[proxy.indices[t + 2]];
+            area += glm::length(glm::cross(v1.position - v0.position, v2.position - v0.position));
+            const glm::vec2 duv1 = v1.texCoord - v0.texCoord;
+            const glm::vec2 duv2 = v2.texCoord - v0.texCoord;
+            uvArea += std::abs(duv1.x * duv2.y - duv1.y * duv2.x);
+          }
+          proxy.lengthPerUv = uvArea > 0 ? static_cast<float>(std::sqrt(area / uvArea)) : 0.0f;
+        }
+      });
+  }
+
+  std::size_t mergedIndices = 0;
+  result.meshes.reserve(result.clusters.size());
+  for (std::size_t cluster = 0; cluster < result.clusters.size(); ++cluster)
+  {
+    auto& hlod = result.clusters[cluster];
+    hlod.proxyMesh = static_cast<std::uint32_t>(baked.meshes.size() + result.meshes.size());
+    hlod.bounds = BoundingBox{
+      .min = glm::vec3(std::numeric_limits<float>::max()),
+      .max = glm::vec3(std::numeric_limits<float>::lowest()),
+    };
+    for (std::uint32_t i = hlod.firstInstance; i < hlod.firstInstance + hlod.instanceCount; ++i)
+    {
+      const auto& bounds = instanceBounds[result.instances[i]];
+      if (glm::any(glm::greaterThan(bounds.min, bounds.max)))
+        continue;
+      hlod.bounds.min = glm::min(hlod.bounds.min, bounds.min);
+      hlod.bounds.max = glm::max(hlod.bounds.max, bounds.max);
+    }
+
+    const auto& proxy = proxies[cluster];
+    auto& mesh = result.meshes.emplace_back(Mesh{
+      .firstRelem = static_cast<std::uint32_t>(baked.relems.size() + result.relems.size()),
+      .relemCount = 0,
+      .lodCount = 1,
+    });
+    if (!proxy.indices.empty())
+    {
+      // NOTE: shaders take materials of proxies from their vertices, the relem has the one
+      // of the first vertex for whatever can't
+      std::uint32_t material;
+      std::memcpy(&material, proxy.vertices.front().padding.data(), sizeof(material));
+      result.relems.push_back(RenderElement{
+        .vertexOffset = static_cast<std::uint32_t>(baked.positions.size() + result.vertices.size()),
+        .indexOffset = static_cast<std::uint32_t>(baked.indices.size() + result.indices.size()),
+        .indexCount = static_cast<std::uint32_t>(proxy.indices.size()),
+        .material = material,
+        .lengthPerUv = proxy.lengthPerUv,
+      });
+      mesh.relemCount = 1;
+      result.vertices.insert(result.vertices.end(), proxy.vertices.begin(), proxy.vertices.end());
+      result.indices.insert(result.indices.end(), proxy.indices.begin(), proxy.indices.end());
+    }
+    mergedIndices += mergedIndexCounts[cluster];
+  }
+
+  spdlog::info(
+    "Built {} HLOD clusters in {} levels over {} instances in {:.1f} ms: {} proxy triangles in "
+    "all of them, {} in the root one, {} in the coarsest LODs",
+    result.clusters.size(),
+    levels.empty() ? 0 : levels.size() - 1,
+    result.instances.size(),
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+    result.indices.size() / 3,
+    result.relems.empty() ? 0 : result.relems.front().indexCount / 3,
+    mergedIndices / 3);
+
+  return result;
+}
+
+void SceneManager::selectBakedScene(std::filesystem::path path)
+{
+  auto maybeModel = loadModel(path);
+  if (!maybeModel.has_value())
+    return;
+
+  auto model = std::move(*maybeModel);
+
+  // NOTE: baked scenes are loaded without any conversion, so a model in another format
+  // is a mistake, not something to recover from
+  ETNA_VERIFYF(
+    std::ranges::find(model.extensionsRequired, "KHR_mesh_quantization") !=
+        model.extensionsRequired.end() &&
+      model.buffers.size() == 1 && model.bufferViews.size() >= 2,
+    "glTF: '{}' wasn't made by model_bakery_baker",
+    path.string());
+  const auto& buffer = model.buffers[0].data;
+  const auto& vertexView = model.bufferViews[BAKED_VERTEX_VIEW];
+  const auto& indexView = model.bufferViews[BAKED_INDEX_VIEW];
+  ETNA_VERIFYF(
+    vertexView.buffer == 0 && vertexView.byteStride == sizeof(BakedVertex) &&
+      vertexView.byteLength % sizeof(BakedVertex) == 0 &&
+      vertexView.byteOffset + vertexView.byteLength <= buffer.size() && indexView.buffer == 0 &&
+      indexView.byteLength % sizeof(std::uint32_t) == 0 &&
+      indexView.byteOffset + indexView.byteLength <= buffer.size(),
+    "glTF: '{}' has a vertex format the renderer doesn't expect",
+    path.string());
+
+  auto [instMats, instMeshes] = processInstances(model);
+  instanceMatrices = std::move(instMats);
+  instanceMeshes = std::move(instMeshes);
+
+  auto baked = processBakedMeshes(model);
+  const auto& bounds = baked.meshBounds;
+
+  renderElements = baked.relems;
+  meshes = baked.meshes;
+
+  instanceBounds.clear();
+  instanceBounds.reserve(instanceMatrices.size());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+    instanceBounds.push_back(transform_bounds(bounds[instanceMeshes[i]], instanceMatrices[i]));
+
+  auto hlods = buildHlods(model, baked);
+  hlodClusters = std::move(hlods.clusters);
+  hlodInstances = std::move(hlods.instances);
+  renderElements.insert(renderElements.end(), hlods.relems.begin(), hlods.relems.end());
+  meshes.insert(meshes.end(), hlods.meshes.begin(), hlods.meshes.end());
+
+  const auto bytes = std::as_bytes(std::span(buffer));
+  uploadData(
+    bytes.subspan(vertexView.byteOffset, vertexView.byteLength),
+    bytes.subspan(indexView.byteOffset, indexView.byteLength),
+    std::as_bytes(std::span(hlods.vertices)),
+    std::as_bytes(std::span(hlods.indices)));
+
+  auto [mats, imageFormats] = processMaterials(model);
+  materials = std::move(mats);
+  loadTextures(model, imageFormats, path);
+
+  positions = std::move(baked.positions);
+  positions.reserve(positions.size() + hlods.vertices.size());
+  for (const auto& vert : hlods.vertices)
+    positions.push_back(vert.position);
+  indices = std::move(baked.indices);
+  indices.insert(indices.end(), hlods.indices.begin(), hlods.indices.end());
+}
+
+void SceneManager::loadTextures(
+  const tinygltf::Model& model,
+  std::span<const vk::Format> image_formats,
+  const std::filesystem::path& model_path)
+{
+  const auto start = std::chrono::steady_clock::now();
+  auto decoded = decodeTextures(
+    model,
+    image_formats,
+    useBakedTextures ? model_path : std::filesystem::path{},
+    streamedTextureSize);
+  const auto decodedAt = std::chrono::steady_clock::now();
+  const auto batches = uploadTextures(decoded);
+  std::size_t textureBytes = 0;
+  for (const auto& texture : decoded)
+    for (const auto size : texture.mipSizes)
+      textureBytes += size;
+  spdlog::info(
+    "Loaded {} textures of {:.1f} MB: decoded with mips in {:.1f} ms on {} threads, "
+    "uploaded in {} batches in {:.1f} ms",
+    decoded.size(),
+    static_cast<double>(textureBytes) / (1 << 20),
+    std::chrono::duration<double, std::milli>(decodedAt - start).count(),
+    get_job_system().getWorkerCount() + 1,
+    batches,
+    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodedAt)
+      .count());
+  textureData.clear();
+  if (streamedTextureSize != 0)
+    textureData = std::move(decoded);
 }
 
 etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription()
@@ -411,3 +1460,31 @@ etna::VertexByteStreamFormatDescription SceneManager::getVertexFormatDescription
       },
     }};
 }
+
+etna::VertexByteStreamFormatDescription SceneManager::getBakedVertexFormatDescription()
+{
+  return etna::VertexByteStreamFormatDescription{
+    .stride = sizeof(BakedVertex),
+    .attributes = {
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32B32Sfloat,
+        .offset = offsetof(BakedVertex, position),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .offset = offsetof(BakedVertex, normal),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32G32Sfloat,
+        .offset = offsetof(BakedVertex, texCoord),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR8G8B8A8Unorm,
+        .offset = offsetof(BakedVertex, tangent),
+      },
+      etna::VertexByteStreamFormatDescription::Attribute{
+        .format = vk::Format::eR32Uint,
+        .offset = offsetof(BakedVertex, padding),
+      },
+    }};
+}
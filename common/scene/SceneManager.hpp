@@ -1,14 +1,38 @@
 #pragma once
 
+#include <array>
 #include <filesystem>
+#include <string>
+#include <utility>
 
 #include <glm/glm.hpp>
 #include <tiny_gltf.h>
 #include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
 #include <etna/BlockingTransferHelper.hpp>
 #include <etna/VertexInput.hpp>
 
 
+// Factors and textures of a glTF metallic-roughness material. Textures are indices into
+// SceneManager::getTextures(), the ones a material doesn't have refer to neutral defaults.
+struct Material
+{
+  // Plain white, for base color and metallic-roughness textures
+  static constexpr std::uint32_t WHITE_TEXTURE = 0;
+  // Normal pointing straight out of the surface
+  static constexpr std::uint32_t FLAT_NORMAL_TEXTURE = 1;
+  // Images of the glTF file come after the defaults, in the same order
+  static constexpr std::uint32_t DEFAULT_TEXTURE_COUNT = 2;
+
+  glm::vec4 baseColorFactor = glm::vec4(1.0f);
+  float metallicFactor = 1.0f;
+  float roughnessFactor = 1.0f;
+  float normalScale = 1.0f;
+  std::uint32_t baseColorTexture = WHITE_TEXTURE;
+  std::uint32_t normalTexture = FLAT_NORMAL_TEXTURE;
+  std::uint32_t metallicRoughnessTexture = WHITE_TEXTURE;
+};
+
 // A single render element (relem) corresponds to a single draw call
 // of a certain pipeline with specific bindings (including material data)
 struct RenderElement
@@ -16,30 +40,106 @@ struct RenderElement
   std::uint32_t vertexOffset;
   std::uint32_t indexOffset;
   std::uint32_t indexCount;
-  // Not implemented!
-  // Material* material;
+  // Index into SceneManager::getMaterials(), it is also stored in every vertex of the relem,
+  // so that shaders know it even when draws are merged into indirect ones
+  std::uint32_t material;
+  // Object-space length of a unit of texture coordinates, averaged over the triangles,
+  // so that texture streaming can tell texels per pixel. 0 if the relem isn't textured.
+  float lengthPerUv;
 };
 
 // A mesh is a collection of relems. A scene may have the same mesh
 // located in several different places, so a scene consists of **instances**,
 // not meshes.
+// Simplified LODs of a mesh come right after its relems: LOD l is relemCount relems starting
+// from firstRelem + l * relemCount. Only baked scenes have more than one, see selectBakedScene.
 struct Mesh
 {
   std::uint32_t firstRelem;
   std::uint32_t relemCount;
+  std::uint32_t lodCount;
+};
+
+// Axis-aligned, in whatever space the thing it bounds is in
+struct BoundingBox
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// Nearby instances of a baked scene which are drawn as a single proxy mesh from far enough
+// away, see selectBakedScene. Clusters form a tree: the first one has all instances, and
+// every other one is half of its parent. The proxy is in world space and is a single relem,
+// its vertices carry their own materials.
+struct HlodCluster
+{
+  // Range of SceneManager::getHlodInstances()
+  std::uint32_t firstInstance;
+  std::uint32_t instanceCount;
+  // Range of SceneManager::getHlodClusters(), leaves have none and are drawn as instances
+  std::uint32_t firstChild;
+  std::uint32_t childCount;
+  // Index into SceneManager::getMeshes()
+  std::uint32_t proxyMesh;
+  // World-space bounds of all the instances
+  BoundingBox bounds;
 };
 
 class SceneManager
 {
 public:
+  // Decoded glTF image, RGBA8 mips down to 1x1, or block-compressed ones of a baked image
+  struct TextureData
+  {
+    std::string name;
+    glm::uvec2 size{};
+    vk::Format format = vk::Format::eUndefined;
+    // Mips of streamed textures which are in a file are empty, except for the ones which
+    // are always resident
+    std::vector<std::vector<std::uint8_t>> mips;
+    // Bytes of every mip, whether it is in mips or not
+    std::vector<std::size_t> mipSizes = {};
+    // Where the mips are, see read_baked_mip. Empty if the texture is only in memory.
+    std::filesystem::path file = {};
+    std::vector<std::uint64_t> mipOffsets = {};
+  };
+
   SceneManager();
 
+  // With a non-zero size, selectScene only uploads mips of textures that fit into it and
+  // keeps these mips in memory for getTextureData, so that the rest can be streamed.
+  // The rest are read from baked textures or, for images which aren't baked, from RGBA8
+  // copies the loader writes to a cache in the temporary directory. Textures the cache
+  // can't be written for keep all of their mips in memory.
+  void setStreamedTextureSize(std::uint32_t resident_size) { streamedTextureSize = resident_size; }
+
+  // With baked textures, selectScene takes images from the .btex files the baker put next to
+  // the model (see baked_texture_path) as they are, and only decodes the ones that are missing
+  void setUseBakedTextures(bool use) { useBakedTextures = use; }
+
   void selectScene(std::filesystem::path path);
 
+  // Loads a scene_baked.gltf of model_bakery_baker: the vertex and index halves of its buffer
+  // go to the GPU as they are, and the LODs of its primitives become LODs of meshes.
+  // The material index of every relem is written into the padding of its vertices.
+  //
+  // Instances are also grouped into a tree of HLOD clusters by where they are. Coarsest LODs
+  // of the instances of a leaf are merged into its proxy mesh and simplified further, proxies
+  // of parents are merged from the ones of their children. Proxies come after all other
+  // meshes and nothing instances them, see HlodCluster.
+  void selectBakedScene(std::filesystem::path path);
+
   // Every instance is a mesh drawn with a certain transform
   // NOTE: maybe you can pass some additional data through unused matrix entries?
   std::span<const glm::mat4x4> getInstanceMatrices() { return instanceMatrices; }
   std::span<const std::uint32_t> getInstanceMeshes() { return instanceMeshes; }
+  // World-space bounds of every instance, for culling
+  std::span<const BoundingBox> getInstanceBounds() { return instanceBounds; }
+
+  // Every instance of a baked scene is in exactly one leaf, other scenes have no clusters
+  std::span<const HlodCluster> getHlodClusters() { return hlodClusters; }
+  // Instance indices, ordered so that each cluster is a range of them
+  std::span<const std::uint32_t> getHlodInstances() { return hlodInstances; }
 
   // Every mesh is a collection of relems
   std::span<const Mesh> getMeshes() { return meshes; }
@@ -47,10 +147,28 @@ public:
   // Every relem is a single draw call
   std::span<const RenderElement> getRenderElements() { return renderElements; }
 
+  // Material 0 is the default one, for relems which don't have any
+  std::span<const Material> getMaterials() { return materials; }
+  // All textures of the scene, indexed by materials. They have full mip chains unless
+  // they are streamed, in which case only the mips from first_mip_fitting on are there.
+  std::span<const etna::Image> getTextures() { return textures; }
+  // Only kept for streamed textures, empty otherwise
+  std::span<const TextureData> getTextureData() { return textureData; }
+  // Streamed textures are owned by whoever streams them from then on
+  std::vector<etna::Image> takeTextures() { return std::exchange(textures, {}); }
+
+  // CPU copies of vertex positions and of the index buffer, for CPU-side culling.
+  // Indices of a relem are relative to its vertexOffset, same as on the GPU.
+  std::span<const glm::vec3> getPositions() { return positions; }
+  std::span<const std::uint32_t> getIndices() { return indices; }
+
   vk::Buffer getVertexBuffer() { return unifiedVbuf.get(); }
   vk::Buffer getIndexBuffer() { return unifiedIbuf.get(); }
 
   etna::VertexByteStreamFormatDescription getVertexFormatDescription();
+  // Position, unorm normal, tex coords, unorm tangent and the uint material index from the
+  // padding, see the model_bakery README
+  etna::VertexByteStreamFormatDescription getBakedVertexFormatDescription();
 
 private:
   std::optional<tinygltf::Model> loadModel(std::filesystem::path path);
@@ -67,8 +185,9 @@ private:
   {
     // First 3 floats are position, 4th float is a packed normal
     glm::vec4 positionAndNormal;
-    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is padding
-    glm::vec4 texCoordAndTangentAndPadding;
+    // First 2 floats are tex coords, 3rd is a packed tangent, 4th is the bits of the
+    // material index of the relem
+    glm::vec4 texCoordAndTangentAndMaterial;
   };
 
   static_assert(sizeof(Vertex) == sizeof(float) * 8);
@@ -79,9 +198,113 @@ private:
     std::vector<std::uint32_t> indices;
     std::vector<RenderElement> relems;
     std::vector<Mesh> meshes;
+    // Local-space bounds of every mesh
+    std::vector<BoundingBox> meshBounds;
   };
   ProcessedMeshes processMeshes(const tinygltf::Model& model) const;
-  void uploadData(std::span<const Vertex> vertices, std::span<const std::uint32_t>);
+  // Extra vertices and indices go right after the main ones in the same buffers
+  void uploadData(
+    std::span<const std::byte> vertices,
+    std::span<const std::byte> indices,
+    std::span<const std::byte> extra_vertices = {},
+    std::span<const std::byte> extra_indices = {});
+
+  // Written by model_bakery_baker, the layout is described with KHR_mesh_quantization
+  struct BakedVertex
+  {
+    glm::vec3 position;
+    std::array<std::uint8_t, 4> normal;
+    glm::vec2 texCoord;
+    std::array<std::uint8_t, 4> tangent;
+    // Zeros as baked, the loader puts the material index of the relem there as a u32
+    std::array<std::uint8_t, 4> padding;
+  };
+
+  static_assert(sizeof(BakedVertex) == 32);
+
+  // Buffer views of the vertex and index halves of a baked model
+  static constexpr int BAKED_VERTEX_VIEW = 0;
+  static constexpr int BAKED_INDEX_VIEW = 1;
+
+  struct ProcessedBakedMeshes
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<std::uint32_t> indices;
+    std::vector<RenderElement> relems;
+    std::vector<Mesh> meshes;
+    std::vector<BoundingBox> meshBounds;
+  };
+  // Also writes the material index of every relem into the padding of its vertices
+  ProcessedBakedMeshes processBakedMeshes(tinygltf::Model& model) const;
+
+  // Clusters are split in halves until there are at most this many instances in each
+  static constexpr std::uint32_t HLOD_CLUSTER_SIZE = 64;
+  // Leaves are simplified down to this share of the coarsest LODs they are merged from, and
+  // parents down to this share of the proxies of their children. A parent takes the place
+  // of its two children once it looks as small as each of them did, so with half of their
+  // triangles it is drawn at about the same density.
+  static constexpr std::size_t HLOD_LEAF_REDUCTION = 4;
+  static constexpr std::size_t HLOD_PARENT_REDUCTION = 2;
+  // Simplifying also stops before the surface would move by more than this share of the
+  // largest extent of the proxy, which is about that of the bounds of its cluster
+  static constexpr float HLOD_MAX_ERROR = 0.02f;
+
+  struct ProcessedHlods
+  {
+    std::vector<HlodCluster> clusters;
+    std::vector<std::uint32_t> instances;
+    std::vector<BakedVertex> vertices;
+    std::vector<std::uint32_t> indices;
+    std::vector<RenderElement> relems;
+    std::vector<Mesh> meshes;
+  };
+  // Needs the instances to be processed already, proxy vertices, indices, relems and meshes
+  // are placed right after the baked ones
+  ProcessedHlods buildHlods(const tinygltf::Model& model, const ProcessedBakedMeshes& baked) const;
+
+  struct ProcessedMaterials
+  {
+    std::vector<Material> materials;
+    // Base color textures are sRGB, everything else is linear,
+    // images no material uses are eUndefined and are never decoded
+    std::vector<vk::Format> imageFormats;
+  };
+  ProcessedMaterials processMaterials(const tinygltf::Model& model) const;
+
+  static TextureData solidTexture(
+    std::string name, vk::Format format, std::array<std::uint8_t, 4> color);
+  static TextureData decodeTexture(
+    const tinygltf::Image& image, std::size_t index, vk::Format format);
+  // Only mips which fit into resident_size are read if it isn't 0, see setStreamedTextureSize
+  static std::optional<TextureData> loadBakedTexture(
+    const std::filesystem::path& path,
+    const tinygltf::Image& image,
+    std::size_t index,
+    std::uint32_t resident_size);
+  // Writes the mips of a decoded texture to the streaming cache and drops the ones which
+  // don't fit into resident_size from memory. Keeps the texture as it is if that fails.
+  static void cacheStreamedTexture(
+    TextureData& texture,
+    const tinygltf::Image& image,
+    std::size_t index,
+    std::uint32_t resident_size);
+  // Decodes all images of the model on the job system, the default textures come first.
+  // Baked images are loaded instead of decoded if model_path isn't empty, as long as they
+  // were baked from the very same encoded image.
+  static std::vector<TextureData> decodeTextures(
+    const tinygltf::Model& model,
+    std::span<const vk::Format> image_formats,
+    const std::filesystem::path& model_path,
+    std::uint32_t resident_size);
+  // Returns the number of submits it took
+  std::size_t uploadTextures(std::span<const TextureData> decoded);
+  void loadTextures(
+    const tinygltf::Model& model,
+    std::span<const vk::Format> image_formats,
+    const std::filesystem::path& model_path);
+
+  static constexpr std::size_t TEXTURE_STAGING_SIZE = 64 * 1024 * 1024;
+  static constexpr std::size_t TEXTURE_STAGING_ALIGNMENT = 16;
 
 private:
   tinygltf::TinyGLTF loader;
@@ -89,9 +312,19 @@ private:
   etna::BlockingTransferHelper transferHelper;
 
   std::vector<RenderElement> renderElements;
+  std::vector<Material> materials;
+  std::vector<etna::Image> textures;
+  std::uint32_t streamedTextureSize = 0;
+  bool useBakedTextures = false;
+  std::vector<TextureData> textureData;
   std::vector<Mesh> meshes;
   std::vector<glm::mat4x4> instanceMatrices;
   std::vector<std::uint32_t> instanceMeshes;
+  std::vector<BoundingBox> instanceBounds;
+  std::vector<HlodCluster> hlodClusters;
+  std::vector<std::uint32_t> hlodInstances;
+  std::vector<glm::vec3> positions;
+  std::vector<std::uint32_t> indices;
 
   etna::Buffer unifiedVbuf;
   etna::Buffer unifiedIbuf;
@@ -0,0 +1,411 @@
+#include "ShaderHotReloader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+
+#include <etna/Assert.hpp>
+#include <shaderc/shaderc.hpp>
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+
+
+// Frequent enough to feel instant, rare enough for stat calls to not matter
+static constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+static std::optional<std::string> read_text_file(const std::filesystem::path& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return std::nullopt;
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static std::optional<shaderc_shader_kind> shader_kind_from_extension(
+  const std::filesystem::path& path)
+{
+  const auto ext = path.extension();
+  if (ext == ".vert")
+    return shaderc_glsl_vertex_shader;
+  if (ext == ".frag")
+    return shaderc_glsl_fragment_shader;
+  if (ext == ".comp")
+    return shaderc_glsl_compute_shader;
+  if (ext == ".geom")
+    return shaderc_glsl_geometry_shader;
+  if (ext == ".tesc")
+    return shaderc_glsl_tess_control_shader;
+  if (ext == ".tese")
+    return shaderc_glsl_tess_evaluation_shader;
+  if (ext == ".mesh")
+    return shaderc_glsl_mesh_shader;
+  if (ext == ".task")
+    return shaderc_glsl_task_shader;
+  return std::nullopt;
+}
+
+// Resolves #include-s the same way glslangValidator does and remembers all included files
+class Includer : public shaderc::CompileOptions::IncluderInterface
+{
+public:
+  Includer(
+    const std::vector<std::filesystem::path>& include_dirs,
+    std::vector<std::filesystem::path>& dependencies)
+    : includeDirs{include_dirs}
+    , deps{dependencies}
+  {
+  }
+
+  shaderc_include_result* GetInclude(
+    const char* requested_source,
+    shaderc_include_type type,
+    const char* requesting_source,
+    size_t /*include_depth*/) override
+  {
+    auto data = std::make_unique<Data>();
+
+    std::vector<std::filesystem::path> candidates;
+    if (type == shaderc_include_type_relative)
+      candidates.push_back(std::filesystem::path(requesting_source).parent_path());
+    candidates.insert(candidates.end(), includeDirs.begin(), includeDirs.end());
+
+    for (const auto& dir : candidates)
+    {
+      auto path = (dir / requested_source).lexically_normal();
+      if (auto content = read_text_file(path))
+      {
+        data->name = path.string();
+        data->content = std::move(*content);
+        if (std::find(deps.begin(), deps.end(), path) == deps.end())
+          deps.push_back(std::move(path));
+        break;
+      }
+    }
+
+    // NOTE: an empty name tells shaderc that the include failed, content is the error then
+    if (data->name.empty())
+      data->content = fmt::format("cannot find or open include file '{}'", requested_source);
+
+    data->result = shaderc_include_result{
+      .source_name = data->name.c_str(),
+      .source_name_length = data->name.size(),
+      .content = data->content.c_str(),
+      .content_length = data->content.size(),
+      .user_data = data.get(),
+    };
+    return &data.release()->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result* result) override
+  {
+    delete static_cast<Data*>(result->user_data);
+  }
+
+private:
+  struct Data
+  {
+    shaderc_include_result result;
+    std::string name;
+    std::string content;
+  };
+
+  const std::vector<std::filesystem::path>& includeDirs;
+  std::vector<std::filesystem::path>& deps;
+};
+
+// NOTE: options are set up in place, as moving them around loses the includer
+static void setup_compile_options(
+  shaderc::CompileOptions& options,
+  const std::vector<std::string>& defines,
+  const std::vector<std::filesystem::path>& include_dirs,
+  std::vector<std::filesystem::path>& dependencies)
+{
+  for (const auto& define : defines)
+    options.AddMacroDefinition(define);
+  // Same as what target_add_shaders passes to glslangValidator
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+#ifndef NDEBUG
+  options.SetGenerateDebugInfo();
+#endif
+  options.SetIncluder(std::make_unique<Includer>(include_dirs, dependencies));
+}
+
+// The newest modification time of a shader and everything it includes. Missing files
+// don't count, a shader which lost its includes simply fails to compile.
+static std::filesystem::file_time_type latest_write_time(
+  const std::filesystem::path& source, const std::vector<std::filesystem::path>& dependencies)
+{
+  std::error_code ec;
+  auto result = std::filesystem::last_write_time(source, ec);
+  if (ec)
+    result = {};
+  for (const auto& dep : dependencies)
+  {
+    const auto time = std::filesystem::last_write_time(dep, ec);
+    if (!ec)
+      result = std::max(result, time);
+  }
+  return result;
+}
+
+const std::filesystem::path& ShaderHotReloader::Update::getBinary(const std::string& name) const
+{
+  auto it = binaries.find(name);
+  ETNA_VERIFYF(it != binaries.end(), "Shader '{}' is not hot-reloadable!", name);
+  return it->second;
+}
+
+ShaderHotReloader::ShaderHotReloader(CreateInfo info)
+  : onUpdate{std::move(info.onUpdate)}
+{
+  if (!readManifest(info.manifest))
+    return;
+
+  outputDir = info.manifest.parent_path() / "hot_reload";
+  // Leftovers of previous runs are of no use
+  std::error_code ec;
+  std::filesystem::remove_all(outputDir, ec);
+
+  watcher = std::thread([this]() { watch(); });
+}
+
+ShaderHotReloader::~ShaderHotReloader()
+{
+  {
+    std::unique_lock lock{mutex};
+    stopping = true;
+  }
+  wakeUp.notify_all();
+
+  if (watcher.joinable())
+    watcher.join();
+}
+
+void ShaderHotReloader::rebuildAll()
+{
+  // NOTE: setting the flag outside of the lock could happen right between the watcher
+  // checking it and going to sleep, and the request would wait for the next poll
+  {
+    std::unique_lock lock{mutex};
+    rebuildRequested = true;
+  }
+  wakeUp.notify_all();
+}
+
+std::optional<ShaderHotReloader::Update> ShaderHotReloader::takeUpdate()
+{
+  std::unique_lock lock{mutex};
+  return std::exchange(latestUpdate, std::nullopt);
+}
+
+bool ShaderHotReloader::readManifest(const std::filesystem::path& manifest)
+{
+  std::ifstream file(manifest);
+  if (!file)
+  {
+    spdlog::warn(
+      "Shader hot-reload is disabled: couldn't open manifest '{}'", manifest.string());
+    return false;
+  }
+
+  // Every line is either "source <glsl file>", "include <directory>" or
+  // "variant <binary file name> <defines...>" for a permutation of the preceding source
+  std::string line;
+  while (std::getline(file, line))
+  {
+    const auto space = line.find(' ');
+    if (space == std::string::npos)
+      continue;
+    const std::string_view kind = std::string_view(line).substr(0, space);
+
+    if (kind == "variant")
+    {
+      if (shaders.empty())
+        continue;
+      std::istringstream words(line.substr(space + 1));
+      Shader variant{.source = shaders.back().source};
+      words >> variant.binaryName;
+      variant.binary = manifest.parent_path() / variant.binaryName;
+      for (std::string define; words >> define;)
+        variant.defines.push_back(std::move(define));
+      shaders.push_back(std::move(variant));
+      continue;
+    }
+
+    std::filesystem::path path = line.substr(space + 1);
+
+    if (kind == "include")
+      includeDirs.push_back(std::move(path));
+    else if (kind == "source")
+    {
+      auto binaryName = path.filename().string() + ".spv";
+      auto binary = manifest.parent_path() / binaryName;
+      shaders.push_back(Shader{
+        .source = std::move(path),
+        .binaryName = std::move(binaryName),
+        .binary = std::move(binary),
+      });
+    }
+  }
+
+  return true;
+}
+
+void ShaderHotReloader::watch()
+{
+  tracy::SetThreadName("Shader watcher");
+
+  // Dependencies are only known after preprocessing, they get updated on every compilation
+  {
+    ZoneScopedN("findDependencies");
+    shaderc::Compiler compiler;
+    for (auto& shader : shaders)
+    {
+      if (auto source = read_text_file(shader.source))
+      {
+        shaderc::CompileOptions options;
+        setup_compile_options(options, shader.defines, includeDirs, shader.dependencies);
+        const auto sourceName = shader.source.string();
+        compiler.PreprocessGlsl(
+          *source,
+          shader_kind_from_extension(shader.source).value_or(shaderc_glsl_infer_from_source),
+          sourceName.c_str(),
+          options);
+      }
+      shader.lastWrite = latest_write_time(shader.source, shader.dependencies);
+    }
+  }
+
+  std::uint32_t generation = 0;
+  while (true)
+  {
+    {
+      std::unique_lock lock{mutex};
+      wakeUp.wait_for(lock, POLL_INTERVAL, [this]() { return stopping || rebuildRequested; });
+      if (stopping)
+        return;
+    }
+
+    const bool rebuild = rebuildRequested.exchange(false);
+
+    bool changed = false;
+    for (auto& shader : shaders)
+    {
+      const auto lastWrite = latest_write_time(shader.source, shader.dependencies);
+      if (rebuild || lastWrite != shader.lastWrite)
+      {
+        shader.lastWrite = lastWrite;
+        shader.dirty = true;
+        changed = true;
+      }
+    }
+
+    // NOTE: dirty shaders which failed to compile are only retried once something changes,
+    // so that errors are not spammed into the log.
+    if (!changed)
+      continue;
+
+    if (!compileDirty(generation + 1))
+      continue;
+
+    Update update{.generation = ++generation};
+    for (const auto& shader : shaders)
+      update.binaries.emplace(shader.binaryName, shader.binary);
+
+    {
+      std::unique_lock lock{mutex};
+      latestUpdate = std::move(update);
+    }
+
+    if (onUpdate)
+      onUpdate();
+  }
+}
+
+bool ShaderHotReloader::compileDirty(std::uint32_t generation)
+{
+  ZoneScoped;
+
+  const auto generationDir = outputDir / std::to_string(generation);
+
+  struct Compiled
+  {
+    Shader* shader;
+    std::vector<std::uint32_t> spirv;
+  };
+  std::vector<Compiled> compiled;
+
+  // Everything has to compile for an update to be published, as shaders that are changed
+  // together might depend on each other, e.g. through interfaces between stages.
+  shaderc::Compiler compiler;
+  bool success = true;
+  for (auto& shader : shaders)
+  {
+    if (!shader.dirty)
+      continue;
+
+    const auto kind = shader_kind_from_extension(shader.source);
+    const auto source = read_text_file(shader.source);
+    if (!kind.has_value() || !source.has_value())
+    {
+      spdlog::error("Shader hot-reload: can't compile '{}'", shader.source.string());
+      success = false;
+      continue;
+    }
+
+    std::vector<std::filesystem::path> dependencies;
+    shaderc::CompileOptions options;
+    setup_compile_options(options, shader.defines, includeDirs, dependencies);
+    const auto sourceName = shader.source.string();
+    auto result = compiler.CompileGlslToSpv(*source, *kind, sourceName.c_str(), options);
+
+    // Even a failed compilation knows which files it has read, so that fixing an
+    // include which didn't compile triggers a recompilation as well.
+    shader.dependencies = std::move(dependencies);
+    shader.lastWrite = latest_write_time(shader.source, shader.dependencies);
+
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+    {
+      spdlog::error("Shader hot-reload: {}", result.GetErrorMessage());
+      success = false;
+      continue;
+    }
+
+    compiled.push_back(Compiled{
+      .shader = &shader,
+      .spirv = {result.cbegin(), result.cend()},
+    });
+  }
+
+  if (!success)
+    return false;
+
+  std::error_code ec;
+  std::filesystem::create_directories(generationDir, ec);
+
+  for (auto& [shader, spirv] : compiled)
+  {
+    auto binary = generationDir / shader->binaryName;
+    std::ofstream file(binary, std::ios::binary);
+    file.write(
+      reinterpret_cast<const char*>(spirv.data()),
+      static_cast<std::streamsize>(spirv.size() * sizeof(spirv[0])));
+    if (!file)
+    {
+      spdlog::error("Shader hot-reload: couldn't write '{}'", binary.string());
+      return false;
+    }
+  }
+
+  for (auto& [shader, spirv] : compiled)
+  {
+    shader->binary = generationDir / shader->binaryName;
+    shader->dirty = false;
+    spdlog::info("Shader hot-reload: recompiled '{}'", shader->binaryName);
+  }
+
+  return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <function2/function2.hpp>
+
+
+/**
+ * Recompiles GLSL shaders in-process when their sources change, so that they can be
+ * reloaded without rebuilding anything.
+ *
+ * Sources and include directories are taken from the manifest which target_add_shaders
+ * generates next to the SPIR-V binaries of a target, every permutation of shader features
+ * is compiled just like a separate shader. A background thread watches the
+ * sources along with everything they #include, compiles the changed ones into a new
+ * directory per generation and publishes an update, which the render thread picks up
+ * at a frame boundary.
+ *
+ * NOTE: binaries of a generation are never overwritten, so the render thread can still
+ * read the ones of an update while the next generation is being compiled.
+ */
+class ShaderHotReloader
+{
+public:
+  struct CreateInfo
+  {
+    // The hot_reload.txt file in the shader binaries directory of a target
+    std::filesystem::path manifest;
+    // Called on the watcher thread once an update is ready, e.g. to wake up an idle app
+    fu2::unique_function<void()> onUpdate = {};
+  };
+
+  struct Update
+  {
+    // Starts at 1, generation 0 are the binaries produced by the build
+    std::uint32_t generation = 0;
+    // Current SPIR-V of every shader by its binary's file name, e.g. "simple.vert.spv"
+    std::unordered_map<std::string, std::filesystem::path> binaries = {};
+
+    const std::filesystem::path& getBinary(const std::string& name) const;
+  };
+
+  explicit ShaderHotReloader(CreateInfo info);
+  ~ShaderHotReloader();
+
+  ShaderHotReloader(const ShaderHotReloader&) = delete;
+  ShaderHotReloader& operator=(const ShaderHotReloader&) = delete;
+
+  // Recompiles all shaders regardless of whether they changed. May be called from any thread.
+  void rebuildAll();
+
+  // Returns the latest update if there was one since the previous call. Only the latest
+  // one matters, as it contains all shaders, so older ones are dropped.
+  std::optional<Update> takeUpdate();
+
+private:
+  struct Shader
+  {
+    std::filesystem::path source;
+    std::string binaryName = {};
+    std::filesystem::path binary = {};
+    // Preprocessor defines of a permutation of shader features
+    std::vector<std::string> defines = {};
+    // Files included by the source, directly or not
+    std::vector<std::filesystem::path> dependencies = {};
+    std::filesystem::file_time_type lastWrite = {};
+    // Changed but not published yet, e.g. because some shader failed to compile
+    bool dirty = false;
+  };
+
+  bool readManifest(const std::filesystem::path& manifest);
+  void watch();
+  // Returns false if any of the dirty shaders failed to compile
+  bool compileDirty(std::uint32_t generation);
+
+private:
+  std::vector<Shader> shaders;
+  std::vector<std::filesystem::path> includeDirs;
+  std::filesystem::path outputDir;
+  fu2::unique_function<void()> onUpdate;
+
+  std::thread watcher;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+  std::atomic<bool> rebuildRequested{false};
+  std::optional<Update> latestUpdate;
+};
@@ -0,0 +1,403 @@
+#include "TextureStreamer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <etna/Etna.hpp>
+#include <etna/GlobalContext.hpp>
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+
+#include "textures/BakedTexture.hpp"
+#include "textures/TextureMips.hpp"
+
+
+// Copies from buffers to images need offsets aligned to texels
+static constexpr std::size_t RING_ALIGNMENT = 16;
+// Loads are scheduled in small portions, so that they follow the camera closely
+static constexpr std::uint32_t MAX_PENDING_LOADS = 16;
+// Whatever doesn't fit waits for the next frame, so that a burst of loads doesn't stall one
+static constexpr std::size_t MAX_FRAME_UPLOAD = std::size_t{32} << 20;
+
+static constexpr std::uint32_t NO_TEXTURE = ~0u;
+
+TextureStreamer::TextureStreamer(CreateInfo info)
+  : textures{info.textures}
+  , images{std::move(info.images)}
+  , framesInFlight{info.framesInFlight}
+  , budget{info.budget}
+{
+  ETNA_VERIFY(images.size() == textures.size());
+
+  std::size_t largestMip = 0;
+  states.resize(textures.size());
+  for (std::uint32_t i = 0; i < states.size(); ++i)
+  {
+    auto& state = states[i];
+    state.mipCount = static_cast<std::uint32_t>(textures[i].mipSizes.size());
+    state.tailMip =
+      std::min(first_mip_fitting(textures[i].size, info.residentSize), state.mipCount - 1);
+    state.residentMip = state.tailMip;
+    state.requestedMip = state.tailMip;
+
+    currentBytes += residentBytes(i, state.tailMip);
+    stats.fullBytes += residentBytes(i, 0);
+    largestMip = std::max(largestMip, textures[i].mipSizes.front());
+  }
+
+  ringSize = std::max(info.ringSize, largestMip);
+  ringSize = (ringSize + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+  ring = etna::get_context().createBuffer(etna::Buffer::CreateInfo{
+    .size = ringSize,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "texture_streaming_ring",
+  });
+  ringData = ring.map();
+
+  worker = std::thread([this]() { workerLoop(); });
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  {
+    std::unique_lock lock{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+
+  ring.unmap();
+}
+
+std::size_t TextureStreamer::residentBytes(
+  std::uint32_t texture, std::uint32_t resident_mip) const
+{
+  std::size_t bytes = 0;
+  for (std::uint32_t mip = resident_mip; mip < states[texture].mipCount; ++mip)
+    bytes += textures[texture].mipSizes[mip];
+  return bytes;
+}
+
+void TextureStreamer::beginFrame()
+{
+  ++frame;
+
+  // NOTE: ring space is released in the order it was allocated in
+  bool released = false;
+  std::uint64_t tail = 0;
+  while (!ringUses.empty() && frame - ringUses.front().frame >= framesInFlight)
+  {
+    tail = ringUses.front().end;
+    ringUses.pop_front();
+    released = true;
+  }
+  if (!released)
+    return;
+
+  {
+    std::unique_lock lock{mutex};
+    ringTail = tail;
+  }
+  wake.notify_all();
+}
+
+void TextureStreamer::request(std::uint32_t texture, std::uint32_t mip)
+{
+  auto& state = states[texture];
+  state.requestedMip = std::min(state.requestedMip, std::max(mip, state.finestMip));
+  state.lastRequestFrame = frame;
+}
+
+void TextureStreamer::reallocate(
+  vk::CommandBuffer cmd_buf,
+  DeferredDestroyQueue& retired,
+  std::uint32_t texture,
+  std::uint32_t resident_mip)
+{
+  auto& state = states[texture];
+  const auto& data = textures[texture];
+
+  const glm::uvec2 size = mip_size(data.size, resident_mip);
+  auto image = etna::get_context().createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{size.x, size.y, 1},
+    .name = data.name,
+    .format = data.format,
+    .imageUsage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst |
+      vk::ImageUsageFlagBits::eTransferSrc,
+    .mipLevels = state.mipCount - resident_mip,
+  });
+
+  etna::set_state(
+    cmd_buf,
+    images[texture].get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferRead,
+    vk::ImageLayout::eTransferSrcOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::set_state(
+    cmd_buf,
+    image.get(),
+    vk::PipelineStageFlagBits2::eTransfer,
+    vk::AccessFlagBits2::eTransferWrite,
+    vk::ImageLayout::eTransferDstOptimal,
+    vk::ImageAspectFlagBits::eColor);
+  etna::flush_barriers(cmd_buf);
+
+  // Only the mips both images have, a new finest one is copied by the caller
+  std::vector<vk::ImageCopy> regions;
+  for (std::uint32_t mip = std::max(resident_mip, state.residentMip); mip < state.mipCount; ++mip)
+  {
+    const glm::uvec2 mipSize = mip_size(data.size, mip);
+    regions.push_back(vk::ImageCopy{
+      .srcSubresource =
+        {
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .mipLevel = mip - state.residentMip,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+      .dstSubresource =
+        {
+          .aspectMask = vk::ImageAspectFlagBits::eColor,
+          .mipLevel = mip - resident_mip,
+          .baseArrayLayer = 0,
+          .layerCount = 1,
+        },
+      .extent = vk::Extent3D{mipSize.x, mipSize.y, 1},
+    });
+  }
+  cmd_buf.copyImage(
+    images[texture].get(),
+    vk::ImageLayout::eTransferSrcOptimal,
+    image.get(),
+    vk::ImageLayout::eTransferDstOptimal,
+    regions);
+
+  retired.push(std::move(images[texture]));
+  images[texture] = std::move(image);
+
+  currentBytes =
+    currentBytes - residentBytes(texture, state.residentMip) + residentBytes(texture, resident_mip);
+  state.residentMip = resident_mip;
+}
+
+bool TextureStreamer::evictOne(
+  vk::CommandBuffer cmd_buf, DeferredDestroyQueue& retired, std::uint32_t keep)
+{
+  std::uint32_t victim = NO_TEXTURE;
+  for (std::uint32_t i = 0; i < states.size(); ++i)
+    if (
+      i != keep && states[i].residentMip < states[i].requestedMip &&
+      (victim == NO_TEXTURE || states[i].lastRequestFrame < states[victim].lastRequestFrame))
+      victim = i;
+
+  if (victim == NO_TEXTURE)
+    return false;
+
+  const std::size_t before = currentBytes;
+  reallocate(cmd_buf, retired, victim, states[victim].requestedMip);
+  stats.evictedBytes += before - currentBytes;
+  return true;
+}
+
+bool TextureStreamer::recordUploads(vk::CommandBuffer cmd_buf, DeferredDestroyQueue& retired)
+{
+  ZoneScoped;
+
+  bool replaced = false;
+
+  // The budget might have just been lowered
+  while (currentBytes > budget && evictOne(cmd_buf, retired, NO_TEXTURE))
+    replaced = true;
+
+  std::vector<ReadyLoad> arrived;
+  {
+    std::unique_lock lock{mutex};
+    std::size_t bytes = 0;
+    while (!ready.empty() && bytes < MAX_FRAME_UPLOAD)
+    {
+      bytes += ready.front().size;
+      arrived.push_back(ready.front());
+      ready.pop_front();
+    }
+  }
+
+  for (const auto& item : arrived)
+  {
+    const auto texture = item.load.texture;
+    auto& state = states[texture];
+    state.loadPending = false;
+
+    // NOTE: the file is broken or gone, requesting the mip again would fail the same way
+    if (item.failed)
+    {
+      state.finestMip = item.load.mip + 1;
+      continue;
+    }
+
+    // The texture might have been shrunk in the meantime
+    if (state.residentMip != item.load.mip + 1)
+      continue;
+
+    while (currentBytes + item.size > budget && evictOne(cmd_buf, retired, texture))
+      replaced = true;
+    if (currentBytes + item.size > budget)
+      continue;
+
+    reallocate(cmd_buf, retired, texture, item.load.mip);
+    const glm::uvec2 size = mip_size(textures[texture].size, item.load.mip);
+    cmd_buf.copyBufferToImage(
+      ring.get(),
+      images[texture].get(),
+      vk::ImageLayout::eTransferDstOptimal,
+      {vk::BufferImageCopy{
+        .bufferOffset = item.offset,
+        .imageSubresource =
+          {
+            .aspectMask = vk::ImageAspectFlagBits::eColor,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1,
+          },
+        .imageExtent = vk::Extent3D{size.x, size.y, 1},
+      }});
+    stats.uploadedBytes += item.size;
+    replaced = true;
+  }
+
+  // Copies of this frame read from the ring until the GPU is done with it
+  if (!arrived.empty())
+    ringUses.push_back(RingUse{.frame = frame, .end = arrived.back().ringEnd});
+
+  scheduleLoads();
+
+  stats.textures = static_cast<std::uint32_t>(states.size());
+  stats.missingMips = 0;
+  stats.pendingLoads = 0;
+  for (auto& state : states)
+  {
+    if (state.residentMip > state.requestedMip)
+      ++stats.missingMips;
+    if (state.loadPending)
+      ++stats.pendingLoads;
+    state.requestedMip = state.tailMip;
+  }
+  stats.residentBytes = currentBytes;
+  stats.budgetBytes = budget;
+
+  return replaced;
+}
+
+void TextureStreamer::scheduleLoads()
+{
+  std::uint32_t pending = 0;
+  // Resident mips with pending loads and mips that are there but aren't needed anymore
+  std::size_t plannedBytes = currentBytes;
+  std::size_t reclaimableBytes = 0;
+  std::vector<std::uint32_t> wanted;
+  for (std::uint32_t i = 0; i < states.size(); ++i)
+  {
+    const auto& state = states[i];
+    if (state.loadPending)
+    {
+      ++pending;
+      plannedBytes += textures[i].mipSizes[state.residentMip - 1];
+    }
+    else if (state.requestedMip < state.residentMip)
+      wanted.push_back(i);
+    else if (state.requestedMip > state.residentMip)
+      reclaimableBytes +=
+        residentBytes(i, state.residentMip) - residentBytes(i, state.requestedMip);
+  }
+
+  // Textures which lack the most mips go first
+  std::sort(wanted.begin(), wanted.end(), [this](std::uint32_t a, std::uint32_t b) {
+    return states[a].residentMip - states[a].requestedMip >
+      states[b].residentMip - states[b].requestedMip;
+  });
+
+  std::vector<Load> scheduled;
+  for (const auto texture : wanted)
+  {
+    if (pending + scheduled.size() >= MAX_PENDING_LOADS)
+      break;
+
+    // NOTE: loads which won't fit even after evicting everything that isn't needed would
+    // only be thrown away once they arrive
+    auto& state = states[texture];
+    const std::size_t bytes = textures[texture].mipSizes[state.residentMip - 1];
+    if (plannedBytes + bytes > budget + reclaimableBytes)
+      continue;
+
+    plannedBytes += bytes;
+    state.loadPending = true;
+    scheduled.push_back(Load{.texture = texture, .mip = state.residentMip - 1});
+  }
+
+  if (scheduled.empty())
+    return;
+
+  {
+    std::unique_lock lock{mutex};
+    loads.insert(loads.end(), scheduled.begin(), scheduled.end());
+  }
+  wake.notify_all();
+}
+
+void TextureStreamer::workerLoop()
+{
+  tracy::SetThreadName("Texture streaming");
+
+  std::unique_lock lock{mutex};
+  while (true)
+  {
+    wake.wait(lock, [this]() { return stopping || !loads.empty(); });
+    if (stopping)
+      return;
+
+    const Load load = loads.front();
+    loads.pop_front();
+    const auto& texture = textures[load.texture];
+    const std::size_t size = texture.mipSizes[load.mip];
+
+    // Mips never wrap around the end of the ring, the rest of it is skipped instead
+    const std::uint64_t allocated = ringHead;
+    std::uint64_t start = (allocated + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    if (start % ringSize + size > ringSize)
+      start += ringSize - start % ringSize;
+    ringHead = start + size;
+
+    // NOTE: with all of the ring released, a mip larger than what is left of it after the
+    // skipped part still fits, as nothing else is there
+    wake.wait(lock, [this, allocated]() {
+      return stopping || ringTail == allocated || ringHead - ringTail <= ringSize;
+    });
+    if (stopping)
+      return;
+
+    // Mips are read right into the ring, only textures which have no file keep them in memory
+    lock.unlock();
+    bool loaded = true;
+    {
+      ZoneScopedN("readMip");
+      auto* dst = reinterpret_cast<std::uint8_t*>(ringData + start % ringSize);
+      if (!texture.mips[load.mip].empty())
+        std::memcpy(dst, texture.mips[load.mip].data(), size);
+      else if (!read_baked_mip(texture.file, texture.mipOffsets[load.mip], {dst, size}))
+      {
+        spdlog::error("Couldn't read mip {} of {}", load.mip, texture.file.string());
+        loaded = false;
+      }
+    }
+    lock.lock();
+
+    ready.push_back(ReadyLoad{
+      .load = load,
+      .offset = static_cast<std::size_t>(start % ringSize),
+      .size = size,
+      .ringEnd = start + size,
+      .failed = !loaded,
+    });
+  }
+}
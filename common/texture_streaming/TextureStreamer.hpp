@@ -0,0 +1,168 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <etna/Buffer.hpp>
+#include <etna/Image.hpp>
+
+#include "render_utils/DeferredDestroyQueue.hpp"
+#include "scene/SceneManager.hpp"
+
+
+/**
+ * Keeps only the mips of scene textures which are actually needed resident, within a budget.
+ *
+ * Every texture always has its tail, the mips that fit into residentSize. Finer mips are
+ * requested every frame, whichever are missing are loaded one by one: a background thread
+ * reads them from the files of the textures right into a ring staging buffer, and the render
+ * thread records copies from there, so only the tails and the mips in the ring are in memory.
+ * A texture grows by moving into a new image with one more mip, the old mips are copied over
+ * on the GPU. Once the budget is exceeded, the least recently used textures that have more
+ * mips than requested are shrunk the same way.
+ *
+ * NOTE: replaced images are only destroyed once frames in flight are done with them,
+ * they aren't counted towards the budget in the meantime.
+ */
+class TextureStreamer
+{
+public:
+  struct CreateInfo
+  {
+    // Must outlive the streamer, see SceneManager::getTextureData. Mips which are in memory
+    // are taken from there, the rest are read from the file of the texture.
+    std::span<const SceneManager::TextureData> textures;
+    // Textures with only their tails uploaded, see SceneManager::takeTextures
+    std::vector<etna::Image> images;
+    // Same as SceneManager::setStreamedTextureSize was called with
+    std::uint32_t residentSize = 64;
+    std::uint32_t framesInFlight = 2;
+    std::size_t budget = std::size_t{256} << 20;
+    // Grows to the largest mip if that doesn't fit
+    std::size_t ringSize = std::size_t{64} << 20;
+  };
+
+  struct Stats
+  {
+    std::uint32_t textures = 0;
+    // Textures with fewer mips than were requested
+    std::uint32_t missingMips = 0;
+    std::uint32_t pendingLoads = 0;
+    std::size_t residentBytes = 0;
+    std::size_t budgetBytes = 0;
+    // What all mips of all textures would take
+    std::size_t fullBytes = 0;
+    // Totals since the start, for bandwidth
+    std::uint64_t uploadedBytes = 0;
+    std::uint64_t evictedBytes = 0;
+  };
+
+  explicit TextureStreamer(CreateInfo info);
+  ~TextureStreamer();
+
+  TextureStreamer(const TextureStreamer&) = delete;
+  TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+  std::span<const etna::Image> getImages() const { return images; }
+  std::uint32_t getMipCount(std::uint32_t texture) const { return states[texture].mipCount; }
+  glm::uvec2 getSize(std::uint32_t texture) const { return textures[texture].size; }
+
+  void setBudget(std::size_t bytes) { budget = bytes; }
+
+  // Must be called at the start of every frame, once the GPU is done with the frame from
+  // frames in flight ago, so that the ring space it used can be reused
+  void beginFrame();
+
+  // The finest mip of a texture that is needed this frame, the finest one of all requests wins
+  void request(std::uint32_t texture, std::uint32_t mip);
+
+  // Evicts, uploads whatever has arrived since the last call and schedules new loads for
+  // this frame's requests. Returns whether any images were replaced, descriptors which refer
+  // to them have to be rewritten then. The old images go to `retired`.
+  bool recordUploads(vk::CommandBuffer cmd_buf, DeferredDestroyQueue& retired);
+
+  Stats getStats() const { return stats; }
+
+private:
+  struct TextureState
+  {
+    std::uint32_t mipCount = 0;
+    // Mips from this one on are always resident
+    std::uint32_t tailMip = 0;
+    std::uint32_t residentMip = 0;
+    // Finest mip requested since the last recordUploads, tailMip if none was
+    std::uint32_t requestedMip = 0;
+    std::uint64_t lastRequestFrame = 0;
+    bool loadPending = false;
+    // Finer mips couldn't be read, so they aren't requested anymore
+    std::uint32_t finestMip = 0;
+  };
+
+  struct Load
+  {
+    std::uint32_t texture;
+    std::uint32_t mip;
+  };
+
+  // A mip in the ring, which is released in the order of allocation
+  struct ReadyLoad
+  {
+    Load load;
+    std::size_t offset;
+    std::size_t size;
+    std::uint64_t ringEnd;
+    // The mip couldn't be read, the ring space is just released then
+    bool failed;
+  };
+
+  std::size_t residentBytes(std::uint32_t texture, std::uint32_t resident_mip) const;
+  // Moves the texture into a new image with mips from resident_mip on
+  void reallocate(
+    vk::CommandBuffer cmd_buf,
+    DeferredDestroyQueue& retired,
+    std::uint32_t texture,
+    std::uint32_t resident_mip);
+  // Shrinks the least recently requested texture with more mips than it needs, if any
+  bool evictOne(vk::CommandBuffer cmd_buf, DeferredDestroyQueue& retired, std::uint32_t keep);
+  void scheduleLoads();
+
+  void workerLoop();
+
+private:
+  std::span<const SceneManager::TextureData> textures;
+  std::vector<etna::Image> images;
+  std::vector<TextureState> states;
+  std::uint32_t framesInFlight;
+  std::size_t budget;
+
+  std::size_t currentBytes = 0;
+  std::uint64_t frame = 0;
+  Stats stats;
+
+  // Positions in the ring only ever grow, offsets are positions modulo its size
+  etna::Buffer ring;
+  std::size_t ringSize;
+  std::byte* ringData = nullptr;
+  struct RingUse
+  {
+    std::uint64_t frame;
+    std::uint64_t end;
+  };
+  std::deque<RingUse> ringUses;
+
+  // Shared with the worker
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Load> loads;
+  std::deque<ReadyLoad> ready;
+  std::uint64_t ringHead = 0;
+  std::uint64_t ringTail = 0;
+  bool stopping = false;
+
+  std::thread worker;
+};
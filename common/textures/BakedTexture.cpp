@@ -0,0 +1,179 @@
+#include "BakedTexture.hpp"
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#include <spdlog/spdlog.h>
+
+#include "BlockCompression.hpp"
+#include "TextureMips.hpp"
+#include "hashing/Hasher.hpp"
+
+
+static constexpr std::array<char, 4> MAGIC{'B', 'T', 'E', 'X'};
+
+struct Header
+{
+  std::array<char, 4> magic;
+  std::uint32_t version;
+  std::uint32_t format;
+  std::uint32_t width;
+  std::uint32_t height;
+  std::uint32_t mipCount;
+  std::uint64_t sourceHash;
+};
+
+static_assert(sizeof(Header) == 32);
+
+// Larger than any image the GPU can have, so that sizes in corrupted headers can't overflow
+static constexpr std::uint32_t MAX_EXTENT = 1u << 16;
+
+std::uint64_t hash_source_image(std::span<const std::uint8_t> encoded)
+{
+  Hasher hasher;
+  hasher.bytes(encoded.data(), encoded.size());
+  return hasher.state;
+}
+
+std::size_t baked_mip_bytes(TextureFormat format, glm::uvec2 size)
+{
+  switch (format)
+  {
+  case TextureFormat::RGBA8_UNORM:
+  case TextureFormat::RGBA8_SRGB:
+    return std::size_t{size.x} * size.y * 4;
+  case TextureFormat::BC1_UNORM:
+  case TextureFormat::BC1_SRGB:
+    return compressed_size(BlockFormat::BC1, size);
+  case TextureFormat::BC5_UNORM:
+    return compressed_size(BlockFormat::BC5, size);
+  case TextureFormat::BC7_UNORM:
+  case TextureFormat::BC7_SRGB:
+    return compressed_size(BlockFormat::BC7, size);
+  }
+  return 0;
+}
+
+bool write_baked_texture(const std::filesystem::path& path, const BakedTexture& texture)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file)
+    return false;
+
+  const Header header{
+    .magic = MAGIC,
+    .version = BAKED_TEXTURE_VERSION,
+    .format = static_cast<std::uint32_t>(texture.format),
+    .width = texture.size.x,
+    .height = texture.size.y,
+    .mipCount = static_cast<std::uint32_t>(texture.mips.size()),
+    .sourceHash = texture.sourceHash,
+  };
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (const auto& mip : texture.mips)
+  {
+    const std::uint64_t size = mip.size();
+    file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  }
+  for (const auto& mip : texture.mips)
+    file.write(
+      reinterpret_cast<const char*>(mip.data()), static_cast<std::streamsize>(mip.size()));
+
+  return static_cast<bool>(file);
+}
+
+std::optional<BakedTexture> read_baked_texture(
+  const std::filesystem::path& path, std::uint32_t max_extent)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+  {
+    spdlog::warn("Baked texture {} can't be opened", path.string());
+    return std::nullopt;
+  }
+
+  Header header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != MAGIC || header.version != BAKED_TEXTURE_VERSION ||
+    header.format > static_cast<std::uint32_t>(TextureFormat::BC7_SRGB) ||
+    header.width == 0 || header.height == 0 || header.width > MAX_EXTENT ||
+    header.height > MAX_EXTENT || header.mipCount != mip_count({header.width, header.height}))
+  {
+    spdlog::warn("{} isn't a baked texture of version {}", path.string(), BAKED_TEXTURE_VERSION);
+    return std::nullopt;
+  }
+
+  std::vector<std::uint64_t> sizes(header.mipCount);
+  file.read(
+    reinterpret_cast<char*>(sizes.data()),
+    static_cast<std::streamsize>(sizes.size() * sizeof(std::uint64_t)));
+
+  BakedTexture texture{
+    .format = static_cast<TextureFormat>(header.format),
+    .size = {header.width, header.height},
+    .sourceHash = header.sourceHash,
+    .mips = std::vector<std::vector<std::uint8_t>>(header.mipCount),
+    .mipOffsets = std::vector<std::uint64_t>(header.mipCount),
+  };
+  // NOTE: mips are copied to images as they are, so a mip of any other size than the format
+  // requires would make the GPU read past it. Mips which aren't read now might be read later
+  // on, so all of them have to be in the file.
+  std::uint64_t offset = sizeof(header) + sizes.size() * sizeof(std::uint64_t);
+  for (std::uint32_t i = 0; i < header.mipCount; ++i)
+  {
+    if (!file || sizes[i] != baked_mip_bytes(texture.format, mip_size(texture.size, i)))
+    {
+      spdlog::warn("Baked texture {} is truncated or corrupted", path.string());
+      return std::nullopt;
+    }
+    texture.mipOffsets[i] = offset;
+    offset += sizes[i];
+  }
+  std::error_code ec;
+  if (std::filesystem::file_size(path, ec) < offset || ec)
+  {
+    spdlog::warn("Baked texture {} is truncated or corrupted", path.string());
+    return std::nullopt;
+  }
+
+  const std::uint32_t firstMip = first_mip_fitting(texture.size, max_extent);
+  file.seekg(static_cast<std::streamoff>(texture.mipOffsets[firstMip]));
+  for (std::uint32_t i = firstMip; i < header.mipCount; ++i)
+  {
+    texture.mips[i].resize(sizes[i]);
+    file.read(
+      reinterpret_cast<char*>(texture.mips[i].data()), static_cast<std::streamsize>(sizes[i]));
+  }
+  if (!file)
+  {
+    spdlog::warn("Baked texture {} is truncated or corrupted", path.string());
+    return std::nullopt;
+  }
+
+  return texture;
+}
+
+bool read_baked_mip(
+  const std::filesystem::path& path, std::uint64_t offset, std::span<std::uint8_t> dst)
+{
+  std::ifstream file(path, std::ios::binary);
+  file.seekg(static_cast<std::streamoff>(offset));
+  file.read(reinterpret_cast<char*>(dst.data()), static_cast<std::streamsize>(dst.size()));
+  return static_cast<bool>(file);
+}
+
+std::filesystem::path baked_texture_path(
+  const std::filesystem::path& gltf_path, std::uint32_t image_index)
+{
+  static constexpr std::string_view BAKED_SUFFIX = "_baked";
+
+  std::string stem = gltf_path.stem().string();
+  if (stem.ends_with(BAKED_SUFFIX))
+    stem.resize(stem.size() - BAKED_SUFFIX.size());
+
+  return gltf_path.parent_path() / (stem + "_textures") /
+    (std::to_string(image_index) + ".btex");
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Formats of baked textures, numbered the way they are stored on disk
+enum class TextureFormat : std::uint32_t
+{
+  RGBA8_UNORM,
+  RGBA8_SRGB,
+  BC1_UNORM,
+  BC1_SRGB,
+  BC5_UNORM,
+  BC7_UNORM,
+  BC7_SRGB,
+};
+
+/**
+ * A texture exactly the way the GPU wants it: all mips in the final format, so loading it
+ * is a read and an upload without any decoding.
+ *
+ * On disk (.btex, little endian) it is a header of
+ *   char magic[4] = "BTEX", u32 version, u32 format, u32 width, u32 height, u32 mipCount,
+ *   u64 sourceHash
+ * followed by a u64 byte size for every mip and then the mips themselves, finest first,
+ * all of them down to 1x1.
+ */
+struct BakedTexture
+{
+  TextureFormat format = TextureFormat::RGBA8_UNORM;
+  glm::uvec2 size{};
+  // hash_source_image of the image it was baked from, so that a baked texture of an image
+  // which has been edited or replaced since is never taken for it
+  std::uint64_t sourceHash = 0;
+  std::vector<std::vector<std::uint8_t>> mips;
+  // Where every mip starts in the file the texture was read from, so that the ones which
+  // weren't read can be read later on, see read_baked_mip
+  std::vector<std::uint64_t> mipOffsets = {};
+};
+
+// Bumped whenever the layout or the encoders change, older files are ignored then
+inline constexpr std::uint32_t BAKED_TEXTURE_VERSION = 2;
+
+// Of the encoded image, e.g. the PNG file
+// NOTE: the hash isn't guaranteed to be stable across versions, a texture baked by another
+// one is merely rebaked or decoded once more because of that
+std::uint64_t hash_source_image(std::span<const std::uint8_t> encoded);
+
+// Bytes a mip of size pixels takes in the format, whole 4x4 blocks of the edges included
+std::size_t baked_mip_bytes(TextureFormat format, glm::uvec2 size);
+
+bool write_baked_texture(const std::filesystem::path& path, const BakedTexture& texture);
+
+// Warns and returns nothing if the file is missing, truncated or of another version.
+// Only mips with both sides of at most max_extent are read, the finer ones are left empty.
+std::optional<BakedTexture> read_baked_texture(
+  const std::filesystem::path& path, std::uint32_t max_extent = ~0u);
+
+// Reads a single mip of a file read_baked_texture has accepted before, at one of mipOffsets
+bool read_baked_mip(
+  const std::filesystem::path& path, std::uint64_t offset, std::span<std::uint8_t> dst);
+
+// Where the baker puts the image of a glTF model and the scene loader looks for it:
+// scene.gltf and scene_baked.gltf both use scene_textures/<image_index>.btex
+std::filesystem::path baked_texture_path(
+  const std::filesystem::path& gltf_path, std::uint32_t image_index);
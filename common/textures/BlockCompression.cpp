@@ -0,0 +1,350 @@
+#include "BlockCompression.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include <tracy/Tracy.hpp>
+
+#include "jobs/JobSystem.hpp"
+
+
+// Pixels of a block in 0..255, row by row
+using BlockPixels = std::array<glm::vec4, 16>;
+
+static void load_block(
+  std::span<const std::uint8_t> rgba, glm::uvec2 size, glm::uvec2 block, BlockPixels& pixels)
+{
+  for (std::uint32_t y = 0; y < 4; ++y)
+    for (std::uint32_t x = 0; x < 4; ++x)
+    {
+      const std::uint32_t px = std::min(block.x * 4 + x, size.x - 1);
+      const std::uint32_t py = std::min(block.y * 4 + y, size.y - 1);
+      const std::uint8_t* src = &rgba[(std::size_t{py} * size.x + px) * 4];
+      pixels[y * 4 + x] = glm::vec4(src[0], src[1], src[2], src[3]);
+    }
+}
+
+// Direction in which the pixels vary the most, only over the channels of the mask
+static glm::vec4 principal_axis(const BlockPixels& pixels, glm::vec4 mean, glm::vec4 mask)
+{
+  glm::mat4 covariance{0.0f};
+  glm::vec4 lo{std::numeric_limits<float>::max()};
+  glm::vec4 hi{std::numeric_limits<float>::lowest()};
+  for (const auto& pixel : pixels)
+  {
+    const glm::vec4 d = (pixel - mean) * mask;
+    covariance += glm::outerProduct(d, d);
+    lo = glm::min(lo, pixel);
+    hi = glm::max(hi, pixel);
+  }
+
+  // Power iteration, starting from the diagonal of the bounding box converges quickly
+  glm::vec4 axis = (hi - lo) * mask;
+  for (int i = 0; i < 8; ++i)
+  {
+    const glm::vec4 next = covariance * axis;
+    const glm::vec4 magnitude = glm::abs(next);
+    const float largest =
+      std::max(std::max(magnitude.x, magnitude.y), std::max(magnitude.z, magnitude.w));
+    if (largest <= 0.0f)
+      break;
+    axis = next / largest;
+  }
+  const float length = glm::length(axis);
+  return length > 0.0f ? axis / length : glm::vec4(0.0f);
+}
+
+// Extremes of the pixels projected onto the principal axis
+static void fit_endpoints(
+  const BlockPixels& pixels, glm::vec4 mask, float inset, glm::vec4& e0, glm::vec4& e1)
+{
+  glm::vec4 mean{0.0f};
+  for (const auto& pixel : pixels)
+    mean += pixel;
+  mean /= 16.0f;
+
+  const glm::vec4 axis = principal_axis(pixels, mean, mask);
+  float lo = 0.0f;
+  float hi = 0.0f;
+  for (const auto& pixel : pixels)
+  {
+    const float t = glm::dot(pixel - mean, axis);
+    lo = std::min(lo, t);
+    hi = std::max(hi, t);
+  }
+  // NOTE: extremes are rarely hit exactly once quantized, pulling them in a bit helps the rest
+  const float shrink = (hi - lo) * inset;
+  e0 = glm::clamp(mean + axis * (hi - shrink), 0.0f, 255.0f);
+  e1 = glm::clamp(mean + axis * (lo + shrink), 0.0f, 255.0f);
+}
+
+static float distance2(glm::vec4 a, glm::vec4 b, glm::vec4 mask)
+{
+  const glm::vec4 d = (a - b) * mask;
+  return glm::dot(d, d);
+}
+
+static std::uint16_t to_565(glm::vec4 color)
+{
+  const auto r = static_cast<std::uint16_t>(std::lround(color.r * 31.0f / 255.0f));
+  const auto g = static_cast<std::uint16_t>(std::lround(color.g * 63.0f / 255.0f));
+  const auto b = static_cast<std::uint16_t>(std::lround(color.b * 31.0f / 255.0f));
+  return static_cast<std::uint16_t>(r << 11 | g << 5 | b);
+}
+
+static glm::vec4 from_565(std::uint16_t color)
+{
+  const std::uint32_t r = color >> 11 & 31;
+  const std::uint32_t g = color >> 5 & 63;
+  const std::uint32_t b = color & 31;
+  return glm::vec4(r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255);
+}
+
+static void encode_bc1(const BlockPixels& pixels, std::uint8_t* out)
+{
+  const glm::vec4 rgb{1, 1, 1, 0};
+  glm::vec4 e0;
+  glm::vec4 e1;
+  fit_endpoints(pixels, rgb, 1.0f / 16.0f, e0, e1);
+
+  std::uint16_t c0 = to_565(e0);
+  std::uint16_t c1 = to_565(e1);
+  // c0 > c1 selects the 4-color mode, c0 == c1 is left with all indices 0
+  if (c0 < c1)
+    std::swap(c0, c1);
+
+  std::uint32_t indices = 0;
+  if (c0 != c1)
+  {
+    const glm::vec4 p0 = from_565(c0);
+    const glm::vec4 p1 = from_565(c1);
+    const std::array<glm::vec4, 4> palette{
+      p0, p1, (2.0f * p0 + p1) / 3.0f, (p0 + 2.0f * p1) / 3.0f};
+    for (std::uint32_t i = 0; i < 16; ++i)
+    {
+      std::uint32_t best = 0;
+      float bestError = std::numeric_limits<float>::max();
+      for (std::uint32_t j = 0; j < 4; ++j)
+        if (const float error = distance2(pixels[i], palette[j], rgb); error < bestError)
+        {
+          best = j;
+          bestError = error;
+        }
+      indices |= best << (2 * i);
+    }
+  }
+
+  out[0] = static_cast<std::uint8_t>(c0);
+  out[1] = static_cast<std::uint8_t>(c0 >> 8);
+  out[2] = static_cast<std::uint8_t>(c1);
+  out[3] = static_cast<std::uint8_t>(c1 >> 8);
+  for (std::uint32_t i = 0; i < 4; ++i)
+    out[4 + i] = static_cast<std::uint8_t>(indices >> (8 * i));
+}
+
+static void encode_bc4(const BlockPixels& pixels, int channel, std::uint8_t* out)
+{
+  float lo = 255.0f;
+  float hi = 0.0f;
+  for (const auto& pixel : pixels)
+  {
+    lo = std::min(lo, pixel[channel]);
+    hi = std::max(hi, pixel[channel]);
+  }
+  const auto r0 = static_cast<std::uint32_t>(hi);
+  const auto r1 = static_cast<std::uint32_t>(lo);
+
+  // r0 > r1 selects 6 interpolated values, r0 == r1 is left with all indices 0
+  std::uint64_t indices = 0;
+  if (r0 != r1)
+  {
+    std::array<float, 8> palette{static_cast<float>(r0), static_cast<float>(r1)};
+    for (std::uint32_t i = 2; i < 8; ++i)
+      palette[i] = static_cast<float>(((8 - i) * r0 + (i - 1) * r1) / 7);
+    for (std::uint32_t i = 0; i < 16; ++i)
+    {
+      std::uint64_t best = 0;
+      float bestError = std::numeric_limits<float>::max();
+      for (std::uint32_t j = 0; j < 8; ++j)
+        if (const float error = std::abs(pixels[i][channel] - palette[j]); error < bestError)
+        {
+          best = j;
+          bestError = error;
+        }
+      indices |= best << (3 * i);
+    }
+  }
+
+  out[0] = static_cast<std::uint8_t>(r0);
+  out[1] = static_cast<std::uint8_t>(r1);
+  for (std::uint32_t i = 0; i < 6; ++i)
+    out[2 + i] = static_cast<std::uint8_t>(indices >> (8 * i));
+}
+
+static void encode_bc5(const BlockPixels& pixels, std::uint8_t* out)
+{
+  encode_bc4(pixels, 0, out);
+  encode_bc4(pixels, 1, out + 8);
+}
+
+static constexpr std::array<std::uint32_t, 16> BC7_WEIGHTS{
+  0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static glm::vec4 bc7_interpolate(glm::uvec4 e0, glm::uvec4 e1, std::uint32_t index)
+{
+  const std::uint32_t w = BC7_WEIGHTS[index];
+  return glm::vec4(((64 - w) * e0 + w * e1 + 32u) >> 6u);
+}
+
+// Bits of a block, least significant first
+class BlockWriter
+{
+public:
+  void write(std::uint64_t value, std::uint32_t bits)
+  {
+    for (std::uint32_t i = 0; i < bits; ++i, ++position)
+      if (value >> i & 1)
+        words[position / 64] |= std::uint64_t{1} << (position % 64);
+  }
+
+  void store(std::uint8_t* out) const
+  {
+    for (std::uint32_t i = 0; i < 16; ++i)
+      out[i] = static_cast<std::uint8_t>(words[i / 8] >> (8 * (i % 8)));
+  }
+
+private:
+  std::array<std::uint64_t, 2> words{};
+  std::uint32_t position = 0;
+};
+
+static void encode_bc7(const BlockPixels& pixels, std::uint8_t* out)
+{
+  const glm::vec4 rgba{1.0f};
+  glm::vec4 f0;
+  glm::vec4 f1;
+  fit_endpoints(pixels, rgba, 1.0f / 32.0f, f0, f1);
+
+  // Every combination of p-bits rounds the endpoints differently, the best one wins
+  float bestError = std::numeric_limits<float>::max();
+  glm::uvec4 bestQ0{};
+  glm::uvec4 bestQ1{};
+  std::array<std::uint32_t, 2> bestP{};
+  std::array<std::uint32_t, 16> bestIndices{};
+  for (std::uint32_t p0 = 0; p0 < 2; ++p0)
+    for (std::uint32_t p1 = 0; p1 < 2; ++p1)
+    {
+      const glm::uvec4 q0{glm::clamp(glm::round((f0 - float(p0)) * 0.5f), 0.0f, 127.0f)};
+      const glm::uvec4 q1{glm::clamp(glm::round((f1 - float(p1)) * 0.5f), 0.0f, 127.0f)};
+      const glm::uvec4 e0 = q0 << 1u | p0;
+      const glm::uvec4 e1 = q1 << 1u | p1;
+
+      const glm::vec4 axis = glm::vec4(e1) - glm::vec4(e0);
+      const float axisLength2 = glm::dot(axis, axis);
+      std::array<std::uint32_t, 16> indices{};
+      float error = 0.0f;
+      for (std::uint32_t i = 0; i < 16; ++i)
+      {
+        // The projection onto the endpoints is close, the neighbours of it might be closer
+        const float t = axisLength2 > 0.0f
+          ? glm::dot(pixels[i] - glm::vec4(e0), axis) / axisLength2 * 64.0f
+          : 0.0f;
+        const auto nearest = static_cast<std::uint32_t>(
+          std::lower_bound(BC7_WEIGHTS.begin(), BC7_WEIGHTS.end(), t) - BC7_WEIGHTS.begin());
+        float pixelError = std::numeric_limits<float>::max();
+        for (std::uint32_t j = nearest > 0 ? nearest - 1 : 0; j <= std::min(nearest, 15u); ++j)
+          if (const float e = distance2(pixels[i], bc7_interpolate(e0, e1, j), rgba);
+              e < pixelError)
+          {
+            pixelError = e;
+            indices[i] = j;
+          }
+        error += pixelError;
+      }
+
+      if (error < bestError)
+      {
+        bestError = error;
+        bestQ0 = q0;
+        bestQ1 = q1;
+        bestP = {p0, p1};
+        bestIndices = indices;
+      }
+    }
+
+  // The most significant bit of the first index is implied to be 0
+  if (bestIndices[0] >= 8)
+  {
+    std::swap(bestQ0, bestQ1);
+    std::swap(bestP[0], bestP[1]);
+    for (auto& index : bestIndices)
+      index = 15 - index;
+  }
+
+  BlockWriter writer;
+  writer.write(1u << 6, 7);
+  for (int c = 0; c < 4; ++c)
+  {
+    writer.write(bestQ0[c], 7);
+    writer.write(bestQ1[c], 7);
+  }
+  writer.write(bestP[0], 1);
+  writer.write(bestP[1], 1);
+  writer.write(bestIndices[0], 3);
+  for (std::uint32_t i = 1; i < 16; ++i)
+    writer.write(bestIndices[i], 4);
+  writer.store(out);
+}
+
+std::size_t block_bytes(BlockFormat format)
+{
+  return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+std::size_t compressed_size(BlockFormat format, glm::uvec2 size)
+{
+  const glm::uvec2 blocks = (size + 3u) / 4u;
+  return std::size_t{blocks.x} * blocks.y * block_bytes(format);
+}
+
+std::vector<std::uint8_t> compress_blocks(
+  BlockFormat format, std::span<const std::uint8_t> rgba, glm::uvec2 size, JobSystem* jobs)
+{
+  ZoneScoped;
+
+  const glm::uvec2 blocks = (size + 3u) / 4u;
+  const std::size_t blockSize = block_bytes(format);
+  std::vector<std::uint8_t> result(compressed_size(format, size));
+
+  auto compressRows = [&](std::size_t begin, std::size_t end) {
+    BlockPixels pixels;
+    for (std::size_t y = begin; y < end; ++y)
+      for (std::uint32_t x = 0; x < blocks.x; ++x)
+      {
+        load_block(rgba, size, {x, static_cast<std::uint32_t>(y)}, pixels);
+        std::uint8_t* out = &result[(y * blocks.x + x) * blockSize];
+        switch (format)
+        {
+        case BlockFormat::BC1:
+          encode_bc1(pixels, out);
+          break;
+        case BlockFormat::BC5:
+          encode_bc5(pixels, out);
+          break;
+        case BlockFormat::BC7:
+          encode_bc7(pixels, out);
+          break;
+        }
+      }
+  };
+
+  // NOTE: small mips aren't worth the scheduling
+  if (jobs != nullptr && blocks.y > 1)
+    jobs->parallelFor("compressBlocks", blocks.y, 1, compressRows);
+  else
+    compressRows(0, blocks.y);
+
+  return result;
+}
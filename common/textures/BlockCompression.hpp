@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+class JobSystem;
+
+// Block-compressed formats of the GPU, all of them are made of 4x4 pixel blocks:
+// BC1 -- RGB with two 5:6:5 endpoints and 2-bit indices, 8 bytes per block
+// BC5 -- two BC4 channels (R and G) with 8-bit endpoints and 3-bit indices, 16 bytes
+// BC7 -- RGBA, only mode 6 is used: a single pair of 7.7.7.7 endpoints with p-bits
+//        and 4-bit indices, 16 bytes
+enum class BlockFormat
+{
+  BC1,
+  BC5,
+  BC7,
+};
+
+std::size_t block_bytes(BlockFormat format);
+
+// Size of an image of size pixels in the format, whole blocks of the edges included
+std::size_t compressed_size(BlockFormat format, glm::uvec2 size);
+
+// Compresses an RGBA8 image, blocks on the edges of sizes which aren't multiples of 4 repeat
+// the last row or column. Rows of blocks are compressed on the job system if there is one.
+// NOTE: endpoints are fit along the principal axis of a block without any refinement, which
+// is what real-time encoders do, offline ones are slower and somewhat better.
+std::vector<std::uint8_t> compress_blocks(
+  BlockFormat format, std::span<const std::uint8_t> rgba, glm::uvec2 size, JobSystem* jobs);
@@ -0,0 +1,54 @@
+#include "EncodedImages.hpp"
+
+#include <stb_image.h>
+#include <tiny_gltf.h>
+
+#include "TextureMips.hpp"
+
+
+static bool keep_encoded_image(
+  tinygltf::Image* image,
+  const int /*image_idx*/,
+  std::string* /*err*/,
+  std::string* /*warn*/,
+  int /*req_width*/,
+  int /*req_height*/,
+  const unsigned char* bytes,
+  int size,
+  void* user_data)
+{
+  // NOTE: tinygltf only sets the URI for images which are read from files
+  const auto kept = *static_cast<const KeptImages*>(user_data);
+  if (kept == KeptImages::All || image->uri.empty())
+    image->image.assign(bytes, bytes + size);
+  return true;
+}
+
+void keep_images_encoded(tinygltf::TinyGLTF& loader, KeptImages kept)
+{
+  // The loader only keeps a pointer, so it has to point to something that is always there
+  static constexpr KeptImages ALL = KeptImages::All;
+  static constexpr KeptImages EMBEDDED = KeptImages::Embedded;
+  loader.SetImageLoader(
+    keep_encoded_image, const_cast<KeptImages*>(kept == KeptImages::All ? &ALL : &EMBEDDED));
+}
+
+DecodedImage decode_image_mips(std::span<const std::uint8_t> encoded)
+{
+  int width = 0;
+  int height = 0;
+  int channels = 0;
+  stbi_uc* pixels = stbi_load_from_memory(
+    encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels, 4);
+  if (pixels == nullptr)
+    return DecodedImage{.error = stbi_failure_reason()};
+
+  const glm::uvec2 size{static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height)};
+  std::vector<std::uint8_t> rgba(pixels, pixels + std::size_t{size.x} * size.y * 4);
+  stbi_image_free(pixels);
+
+  return DecodedImage{
+    .size = size,
+    .mips = build_mip_chain_rgba8(std::move(rgba), size),
+  };
+}
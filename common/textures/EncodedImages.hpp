@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+namespace tinygltf
+{
+class TinyGLTF;
+}
+
+// Images of glTF models as they are in files, PNGs and JPEGs, and what decoding them gives.
+
+enum class KeptImages
+{
+  // Every image stays in tinygltf::Image::image
+  All,
+  // Only the ones embedded into the model do, those read from files are dropped and are
+  // only left with their URIs
+  Embedded,
+};
+
+// Makes the loader leave images encoded rather than decode them one after another while it
+// parses the model, so that they can be decoded in parallel later on, see decode_image_mips
+void keep_images_encoded(tinygltf::TinyGLTF& loader, KeptImages kept);
+
+struct DecodedImage
+{
+  glm::uvec2 size{};
+  // RGBA8, the first one is the image itself, see build_mip_chain_rgba8
+  std::vector<std::vector<std::uint8_t>> mips = {};
+  // Why the image couldn't be decoded, there are no mips then
+  std::string error = {};
+};
+
+// Decodes anything stb_image can read into RGBA8 and builds the whole mip chain of it
+DecodedImage decode_image_mips(std::span<const std::uint8_t> encoded);
@@ -0,0 +1,100 @@
+#include "TextureMips.hpp"
+
+#include <algorithm>
+#include <bit>
+
+// NOTE: SSE2 is a part of x86-64, so no special flags or runtime checks are needed for it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_MIPS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+std::uint32_t mip_count(glm::uvec2 size)
+{
+  return static_cast<std::uint32_t>(std::bit_width(std::max(size.x, size.y)));
+}
+
+std::uint32_t first_mip_fitting(glm::uvec2 size, std::uint32_t max_extent)
+{
+  std::uint32_t mip = 0;
+  while (glm::any(glm::greaterThan(mip_size(size, mip), glm::uvec2(std::max(max_extent, 1u)))))
+    ++mip;
+  return mip;
+}
+
+static void downsample_pixel(
+  const std::uint8_t* row0,
+  const std::uint8_t* row1,
+  std::size_t col0,
+  std::size_t col1,
+  std::uint8_t* dst)
+{
+  for (std::size_t c = 0; c < 4; ++c)
+  {
+    const std::uint32_t sum =
+      row0[col0 * 4 + c] + row0[col1 * 4 + c] + row1[col0 * 4 + c] + row1[col1 * 4 + c];
+    dst[c] = static_cast<std::uint8_t>((sum + 2) / 4);
+  }
+}
+
+void downsample_rgba8(
+  std::span<const std::uint8_t> src, glm::uvec2 src_size, std::span<std::uint8_t> dst)
+{
+  const glm::uvec2 dstSize = mip_size(src_size, 1);
+  for (std::uint32_t y = 0; y < dstSize.y; ++y)
+  {
+    const std::uint8_t* row0 = &src[std::size_t{std::min(2 * y, src_size.y - 1)} * src_size.x * 4];
+    const std::uint8_t* row1 =
+      &src[std::size_t{std::min(2 * y + 1, src_size.y - 1)} * src_size.x * 4];
+    std::uint8_t* out = &dst[std::size_t{y} * dstSize.x * 4];
+
+    std::uint32_t x = 0;
+#if TEXTURE_MIPS_SSE2
+    // Two output pixels from four source ones of both rows at a time, as long as
+    // all of them are there, i.e. everywhere but the odd last column
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rounding = _mm_set1_epi16(2);
+    for (; 2 * x + 3 < src_size.x; x += 2)
+    {
+      const __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+      const __m128i bottom = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+      // Vertical sums of pixels 0, 1 and of pixels 2, 3 in 16 bits
+      const __m128i left =
+        _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+      const __m128i right =
+        _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+      // Horizontal ones end up in the low halves
+      const __m128i sums = _mm_unpacklo_epi64(
+        _mm_add_epi16(left, _mm_srli_si128(left, 8)),
+        _mm_add_epi16(right, _mm_srli_si128(right, 8)));
+      const __m128i averages = _mm_srli_epi16(_mm_add_epi16(sums, rounding), 2);
+      _mm_storel_epi64(
+        reinterpret_cast<__m128i*>(out + 4 * x), _mm_packus_epi16(averages, averages));
+    }
+#endif
+    for (; x < dstSize.x; ++x)
+      downsample_pixel(
+        row0,
+        row1,
+        std::min(2 * x, src_size.x - 1),
+        std::min(2 * x + 1, src_size.x - 1),
+        out + 4 * x);
+  }
+}
+
+std::vector<std::vector<std::uint8_t>> build_mip_chain_rgba8(
+  std::vector<std::uint8_t> image, glm::uvec2 size)
+{
+  const std::uint32_t count = mip_count(size);
+  std::vector<std::vector<std::uint8_t>> mips;
+  mips.reserve(count);
+  mips.push_back(std::move(image));
+  for (std::uint32_t mip = 1; mip < count; ++mip)
+  {
+    const glm::uvec2 dstSize = mip_size(size, mip);
+    auto& dst = mips.emplace_back(std::size_t{dstSize.x} * dstSize.y * 4);
+    downsample_rgba8(mips[mip - 1], mip_size(size, mip - 1), dst);
+  }
+  return mips;
+}
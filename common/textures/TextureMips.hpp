@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+// Mip chains of RGBA8 images, built on the CPU while loading, so that textures
+// arrive on the GPU complete and nothing has to be generated there.
+
+inline glm::uvec2 mip_size(glm::uvec2 size, std::uint32_t mip)
+{
+  return glm::max(glm::uvec2(size.x >> mip, size.y >> mip), glm::uvec2(1));
+}
+
+// Down to 1x1, including the image itself
+std::uint32_t mip_count(glm::uvec2 size);
+
+// The largest mip with both sides of at most max_extent
+std::uint32_t first_mip_fitting(glm::uvec2 size, std::uint32_t max_extent);
+
+// Box-filters an RGBA8 mip down to the next one, odd sizes repeat their last row or column.
+// dst must have room for mip_size(src_size, 1) pixels.
+// NOTE: sRGB is filtered as is, which darkens high-contrast textures in the distance a bit.
+void downsample_rgba8(
+  std::span<const std::uint8_t> src, glm::uvec2 src_size, std::span<std::uint8_t> dst);
+
+// All mips of an RGBA8 image, the first one is the image itself
+std::vector<std::vector<std::uint8_t>> build_mip_chain_rgba8(
+  std::vector<std::uint8_t> image, glm::uvec2 size);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+
+// A single input event as reported by the OS. Events are queued up while polling
+// and applied to the keyboard and mouse states of windows afterwards.
+struct InputEvent
+{
+  enum class Type : std::uint8_t
+  {
+    Key,
+    MouseButton,
+    CursorPos,
+    Scroll,
+  };
+
+  Type type = Type::Key;
+  // Index of the window in order of creation
+  std::uint8_t window = 0;
+  // For keys and mouse buttons only
+  bool pressed = false;
+  std::uint8_t padding = 0;
+  // KeyboardKey or MouseButton
+  std::uint32_t code = 0;
+  // Cursor position or scroll offset
+  double x = 0;
+  double y = 0;
+};
+
+// NOTE: events are written to input recordings as is
+static_assert(std::is_trivially_copyable_v<InputEvent> && sizeof(InputEvent) == 24);
@@ -0,0 +1,76 @@
+#include "InputRecording.hpp"
+
+#include <array>
+#include <cstdint>
+
+#include <spdlog/spdlog.h>
+
+
+static constexpr std::array<char, 4> MAGIC{'G', 'C', 'I', 'R'};
+static constexpr std::uint32_t VERSION = 1;
+
+template <class T>
+static void write_value(std::ofstream& file, const T& value)
+{
+  file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <class T>
+static bool read_value(std::ifstream& file, T& value)
+{
+  return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+InputRecorder::InputRecorder(const std::filesystem::path& path)
+  : file{path, std::ios::binary | std::ios::trunc}
+{
+  if (!file)
+  {
+    spdlog::error("Input recording: unable to open '{}' for writing", path.string());
+    file.close();
+    return;
+  }
+
+  write_value(file, MAGIC);
+  write_value(file, VERSION);
+}
+
+void InputRecorder::writeFrame(double time, std::span<const InputEvent> events)
+{
+  write_value(file, time);
+  write_value(file, static_cast<std::uint32_t>(events.size()));
+  file.write(reinterpret_cast<const char*>(events.data()), events.size_bytes());
+}
+
+InputReplayer::InputReplayer(const std::filesystem::path& path)
+  : file{path, std::ios::binary}
+{
+  std::array<char, 4> magic{};
+  std::uint32_t version = 0;
+  if (!file || !read_value(file, magic) || !read_value(file, version) || magic != MAGIC
+      || version != VERSION)
+  {
+    spdlog::error(
+      "Input recording: '{}' is not a valid version {} recording", path.string(), VERSION);
+    file.close();
+  }
+}
+
+bool InputReplayer::readFrame(double& time, std::vector<InputEvent>& events)
+{
+  std::uint32_t count = 0;
+  if (!read_value(file, time) || !read_value(file, count))
+    return false;
+
+  const std::size_t first = events.size();
+  events.resize(first + count);
+  if (!file.read(reinterpret_cast<char*>(events.data() + first), count * sizeof(InputEvent)))
+  {
+    spdlog::warn("Input recording: the last frame is truncated");
+    events.resize(first);
+    return false;
+  }
+
+  ++framesRead;
+  return true;
+}
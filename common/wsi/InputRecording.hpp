@@ -0,0 +1,46 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <vector>
+
+#include "wsi/InputEvent.hpp"
+
+
+// Input recordings are a header followed by a record per polled frame: the frame
+// time (f64), the amount of events (u32) and the events themselves, stored as is.
+// NOTE: numbers are stored in native byte order, so recordings can't be moved
+// between little- and big-endian machines, which is not something we care about.
+
+class InputRecorder
+{
+public:
+  // Check isOpen afterwards
+  explicit InputRecorder(const std::filesystem::path& path);
+
+  bool isOpen() const { return file.is_open(); }
+
+  void writeFrame(double time, std::span<const InputEvent> events);
+
+private:
+  std::ofstream file;
+};
+
+class InputReplayer
+{
+public:
+  // Check isOpen afterwards
+  explicit InputReplayer(const std::filesystem::path& path);
+
+  bool isOpen() const { return file.is_open(); }
+
+  // Returns false once the recording is over
+  bool readFrame(double& time, std::vector<InputEvent>& events);
+
+  std::size_t getFramesRead() const { return framesRead; }
+
+private:
+  std::ifstream file;
+  std::size_t framesRead = 0;
+};
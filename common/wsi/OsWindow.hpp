@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 #include <etna/Vulkan.hpp>
 #include <function2/function2.hpp>
 
@@ -75,4 +78,14 @@ private:
   OsWindowResizeCb onResize;
   OsWindowRefreshCb onRefresh;
   bool mouseWasCaptured = false;
+
+  std::uint8_t id = 0;
+  glm::dvec2 lastCursorPos = {0, 0};
+  bool cursorPosValid = false;
+
+  // Buttons which are Rising or Falling, they move on to High or Low on the next poll
+  std::vector<KeyboardKey> changedKeys;
+  std::vector<MouseButton> changedButtons;
+  // Keys and mouse buttons which are held down, nothing is idle while there are any
+  std::uint32_t heldButtons = 0;
 };
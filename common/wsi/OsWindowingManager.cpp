@@ -1,5 +1,8 @@
 #include "OsWindowingManager.hpp"
 
+#include <algorithm>
+#include <optional>
+
 #include <GLFW/glfw3.h>
 #include <etna/Assert.hpp>
 
@@ -8,15 +11,89 @@
 
 static OsWindowingManager* instance = nullptr;
 
+static std::optional<KeyboardKey> keyboard_key_from_glfw(int glfw_key)
+{
+  switch (glfw_key)
+  {
+#define X(key, glfwKey)                                                                            \
+  case glfwKey:                                                                                    \
+    return KeyboardKey::key;
+    ALL_KEYBOARD_KEYS
+#undef X
+  default:
+    return std::nullopt;
+  }
+}
+
+static std::optional<MouseButton> mouse_button_from_glfw(int glfw_mb)
+{
+  switch (glfw_mb)
+  {
+#define X(mb, glfwMb)                                                                              \
+  case glfwMb:                                                                                     \
+    return MouseButton::mb;
+    ALL_MOUSE_BUTTONS
+#undef X
+  default:
+    return std::nullopt;
+  }
+}
+
 void OsWindowingManager::onErrorCb(int /*errc*/, const char* message)
 {
   spdlog::error("GLFW: {}", message);
 }
 
-void OsWindowingManager::onMouseScrollCb(GLFWwindow* window, double xoffset, double yoffset)
+void OsWindowingManager::queueEvent(GLFWwindow* window, InputEvent event)
 {
+  // NOTE: real input is ignored during replays, it must not interfere with the recorded one
+  if (instance->replayer != nullptr)
+    return;
+
   if (auto it = instance->windows.find(window); it != instance->windows.end())
-    it->second->mouse.scrollDelta = {xoffset, yoffset};
+  {
+    event.window = it->second->id;
+    instance->newEvents.push_back(event);
+  }
+}
+
+void OsWindowingManager::onKeyCb(
+  GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/)
+{
+  // Repeats are of no use, we report held buttons anyways
+  if (action == GLFW_REPEAT)
+    return;
+
+  if (auto kbKey = keyboard_key_from_glfw(key))
+    queueEvent(
+      window,
+      InputEvent{
+        .type = InputEvent::Type::Key,
+        .pressed = action == GLFW_PRESS,
+        .code = static_cast<std::uint32_t>(*kbKey),
+      });
+}
+
+void OsWindowingManager::onMouseButtonCb(GLFWwindow* window, int button, int action, int /*mods*/)
+{
+  if (auto mb = mouse_button_from_glfw(button))
+    queueEvent(
+      window,
+      InputEvent{
+        .type = InputEvent::Type::MouseButton,
+        .pressed = action == GLFW_PRESS,
+        .code = static_cast<std::uint32_t>(*mb),
+      });
+}
+
+void OsWindowingManager::onCursorPosCb(GLFWwindow* window, double x, double y)
+{
+  queueEvent(window, InputEvent{.type = InputEvent::Type::CursorPos, .x = x, .y = y});
+}
+
+void OsWindowingManager::onMouseScrollCb(GLFWwindow* window, double xoffset, double yoffset)
+{
+  queueEvent(window, InputEvent{.type = InputEvent::Type::Scroll, .x = xoffset, .y = yoffset});
 }
 
 void OsWindowingManager::onWindowClosedCb(GLFWwindow* window)
@@ -26,6 +103,7 @@ void OsWindowingManager::onWindowClosedCb(GLFWwindow* window)
 
 void OsWindowingManager::onWindowRefreshCb(GLFWwindow* window)
 {
+  instance->windowsChanged = true;
   if (auto it = instance->windows.find(window); it != instance->windows.end())
     if (it->second->onRefresh)
       it->second->onRefresh();
@@ -33,6 +111,7 @@ void OsWindowingManager::onWindowRefreshCb(GLFWwindow* window)
 
 void OsWindowingManager::onWindowSizeCb(GLFWwindow* window, int width, int height)
 {
+  instance->windowsChanged = true;
   if (auto it = instance->windows.find(window); it != instance->windows.end())
     if (it->second->onResize)
       it->second->onResize({static_cast<glm::uint>(width), static_cast<glm::uint>(height)});
@@ -45,6 +124,8 @@ OsWindowingManager::OsWindowingManager()
   glfwSetErrorCallback(&OsWindowingManager::onErrorCb);
 
   ETNA_VERIFY(std::exchange(instance, this) == nullptr);
+
+  pollTime = glfwGetTime();
 }
 
 OsWindowingManager::~OsWindowingManager()
@@ -58,18 +139,109 @@ void OsWindowingManager::poll()
 {
   ZoneScoped;
 
+  pollEvents(false, 0);
+}
+
+void OsWindowingManager::pollOrIdle(bool animating, double max_idle_seconds)
+{
+  ZoneScoped;
+
+  bool heldButtons = false;
+  for (auto [_, window] : windows)
+    heldButtons = heldButtons || window->heldButtons > 0;
+
+  // NOTE: a pending redraw request is consumed here, while one that comes in during the
+  // sleep wakes it up through an empty event and is consumed on the next call.
+  const bool redraw = redrawRequested.exchange(false);
+
+  const bool wait = !animating && !redraw && !heldButtons && busyPollsLeft == 0
+    && deferredEvents.empty() && replayer == nullptr;
+
+  pollEvents(wait, max_idle_seconds);
+}
+
+void OsWindowingManager::requestRedraw()
+{
+  redrawRequested = true;
+  glfwPostEmptyEvent();
+}
+
+void OsWindowingManager::pollEvents(bool wait, double timeout)
+{
   for (auto [_, window] : windows)
-    window->mouse.scrollDelta = {0, 0};
+    beginWindowFrame(*window);
+
+  idle = wait;
+  windowsChanged = false;
+  if (wait)
+  {
+    ZoneScopedN("Idle");
+    glfwWaitEventsTimeout(timeout);
+  }
+  else
+    glfwPollEvents();
+
+  pollTime = glfwGetTime();
+
+  if (replayer != nullptr)
+  {
+    double replayTime = 0;
+    if (replayer->readFrame(replayTime, newEvents))
+      pollTime = replayTime;
+    else
+    {
+      spdlog::info("Input replay is over after {} frames", replayer->getFramesRead());
+      replayer.reset();
+    }
+  }
+
+  if (recorder != nullptr)
+    recorder->writeFrame(pollTime, newEvents);
+
+  // Events that didn't fit into the previous poll happened before the new ones
+  std::vector<InputEvent> events = std::move(deferredEvents);
+  deferredEvents.clear();
+  events.insert(events.end(), newEvents.begin(), newEvents.end());
+  newEvents.clear();
 
-  glfwPollEvents();
+  for (const auto& event : events)
+    if (!applyEvent(event))
+      deferredEvents.push_back(event);
+
+  if (!events.empty() || windowsChanged)
+    busyPollsLeft = BUSY_POLLS_AFTER_ACTIVITY;
+  else if (busyPollsLeft > 0)
+    --busyPollsLeft;
 
   for (auto [_, window] : windows)
-    updateWindow(*window);
+    endWindowFrame(*window);
 }
 
 double OsWindowingManager::getTime()
 {
-  return glfwGetTime();
+  return recorder != nullptr || replayer != nullptr ? pollTime : glfwGetTime();
+}
+
+bool OsWindowingManager::startRecording(const std::filesystem::path& path)
+{
+  auto newRecorder = std::make_unique<InputRecorder>(path);
+  if (!newRecorder->isOpen())
+    return false;
+
+  recorder = std::move(newRecorder);
+  spdlog::info("Recording input into '{}'", path.string());
+  return true;
+}
+
+bool OsWindowingManager::startReplay(const std::filesystem::path& path)
+{
+  auto newReplayer = std::make_unique<InputReplayer>(path);
+  if (!newReplayer->isOpen())
+    return false;
+
+  replayer = std::move(newReplayer);
+  spdlog::info("Replaying input from '{}'", path.string());
+  return true;
 }
 
 std::unique_ptr<OsWindow> OsWindowingManager::createWindow(OsWindow::CreateInfo info)
@@ -84,6 +256,9 @@ std::unique_ptr<OsWindow> OsWindowingManager::createWindow(OsWindow::CreateInfo
     nullptr,
     nullptr);
 
+  glfwSetKeyCallback(glfwWindow, &onKeyCb);
+  glfwSetMouseButtonCallback(glfwWindow, &onMouseButtonCb);
+  glfwSetCursorPosCallback(glfwWindow, &onCursorPosCb);
   glfwSetScrollCallback(glfwWindow, &onMouseScrollCb);
   glfwSetWindowCloseCallback(glfwWindow, &onWindowClosedCb);
   glfwSetWindowRefreshCallback(glfwWindow, &onWindowRefreshCb);
@@ -94,6 +269,7 @@ std::unique_ptr<OsWindow> OsWindowingManager::createWindow(OsWindow::CreateInfo
   result->impl = glfwWindow;
   result->onRefresh = std::move(info.refreshCb);
   result->onResize = std::move(info.resizeCb);
+  result->id = nextWindowId++;
 
   windows.emplace(glfwWindow, result.get());
   return result;
@@ -112,79 +288,108 @@ void OsWindowingManager::onWindowDestroyed(GLFWwindow* impl)
   glfwDestroyWindow(impl);
 }
 
-void OsWindowingManager::updateWindow(OsWindow& window)
+void OsWindowingManager::beginWindowFrame(OsWindow& window)
 {
-  auto transitionState = [](ButtonState& state, bool glfw_state) {
-    switch (state)
-    {
-    case ButtonState::Low:
-      if (glfw_state)
-        state = ButtonState::Rising;
-      break;
-    case ButtonState::Rising:
-      state = ButtonState::High;
-      break;
-    case ButtonState::High:
-      if (!glfw_state)
-        state = ButtonState::Falling;
-      break;
-    case ButtonState::Falling:
-      state = ButtonState::Low;
-      break;
-    default:
-      break;
-    }
-  };
+  for (KeyboardKey key : window.changedKeys)
+  {
+    auto& state = window.keyboard.keys[static_cast<std::size_t>(key)];
+    state = state == ButtonState::Rising ? ButtonState::High : ButtonState::Low;
+  }
+  window.changedKeys.clear();
 
-  auto processMb = [&window, &transitionState](MouseButton mb, int glfw_mb) {
-    const bool pressed = glfwGetMouseButton(window.impl, glfw_mb) == GLFW_PRESS;
-    transitionState(window.mouse.buttons[static_cast<std::size_t>(mb)], pressed);
-  };
+  for (MouseButton mb : window.changedButtons)
+  {
+    auto& state = window.mouse.buttons[static_cast<std::size_t>(mb)];
+    state = state == ButtonState::Rising ? ButtonState::High : ButtonState::Low;
+  }
+  window.changedButtons.clear();
 
-#define X(mb, glfwMb) processMb(MouseButton::mb, glfwMb);
-  ALL_MOUSE_BUTTONS
-#undef X
+  window.mouse.scrollDelta = {0, 0};
+  window.mouse.capturedPosDelta = {0, 0};
 
-  auto processKey = [&window, &transitionState](KeyboardKey key, int glfw_key) {
-    const bool pressed = glfwGetKey(window.impl, glfw_key) == GLFW_PRESS;
-    transitionState(window.keyboard.keys[static_cast<std::size_t>(key)], pressed);
-  };
+  if (window.captureMouse != window.mouseWasCaptured)
+  {
+    glfwSetInputMode(
+      window.impl, GLFW_CURSOR, window.captureMouse ? GLFW_CURSOR_DISABLED : GLFW_CURSOR_NORMAL);
+    window.mouseWasCaptured = window.captureMouse;
 
-#define X(mb, glfwMb) processKey(KeyboardKey::mb, glfwMb);
-  ALL_KEYBOARD_KEYS
-#undef X
+    // Switching modes makes the cursor jump, so the next position is only used as a
+    // reference, otherwise the camera would "jitter" due to a big offset.
+    window.cursorPosValid = false;
+  }
+}
 
+void OsWindowingManager::endWindowFrame(OsWindow& window)
+{
   if (window.captureMouse)
-  {
-    // Skip first frame on which mouse was captured so as not to
-    // "jitter" the camera due to big offset from 0,0
-    if (window.mouseWasCaptured)
-    {
-      double x;
-      double y;
-      glfwGetCursorPos(window.impl, &x, &y);
-      glfwSetCursorPos(window.impl, 0, 0);
+    window.mouse.freePos = {0, 0};
+}
 
-      window.mouse.capturedPosDelta = {x, y};
+bool OsWindowingManager::applyEvent(const InputEvent& event)
+{
+  auto it = std::find_if(windows.begin(), windows.end(), [&event](const auto& pair) {
+    return pair.second->id == event.window;
+  });
+  if (it == windows.end())
+    return true;
+  OsWindow& window = *it->second;
+
+  // A button may only change once per poll, otherwise quick taps would get lost
+  auto applyButton = [&event, &window](ButtonState& state, auto& changed, auto button) {
+    if (state == ButtonState::Rising || state == ButtonState::Falling)
+      return false;
+
+    if (event.pressed && state == ButtonState::Low)
+    {
+      state = ButtonState::Rising;
+      ++window.heldButtons;
     }
-    else
+    else if (!event.pressed && state == ButtonState::High)
     {
-      glfwSetInputMode(window.impl, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-      glfwSetCursorPos(window.impl, 0, 0);
-      window.mouseWasCaptured = true;
+      state = ButtonState::Falling;
+      --window.heldButtons;
     }
+    else
+      return true;
 
-    window.mouse.freePos = {0, 0};
+    changed.push_back(button);
+    return true;
+  };
+
+  switch (event.type)
+  {
+  case InputEvent::Type::Key:
+  {
+    if (event.code >= window.keyboard.keys.size())
+      return true;
+    const auto key = static_cast<KeyboardKey>(event.code);
+    return applyButton(window.keyboard.keys[event.code], window.changedKeys, key);
   }
-  else
+  case InputEvent::Type::MouseButton:
   {
-    glfwSetInputMode(window.impl, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-    window.mouseWasCaptured = false;
-
-    double x;
-    double y;
-    glfwGetCursorPos(window.impl, &x, &y);
-    window.mouse.freePos = {x, y};
-    window.mouse.capturedPosDelta = {0, 0};
+    if (event.code >= window.mouse.buttons.size())
+      return true;
+    const auto mb = static_cast<MouseButton>(event.code);
+    return applyButton(window.mouse.buttons[event.code], window.changedButtons, mb);
   }
+  case InputEvent::Type::CursorPos:
+  {
+    const glm::dvec2 pos{event.x, event.y};
+    if (window.captureMouse)
+    {
+      if (window.cursorPosValid)
+        window.mouse.capturedPosDelta += glm::vec2(pos - window.lastCursorPos);
+    }
+    else
+      window.mouse.freePos = glm::vec2(pos);
+    window.lastCursorPos = pos;
+    window.cursorPosValid = true;
+    return true;
+  }
+  case InputEvent::Type::Scroll:
+    window.mouse.scrollDelta += glm::vec2(event.x, event.y);
+    return true;
+  }
+
+  return true;
 }
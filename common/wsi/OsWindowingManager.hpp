@@ -1,10 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <filesystem>
 #include <memory>
 #include <span>
 #include <unordered_map>
+#include <vector>
 
 #include "wsi/OsWindow.hpp"
+#include "wsi/InputEvent.hpp"
+#include "wsi/InputRecording.hpp"
 
 
 class OsWindowingManager
@@ -22,19 +27,53 @@ public:
   OsWindowingManager& operator=(OsWindowingManager&&) = delete;
 
 
+  // Gathers input events from the OS and applies them to keyboard and mouse states
+  // of windows. Only the buttons that changed are touched.
   void poll();
 
+  // Same as poll, but sleeps until there is input, a window is resized or a redraw
+  // is requested if nothing has been going on lately and `animating` is false, i.e.
+  // the app has nothing time-driven to show. The sleep lasts at most `max_idle_seconds`.
+  // NOTE: never sleeps while replaying input, recordings are replayed as fast as possible.
+  void pollOrIdle(bool animating, double max_idle_seconds = 0.5);
+
+  // Wakes up a sleeping pollOrIdle or makes the next one return right away,
+  // e.g. when some data arrived in the background and has to be shown.
+  // NOTE: unlike everything else here, this may be called from any thread.
+  void requestRedraw();
+
+  // Whether the latest poll has slept because there was nothing to do
+  bool wasIdle() const { return idle; }
+
+  // While recording or replaying input, this is the time of the latest poll,
+  // so that everything that depends on time behaves exactly the same on replay.
   double getTime();
 
+  // Records all input from now on into a file. Returns false if it couldn't be opened.
+  bool startRecording(const std::filesystem::path& path);
+  // Replaces real input with a recording until it is over. Returns false if it
+  // couldn't be opened. Only input of windows is replayed, not ImGui's.
+  bool startReplay(const std::filesystem::path& path);
+  bool isReplaying() const { return replayer != nullptr; }
+
   // Creates a new OS-native window. See OsWindow::CreateInfo.
   std::unique_ptr<OsWindow> createWindow(OsWindow::CreateInfo info);
 
   std::span<const char*> getRequiredVulkanInstanceExtensions();
 
 private:
-  void updateWindow(OsWindow& window);
+  void pollEvents(bool wait, double timeout);
+  void beginWindowFrame(OsWindow& window);
+  void endWindowFrame(OsWindow& window);
+  // Returns false if the event has to wait for the next poll
+  bool applyEvent(const InputEvent& event);
+
+  static void queueEvent(GLFWwindow* window, InputEvent event);
 
   static void onErrorCb(int errc, const char* message);
+  static void onKeyCb(GLFWwindow* window, int key, int scancode, int action, int mods);
+  static void onMouseButtonCb(GLFWwindow* window, int button, int action, int mods);
+  static void onCursorPosCb(GLFWwindow* window, double x, double y);
   static void onMouseScrollCb(GLFWwindow* window, double xoffset, double yoffset);
   static void onWindowClosedCb(GLFWwindow* window);
   static void onWindowRefreshCb(GLFWwindow* window);
@@ -44,4 +83,23 @@ private:
 
 private:
   std::unordered_map<GLFWwindow*, OsWindow*> windows;
+  std::uint8_t nextWindowId = 0;
+
+  // Events reported by the OS during the current poll
+  std::vector<InputEvent> newEvents;
+  // A button can only change once per poll, so further events for it wait here
+  std::vector<InputEvent> deferredEvents;
+
+  std::unique_ptr<InputRecorder> recorder;
+  std::unique_ptr<InputReplayer> replayer;
+  double pollTime = 0;
+
+  // ImGui needs a couple of frames to settle after input, e.g. for hover highlights,
+  // so sleeping is only allowed after this many polls without anything going on.
+  static constexpr std::uint32_t BUSY_POLLS_AFTER_ACTIVITY = 3;
+  std::uint32_t busyPollsLeft = BUSY_POLLS_AFTER_ACTIVITY;
+  // Set by window callbacks which are not input events, e.g. resizes
+  bool windowsChanged = false;
+  std::atomic<bool> redrawRequested = false;
+  bool idle = false;
 };
@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "jobs/JobSystem.hpp"
+
+
+// Compares JobSystem with std::async on lots of tiny independent tasks,
+// which is where spawning a thread per task can't possibly pay off.
+
+static constexpr int REPEATS = 3;
+
+// A few hundred nanoseconds of pure ALU work the compiler can't fold away
+static std::uint64_t tiny_task(std::uint64_t seed, std::uint32_t iterations)
+{
+  std::uint64_t state = seed * 0x9E3779B97F4A7C15ull + 1;
+  for (std::uint32_t i = 0; i < iterations; ++i)
+  {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+  }
+  return state;
+}
+
+template <class F>
+static double best_of(F&& run)
+{
+  double result = std::numeric_limits<double>::max();
+  for (int i = 0; i < REPEATS; ++i)
+  {
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    result = std::min(
+      result, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+  }
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: jobs_benchmark [task count] [iterations per task]
+  const std::size_t taskCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1 << 16;
+  const auto iterations =
+    static_cast<std::uint32_t>(argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 256);
+
+  if (taskCount == 0)
+  {
+    spdlog::error("Usage: jobs_benchmark [task count] [iterations per task]");
+    return 1;
+  }
+
+  JobSystem jobs;
+
+  spdlog::info(
+    "{} tasks of {} iterations each, {} job workers + the main thread",
+    taskCount,
+    iterations,
+    jobs.getWorkerCount());
+
+  std::vector<std::uint64_t> expected(taskCount);
+  std::vector<std::uint64_t> results(taskCount);
+
+  const double serial = best_of([&]() {
+    for (std::size_t i = 0; i < taskCount; ++i)
+      expected[i] = tiny_task(i, iterations);
+  });
+
+  auto report = [&](const char* name, double seconds) {
+    if (results != expected)
+    {
+      spdlog::error("{}: incorrect results!", name);
+      return false;
+    }
+    spdlog::info(
+      "{:<28} {:>10.3f} ms {:>10.1f} ns/task {:>8.2f}x vs serial",
+      name,
+      seconds * 1e3,
+      seconds * 1e9 / static_cast<double>(taskCount),
+      serial / seconds);
+    std::fill(results.begin(), results.end(), 0);
+    return true;
+  };
+
+  spdlog::info(
+    "{:<28} {:>10.3f} ms {:>10.1f} ns/task",
+    "serial",
+    serial * 1e3,
+    serial * 1e9 / static_cast<double>(taskCount));
+
+  const double async = best_of([&]() {
+    std::vector<std::future<void>> futures;
+    futures.reserve(taskCount);
+    for (std::size_t i = 0; i < taskCount; ++i)
+      futures.push_back(std::async(std::launch::async, [&results, i, iterations]() {
+        results[i] = tiny_task(i, iterations);
+      }));
+    for (auto& future : futures)
+      future.wait();
+  });
+  if (!report("std::async, task each", async))
+    return 1;
+
+  const double scheduled = best_of([&]() {
+    std::vector<JobSystem::Handle> handles;
+    handles.reserve(taskCount);
+    for (std::size_t i = 0; i < taskCount; ++i)
+      handles.push_back(jobs.schedule(
+        "Tiny task", [&results, i, iterations]() { results[i] = tiny_task(i, iterations); }));
+    jobs.wait(handles);
+  });
+  if (!report("JobSystem, job each", scheduled))
+    return 1;
+
+  // Every task is split off by a job, so most of them get pushed into worker deques
+  // and spread through stealing rather than through the shared injection queue.
+  const double nested = best_of([&]() {
+    const std::size_t spawnerCount = jobs.getWorkerCount() + 1;
+    std::vector<JobSystem::Handle> spawners;
+    for (std::size_t s = 0; s < spawnerCount; ++s)
+      spawners.push_back(jobs.schedule("Spawner", [&, s]() {
+        std::vector<JobSystem::Handle> handles;
+        for (std::size_t i = s; i < taskCount; i += spawnerCount)
+          handles.push_back(jobs.schedule(
+            "Tiny task", [&results, i, iterations]() { results[i] = tiny_task(i, iterations); }));
+        jobs.wait(handles);
+      }));
+    jobs.wait(spawners);
+  });
+  if (!report("JobSystem, spawned by jobs", nested))
+    return 1;
+
+  for (const std::size_t grain : {1u, 16u, 256u})
+  {
+    const double parallel = best_of([&]() {
+      jobs.parallelFor("Tiny tasks", taskCount, grain, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+          results[i] = tiny_task(i, iterations);
+      });
+    });
+    const std::string name = fmt::format("JobSystem::parallelFor, {}", grain);
+    if (!report(name.c_str(), parallel))
+      return 1;
+  }
+
+  return 0;
+}
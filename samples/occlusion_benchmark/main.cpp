@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <limits>
+#include <numbers>
+#include <vector>
+
+#include <etna/Etna.hpp>
+#include <spdlog/spdlog.h>
+
+#include "jobs/JobSystem.hpp"
+#include "occlusion/OcclusionCuller.hpp"
+#include "scene/Camera.hpp"
+#include "scene/SceneManager.hpp"
+
+
+// Culls a scene with OcclusionCuller from street-level views all around it, on the calling
+// thread and on the job system. The GPU is only needed for SceneManager to load the scene.
+
+static constexpr int REPEATS = 10;
+static constexpr int VIEW_COUNT = 16;
+
+struct ViewResult
+{
+  OcclusionCuller::Stats stats;
+  double totalMs = std::numeric_limits<double>::max();
+};
+
+static ViewResult cull_view(
+  OcclusionCuller& culler,
+  SceneManager& scene,
+  const glm::mat4x4& view_proj,
+  const OcclusionCuller::Settings& settings,
+  JobSystem* jobs)
+{
+  ViewResult result;
+  for (int i = 0; i < REPEATS; ++i)
+  {
+    culler.cull(scene, view_proj, settings, jobs);
+    const auto& stats = culler.getStats();
+    const double totalMs = stats.selectMs + stats.rasterizeMs + stats.testMs;
+    if (totalMs < result.totalMs)
+      result = ViewResult{.stats = stats, .totalMs = totalMs};
+  }
+  return result;
+}
+
+static void run(SceneManager& scene, JobSystem& jobs, const OcclusionCuller::Settings& settings)
+{
+  BoundingBox sceneBounds{
+    .min = glm::vec3(std::numeric_limits<float>::max()),
+    .max = glm::vec3(std::numeric_limits<float>::lowest()),
+  };
+  for (const auto& bounds : scene.getInstanceBounds())
+    if (!glm::any(glm::greaterThan(bounds.min, bounds.max)))
+    {
+      sceneBounds.min = glm::min(sceneBounds.min, bounds.min);
+      sceneBounds.max = glm::max(sceneBounds.max, bounds.max);
+    }
+
+  const glm::vec3 center = (sceneBounds.min + sceneBounds.max) * 0.5f;
+  const glm::vec3 extent = sceneBounds.max - sceneBounds.min;
+  const float orbit = 0.3f * std::max(extent.x, extent.z);
+  const float eyeHeight = sceneBounds.min.y + 0.05f * extent.y;
+
+  Camera camera;
+  camera.zFar = glm::length(extent) * 2.0f;
+  camera.zNear = camera.zFar * 1e-4f;
+
+  OcclusionCuller culler{{320, 184}};
+
+  for (JobSystem* pool : {static_cast<JobSystem*>(nullptr), &jobs})
+  {
+    double selectMs = 0;
+    double rasterizeMs = 0;
+    double testMs = 0;
+    double occluders = 0;
+    double triangles = 0;
+    double culled = 0;
+    std::uint32_t instances = 0;
+
+    // Looking across the scene from its outskirts, where most of it is behind the closest
+    // buildings, like it is from the streets
+    for (int view = 0; view < VIEW_COUNT; ++view)
+    {
+      const float angle = 2.0f * std::numbers::pi_v<float> * static_cast<float>(view) / VIEW_COUNT;
+      const glm::vec3 eye{
+        center.x + orbit * std::cos(angle), eyeHeight, center.z + orbit * std::sin(angle)};
+      camera.lookAt(eye, glm::vec3(center.x, eyeHeight, center.z), glm::vec3(0, 1, 0));
+      const glm::mat4x4 viewProj = camera.projTm(16.0f / 9.0f) * camera.viewTm();
+
+      const auto [stats, totalMs] = cull_view(culler, scene, viewProj, settings, pool);
+      selectMs += stats.selectMs;
+      rasterizeMs += stats.rasterizeMs;
+      testMs += stats.testMs;
+      occluders += stats.occluders;
+      triangles += static_cast<double>(stats.occluderTriangles);
+      culled += static_cast<double>(stats.outside + stats.occluded) /
+        static_cast<double>(std::max(stats.instances, 1u));
+      instances = stats.instances;
+    }
+
+    spdlog::info(
+      "{:<12} select {:>7.3f} ms, rasterize {:>7.3f} ms, test {:>7.3f} ms per view",
+      pool != nullptr ? "job system" : "serial",
+      selectMs / VIEW_COUNT,
+      rasterizeMs / VIEW_COUNT,
+      testMs / VIEW_COUNT);
+    spdlog::info(
+      "{:<12} {:.1f} occluders of {:.0f} triangles, {:.1f}% of {} instances culled per view",
+      "",
+      occluders / VIEW_COUNT,
+      triangles / VIEW_COUNT,
+      culled * 100.0 / VIEW_COUNT,
+      instances);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: occlusion_benchmark [scene] [max occluders]
+  const std::filesystem::path scenePath =
+    argc > 1 ? argv[1] : GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene.gltf";
+  OcclusionCuller::Settings settings;
+  if (argc > 2)
+    settings.maxOccluders = static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10));
+
+  if (settings.maxOccluders == 0)
+  {
+    spdlog::error("Usage: occlusion_benchmark [scene] [max occluders]");
+    return 1;
+  }
+
+  etna::initialize(etna::InitParams{
+    .applicationName = "OcclusionBenchmark",
+    .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+  });
+
+  int result = 0;
+  {
+    SceneManager scene;
+    scene.selectScene(scenePath);
+
+    if (scene.getInstanceBounds().empty())
+    {
+      spdlog::error("Failed to load any instances from {}", scenePath.string());
+      result = 1;
+    }
+    else
+    {
+      JobSystem jobs;
+      spdlog::info(
+        "{}: {} instances, {} views, best of {} runs, {} job workers + the main thread",
+        scenePath.string(),
+        scene.getInstanceBounds().size(),
+        VIEW_COUNT,
+        REPEATS,
+        jobs.getWorkerCount());
+      run(scene, jobs, settings);
+    }
+  }
+
+  etna::shutdown();
+
+  return result;
+}
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <spdlog/spdlog.h>
+
+#include "jobs/JobSystem.hpp"
+#include "occlusion/MaskedOcclusion.hpp"
+
+
+// Checks MaskedOcclusion against a per-pixel depth buffer rasterized from the same random
+// triangles. A box may only be reported as occluded if every pixel it touches is closer
+// than the box in the reference, anything else is a false occlusion and fails the check.
+// Occluded boxes the rasterizer misses are fine, they are reported to show how
+// conservative it is.
+
+static constexpr std::uint32_t WIDTH = 256;
+static constexpr std::uint32_t HEIGHT = 128;
+static constexpr int OCCLUDERS_PER_SCENE = 4;
+static constexpr int TRIANGLES_PER_OCCLUDER = 8;
+static constexpr int BOXES_PER_SCENE = 200;
+
+struct Scene
+{
+  std::vector<glm::vec3> positions;
+  std::vector<std::uint32_t> indices;
+};
+
+// Triangles of a few meters in front of a camera at the origin looking along +z
+static Scene random_scene(std::mt19937& rng)
+{
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  Scene scene;
+  for (int i = 0; i < OCCLUDERS_PER_SCENE * TRIANGLES_PER_OCCLUDER; ++i)
+  {
+    const glm::vec3 center{unit(rng) * 8.0f, unit(rng) * 4.0f, 15.0f + unit(rng) * 10.0f};
+    for (int corner = 0; corner < 3; ++corner)
+    {
+      scene.indices.push_back(static_cast<std::uint32_t>(scene.positions.size()));
+      scene.positions.push_back(
+        center + glm::vec3{unit(rng) * 6.0f, unit(rng) * 6.0f, unit(rng) * 3.0f});
+    }
+  }
+  return scene;
+}
+
+// Closest depth at every pixel center, 1 where nothing is
+static std::vector<float> reference_depth(const Scene& scene, const glm::mat4x4& view_proj)
+{
+  const glm::vec2 size = glm::vec2(WIDTH, HEIGHT);
+  std::vector<float> depth(WIDTH * HEIGHT, 1.0f);
+
+  for (std::size_t i = 0; i + 2 < scene.indices.size(); i += 3)
+  {
+    std::array<glm::vec2, 3> pixel;
+    std::array<float, 3> z;
+    bool inFront = true;
+    for (std::size_t k = 0; k < 3; ++k)
+    {
+      const glm::vec4 clip = view_proj * glm::vec4(scene.positions[scene.indices[i + k]], 1.0f);
+      // The rasterizer skips triangles crossing the near plane, so does the reference
+      inFront = inFront && clip.w > 0.0f && clip.z >= 0.0f;
+      pixel[k] = (glm::vec2(clip) / clip.w * 0.5f + 0.5f) * size;
+      z[k] = clip.z / clip.w;
+    }
+
+    const auto edge = [](glm::vec2 a, glm::vec2 b, glm::vec2 p) {
+      return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+    };
+    const float area = edge(pixel[0], pixel[1], pixel[2]);
+    if (!inFront || area == 0.0f)
+      continue;
+
+    for (std::uint32_t y = 0; y < HEIGHT; ++y)
+      for (std::uint32_t x = 0; x < WIDTH; ++x)
+      {
+        const glm::vec2 center{static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f};
+        const glm::vec3 weights =
+          glm::vec3{
+            edge(pixel[1], pixel[2], center),
+            edge(pixel[2], pixel[0], center),
+            edge(pixel[0], pixel[1], center)}
+          / area;
+        if (weights.x < 0.0f || weights.y < 0.0f || weights.z < 0.0f)
+          continue;
+        float& texel = depth[y * WIDTH + x];
+        texel = std::min(texel, weights.x * z[0] + weights.y * z[1] + weights.z * z[2]);
+      }
+  }
+
+  return depth;
+}
+
+// Whether every pixel touched by the screen-space bounds of the box is closer than the box
+static bool reference_occluded(
+  std::span<const float> depth, glm::vec3 min, glm::vec3 max, const glm::mat4x4& view_proj)
+{
+  glm::vec3 ndcMin{1e30f};
+  glm::vec3 ndcMax{-1e30f};
+  for (int corner = 0; corner < 8; ++corner)
+  {
+    const glm::vec3 point{
+      corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z};
+    const glm::vec4 clip = view_proj * glm::vec4(point, 1.0f);
+    if (clip.w <= 0.0f)
+      return false;
+    ndcMin = glm::min(ndcMin, glm::vec3(clip) / clip.w);
+    ndcMax = glm::max(ndcMax, glm::vec3(clip) / clip.w);
+  }
+
+  const glm::vec2 size = glm::vec2(WIDTH, HEIGHT);
+  const auto toPixel = [&size](float ndc, int axis) {
+    const float pixel = std::floor((ndc * 0.5f + 0.5f) * size[axis]);
+    return static_cast<int>(std::clamp(pixel, 0.0f, size[axis] - 1.0f));
+  };
+  for (int y = toPixel(ndcMin.y, 1); y <= toPixel(ndcMax.y, 1); ++y)
+    for (int x = toPixel(ndcMin.x, 0); x <= toPixel(ndcMax.x, 0); ++x)
+      if (!(depth[y * WIDTH + x] < ndcMin.z))
+        return false;
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  // Usage: occlusion_reference_check [scene count] [seed]
+  const int sceneCount = argc > 1 ? std::atoi(argv[1]) : 200;
+  const auto seed =
+    argc > 2 ? static_cast<std::uint32_t>(std::strtoul(argv[2], nullptr, 10)) : std::uint32_t{1};
+
+  if (sceneCount <= 0)
+  {
+    spdlog::error("Usage: occlusion_reference_check [scene count] [seed]");
+    return 1;
+  }
+
+  std::mt19937 rng{seed};
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  const glm::mat4x4 viewProj = glm::perspectiveLH_ZO(
+    1.0f, static_cast<float>(WIDTH) / HEIGHT, 0.1f, 100.0f);
+
+  JobSystem jobs;
+  MaskedOcclusion occlusion{{WIDTH, HEIGHT}};
+
+  std::uint64_t boxes = 0;
+  std::uint64_t occluded = 0;
+  std::uint64_t referenceOccluded = 0;
+  std::uint64_t falseOcclusions = 0;
+
+  for (int i = 0; i < sceneCount; ++i)
+  {
+    const Scene scene = random_scene(rng);
+
+    // Several occluders, so that layers of tiles get merged, rasterized on both paths
+    occlusion.clear();
+    const std::size_t indicesPerOccluder = 3 * TRIANGLES_PER_OCCLUDER;
+    for (std::size_t first = 0; first < scene.indices.size(); first += indicesPerOccluder)
+      occlusion.addOccluder(
+        scene.positions,
+        std::span(scene.indices).subspan(first, indicesPerOccluder),
+        viewProj);
+    occlusion.rasterize(i % 2 == 0 ? nullptr : &jobs);
+
+    const auto depth = reference_depth(scene, viewProj);
+
+    for (int box = 0; box < BOXES_PER_SCENE; ++box)
+    {
+      const glm::vec3 center{unit(rng) * 10.0f, unit(rng) * 5.0f, 25.0f + unit(rng) * 20.0f};
+      const glm::vec3 extent =
+        glm::abs(glm::vec3{unit(rng) * 1.5f, unit(rng) * 1.5f, unit(rng)});
+      const glm::vec3 min = center - extent;
+      const glm::vec3 max = center + extent;
+
+      const bool isOccluded =
+        occlusion.testBox(min, max, viewProj) == OcclusionResult::OCCLUDED;
+      const bool shouldBeOccluded = reference_occluded(depth, min, max, viewProj);
+
+      ++boxes;
+      occluded += isOccluded ? 1 : 0;
+      referenceOccluded += shouldBeOccluded ? 1 : 0;
+      if (isOccluded && !shouldBeOccluded)
+      {
+        ++falseOcclusions;
+        spdlog::error(
+          "Scene {}: box ({}, {}, {}) - ({}, {}, {}) is visible, but was reported occluded",
+          i,
+          min.x,
+          min.y,
+          min.z,
+          max.x,
+          max.y,
+          max.z);
+      }
+    }
+  }
+
+  spdlog::info(
+    "{} scenes, {} boxes: {} occluded of {} occluded in the reference, {} false occlusions",
+    sceneCount,
+    boxes,
+    occluded,
+    referenceOccluded,
+    falseOcclusions);
+
+  return falseOcclusions == 0 ? 0 : 1;
+}
@@ -1,5 +1,6 @@
 #include "App.hpp"
 
+#include <spdlog/spdlog.h>
 #include <tracy/Tracy.hpp>
 
 #include "gui/ImGuiRenderer.hpp"
@@ -19,22 +20,22 @@ App::App()
       },
     .resizeCb =
       [this](glm::uvec2 res) {
-        if (res.x == 0 || res.y == 0)
-          return;
-
-        renderer->recreateSwapchain(res);
+        // NOTE: the swapchain is recreated by the render thread once it gets a packet
+        // with the new resolution.
+        windowResolution = res;
       },
   });
+  windowResolution = initialRes;
 
   renderer.reset(new Renderer(initialRes));
+  renderer->setRedrawRequestCallback([this]() { windowing.requestRedraw(); });
 
   auto instExts = windowing.getRequiredVulkanInstanceExtensions();
   renderer->initVulkan(instExts);
 
   auto surface = mainWindow->createVkSurface(etna::get_context().getInstance());
 
-  renderer->initFrameDelivery(
-    std::move(surface), [window = mainWindow.get()]() { return window->getResolution(); });
+  renderer->initFrameDelivery(std::move(surface));
 
   // TODO: this is bad design, this initialization is dependent on the current ImGui context, but we
   // pass it implicitly here instead of explicitly. Beware if trying to do something tricky.
@@ -46,21 +47,54 @@ App::App()
   renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
 }
 
+bool App::recordInput(const std::filesystem::path& path)
+{
+  return windowing.startRecording(path);
+}
+
+bool App::replayInput(const std::filesystem::path& path)
+{
+  replayStart = std::chrono::steady_clock::now();
+  return windowing.startReplay(path);
+}
+
 void App::run()
 {
+  const bool replaying = windowing.isReplaying();
+  std::size_t frameCount = 0;
+
   double lastTime = windowing.getTime();
   while (!mainWindow->isBeingClosed())
   {
+    // NOTE: time is taken after polling, as during input recording
+    // and replay it is the time of the latest poll.
+    // If nothing changes on the screen without input, we sleep until there is some,
+    // so that a viewer left open doesn't keep the CPU and GPU busy.
+    windowing.pollOrIdle(renderer->hasTimeDrivenContent(renderSettings));
+    if (windowing.wasIdle())
+      renderer->resumeAfterIdle();
+
     const double currTime = windowing.getTime();
     const float diffTime = static_cast<float>(currTime - lastTime);
     lastTime = currTime;
 
-    windowing.poll();
+    if (replaying && !windowing.isReplaying())
+    {
+      const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+      spdlog::info(
+        "Replayed {} frames in {:.3f} s, {:.3f} ms per frame on average",
+        frameCount,
+        seconds,
+        frameCount > 0 ? seconds * 1e3 / static_cast<double>(frameCount) : 0.0);
+      break;
+    }
 
     processInput(diffTime);
 
     drawFrame();
 
+    ++frameCount;
     FrameMark;
   }
 }
@@ -89,19 +123,24 @@ void App::processInput(float dt)
   if (mainWindow->captureMouse)
     rotateCam(camToControl, mainWindow->mouse, dt);
 
-  renderer->debugInput(mainWindow->keyboard);
+  renderer->debugInput(mainWindow->keyboard, renderSettings);
 }
 
 void App::drawFrame()
 {
   ZoneScoped;
 
-  renderer->update(FramePacket{
+  // The GUI goes first, as it may change the settings
+  auto gui = renderer->drawGui(renderSettings);
+
+  renderer->submitFrame(FramePacket{
     .mainCam = mainCam,
     .shadowCam = shadowCam,
     .currentTime = static_cast<float>(windowing.getTime()),
+    .resolution = windowResolution,
+    .settings = renderSettings,
+    .gui = std::move(gui),
   });
-  renderer->drawFrame();
 }
 
 void App::moveCam(Camera& cam, const Keyboard& kb, float dt)
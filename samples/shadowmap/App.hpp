@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <filesystem>
+
 #include "wsi/OsWindowingManager.hpp"
 #include "scene/Camera.hpp"
 
@@ -9,12 +12,20 @@
 /**
  * Main class of the application. Contains things that are not strictly
  * related to rendering, e.g. OS window creation, input handling.
+ *
+ * NOTE: all of this runs on the main thread, which only builds frame packets,
+ * rendering them happens on the render thread owned by the Renderer.
  */
 class App
 {
 public:
   App();
 
+  // Input of the session can be recorded into a file and replayed later on, to reproduce
+  // exactly the same frames for performance comparisons. The app quits once a replay is over.
+  bool recordInput(const std::filesystem::path& path);
+  bool replayInput(const std::filesystem::path& path);
+
   void run();
 
 private:
@@ -27,6 +38,7 @@ private:
 private:
   OsWindowingManager windowing;
   std::unique_ptr<OsWindow> mainWindow;
+  glm::uvec2 windowResolution;
 
   float camMoveSpeed = 1;
   float camRotateSpeed = 0.1f;
@@ -36,5 +48,9 @@ private:
 
   bool controlShadowCam = false;
 
+  RenderSettings renderSettings;
+
   std::unique_ptr<Renderer> renderer;
+
+  std::chrono::steady_clock::time_point replayStart;
 };
@@ -1,15 +1,55 @@
 #pragma once
 
+#include <glm/glm.hpp>
 #include <scene/Camera.hpp>
+#include <gui/CachedGuiLayer.hpp>
 
 
+/**
+ * Settings changed through the GUI and debug keys. They are owned by the main thread,
+ * the renderer only ever sees the copies which come with frame packets.
+ */
+struct RenderSettings
+{
+  glm::vec3 baseColor = {0.9f, 0.92f, 1.0f};
+  bool drawDebugFSQuad = false;
+  bool perspectiveShadowMap = false;
+  bool softShadows = false;
+  // Lays down depth first, so that the forward pass only shades visible fragments
+  bool depthPrepass = false;
+  // Two-phase Hi-Z occlusion culling of the main view on the GPU
+  bool occlusionCulling = false;
+  // Occluder-based culling of the main view and the shadow map on the CPU
+  bool cpuOcclusionCulling = false;
+  int maxCpuOccluders = 16;
+  // VRAM for scene textures, the streamer drops mips which aren't needed to stay within it
+  int textureBudgetMb = 256;
+  // Lights and particles change over time, with this off the app may idle
+  bool animate = true;
+
+  int particleSubsteps = 16;
+  // Off by default: etna only gives us the main queue, so the separate submit can't overlap
+  // with rendering and merely costs an extra compute and join submit every frame
+  bool asyncParticles = false;
+};
+
 /**
  * Contains data sent from the gameplay/logic part of the application
  * to the renderer on every frame.
+ *
+ * NOTE: packets are built on the main thread and rendered on the render thread
+ * while the main thread is already busy with the next one, so a packet must
+ * be self-contained and is never changed after it has been handed over.
  */
 struct FramePacket
 {
   Camera mainCam;
   Camera shadowCam;
   float currentTime = 0;
+
+  // Size of the window, might be 0,0 if it is minimized
+  glm::uvec2 resolution = {0, 0};
+
+  RenderSettings settings;
+  CachedGuiLayer::Frame gui;
 };
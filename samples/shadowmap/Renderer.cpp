@@ -5,13 +5,28 @@
 #include <etna/RenderTargetStates.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
+
+#include <gui/CachedGuiLayer.hpp>
+#include <render_utils/AsyncCompute.hpp>
 #include <imgui.h>
+#include <tracy/Tracy.hpp>
+
 
-#include <gui/ImGuiRenderer.hpp>
+// Exponential moving average over roughly the last 20 frames
+static void smooth(double& value, double sample)
+{
+  value += (sample - value) * 0.05;
+}
 
+static double ms_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+    .count();
+}
 
 Renderer::Renderer(glm::uvec2 res)
   : resolution{res}
+  , windowResolution{res}
 {
 }
 
@@ -26,12 +41,28 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
 
   deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+  // Materials index the array of all scene textures with indices that vary between draws
+  // of a single multi-draw call
+  vk::PhysicalDeviceVulkan12Features vulkan12Features{
+    .shaderSampledImageArrayNonUniformIndexing = vk::True,
+  };
+
   etna::initialize(etna::InitParams{
     .applicationName = "ShadowmapSample",
     .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
     .instanceExtensions = instanceExtensions,
     .deviceExtensions = deviceExtensions,
-    .features = vk::PhysicalDeviceFeatures2{.features = {}},
+    // Occlusion culling draws the scene with a single indirect call per phase
+    .features = vk::PhysicalDeviceFeatures2{
+      .pNext = &vulkan12Features,
+      .features =
+        {
+          .multiDrawIndirect = vk::True,
+          .drawIndirectFirstInstance = vk::True,
+          // Baked scene textures are block-compressed
+          .textureCompressionBC = vk::True,
+        },
+    },
     // Replace with an index if etna detects your preferred GPU incorrectly
     .physicalDeviceIndexOverride = {},
     // How much frames we buffer on the GPU without waiting for their completion on the CPU
@@ -39,11 +70,10 @@ void Renderer::initVulkan(std::span<const char*> instance_extensions)
   });
 }
 
-void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvider res_provider)
+void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface)
 {
   auto& ctx = etna::get_context();
 
-  resolutionProvider = std::move(res_provider);
   commandManager = ctx.createPerFrameCmdMgr();
 
   window = ctx.createWindow(etna::Window::CreateInfo{
@@ -56,19 +86,37 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
   });
   resolution = {w, h};
 
+  asyncCompute = std::make_unique<AsyncCompute>(
+    static_cast<std::uint32_t>(ctx.getMainWorkCount().multiBufferingCount()));
+
   worldRenderer = std::make_unique<WorldRenderer>();
+  worldRenderer->setAsyncComputeQueueInfo(asyncCompute->isAsync());
 
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
   worldRenderer->setupPipelines(window->getCurrentFormat());
 
-  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
+  shaderReloader = std::make_unique<ShaderHotReloader>(ShaderHotReloader::CreateInfo{
+    .manifest = SHADOWMAP_SHADERS_ROOT "hot_reload.txt",
+    .onUpdate =
+      [this]() {
+        if (redrawRequestCb)
+          redrawRequestCb();
+      },
+  });
+
+  guiLayer = std::make_unique<CachedGuiLayer>(CachedGuiLayer::CreateInfo{
+    .format = window->getCurrentFormat(),
+    .resolution = resolution,
+  });
 }
 
 void Renderer::recreateSwapchain(glm::uvec2 res)
 {
   auto& ctx = etna::get_context();
 
+  windowResolution = res;
+
   ETNA_CHECK_VK_RESULT(ctx.getDevice().waitIdle());
 
   auto [w, h] = window->recreateSwapchain(etna::Window::DesiredProperties{
@@ -82,6 +130,8 @@ void Renderer::recreateSwapchain(glm::uvec2 res)
 
   // Format of the swapchain CAN change on android
   worldRenderer->setupPipelines(window->getCurrentFormat());
+
+  guiLayer->resize(resolution);
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -89,48 +139,147 @@ void Renderer::loadScene(std::filesystem::path path)
   worldRenderer->loadScene(path);
 }
 
-void Renderer::debugInput(const Keyboard& kb)
+void Renderer::debugInput(const Keyboard& kb, RenderSettings& settings)
 {
-  worldRenderer->debugInput(kb);
+  worldRenderer->debugInput(kb, settings);
+
+  if (kb[KeyboardKey::kF1] == ButtonState::Falling)
+    guiLayer->setHidden(!guiLayer->isHidden());
 
   if (kb[KeyboardKey::kB] == ButtonState::Falling)
+    shaderReloader->rebuildAll();
+}
+
+CachedGuiLayer::Frame Renderer::drawGui(RenderSettings& settings)
+{
+  if (!guiLayer->beginFrame())
+    return {};
+
+  ZoneScopedN("drawGui");
+  worldRenderer->drawGui(settings);
+  drawPipelineGui();
+  return guiLayer->endFrame();
+}
+
+bool Renderer::hasTimeDrivenContent(const RenderSettings& settings) const
+{
+  return WorldRenderer::hasTimeDrivenContent(settings);
+}
+
+void Renderer::drawPipelineGui()
+{
+  // NOTE: the GUI is only re-rendered when it changes, so these are refreshed periodically
+  if (ImGui::GetTime() - shownTimingsTime > 0.5)
   {
-    const int retval = std::system("cd " GRAPHICS_COURSE_ROOT "/build"
-                                   " && cmake --build . --target shadowmap_shaders");
-    if (retval != 0)
-      spdlog::warn("Shader recompilation returned a non-zero return code!");
-    else
-    {
-      ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
-      etna::reload_shaders();
-      spdlog::info("Successfully reloaded shaders!");
-    }
+    shownTimings = mainTimings;
+    shownTimings.renderBusyMs = renderBusyMs.load();
+    shownTimingsTime = ImGui::GetTime();
+  }
+
+  // NOTE: this appends to the window of the world renderer
+  ImGui::Begin("Simple render settings");
+  if (ImGui::CollapsingHeader("Frame pipeline", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Text("Main thread: %.3f ms busy", shownTimings.mainBusyMs);
+    ImGui::Text("Main thread: %.3f ms waiting for rendering", shownTimings.mainWaitMs);
+    ImGui::Text("Render thread: %.3f ms busy", shownTimings.renderBusyMs);
   }
+  ImGui::End();
 }
 
-void Renderer::update(const FramePacket& packet)
+void Renderer::submitFrame(FramePacket frame_packet)
 {
-  worldRenderer->update(packet);
+  ZoneScoped;
+
+  if (!renderThread.joinable())
+    renderThread = std::thread([this]() { renderLoop(); });
+
+  const auto waitStart = std::chrono::steady_clock::now();
+  if (lastSubmitEnd.has_value())
+    smooth(
+      mainTimings.mainBusyMs,
+      std::chrono::duration<double, std::milli>(waitStart - *lastSubmitEnd).count());
+
+  {
+    ZoneScopedN("waitForRenderThread");
+    std::unique_lock lock{packetMutex};
+    packetChanged.wait(lock, [this]() { return !packet.has_value(); });
+    packet.emplace(std::move(frame_packet));
+  }
+  packetChanged.notify_all();
+
+  smooth(mainTimings.mainWaitMs, ms_since(waitStart));
+  lastSubmitEnd = std::chrono::steady_clock::now();
 }
 
-void Renderer::drawFrame()
+void Renderer::renderLoop()
+{
+  tracy::SetThreadName("Render thread");
+
+  while (true)
+  {
+    const FramePacket* current = nullptr;
+    {
+      std::unique_lock lock{packetMutex};
+      packetChanged.wait(lock, [this]() { return stopping || packet.has_value(); });
+      if (stopping)
+        return;
+      current = &*packet;
+    }
+
+    // NOTE: the main thread doesn't touch the packet until we reset it
+    const auto start = std::chrono::steady_clock::now();
+    renderFrame(*current);
+    smooth(renderBusyMsSmoothed, ms_since(start));
+    renderBusyMs = renderBusyMsSmoothed;
+
+    {
+      std::unique_lock lock{packetMutex};
+      packet.reset();
+    }
+    packetChanged.notify_all();
+
+    FrameMarkNamed("Render");
+  }
+}
+
+void Renderer::renderFrame(const FramePacket& frame_packet)
 {
   ZoneScoped;
 
+  // NOTE: this waits for the GPU, but only when some shader has actually changed
+  if (auto update = shaderReloader->takeUpdate())
   {
-    ZoneScopedN("drawGui");
-    guiRenderer->nextFrame();
-    ImGui::NewFrame();
-    worldRenderer->drawGui();
-    ImGui::Render();
+    worldRenderer->reloadShaders(*update);
+    spdlog::info("Swapped in shaders of generation {}", update->generation);
   }
 
+  // NOTE: GLFW may only be used on the main thread, so window resizes
+  // only reach us through packets.
+  const glm::uvec2 res = frame_packet.resolution;
+  if (res != windowResolution && res.x != 0 && res.y != 0)
+    recreateSwapchain(res);
+
+  worldRenderer->update(frame_packet);
+
   auto currentCmdBuf = commandManager->acquireNext();
 
   // TODO: this makes literally 0 sense here, rename/refactor,
   // it doesn't actually begin anything, just resets descriptor pools
   etna::begin_frame();
 
+  worldRenderer->beginFrame();
+
+  // NOTE: acquiring the command buffer above waited for the graphics work from
+  // numFramesInFlight frames ago, which async compute relies upon.
+  if (worldRenderer->wantsAsyncCompute())
+  {
+    ZoneScopedN("asyncCompute");
+    auto computeCmdBuf = asyncCompute->begin();
+    worldRenderer->recordAsyncCompute(computeCmdBuf);
+    asyncCompute->submit(computeCmdBuf, worldRenderer->getAsyncComputeOutputs());
+  }
+
   auto nextSwapchainImage = window->acquireNext();
 
   // NOTE: here, we skip frames when the window is in the process of being
@@ -147,11 +296,7 @@ void Renderer::drawFrame()
 
       worldRenderer->renderWorld(currentCmdBuf, image, view);
 
-      {
-        ImDrawData* pDrawData = ImGui::GetDrawData();
-        guiRenderer->render(
-          currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
-      }
+      guiLayer->render(currentCmdBuf, image, view, frame_packet.gui);
 
       etna::set_state(
         currentCmdBuf,
@@ -177,17 +322,28 @@ void Renderer::drawFrame()
 
   etna::end_frame();
 
-  if (!nextSwapchainImage)
-  {
-    auto res = resolutionProvider();
-    // On windows, we get 0,0 while the window is minimized and
-    // must skip frames until the window is un-minimized again
-    if (res.x != 0 && res.y != 0)
-      recreateSwapchain(res);
-  }
+  // NOTE: the main thread idles until something changes, which arriving mips don't count
+  // as, so it would only show them once it wakes up on its own
+  if (worldRenderer->isStreamingTextures() && redrawRequestCb)
+    redrawRequestCb();
+
+  // On windows, we get 0,0 while the window is minimized and
+  // must skip frames until the window is un-minimized again
+  if (!nextSwapchainImage && res.x != 0 && res.y != 0)
+    recreateSwapchain(res);
 }
 
 Renderer::~Renderer()
 {
+  if (renderThread.joinable())
+  {
+    {
+      std::unique_lock lock{packetMutex};
+      stopping = true;
+    }
+    packetChanged.notify_all();
+    renderThread.join();
+  }
+
   ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
 }
@@ -1,23 +1,33 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PerFrameCmdMgr.hpp>
-#include <glm/glm.hpp>
 #include <function2/function2.hpp>
+#include <glm/glm.hpp>
 
 #include "wsi/Keyboard.hpp"
+#include "shader_reload/ShaderHotReloader.hpp"
 
 #include "FramePacket.hpp"
 #include "WorldRenderer.hpp"
 
 
-class ImGuiRenderer;
-
-using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
+class AsyncCompute;
 
 /**
  * This class encapsulates things that are very unlikely to change from one sample to another.
  * E.g. initialization, frame delivery logic, window resizing, gui setup, etc.
+ *
+ * Frames are pipelined: the main thread handles input, the GUI and builds frame packets,
+ * while a dedicated render thread records and submits the previous frame. So the CPU frame
+ * time is about the max of the two instead of their sum.
  */
 class Renderer
 {
@@ -25,24 +35,78 @@ public:
   explicit Renderer(glm::uvec2 resolution);
   ~Renderer();
 
+  // Called from other threads when there is something new to show even though
+  // nothing has changed on the main thread, e.g. reloaded shaders or streamed mips. Must be set
+  // before initFrameDelivery.
+  void setRedrawRequestCallback(fu2::unique_function<void()> callback)
+  {
+    redrawRequestCb = std::move(callback);
+  }
+
   // Initializing all of rendering is a tricky multi-step dance
   void initVulkan(std::span<const char*> instance_extensions);
-  void initFrameDelivery(vk::UniqueSurfaceKHR surface, ResolutionProvider res_provider);
-  void recreateSwapchain(glm::uvec2 res);
+  void initFrameDelivery(vk::UniqueSurfaceKHR surface);
   void loadScene(std::filesystem::path path);
 
-  void debugInput(const Keyboard& kb);
-  void update(const FramePacket& packet);
-  void drawFrame();
+  // NOTE: everything below is called on the main thread. The render thread is started
+  // by the first submitted frame, everything above must be done by then.
 
+  void debugInput(const Keyboard& kb, RenderSettings& settings);
+  // Builds the GUI for the next frame packet
+  CachedGuiLayer::Frame drawGui(RenderSettings& settings);
+  // If this is false, frames only change due to input, so the app may idle in between
+  bool hasTimeDrivenContent(const RenderSettings& settings) const;
+  // Time spent idling doesn't count as main thread work in the timings
+  void resumeAfterIdle() { lastSubmitEnd.reset(); }
+  // Hands the packet over to the render thread and returns right away, unless the render
+  // thread is still busy with the previous packet, in which case this waits for it.
+  // So the main thread is never more than one frame ahead of the render thread.
+  void submitFrame(FramePacket frame_packet);
+
+private:
+  void renderLoop();
+  void renderFrame(const FramePacket& frame_packet);
+  void recreateSwapchain(glm::uvec2 res);
+  void drawPipelineGui();
 
 private:
-  ResolutionProvider resolutionProvider;
   std::unique_ptr<etna::Window> window;
   std::unique_ptr<etna::PerFrameCmdMgr> commandManager;
+  std::unique_ptr<AsyncCompute> asyncCompute;
 
   glm::uvec2 resolution;
-  std::unique_ptr<ImGuiRenderer> guiRenderer;
+  // Resolution of the window the swapchain was last created for, the swapchain
+  // itself might have gotten a slightly different one.
+  glm::uvec2 windowResolution;
+  std::unique_ptr<CachedGuiLayer> guiLayer;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
+
+  std::thread renderThread;
+  std::mutex packetMutex;
+  std::condition_variable packetChanged;
+  // The packet being rendered, it is only reset once the frame has been submitted
+  std::optional<FramePacket> packet;
+  bool stopping = false;
+
+  // Recompiles shaders in the background, they are swapped in by the render thread
+  std::unique_ptr<ShaderHotReloader> shaderReloader;
+  fu2::unique_function<void()> redrawRequestCb;
+
+  // Smoothed CPU time spent per frame, to see which of the threads is the bottleneck
+  struct CpuTimings
+  {
+    double mainBusyMs = 0;
+    double mainWaitMs = 0;
+    double renderBusyMs = 0;
+  };
+  CpuTimings mainTimings;
+  std::atomic<double> renderBusyMs{0};
+  std::optional<std::chrono::steady_clock::time_point> lastSubmitEnd;
+  // Render thread only
+  double renderBusyMsSmoothed = 0;
+
+  // GUI-only state
+  CpuTimings shownTimings;
+  double shownTimingsTime = 0;
 };
@@ -1,31 +1,94 @@
 #include "WorldRenderer.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include <etna/Etna.hpp>
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
 #include <imgui.h>
+#include <spdlog/spdlog.h>
+#include <tracy/Tracy.hpp>
+
+#include "shaders/ParticleParams.h"
+#include "shaders/InstanceData.h"
+#include "shaders/MaterialData.h"
+#include "shaders/CullingParams.h"
+#include "jobs/JobSystem.hpp"
 
 
 WorldRenderer::WorldRenderer()
   : sceneMgr{std::make_unique<SceneManager>()}
 {
+  auto& ctx = etna::get_context();
+
+  sceneMgr->setStreamedTextureSize(STREAMING_RESIDENT_SIZE);
+  // Whatever model_bakery_baker has baked is taken as is, the rest is decoded as usual
+  sceneMgr->setUseBakedTextures(true);
+
+  const auto framesInFlight =
+    static_cast<std::uint32_t>(ctx.getMainWorkCount().multiBufferingCount());
+  timestamps = std::make_unique<GpuTimestamps>(framesInFlight, TIMESTAMP_COUNT);
+  retiredObjects = std::make_unique<DeferredDestroyQueue>(framesInFlight);
+
+  // Particles don't depend on the resolution, so they live through swapchain recreations
+  particleState = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = 2 * sizeof(glm::vec4) * PARTICLE_COUNT,
+    .bufferUsage =
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+    .name = "particle_state",
+  });
+  materialSampler = etna::Sampler(etna::Sampler::CreateInfo{
+    .filter = vk::Filter::eLinear,
+    .addressMode = vk::SamplerAddressMode::eRepeat,
+    .name = "material_sampler",
+  });
+
+  particlePositions.emplace(ctx.getMainWorkCount(), [&ctx](std::size_t i) {
+    return ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = sizeof(glm::vec4) * PARTICLE_COUNT,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .name = fmt::format("particle_positions{}", i),
+    });
+  });
 }
 
 void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 {
   resolution = swapchain_resolution;
 
+  // Everything bound to the cached sets is recreated below
+  descriptorCache.invalidate(*retiredObjects);
+
   auto& ctx = etna::get_context();
 
   mainViewDepth = ctx.createImage(etna::Image::CreateInfo{
     .extent = vk::Extent3D{resolution.x, resolution.y, 1},
     .name = "main_view_depth",
     .format = vk::Format::eD32Sfloat,
-    .imageUsage = vk::ImageUsageFlagBits::eDepthStencilAttachment,
+    .imageUsage =
+      vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled,
   });
 
+  // NOTE: mip sizes are rounded down, depth_pyramid.comp makes up for that
+  const glm::uvec2 pyramidSize = glm::max(resolution / 2u, glm::uvec2(1));
+  depthPyramidMips =
+    static_cast<std::uint32_t>(std::bit_width(std::max(pyramidSize.x, pyramidSize.y)));
+  depthPyramid = ctx.createImage(etna::Image::CreateInfo{
+    .extent = vk::Extent3D{pyramidSize.x, pyramidSize.y, 1},
+    .name = "depth_pyramid",
+    .format = vk::Format::eR32Sfloat,
+    .imageUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled,
+    .mipLevels = depthPyramidMips,
+  });
+  mainViewDepthHasHistory = false;
+
   shadowMap = ctx.createImage(etna::Image::CreateInfo{
     .extent = vk::Extent3D{2048, 2048, 1},
     .name = "shadow_map",
@@ -35,6 +98,8 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
   });
 
   defaultSampler = etna::Sampler(etna::Sampler::CreateInfo{.name = "default_sampler"});
+  depthPyramidSampler = etna::Sampler(
+    etna::Sampler::CreateInfo{.filter = vk::Filter::eNearest, .name = "depth_pyramid_sampler"});
   constants = ctx.createBuffer(etna::Buffer::CreateInfo{
     .size = sizeof(UniformParams),
     .bufferUsage = vk::BufferUsageFlagBits::eUniformBuffer,
@@ -47,15 +112,246 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
+  // NOTE: the streamer reads the texture data of the current scene, which is replaced here
+  textureStreamer.reset();
   sceneMgr->selectScene(path);
+  createSceneResources();
+}
+
+void WorldRenderer::createSceneResources()
+{
+  auto& ctx = etna::get_context();
+
+  descriptorCache.invalidate(*retiredObjects);
+
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  auto instanceBounds = sceneMgr->getInstanceBounds();
+
+  // NOTE: the data never changes, so it's written once and read straight from host memory
+  instanceData = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(instanceMatrices.size(), 1) * sizeof(InstanceData),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = "instance_data",
+  });
+  auto* instances = reinterpret_cast<InstanceData*>(instanceData.map());
+  for (std::size_t i = 0; i < instanceMatrices.size(); ++i)
+    instances[i] = InstanceData{
+      .model = instanceMatrices[i],
+      .boundsMin = glm::vec4(instanceBounds[i].min, 0.0f),
+      .boundsMax = glm::vec4(instanceBounds[i].max, 0.0f),
+    };
+  instanceData.unmap();
+
+  // Scene textures go to a set of their own, which is written on first use
+  retiredObjects->push(std::move(sceneTexturesSet));
+  sceneTexturesSet = {};
+
+  textureStreamer = std::make_unique<TextureStreamer>(TextureStreamer::CreateInfo{
+    .textures = sceneMgr->getTextureData(),
+    .images = sceneMgr->takeTextures(),
+    .residentSize = STREAMING_RESIDENT_SIZE,
+    .framesInFlight = static_cast<std::uint32_t>(ctx.getMainWorkCount().multiBufferingCount()),
+    .budget = static_cast<std::size_t>(std::max(settings.textureBudgetMb, 1)) << 20,
+  });
+
+  const auto textureCount = textureStreamer->getImages().size();
+  if (textureCount > MAX_SCENE_TEXTURES)
+    spdlog::warn(
+      "The scene has {} textures, only the first {} of them are used",
+      textureCount,
+      MAX_SCENE_TEXTURES);
+  auto textureIndex = [](std::uint32_t texture, std::uint32_t fallback) {
+    return texture < MAX_SCENE_TEXTURES ? texture : fallback;
+  };
+
+  auto materials = sceneMgr->getMaterials();
+  materialData = ctx.createBuffer(etna::Buffer::CreateInfo{
+    .size = std::max<std::size_t>(materials.size(), 1) * sizeof(MaterialData),
+    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+    .name = "material_data",
+  });
+  auto* gpuMaterials = reinterpret_cast<MaterialData*>(materialData.map());
+  for (std::size_t i = 0; i < materials.size(); ++i)
+    gpuMaterials[i] = MaterialData{
+      .baseColorFactor = materials[i].baseColorFactor,
+      .metallicFactor = materials[i].metallicFactor,
+      .roughnessFactor = materials[i].roughnessFactor,
+      .normalScale = materials[i].normalScale,
+      .baseColorTexture = textureIndex(materials[i].baseColorTexture, Material::WHITE_TEXTURE),
+      .normalTexture = textureIndex(materials[i].normalTexture, Material::FLAT_NORMAL_TEXTURE),
+      .metallicRoughnessTexture =
+        textureIndex(materials[i].metallicRoughnessTexture, Material::WHITE_TEXTURE),
+      .padding0 = 0,
+      .padding1 = 0,
+    };
+  materialData.unmap();
+
+  // Every relem of every instance is a draw, see buildDrawList
+  maxCullingDraws = 0;
+  auto meshes = sceneMgr->getMeshes();
+  for (auto meshIdx : sceneMgr->getInstanceMeshes())
+    maxCullingDraws += meshes[meshIdx].relemCount;
+
+  const auto commandsSize =
+    std::max<std::size_t>(maxCullingDraws, 1) * sizeof(vk::DrawIndexedIndirectCommand);
+  cullingDraws.emplace(ctx.getMainWorkCount(), [&ctx, commandsSize](std::size_t i) {
+    auto buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = commandsSize,
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+      .name = fmt::format("culling_draws{}", i),
+    });
+    buffer.map();
+    return buffer;
+  });
+  auto createCommands = [&ctx, commandsSize](const char* name) {
+    return [&ctx, commandsSize, name](std::size_t i) {
+      return ctx.createBuffer(etna::Buffer::CreateInfo{
+        .size = commandsSize,
+        .bufferUsage =
+          vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+        .name = fmt::format("{}{}", name, i),
+      });
+    };
+  };
+  phase1Draws.emplace(ctx.getMainWorkCount(), createCommands("phase1_draws"));
+  phase2Draws.emplace(ctx.getMainWorkCount(), createCommands("phase2_draws"));
+
+  // Cleared by the CPU once read back, so that nothing has to clear them on the GPU
+  cullingCounters.emplace(ctx.getMainWorkCount(), [&ctx](std::size_t i) {
+    auto buffer = ctx.createBuffer(etna::Buffer::CreateInfo{
+      .size = CULLING_STAT_COUNT * sizeof(std::uint32_t),
+      .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = fmt::format("culling_counters{}", i),
+    });
+    std::memset(buffer.map(), 0, CULLING_STAT_COUNT * sizeof(std::uint32_t));
+    return buffer;
+  });
 }
 
 void WorldRenderer::loadShaders()
 {
+  // Programs are loaded from copies of the binaries, which hot reloads overwrite in place
+  const std::filesystem::path buildDir = SHADOWMAP_SHADERS_ROOT;
+  std::error_code ec;
+  std::filesystem::create_directories(buildDir / LIVE_SHADERS_DIR, ec);
+  for (const auto& entry : std::filesystem::directory_iterator(buildDir))
+  {
+    if (entry.path().extension() != ".spv")
+      continue;
+    std::filesystem::copy_file(
+      entry.path(),
+      getBinaryPath(entry.path().filename().string()),
+      std::filesystem::copy_options::overwrite_existing,
+      ec);
+    ETNA_VERIFYF(!ec, "Couldn't copy '{}': {}", entry.path().string(), ec.message());
+  }
+
+  createPrograms();
+}
+
+void WorldRenderer::reloadShaders(const ShaderHotReloader::Update& update)
+{
+  ZoneScoped;
+
+  // NOTE: etna rebuilds programs and every pipeline made from them in place, which is only
+  // safe once the GPU is done with them. Reloads only happen on edits, so waiting is fine.
+  ETNA_CHECK_VK_RESULT(etna::get_context().getDevice().waitIdle());
+
+  for (const auto& [binary, path] : update.binaries)
+  {
+    std::error_code ec;
+    std::filesystem::copy_file(
+      path, getBinaryPath(binary), std::filesystem::copy_options::overwrite_existing, ec);
+    if (ec)
+    {
+      spdlog::error("Couldn't swap in shader '{}': {}", binary, ec.message());
+      return;
+    }
+  }
+
+  etna::reload_shaders();
+
+  // NOTE: layouts of the programs might have changed, sets of the old ones would never be used
+  sceneTexturesSet = {};
+  descriptorCache.invalidate(*retiredObjects);
+}
+
+std::filesystem::path WorldRenderer::getBinaryPath(const std::string& binary) const
+{
+  return std::filesystem::path(SHADOWMAP_SHADERS_ROOT) / LIVE_SHADERS_DIR / binary;
+}
+
+void WorldRenderer::createPrograms()
+{
+  programs = ProgramNames{
+    .simpleShadow = "simple_shadow",
+    .depthPrepass = "depth_prepass",
+    .depthPyramid = "depth_pyramid",
+    .hiZCull = "hiz_cull",
+    .particleSim = "particle_sim",
+    .particleDraw = "particle_draw",
+  };
+
+  etna::create_program(programs.simpleShadow.c_str(), {getBinaryPath("simple.vert.spv")});
+  etna::create_program(programs.depthPrepass.c_str(), {getBinaryPath("depth_only.vert.spv")});
+  etna::create_program(programs.depthPyramid.c_str(), {getBinaryPath("depth_pyramid.comp.spv")});
+  etna::create_program(programs.hiZCull.c_str(), {getBinaryPath("hiz_cull.comp.spv")});
+  etna::create_program(programs.particleSim.c_str(), {getBinaryPath("particles.comp.spv")});
   etna::create_program(
-    "simple_material",
-    {SHADOWMAP_SHADERS_ROOT "simple_shadow.frag.spv", SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
-  etna::create_program("simple_shadow", {SHADOWMAP_SHADERS_ROOT "simple.vert.spv"});
+    programs.particleDraw.c_str(),
+    {getBinaryPath("particles.vert.spv"), getBinaryPath("particles.frag.spv")});
+
+  // Permutations of the material are only created once they are used
+  materialPrograms = PermutationCache<std::string>([this](std::uint32_t mask) {
+    auto name = fmt::format("simple_material.{}", mask);
+    // NOTE: masks of programs never have pipeline state bits
+    etna::create_program(
+      name.c_str(),
+      {getBinaryPath(shader_permutation_binary("simple_shadow.frag", mask)),
+       getBinaryPath("simple.vert.spv")});
+    return name;
+  });
+}
+
+etna::GraphicsPipeline WorldRenderer::createMaterialPipeline(std::uint32_t mask)
+{
+  ZoneScoped;
+
+  etna::GraphicsPipeline::CreateInfo info{
+    .vertexShaderInput =
+      {
+        .bindings = {etna::VertexShaderInputDescription::Binding{
+          .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
+        }},
+      },
+    .rasterizationConfig =
+      vk::PipelineRasterizationStateCreateInfo{
+        .polygonMode = vk::PolygonMode::eFill,
+        .cullMode = vk::CullModeFlagBits::eBack,
+        .frontFace = vk::FrontFace::eCounterClockwise,
+        .lineWidth = 1.f,
+      },
+    .fragmentShaderOutput =
+      {
+        .colorAttachmentFormats = {swapchainFormat},
+        .depthAttachmentFormat = vk::Format::eD32Sfloat,
+      },
+  };
+
+  if (mask & MATERIAL_PIPELINE_EQUAL_DEPTH)
+    info.depthConfig = vk::PipelineDepthStencilStateCreateInfo{
+      .depthTestEnable = vk::True,
+      .depthWriteEnable = vk::False,
+      .depthCompareOp = vk::CompareOp::eEqual,
+      .maxDepthBounds = 1.f,
+    };
+
+  return etna::get_context().getPipelineManager().createGraphicsPipeline(
+    materialPrograms.get(mask & MATERIAL_FEATURES_MASK), std::move(info));
 }
 
 void WorldRenderer::setupPipelines(vk::Format swapchain_format)
@@ -63,6 +359,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
   quadRenderer = std::make_unique<QuadRenderer>(QuadRenderer::CreateInfo{
     .format = swapchain_format,
     .rect = {{0, 0}, {512, 512}},
+    .descriptorCache = &descriptorCache,
   });
 
   etna::VertexShaderInputDescription sceneVertexInputDesc{
@@ -74,9 +371,16 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 
   auto& pipelineManager = etna::get_context().getPipelineManager();
 
-  basicForwardPipeline = {};
-  basicForwardPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_material",
+  // NOTE: this is called after waiting for the GPU or after retiring the old pipelines
+  swapchainFormat = swapchain_format;
+  materialPipelines =
+    PermutationCache<etna::GraphicsPipeline>([this](std::uint32_t mask) {
+      return createMaterialPipeline(mask);
+    });
+
+  shadowPipeline = {};
+  shadowPipeline = pipelineManager.createGraphicsPipeline(
+    programs.simpleShadow,
     etna::GraphicsPipeline::CreateInfo{
       .vertexShaderInput = sceneVertexInputDesc,
       .rasterizationConfig =
@@ -88,16 +392,24 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
         },
       .fragmentShaderOutput =
         {
-          .colorAttachmentFormats = {swapchain_format},
-          .depthAttachmentFormat = vk::Format::eD32Sfloat,
+          .depthAttachmentFormat = vk::Format::eD16Unorm,
         },
     });
 
-  shadowPipeline = {};
-  shadowPipeline = pipelineManager.createGraphicsPipeline(
-    "simple_shadow",
+  // Only positions are fetched, which is the whole point of a depth prepass
+  auto positionOnlyFormat = sceneMgr->getVertexFormatDescription();
+  positionOnlyFormat.attributes.resize(1);
+
+  depthPrepassPipeline = {};
+  depthPrepassPipeline = pipelineManager.createGraphicsPipeline(
+    programs.depthPrepass,
     etna::GraphicsPipeline::CreateInfo{
-      .vertexShaderInput = sceneVertexInputDesc,
+      .vertexShaderInput =
+        {
+          .bindings = {etna::VertexShaderInputDescription::Binding{
+            .byteStreamDescription = positionOnlyFormat,
+          }},
+        },
       .rasterizationConfig =
         vk::PipelineRasterizationStateCreateInfo{
           .polygonMode = vk::PolygonMode::eFill,
@@ -107,24 +419,71 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
         },
       .fragmentShaderOutput =
         {
-          .depthAttachmentFormat = vk::Format::eD16Unorm,
+          .depthAttachmentFormat = vk::Format::eD32Sfloat,
+        },
+    });
+
+  depthPyramidPipeline = {};
+  depthPyramidPipeline = pipelineManager.createComputePipeline(programs.depthPyramid, {});
+  hiZCullPipeline = {};
+  hiZCullPipeline = pipelineManager.createComputePipeline(programs.hiZCull, {});
+
+  particleSimPipeline = {};
+  particleSimPipeline = pipelineManager.createComputePipeline(programs.particleSim, {});
+
+  particleDrawPipeline = {};
+  particleDrawPipeline = pipelineManager.createGraphicsPipeline(
+    programs.particleDraw,
+    etna::GraphicsPipeline::CreateInfo{
+      .inputAssemblyConfig = {.topology = vk::PrimitiveTopology::ePointList},
+      .rasterizationConfig =
+        vk::PipelineRasterizationStateCreateInfo{
+          .polygonMode = vk::PolygonMode::eFill,
+          .cullMode = vk::CullModeFlagBits::eNone,
+          .lineWidth = 1.f,
+        },
+      .depthConfig =
+        vk::PipelineDepthStencilStateCreateInfo{
+          .depthTestEnable = vk::True,
+          .depthWriteEnable = vk::False,
+          .depthCompareOp = vk::CompareOp::eLessOrEqual,
+          .maxDepthBounds = 1.f,
+        },
+      .fragmentShaderOutput =
+        {
+          .colorAttachmentFormats = {swapchain_format},
+          .depthAttachmentFormat = vk::Format::eD32Sfloat,
         },
     });
 }
 
-void WorldRenderer::debugInput(const Keyboard& kb)
+void WorldRenderer::debugInput(const Keyboard& kb, RenderSettings& render_settings)
 {
   if (kb[KeyboardKey::kQ] == ButtonState::Falling)
-    drawDebugFSQuad = !drawDebugFSQuad;
+    render_settings.drawDebugFSQuad = !render_settings.drawDebugFSQuad;
 
   if (kb[KeyboardKey::kP] == ButtonState::Falling)
-    lightProps.usePerspectiveM = !lightProps.usePerspectiveM;
+    render_settings.perspectiveShadowMap = !render_settings.perspectiveShadowMap;
+
+  if (kb[KeyboardKey::kO] == ButtonState::Falling)
+    render_settings.softShadows = !render_settings.softShadows;
+
+  if (kb[KeyboardKey::kZ] == ButtonState::Falling)
+    render_settings.depthPrepass = !render_settings.depthPrepass;
+
+  if (kb[KeyboardKey::kC] == ButtonState::Falling)
+    render_settings.occlusionCulling = !render_settings.occlusionCulling;
+
+  if (kb[KeyboardKey::kX] == ButtonState::Falling)
+    render_settings.cpuOcclusionCulling = !render_settings.cpuOcclusionCulling;
 }
 
 void WorldRenderer::update(const FramePacket& packet)
 {
   ZoneScoped;
 
+  settings = packet.settings;
+
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
@@ -133,7 +492,7 @@ void WorldRenderer::update(const FramePacket& packet)
 
   // calc light matrix
   {
-    const auto mProj = lightProps.usePerspectiveM
+    const auto mProj = settings.perspectiveShadowMap
       ? glm::perspectiveLH_ZO(
           -glm::radians(packet.shadowCam.fov), 1.0f, 1.0f, lightProps.lightTargetDist * 2.0f)
       : glm::orthoLH_ZO(
@@ -149,49 +508,620 @@ void WorldRenderer::update(const FramePacket& packet)
     lightPos = packet.shadowCam.position;
   }
 
+  cpuCullingStats = {};
+  if (settings.cpuOcclusionCulling)
+  {
+    ZoneScopedN("cpuOcclusionCulling");
+
+    const OcclusionCuller::Settings occluderSettings{
+      .maxOccluders = static_cast<std::uint32_t>(std::max(settings.maxCpuOccluders, 0)),
+    };
+    mainViewOcclusion.cull(*sceneMgr, worldViewProj, occluderSettings, &get_job_system());
+    shadowOcclusion.cull(*sceneMgr, lightMatrix, occluderSettings, &get_job_system());
+    cpuCullingStats = CpuCullingStats{
+      .mainView = mainViewOcclusion.getStats(),
+      .shadow = shadowOcclusion.getStats(),
+    };
+  }
+
+  {
+    ZoneScopedN("buildDrawLists");
+
+    std::span<const OcclusionResult> mainVisibility;
+    std::span<const OcclusionResult> shadowVisibility;
+    if (settings.cpuOcclusionCulling)
+    {
+      mainVisibility = mainViewOcclusion.getResults();
+      shadowVisibility = shadowOcclusion.getResults();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    // Closest draws first, so that early-Z rejects as much as possible of the rest
+    buildDrawList(mainDrawList, worldViewProj, DrawOrder::FRONT_TO_BACK, mainVisibility);
+    // Shadow map fragments are cheap, so fewer state changes matter more
+    buildDrawList(shadowDrawList, lightMatrix, DrawOrder::STATE, shadowVisibility);
+
+    drawListTimings = DrawListTimings{
+      .mainDrawCount = mainDrawList.size(),
+      .shadowDrawCount = shadowDrawList.size(),
+      .buildMs =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+          .count(),
+      .mainSortMs = mainDrawList.getSortMs(),
+      .shadowSortMs = shadowDrawList.getSortMs(),
+    };
+  }
+
+  if (textureStreamer != nullptr)
+  {
+    textureStreamer->setBudget(
+      static_cast<std::size_t>(std::max(settings.textureBudgetMb, 1)) << 20);
+    requestTextureMips(packet.mainCam);
+  }
+
+  // Long frames (e.g. while dragging the window or after idling) would make particles explode
+  const float frameDt = std::clamp(packet.currentTime - lastPacketTime, 0.0f, 0.05f);
+  lastPacketTime = packet.currentTime;
+
+  // NOTE: paused particles are still simulated with a zero step, as their positions
+  // are per frame in flight, skipping the simulation would show stale ones.
+  particleDt = settings.animate ? frameDt : 0.0f;
+  animationTime += particleDt;
+
   // Upload everything to GPU-mapped memory
   {
     uniformParams.lightMatrix = lightMatrix;
     uniformParams.lightPos = lightPos;
-    uniformParams.time = packet.currentTime;
+    uniformParams.time = animationTime;
+    uniformParams.baseColor = settings.baseColor;
 
     std::memcpy(constants.data(), &uniformParams, sizeof(uniformParams));
   }
 }
 
-void WorldRenderer::renderScene(
+void WorldRenderer::buildDrawList(
+  DrawList& draw_list,
+  const glm::mat4x4& glob_tm,
+  DrawOrder order,
+  std::span<const OcclusionResult> visibility)
+{
+  draw_list.clear();
+
+  auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+
+  auto meshes = sceneMgr->getMeshes();
+
+  // NOTE: relems don't have bounds, so they are culled with their instance and
+  // sorted by the depth of the origin of their instance
+  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  {
+    if (!visibility.empty() && visibility[instIdx] != OcclusionResult::VISIBLE)
+      continue;
+
+    const glm::vec4 clipPos = glob_tm * instanceMatrices[instIdx][3];
+    const float depth = clipPos.w > 0 ? clipPos.z / clipPos.w : 0.0f;
+
+    const auto& mesh = meshes[instanceMeshes[instIdx]];
+    for (std::uint32_t j = 0; j < mesh.relemCount; ++j)
+      draw_list.add(
+        // Everything is drawn with a single pipeline and 32-bit indices, and materials
+        // are bindless, so only the depth actually differs between draws
+        DrawState{.depth = depth},
+        order,
+        static_cast<std::uint32_t>(instIdx),
+        mesh.firstRelem + j);
+  }
+
+  draw_list.sort();
+}
+
+void WorldRenderer::requestTextureMips(const Camera& camera)
+{
+  ZoneScoped;
+
+  auto relems = sceneMgr->getRenderElements();
+  auto materials = sceneMgr->getMaterials();
+  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  auto instanceBounds = sceneMgr->getInstanceBounds();
+  const auto textureCount =
+    std::min<std::size_t>(textureStreamer->getImages().size(), MAX_SCENE_TEXTURES);
+
+  // Pixels a unit of length covers at a distance of 1
+  const float pixelsPerLength = static_cast<float>(resolution.y) /
+    (2.0f * std::tan(glm::radians(std::abs(camera.fov)) * 0.5f));
+
+  // NOTE: the draw list isn't frustum culled, so textures behind the camera are kept as well
+  // and are there once it turns around
+  for (const auto& draw : mainDrawList.getItems())
+  {
+    const auto& relem = relems[draw.relem];
+    if (relem.lengthPerUv <= 0)
+      continue;
+
+    // Textures are magnified the most at the closest point of the bounds
+    const auto& bounds = instanceBounds[draw.instance];
+    const float distance = std::max(
+      glm::distance(camera.position, glm::clamp(camera.position, bounds.min, bounds.max)),
+      camera.zNear);
+    const auto& matrix = instanceMatrices[draw.instance];
+    const float scale = std::max(
+      {glm::length(glm::vec3(matrix[0])),
+       glm::length(glm::vec3(matrix[1])),
+       glm::length(glm::vec3(matrix[2]))});
+    const float pixelsPerUv = relem.lengthPerUv * scale * pixelsPerLength / distance;
+
+    const auto& material = materials[relem.material];
+    for (const auto texture :
+         {material.baseColorTexture, material.normalTexture, material.metallicRoughnessTexture})
+    {
+      if (texture >= textureCount)
+        continue;
+      const glm::uvec2 size = textureStreamer->getSize(texture);
+      const float texelsPerPixel = static_cast<float>(std::max(size.x, size.y)) / pixelsPerUv;
+      const float mip = std::clamp(std::log2(texelsPerPixel), 0.0f, 31.0f);
+      textureStreamer->request(texture, static_cast<std::uint32_t>(mip));
+    }
+  }
+}
+
+bool WorldRenderer::bindScene(
   vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout)
 {
   if (!sceneMgr->getVertexBuffer())
-    return;
+    return false;
 
   cmd_buf.bindVertexBuffers(0, {sceneMgr->getVertexBuffer()}, {0});
   cmd_buf.bindIndexBuffer(sceneMgr->getIndexBuffer(), 0, vk::IndexType::eUint32);
 
-  pushConst2M.projView = glob_tm;
+  pushConsts.projView = glob_tm;
+  cmd_buf.pushConstants<PushConstants>(
+    pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConsts});
 
-  auto instanceMeshes = sceneMgr->getInstanceMeshes();
-  auto instanceMatrices = sceneMgr->getInstanceMatrices();
+  return true;
+}
+
+void WorldRenderer::renderScene(
+  vk::CommandBuffer cmd_buf,
+  const DrawList& draw_list,
+  const glm::mat4x4& glob_tm,
+  vk::PipelineLayout pipeline_layout)
+{
+  if (!bindScene(cmd_buf, glob_tm, pipeline_layout))
+    return;
 
-  auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+  // NOTE: matrices come from instanceData, indexed with the first instance
+  for (const auto& draw : draw_list.getItems())
   {
-    pushConst2M.model = instanceMatrices[instIdx];
+    const auto& relem = relems[draw.relem];
+    cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, draw.instance);
+  }
+}
 
-    cmd_buf.pushConstants<PushConstants>(
-      pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
+void WorldRenderer::renderMainView(
+  vk::CommandBuffer cmd_buf, MainViewDraws draws, vk::PipelineLayout pipeline_layout)
+{
+  if (draws == MainViewDraws::ALL)
+  {
+    renderScene(cmd_buf, mainDrawList, worldViewProj, pipeline_layout);
+    return;
+  }
 
-    const auto meshIdx = instanceMeshes[instIdx];
+  if (!bindScene(cmd_buf, worldViewProj, pipeline_layout))
+    return;
 
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+  // Culled draws are still there, just with 0 instances
+  const auto drawCount = static_cast<std::uint32_t>(mainDrawList.size());
+  if (draws != MainViewDraws::PHASE_2)
+    cmd_buf.drawIndexedIndirect(
+      phase1Draws->get().get(), 0, drawCount, sizeof(vk::DrawIndexedIndirectCommand));
+  if (draws != MainViewDraws::PHASE_1)
+    cmd_buf.drawIndexedIndirect(
+      phase2Draws->get().get(), 0, drawCount, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+static void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+void WorldRenderer::buildDepthPyramid(vk::CommandBuffer cmd_buf)
+{
+  ETNA_PROFILE_GPU(cmd_buf, buildDepthPyramid);
+
+  // The previous culling pass might still be reading the pyramid
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    {},
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite);
+
+  auto programInfo = etna::get_shader_program(programs.depthPyramid.c_str());
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, depthPyramidPipeline.getVkPipeline());
+
+  glm::uvec2 srcSize = resolution;
+  for (std::uint32_t mip = 0; mip < depthPyramidMips; ++mip)
+  {
+    const glm::uvec2 dstSize = glm::max(srcSize / 2u, glm::uvec2(1));
+
+    // NOTE: the whole pyramid stays in the general layout, so that a mip can be read
+    // while the next one is written
+    auto src = mip == 0
+      ? mainViewDepth.genBinding(depthPyramidSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)
+      : depthPyramid.genBinding(
+          depthPyramidSampler.get(),
+          vk::ImageLayout::eGeneral,
+          {.baseMip = mip - 1, .levelCount = 1});
+    auto dst = depthPyramid.genBinding(
+      {}, vk::ImageLayout::eGeneral, {.baseMip = mip, .levelCount = 1});
+    vk::DescriptorSet vkSet = descriptorCache.get(
+      programInfo.getDescriptorLayoutId(0),
+      cmd_buf,
+      {etna::Binding{0, std::move(src)}, etna::Binding{1, std::move(dst)}});
+    etna::flush_barriers(cmd_buf);
+
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eCompute,
+      depthPyramidPipeline.getVkPipelineLayout(),
+      0,
+      1,
+      &vkSet,
+      0,
+      nullptr);
+    cmd_buf.pushConstants<DepthPyramidParams>(
+      depthPyramidPipeline.getVkPipelineLayout(),
+      vk::ShaderStageFlagBits::eCompute,
+      0,
+      {DepthPyramidParams{.srcSize = srcSize, .dstSize = dstSize}});
+    cmd_buf.dispatch(
+      (dstSize.x + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE,
+      (dstSize.y + DEPTH_PYRAMID_WORKGROUP_SIZE - 1) / DEPTH_PYRAMID_WORKGROUP_SIZE,
+      1);
+
+    // NOTE: etna doesn't see a hazard here, as the layout of the pyramid stays the same
+    memory_barrier(
+      cmd_buf,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderSampledRead);
+
+    srcSize = dstSize;
+  }
+}
+
+void WorldRenderer::cullMainView(vk::CommandBuffer cmd_buf, std::uint32_t phase)
+{
+  ETNA_PROFILE_GPU(cmd_buf, cullMainView);
+
+  const auto drawCount = static_cast<std::uint32_t>(mainDrawList.size());
+  if (phase == 1)
+  {
+    // Draws are culled in the order of the list, so they are drawn front to back as well
+    auto* commands =
+      reinterpret_cast<vk::DrawIndexedIndirectCommand*>(cullingDraws->get().data());
+    auto relems = sceneMgr->getRenderElements();
+    for (const auto& draw : mainDrawList.getItems())
     {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
-      const auto& relem = relems[relemIdx];
-      cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      const auto& relem = relems[draw.relem];
+      *commands++ = vk::DrawIndexedIndirectCommand{
+        .indexCount = relem.indexCount,
+        .instanceCount = 1,
+        .firstIndex = relem.indexOffset,
+        .vertexOffset = static_cast<std::int32_t>(relem.vertexOffset),
+        .firstInstance = draw.instance,
+      };
     }
   }
+
+  auto programInfo = etna::get_shader_program(programs.hiZCull.c_str());
+  vk::DescriptorSet vkSet = descriptorCache.get(
+    programInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, instanceData.genBinding()},
+      etna::Binding{1, cullingDraws->get().genBinding()},
+      etna::Binding{2, phase1Draws->get().genBinding()},
+      etna::Binding{3, phase2Draws->get().genBinding()},
+      etna::Binding{4, cullingCounters->get().genBinding()},
+      etna::Binding{
+        5, depthPyramid.genBinding(depthPyramidSampler.get(), vk::ImageLayout::eGeneral)},
+    });
+  etna::flush_barriers(cmd_buf);
+
+  const CullingParams params{
+    .viewProj = phase == 1 ? previousWorldViewProj : worldViewProj,
+    .depthSize = resolution,
+    .drawCount = drawCount,
+    .phase = phase,
+    .hasHistory = mainViewDepthHasHistory ? 1u : 0u,
+  };
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, hiZCullPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    hiZCullPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+  cmd_buf.pushConstants<CullingParams>(
+    hiZCullPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+  cmd_buf.dispatch((drawCount + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+
+  // Phase 2 reads commands of phase 1 as well, and the counters are read back once it's done
+  memory_barrier(
+    cmd_buf,
+    vk::PipelineStageFlagBits2::eComputeShader,
+    vk::AccessFlagBits2::eShaderStorageWrite,
+    vk::PipelineStageFlagBits2::eDrawIndirect | vk::PipelineStageFlagBits2::eComputeShader |
+      vk::PipelineStageFlagBits2::eHost,
+    vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead |
+      vk::AccessFlagBits2::eHostRead);
+}
+
+void WorldRenderer::readCullingStats()
+{
+  if (!cullingCounters.has_value())
+    return;
+
+  // NOTE: this slot was last used frames in flight ago, and the GPU is done with it by now
+  auto* counters = reinterpret_cast<std::uint32_t*>(cullingCounters->get().data());
+  if (counters[CULLING_STAT_DRAWS] != 0)
+    cullingStats = CullingStats{
+      .draws = counters[CULLING_STAT_DRAWS],
+      .frustumCulled = counters[CULLING_STAT_FRUSTUM_CULLED],
+      .occluded = counters[CULLING_STAT_OCCLUDED],
+      .phase1Drawn = counters[CULLING_STAT_PHASE1_DRAWN],
+      .phase2Drawn = counters[CULLING_STAT_PHASE2_DRAWN],
+    };
+  std::memset(counters, 0, CULLING_STAT_COUNT * sizeof(std::uint32_t));
+}
+
+void WorldRenderer::beginFrame()
+{
+  timestamps->nextFrame();
+  retiredObjects->nextFrame();
+  readCullingStats();
+  if (textureStreamer != nullptr)
+    textureStreamer->beginFrame();
+  publishTimings();
+}
+
+void WorldRenderer::simulateParticles(vk::CommandBuffer cmd_buf)
+{
+  timestamps->write(cmd_buf, TIMESTAMP_COMPUTE_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+
+  // Zero lifetime makes all particles respawn on the first step
+  if (!particleStateCleared)
+  {
+    cmd_buf.fillBuffer(particleState.get(), 0, vk::WholeSize, 0);
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+      .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+    particleStateCleared = true;
+  }
+
+  auto simInfo = etna::get_shader_program(programs.particleSim.c_str());
+  vk::DescriptorSet vkSet = descriptorCache.get(
+    simInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {
+      etna::Binding{0, particleState.genBinding()},
+      etna::Binding{1, particlePositions->get().genBinding()},
+    });
+
+  const ParticleSimParams params{
+    .dt = particleDt,
+    .time = animationTime,
+    .count = PARTICLE_COUNT,
+    .substeps = static_cast<std::uint32_t>(settings.particleSubsteps),
+  };
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, particleSimPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eCompute,
+    particleSimPipeline.getVkPipelineLayout(),
+    0,
+    1,
+    &vkSet,
+    0,
+    nullptr);
+  cmd_buf.pushConstants<ParticleSimParams>(
+    particleSimPipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, {params});
+  cmd_buf.dispatch(
+    (PARTICLE_COUNT + PARTICLES_WORKGROUP_SIZE - 1) / PARTICLES_WORKGROUP_SIZE, 1, 1);
+
+  timestamps->write(cmd_buf, TIMESTAMP_COMPUTE_END, vk::PipelineStageFlagBits2::eAllCommands);
+}
+
+void WorldRenderer::recordAsyncCompute(vk::CommandBuffer cmd_buf)
+{
+  simulateParticles(cmd_buf);
+}
+
+std::vector<AsyncCompute::SharedBuffer> WorldRenderer::getAsyncComputeOutputs()
+{
+  return {AsyncCompute::SharedBuffer{
+    .buffer = particlePositions->get().get(),
+    .dstStage = vk::PipelineStageFlagBits2::eVertexShader,
+    .dstAccess = vk::AccessFlagBits2::eShaderStorageRead,
+  }};
+}
+
+void WorldRenderer::renderParticles(vk::CommandBuffer cmd_buf)
+{
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, particleDrawPipeline.getVkPipeline());
+  cmd_buf.pushConstants<glm::mat4x4>(
+    particleDrawPipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eVertex,
+    0,
+    {worldViewProj});
+  cmd_buf.draw(PARTICLE_COUNT, 1, 0, 0);
+}
+
+void WorldRenderer::renderDepthPrepass(
+  vk::CommandBuffer cmd_buf, MainViewDraws draws, bool clear_depth)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderDepthPrepass);
+
+  auto prepassInfo = etna::get_shader_program(programs.depthPrepass.c_str());
+  auto set = descriptorCache.get(
+    prepassInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{2, instanceData.genBinding()}});
+
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {},
+    {
+      .image = mainViewDepth.get(),
+      .view = mainViewDepth.getView({}),
+      .loadOp = clear_depth ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPrepassPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics,
+    depthPrepassPipeline.getVkPipelineLayout(),
+    0,
+    {set},
+    {});
+  renderMainView(cmd_buf, draws, depthPrepassPipeline.getVkPipelineLayout());
+}
+
+void WorldRenderer::createSceneTexturesSet(
+  vk::CommandBuffer cmd_buf, etna::DescriptorLayoutId layout_id)
+{
+  ZoneScoped;
+
+  auto textures = textureStreamer->getImages();
+  std::vector<etna::Binding> bindings;
+  bindings.reserve(MAX_SCENE_TEXTURES);
+  for (std::uint32_t i = 0; i < MAX_SCENE_TEXTURES; ++i)
+  {
+    // NOTE: all elements of the array must be valid, the unused ones are plain white
+    const auto& texture = i < textures.size() ? textures[i] : textures[Material::WHITE_TEXTURE];
+    bindings.push_back(etna::Binding{
+      0,
+      texture.genBinding(materialSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal),
+      i});
+  }
+  sceneTexturesSet = etna::create_persistent_descriptor_set(layout_id, std::move(bindings));
+
+  // Textures are never used any other way, so they stay in this layout from now on
+  sceneTexturesSet.processBarriers(cmd_buf);
+}
+
+void WorldRenderer::renderForward(
+  vk::CommandBuffer cmd_buf,
+  vk::Image target_image,
+  vk::ImageView target_image_view,
+  MainViewDraws draws,
+  bool first_pass,
+  bool last_pass)
+{
+  ETNA_PROFILE_GPU(cmd_buf, renderForward);
+
+  std::uint32_t materialMask = 0;
+  if (settings.perspectiveShadowMap)
+    materialMask |= MATERIAL_PERSPECTIVE_SHADOWS;
+  if (settings.softShadows)
+    materialMask |= MATERIAL_SOFT_SHADOWS;
+  auto& materialPipeline = materialPipelines.get(
+    materialMask | (settings.depthPrepass ? MATERIAL_PIPELINE_EQUAL_DEPTH : 0u));
+
+  auto simpleMaterialInfo = etna::get_shader_program(materialPrograms.get(materialMask).c_str());
+
+  auto set = descriptorCache.get(
+    simpleMaterialInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, constants.genBinding()},
+     etna::Binding{
+       1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)},
+     etna::Binding{2, instanceData.genBinding()},
+     etna::Binding{3, materialData.genBinding()}});
+
+  // The set is only rewritten once the streamer replaces some of the textures
+  if (
+    !sceneTexturesSet.isValid() && textureStreamer != nullptr &&
+    !textureStreamer->getImages().empty())
+    createSceneTexturesSet(cmd_buf, simpleMaterialInfo.getDescriptorLayoutId(1));
+
+  auto particleDrawInfo = etna::get_shader_program(programs.particleDraw.c_str());
+  auto particleSet = descriptorCache.get(
+    particleDrawInfo.getDescriptorLayoutId(0),
+    cmd_buf,
+    {etna::Binding{0, particlePositions->get().genBinding()}});
+
+  // Later passes add to what the first one drew, the prepass has laid down depth already
+  const bool clearDepth = first_pass && !settings.depthPrepass;
+  etna::RenderTargetState renderTargets(
+    cmd_buf,
+    {{0, 0}, {resolution.x, resolution.y}},
+    {{
+      .image = target_image,
+      .view = target_image_view,
+      .loadOp = first_pass ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+    }},
+    {
+      .image = mainViewDepth.get(),
+      .view = mainViewDepth.getView({}),
+      .loadOp = clearDepth ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad,
+    });
+
+  cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, materialPipeline.getVkPipeline());
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics,
+    materialPipeline.getVkPipelineLayout(),
+    0,
+    {set},
+    {});
+  if (sceneTexturesSet.isValid())
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics,
+      materialPipeline.getVkPipelineLayout(),
+      1,
+      {sceneTexturesSet.getVkSet()},
+      {});
+
+  renderMainView(cmd_buf, draws, materialPipeline.getVkPipelineLayout());
+
+  // Particles aren't culled and don't write depth, so they go after all of the scene
+  if (!last_pass)
+    return;
+
+  cmd_buf.bindDescriptorSets(
+    vk::PipelineBindPoint::eGraphics,
+    particleDrawPipeline.getVkPipelineLayout(),
+    0,
+    {particleSet},
+    {});
+  renderParticles(cmd_buf);
 }
 
 void WorldRenderer::renderWorld(
@@ -199,11 +1129,47 @@ void WorldRenderer::renderWorld(
 {
   ETNA_PROFILE_GPU(cmd_buf, renderWorld);
 
+  timestamps->write(cmd_buf, TIMESTAMP_GRAPHICS_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+
+  if (textureStreamer != nullptr)
+  {
+    ETNA_PROFILE_GPU(cmd_buf, streamTextures);
+    if (textureStreamer->recordUploads(cmd_buf, *retiredObjects))
+    {
+      // The set refers to the images which were just replaced
+      retiredObjects->push(std::move(sceneTexturesSet));
+      sceneTexturesSet = {};
+    }
+  }
+
+  // Without async compute, the simulation simply runs in front of everything else
+  if (!settings.asyncParticles)
+  {
+    ETNA_PROFILE_GPU(cmd_buf, simulateParticles);
+
+    simulateParticles(cmd_buf);
+
+    vk::MemoryBarrier2 barrier{
+      .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader,
+      .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+      .dstStageMask = vk::PipelineStageFlagBits2::eVertexShader,
+      .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead,
+    };
+    cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+      .memoryBarrierCount = 1,
+      .pMemoryBarriers = &barrier,
+    });
+  }
+
   // draw scene to shadowmap
 
   {
     ETNA_PROFILE_GPU(cmd_buf, renderShadowMap);
 
+    auto shadowInfo = etna::get_shader_program(programs.simpleShadow.c_str());
+    auto set = descriptorCache.get(
+      shadowInfo.getDescriptorLayoutId(0), cmd_buf, {etna::Binding{2, instanceData.genBinding()}});
+
     etna::RenderTargetState renderTargets(
       cmd_buf,
       {{0, 0}, {2048, 2048}},
@@ -211,64 +1177,283 @@ void WorldRenderer::renderWorld(
       {.image = shadowMap.get(), .view = shadowMap.getView({})});
 
     cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, shadowPipeline.getVkPipeline());
-    renderScene(cmd_buf, lightMatrix, shadowPipeline.getVkPipelineLayout());
+    cmd_buf.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics,
+      shadowPipeline.getVkPipelineLayout(),
+      0,
+      {set},
+      {});
+    renderScene(cmd_buf, shadowDrawList, lightMatrix, shadowPipeline.getVkPipelineLayout());
   }
 
-  // draw final scene to screen
+  // draw final scene to screen, possibly culling it in two phases on the way
 
+  timestamps->write(cmd_buf, TIMESTAMP_MAIN_VIEW_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+
+  const bool culling = settings.occlusionCulling && maxCullingDraws != 0;
+  if (culling)
   {
-    ETNA_PROFILE_GPU(cmd_buf, renderForward);
+    timestamps->write(cmd_buf, TIMESTAMP_CULLING_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+    if (mainViewDepthHasHistory)
+      buildDepthPyramid(cmd_buf);
+    cullMainView(cmd_buf, 1);
+    timestamps->write(cmd_buf, TIMESTAMP_CULLING_END, vk::PipelineStageFlagBits2::eAllCommands);
+  }
 
-    auto simpleMaterialInfo = etna::get_shader_program("simple_material");
+  const auto firstDraws = culling ? MainViewDraws::PHASE_1 : MainViewDraws::ALL;
+  auto cullPhase2 = [&]() {
+    timestamps->write(
+      cmd_buf, TIMESTAMP_CULLING_PHASE2_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+    buildDepthPyramid(cmd_buf);
+    cullMainView(cmd_buf, 2);
+    timestamps->write(
+      cmd_buf, TIMESTAMP_CULLING_PHASE2_END, vk::PipelineStageFlagBits2::eAllCommands);
+  };
 
-    auto set = etna::create_descriptor_set(
-      simpleMaterialInfo.getDescriptorLayoutId(0),
-      cmd_buf,
-      {etna::Binding{0, constants.genBinding()},
-       etna::Binding{
-         1, shadowMap.genBinding(defaultSampler.get(), vk::ImageLayout::eShaderReadOnlyOptimal)}});
+  if (settings.depthPrepass)
+  {
+    // With a prepass, phase 2 only needs to complete the depth, shading happens once
+    timestamps->write(cmd_buf, TIMESTAMP_PREPASS_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+    renderDepthPrepass(cmd_buf, firstDraws, true);
+    if (culling)
+    {
+      cullPhase2();
+      renderDepthPrepass(cmd_buf, MainViewDraws::PHASE_2, false);
+    }
 
-    etna::RenderTargetState renderTargets(
+    timestamps->write(cmd_buf, TIMESTAMP_FORWARD_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+    renderForward(
       cmd_buf,
-      {{0, 0}, {resolution.x, resolution.y}},
-      {{.image = target_image, .view = target_image_view}},
-      {.image = mainViewDepth.get(), .view = mainViewDepth.getView({})});
+      target_image,
+      target_image_view,
+      culling ? MainViewDraws::BOTH_PHASES : MainViewDraws::ALL,
+      true,
+      true);
+  }
+  else
+  {
+    timestamps->write(cmd_buf, TIMESTAMP_FORWARD_BEGIN, vk::PipelineStageFlagBits2::eAllCommands);
+    renderForward(cmd_buf, target_image, target_image_view, firstDraws, true, !culling);
+    if (culling)
+    {
+      cullPhase2();
+      renderForward(cmd_buf, target_image, target_image_view, MainViewDraws::PHASE_2, false, true);
+    }
+  }
 
-    cmd_buf.bindPipeline(vk::PipelineBindPoint::eGraphics, basicForwardPipeline.getVkPipeline());
-    cmd_buf.bindDescriptorSets(
-      vk::PipelineBindPoint::eGraphics,
-      basicForwardPipeline.getVkPipelineLayout(),
-      0,
-      {set.getVkSet()},
-      {});
+  timestamps->write(cmd_buf, TIMESTAMP_FORWARD_END, vk::PipelineStageFlagBits2::eAllCommands);
 
-    renderScene(cmd_buf, worldViewProj, basicForwardPipeline.getVkPipelineLayout());
-  }
+  // NOTE: the depth is always complete here, whether it was culled or not
+  previousWorldViewProj = worldViewProj;
+  mainViewDepthHasHistory = true;
 
-  if (drawDebugFSQuad)
+  if (settings.drawDebugFSQuad)
     quadRenderer->render(cmd_buf, target_image, target_image_view, shadowMap, defaultSampler);
+
+  timestamps->write(cmd_buf, TIMESTAMP_GRAPHICS_END, vk::PipelineStageFlagBits2::eAllCommands);
+}
+
+void WorldRenderer::publishTimings()
+{
+  const auto computeBegin = timestamps->getAbsoluteMs(TIMESTAMP_COMPUTE_BEGIN);
+  const auto computeEnd = timestamps->getAbsoluteMs(TIMESTAMP_COMPUTE_END);
+  const auto graphicsBegin = timestamps->getAbsoluteMs(TIMESTAMP_GRAPHICS_BEGIN);
+  const auto graphicsEnd = timestamps->getAbsoluteMs(TIMESTAMP_GRAPHICS_END);
+
+  GpuTimings timings;
+  if (computeBegin && computeEnd && graphicsBegin && graphicsEnd)
+  {
+    timings.computeMs = *computeEnd - *computeBegin;
+    timings.graphicsMs = *graphicsEnd - *graphicsBegin;
+    // NOTE: inline, the simulation is a part of the graphics interval
+    timings.spanMs =
+      std::max(*computeEnd, *graphicsEnd) - std::min(*computeBegin, *graphicsBegin);
+  }
+
+  // NOTE: prepass and culling timestamps are only written by frames which had them
+  const auto mainViewMs = timestamps->getMs(TIMESTAMP_MAIN_VIEW_BEGIN, TIMESTAMP_FORWARD_END);
+  const auto cullingMs = timestamps->getMs(TIMESTAMP_CULLING_BEGIN, TIMESTAMP_CULLING_END);
+  const auto cullingPhase2Ms =
+    timestamps->getMs(TIMESTAMP_CULLING_PHASE2_BEGIN, TIMESTAMP_CULLING_PHASE2_END);
+  const auto prepassMs = timestamps->getMs(TIMESTAMP_PREPASS_BEGIN, TIMESTAMP_FORWARD_BEGIN);
+  const auto forwardMs = timestamps->getMs(TIMESTAMP_FORWARD_BEGIN, TIMESTAMP_FORWARD_END);
+  timings.cullingMs = cullingMs.value_or(0.0) + cullingPhase2Ms.value_or(0.0);
+  timings.prepassMs = prepassMs.value_or(0.0);
+  timings.forwardMs = forwardMs.value_or(0.0);
+  // Phase 2 of culling happens in between of the passes of whichever comes first
+  (prepassMs.has_value() ? timings.prepassMs : timings.forwardMs) -= cullingPhase2Ms.value_or(0.0);
+
+  std::unique_lock lock{timingsMutex};
+  timings.mainViewMs = latestTimings.mainViewMs;
+  if (mainViewMs.has_value())
+    timings.mainViewMs[cullingMs.has_value() ? 1 : 0][prepassMs.has_value() ? 1 : 0] =
+      *mainViewMs;
+  latestTimings = timings;
+  latestCullingStats = cullingStats;
+  latestCpuCullingStats = cpuCullingStats;
+  latestDrawListTimings = drawListTimings;
+  latestDescriptorStats = descriptorCache.getStats();
+  if (textureStreamer != nullptr)
+    latestStreamingStats = textureStreamer->getStats();
 }
 
-void WorldRenderer::drawGui()
+void WorldRenderer::drawGui(RenderSettings& render_settings)
 {
   ImGui::Begin("Simple render settings");
 
-  float color[3]{uniformParams.baseColor.r, uniformParams.baseColor.g, uniformParams.baseColor.b};
+  float color[3]{
+    render_settings.baseColor.r, render_settings.baseColor.g, render_settings.baseColor.b};
   ImGui::ColorEdit3(
     "Meshes base color", color, ImGuiColorEditFlags_PickerHueWheel | ImGuiColorEditFlags_NoInputs);
-  uniformParams.baseColor = {color[0], color[1], color[2]};
+  render_settings.baseColor = {color[0], color[1], color[2]};
 
-  float pos[3]{uniformParams.lightPos.x, uniformParams.lightPos.y, uniformParams.lightPos.z};
-  ImGui::SliderFloat3("Light source position", pos, -10.f, 10.f);
-  uniformParams.lightPos = {pos[0], pos[1], pos[2]};
+  // NOTE: the GUI is only re-rendered when it changes, so refreshing this
+  // every frame would make the GUI redraw every frame as well. The first frame
+  // seeds it right away, there is nothing to show before that.
+  if (shownFramerate == 0 || ImGui::GetTime() - shownFramerateTime > 0.5)
+  {
+    const double elapsed = ImGui::GetTime() - shownFramerateTime;
+    shownFramerate = ImGui::GetIO().Framerate;
+    shownFramerateTime = ImGui::GetTime();
 
+    std::unique_lock lock{timingsMutex};
+    shownTimings = latestTimings;
+    shownDrawListTimings = latestDrawListTimings;
+    shownCullingStats = latestCullingStats;
+    shownCpuCullingStats = latestCpuCullingStats;
+    shownDescriptorStats = latestDescriptorStats;
+    const auto uploaded = latestStreamingStats.uploadedBytes;
+    shownStreamingBandwidth = uploaded >= shownStreamingStats.uploadedBytes
+      ? static_cast<double>(uploaded - shownStreamingStats.uploadedBytes) / elapsed
+      : 0.0;
+    shownStreamingStats = latestStreamingStats;
+  }
   ImGui::Text(
-    "Application average %.3f ms/frame (%.1f FPS)",
-    1000.0f / ImGui::GetIO().Framerate,
-    ImGui::GetIO().Framerate);
+    "Application average %.3f ms/frame (%.1f FPS)", 1000.0f / shownFramerate, shownFramerate);
+
+  ImGui::Checkbox("Animate lights and particles", &render_settings.animate);
+  if (!render_settings.animate)
+    ImGui::Text("Nothing is animated, frames are only drawn on input");
+
+  if (ImGui::CollapsingHeader("Shadows", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    // NOTE: these select permutations of the material shader, which are compiled
+    // without the unused code paths instead of branching on uniforms
+    ImGui::Checkbox("Perspective shadow map ('P')", &render_settings.perspectiveShadowMap);
+    ImGui::Checkbox("Soft shadows ('O')", &render_settings.softShadows);
+  }
+
+  if (ImGui::CollapsingHeader("Depth prepass", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Checkbox("Depth prepass ('Z')", &render_settings.depthPrepass);
+    ImGui::Text("GPU depth prepass: %.3f ms", shownTimings.prepassMs);
+    ImGui::Text("GPU forward pass: %.3f ms", shownTimings.forwardMs);
+  }
+
+  if (ImGui::CollapsingHeader("Occlusion culling", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Checkbox("Two-phase Hi-Z culling ('C')", &render_settings.occlusionCulling);
+    ImGui::Text("GPU culling, both phases: %.3f ms", shownTimings.cullingMs);
+    const auto& stats = shownCullingStats;
+    ImGui::Text("Draws: %u, outside of the view: %u", stats.draws, stats.frustumCulled);
+    ImGui::Text("Occluded: %u", stats.occluded);
+    ImGui::Text("Drawn in phase 1: %u, in phase 2: %u", stats.phase1Drawn, stats.phase2Drawn);
+  }
+
+  if (ImGui::CollapsingHeader("CPU occlusion culling", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Checkbox("Masked occlusion culling ('X')", &render_settings.cpuOcclusionCulling);
+    ImGui::SliderInt("Max occluders", &render_settings.maxCpuOccluders, 1, 64);
+    auto showStats = [](const char* view, const OcclusionCuller::Stats& stats) {
+      ImGui::Text(
+        "%s: %u occluders of %zu triangles", view, stats.occluders, stats.occluderTriangles);
+      ImGui::Text(
+        "  %u instances, %u outside of the view, %u occluded",
+        stats.instances,
+        stats.outside,
+        stats.occluded);
+      ImGui::Text(
+        "  CPU select %.3f ms, rasterize %.3f ms, test %.3f ms",
+        stats.selectMs,
+        stats.rasterizeMs,
+        stats.testMs);
+    };
+    showStats("Main view", shownCpuCullingStats.mainView);
+    showStats("Shadow map", shownCpuCullingStats.shadow);
+  }
+
+  // NOTE: overdraw and occlusion depend on the scene and the view, so all variants
+  // are shown to pick from
+  if (ImGui::CollapsingHeader("GPU main view", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    const auto& ms = shownTimings.mainViewMs;
+    ImGui::Text("Plain: %.3f ms", ms[0][0]);
+    ImGui::Text("Depth prepass: %.3f ms", ms[0][1]);
+    ImGui::Text("Culling: %.3f ms", ms[1][0]);
+    ImGui::Text("Culling and depth prepass: %.3f ms", ms[1][1]);
+  }
+
+  if (ImGui::CollapsingHeader("Draw lists", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Text(
+      "Draws: main view %zu, shadow map %zu",
+      shownDrawListTimings.mainDrawCount,
+      shownDrawListTimings.shadowDrawCount);
+    ImGui::Text("CPU build of both lists: %.3f ms", shownDrawListTimings.buildMs);
+    ImGui::Text("CPU sort, front to back: %.3f ms", shownDrawListTimings.mainSortMs);
+    ImGui::Text("CPU sort, shadow by state: %.3f ms", shownDrawListTimings.shadowSortMs);
+  }
+
+  if (ImGui::CollapsingHeader("Descriptor sets", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    const auto& stats = shownDescriptorStats;
+    const auto lookups = stats.hits + stats.misses;
+    ImGui::Text("Persistent sets: %zu", stats.sets);
+    ImGui::Text(
+      "Lookups: %llu, hit rate %.2f%%",
+      static_cast<unsigned long long>(lookups),
+      lookups != 0 ? 100.0 * static_cast<double>(stats.hits) / static_cast<double>(lookups)
+                   : 0.0);
+  }
+
+  if (ImGui::CollapsingHeader("Texture streaming", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    constexpr double MB = 1024.0 * 1024.0;
+    const auto& stats = shownStreamingStats;
+    ImGui::SliderInt("VRAM budget, MB", &render_settings.textureBudgetMb, 16, 2048);
+    ImGui::Text(
+      "Resident: %.1f MB of %.1f MB, all mips would take %.1f MB",
+      static_cast<double>(stats.residentBytes) / MB,
+      static_cast<double>(stats.budgetBytes) / MB,
+      static_cast<double>(stats.fullBytes) / MB);
+    ImGui::Text("Textures lacking requested mips: %u of %u", stats.missingMips, stats.textures);
+    ImGui::Text("Loads in flight: %u", stats.pendingLoads);
+    ImGui::Text(
+      "Upload: %.1f MB/s, %.1f MB in total",
+      shownStreamingBandwidth / MB,
+      static_cast<double>(stats.uploadedBytes) / MB);
+    ImGui::Text("Evicted: %.1f MB in total", static_cast<double>(stats.evictedBytes) / MB);
+  }
+  if (ImGui::CollapsingHeader("Async compute", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Checkbox("Simulate particles in a separate submit", &render_settings.asyncParticles);
+    ImGui::SliderInt("Simulation substeps", &render_settings.particleSubsteps, 1, 64);
+    // NOTE: without a separate queue the simulation and rendering run one after another
+    if (asyncComputeQueue)
+      ImGui::Text("Compute queue: separate");
+    else
+      ImGui::TextWrapped(
+        "Async compute isn't available with the current etna context, "
+        "the separate submit runs on the main queue and doesn't overlap with rendering");
+    ImGui::Text("GPU particle simulation: %.3f ms", shownTimings.computeMs);
+    ImGui::Text("GPU scene rendering: %.3f ms", shownTimings.graphicsMs);
+    ImGui::Text("GPU frame span: %.3f ms", shownTimings.spanMs);
+  }
 
   ImGui::NewLine();
 
-  ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'B' to recompile and reload shaders");
+  ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Shaders are reloaded whenever they change");
+  ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'B' to recompile all shaders");
+  ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "Press 'F1' to hide or show the GUI");
   ImGui::End();
 }
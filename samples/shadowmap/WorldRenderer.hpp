@@ -1,14 +1,31 @@
 #pragma once
 
+#include <array>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
 #include <etna/Image.hpp>
 #include <etna/Sampler.hpp>
 #include <etna/Buffer.hpp>
 #include <etna/GraphicsPipeline.hpp>
+#include <etna/ComputePipeline.hpp>
+#include <etna/GpuSharedResource.hpp>
 #include <glm/glm.hpp>
 
 #include "shaders/UniformParams.h"
 #include "scene/SceneManager.hpp"
 #include "render_utils/QuadRenderer.hpp"
+#include "render_utils/AsyncCompute.hpp"
+#include "render_utils/GpuTimestamps.hpp"
+#include "render_utils/DeferredDestroyQueue.hpp"
+#include "render_utils/PermutationCache.hpp"
+#include "render_utils/DrawList.hpp"
+#include "render_utils/DescriptorCache.hpp"
+#include "occlusion/OcclusionCuller.hpp"
+#include "texture_streaming/TextureStreamer.hpp"
+#include "shader_reload/ShaderHotReloader.hpp"
 #include "wsi/Keyboard.hpp"
 
 #include "FramePacket.hpp"
@@ -28,16 +45,96 @@ public:
   void loadShaders();
   void allocateResources(glm::uvec2 swapchain_resolution);
   void setupPipelines(vk::Format swapchain_format);
+  // Rebuilds programs and pipelines from recompiled shaders in place. Must be called at a frame
+  // boundary, waits for the GPU to be done with the old ones.
+  void reloadShaders(const ShaderHotReloader::Update& update);
+
+  // NOTE: these two are called on the main thread while the render thread is recording
+  // the previous frame, so they may only touch the settings and the GUI-only state.
+  void debugInput(const Keyboard& kb, RenderSettings& settings);
+  void drawGui(RenderSettings& settings);
 
-  void debugInput(const Keyboard& kb);
   void update(const FramePacket& packet);
-  void drawGui();
+
+  // Must be called at the start of every frame, before any recording, once the GPU is done
+  // with the frame from frames in flight ago
+  void beginFrame();
+
+  // Whether frames look different over time even without any input, otherwise
+  // there's no point in rendering new ones until something changes.
+  static bool hasTimeDrivenContent(const RenderSettings& render_settings)
+  {
+    return render_settings.animate;
+  }
+
+  // Whether mips requested by the latest renderWorld are still on their way. They show up
+  // on their own, so frames have to keep coming even if nothing else changes.
+  bool isStreamingTextures() const
+  {
+    return textureStreamer != nullptr && textureStreamer->getStats().pendingLoads > 0;
+  }
+
+  // Work for the async compute queue, which is recorded and submitted before renderWorld.
+  // Returned buffers are read by renderWorld and must be handed over to graphics.
+  bool wantsAsyncCompute() const { return settings.asyncParticles; }
+  void setAsyncComputeQueueInfo(bool separate_queue) { asyncComputeQueue = separate_queue; }
+  void recordAsyncCompute(vk::CommandBuffer cmd_buf);
+  std::vector<AsyncCompute::SharedBuffer> getAsyncComputeOutputs();
+
   void renderWorld(
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
-  void renderScene(
+  // Copy of a binary from the build or of its latest hot-reloaded version, see loadShaders
+  std::filesystem::path getBinaryPath(const std::string& binary) const;
+  void createPrograms();
+  etna::GraphicsPipeline createMaterialPipeline(std::uint32_t mask);
+
+  void createSceneResources();
+
+  // Instances not VISIBLE in visibility are skipped, an empty one means all are visible
+  void buildDrawList(
+    DrawList& draw_list,
+    const glm::mat4x4& glob_tm,
+    DrawOrder order,
+    std::span<const OcclusionResult> visibility);
+  bool bindScene(
     vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
+  void renderScene(
+    vk::CommandBuffer cmd_buf,
+    const DrawList& draw_list,
+    const glm::mat4x4& glob_tm,
+    vk::PipelineLayout pipeline_layout);
+
+  // Which draws of the main view a pass submits: with occlusion culling, draws come from
+  // the GPU in two phases, otherwise all of mainDrawList is drawn straight away
+  enum class MainViewDraws
+  {
+    ALL,
+    PHASE_1,
+    PHASE_2,
+    BOTH_PHASES,
+  };
+  void buildDepthPyramid(vk::CommandBuffer cmd_buf);
+  void cullMainView(vk::CommandBuffer cmd_buf, std::uint32_t phase);
+  void readCullingStats();
+  void renderMainView(
+    vk::CommandBuffer cmd_buf, MainViewDraws draws, vk::PipelineLayout pipeline_layout);
+  void renderDepthPrepass(vk::CommandBuffer cmd_buf, MainViewDraws draws, bool clear_depth);
+  void renderForward(
+    vk::CommandBuffer cmd_buf,
+    vk::Image target_image,
+    vk::ImageView target_image_view,
+    MainViewDraws draws,
+    bool first_pass,
+    bool last_pass);
+  void createSceneTexturesSet(vk::CommandBuffer cmd_buf, etna::DescriptorLayoutId layout_id);
+  // Estimates how many texels per pixel textures of the main view's draws have on the screen
+  void requestTextureMips(const Camera& camera);
+
+  void simulateParticles(vk::CommandBuffer cmd_buf);
+  void renderParticles(vk::CommandBuffer cmd_buf);
+  void publishTimings();
 
 
 private:
@@ -51,32 +148,201 @@ private:
   struct PushConstants
   {
     glm::mat4x4 projView;
-    glm::mat4x4 model;
-  } pushConst2M;
+  } pushConsts;
+
+  // Matrices and bounds of all instances of the scene, see InstanceData.h
+  etna::Buffer instanceData;
+
+  // Bindless materials: relems index the material table through their vertices, and
+  // materials index an array of all textures of the scene, which is bound once per pass
+  etna::Buffer materialData;
+  etna::Sampler materialSampler;
+  etna::PersistentDescriptorSet sceneTexturesSet;
+
+  // Textures start with mips of at most this size, finer ones are streamed in on demand
+  static constexpr std::uint32_t STREAMING_RESIDENT_SIZE = 64;
+  std::unique_ptr<TextureStreamer> textureStreamer;
 
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
   glm::vec3 lightPos;
 
+  // Rebuilt every frame: the main view goes front to back, the shadow map by state
+  DrawList mainDrawList;
+  DrawList shadowDrawList;
+
   struct ShadowMapCam
   {
     float radius = 10;
     float lightTargetDist = 24;
-    bool usePerspectiveM = false;
   } lightProps;
 
+  // Settings of the frame being rendered
+  RenderSettings settings;
+
   UniformParams uniformParams{
     .lightMatrix = {},
     .lightPos = {},
     .time = {},
-    .baseColor = {0.9f, 0.92f, 1.0f},
+    .baseColor = {},
   };
 
-  etna::GraphicsPipeline basicForwardPipeline{};
+  // Under the shader binaries directory, programs are loaded from here, see loadShaders
+  static constexpr const char* LIVE_SHADERS_DIR = "live";
+  struct ProgramNames
+  {
+    std::string simpleShadow;
+    std::string depthPrepass;
+    std::string depthPyramid;
+    std::string hiZCull;
+    std::string particleSim;
+    std::string particleDraw;
+  } programs;
+  std::unique_ptr<DeferredDestroyQueue> retiredObjects;
+
+  // Sets of all passes, invalidated whenever anything bound to them is recreated
+  DescriptorCache descriptorCache;
+
+  // FEATURES of simple_shadow.frag, in order of declaration in CMakeLists.txt
+  enum MaterialFeature : std::uint32_t
+  {
+    MATERIAL_PERSPECTIVE_SHADOWS = 1u << 0,
+    MATERIAL_SOFT_SHADOWS = 1u << 1,
+    MATERIAL_FEATURES_MASK = (1u << 2) - 1,
+
+    // Pipeline state rather than a shader feature: depth is tested for equality
+    // and not written, as it has already been laid down by the depth prepass
+    MATERIAL_PIPELINE_EQUAL_DEPTH = 1u << 31,
+  };
+  // Programs are keyed by features only, pipelines by features and pipeline state bits
+  PermutationCache<std::string> materialPrograms;
+  PermutationCache<etna::GraphicsPipeline> materialPipelines;
+  vk::Format swapchainFormat = vk::Format::eUndefined;
   etna::GraphicsPipeline shadowPipeline{};
+  etna::GraphicsPipeline depthPrepassPipeline{};
+
+  // Two-phase occlusion culling of the main view. Phase 1 draws what was visible in the
+  // previous frame according to a depth pyramid (Hi-Z) of its depth, phase 2 tests everything
+  // else against a pyramid of what phase 1 drew and draws whatever turned out to be visible.
+  etna::Image depthPyramid;
+  std::uint32_t depthPyramidMips = 0;
+  etna::Sampler depthPyramidSampler;
+  etna::ComputePipeline depthPyramidPipeline{};
+  etna::ComputePipeline hiZCullPipeline{};
+
+  // Every relem of every instance, CPU culling may leave fewer of them in mainDrawList
+  std::uint32_t maxCullingDraws = 0;
+  // Commands for all draws of mainDrawList, written by the CPU every frame
+  std::optional<etna::GpuSharedResource<etna::Buffer>> cullingDraws;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> phase1Draws;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> phase2Draws;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> cullingCounters;
+
+  // What the previous frame left in mainViewDepth, which phase 1 relies upon
+  bool mainViewDepthHasHistory = false;
+  glm::mat4x4 previousWorldViewProj;
+
+  // Async compute demo: a particle simulation submitted through AsyncCompute
+  static constexpr std::uint32_t PARTICLE_COUNT = 1u << 20;
+
+  etna::Buffer particleState;
+  std::optional<etna::GpuSharedResource<etna::Buffer>> particlePositions;
+  bool particleStateCleared = false;
+  float particleDt = 0;
+  // Only goes forward while animating, so that nothing jumps when animations are resumed
+  float animationTime = 0;
+  float lastPacketTime = 0;
+
+  etna::ComputePipeline particleSimPipeline{};
+  etna::GraphicsPipeline particleDrawPipeline{};
+
+  enum Timestamp : std::uint32_t
+  {
+    TIMESTAMP_COMPUTE_BEGIN,
+    TIMESTAMP_COMPUTE_END,
+    TIMESTAMP_GRAPHICS_BEGIN,
+    TIMESTAMP_GRAPHICS_END,
+    TIMESTAMP_MAIN_VIEW_BEGIN,
+    TIMESTAMP_CULLING_BEGIN,
+    TIMESTAMP_CULLING_END,
+    TIMESTAMP_CULLING_PHASE2_BEGIN,
+    TIMESTAMP_CULLING_PHASE2_END,
+    TIMESTAMP_PREPASS_BEGIN,
+    TIMESTAMP_FORWARD_BEGIN,
+    TIMESTAMP_FORWARD_END,
+    TIMESTAMP_COUNT,
+  };
+  std::unique_ptr<GpuTimestamps> timestamps;
+  bool asyncComputeQueue = false;
+
+  struct GpuTimings
+  {
+    double computeMs = 0;
+    double graphicsMs = 0;
+    double spanMs = 0;
+
+    double cullingMs = 0;
+    double prepassMs = 0;
+    double forwardMs = 0;
+    // Whole main view of the latest frames rendered without and with occlusion culling (outer)
+    // and a prepass (inner), so that all variants can be compared after switching between them
+    std::array<std::array<double, 2>, 2> mainViewMs = {};
+  };
+
+  // CPU side of the frame, measured on the render thread
+  struct DrawListTimings
+  {
+    std::size_t mainDrawCount = 0;
+    std::size_t shadowDrawCount = 0;
+    double buildMs = 0;
+    double mainSortMs = 0;
+    double shadowSortMs = 0;
+  };
+  DrawListTimings drawListTimings;
+
+  // Counted by the GPU in draws, read back frames in flight later
+  struct CullingStats
+  {
+    std::uint32_t draws = 0;
+    std::uint32_t frustumCulled = 0;
+    std::uint32_t occluded = 0;
+    std::uint32_t phase1Drawn = 0;
+    std::uint32_t phase2Drawn = 0;
+  };
+  CullingStats cullingStats;
+
+  // Both views are culled on the CPU before their draw lists are built, the resolutions
+  // are independent of the window, as only large occluders are rasterized anyway
+  OcclusionCuller mainViewOcclusion{{320, 184}};
+  OcclusionCuller shadowOcclusion{{256, 256}};
+  struct CpuCullingStats
+  {
+    OcclusionCuller::Stats mainView;
+    OcclusionCuller::Stats shadow;
+  };
+  CpuCullingStats cpuCullingStats;
+
+  // Written by the render thread, read by the GUI on the main thread
+  std::mutex timingsMutex;
+  GpuTimings latestTimings;
+  DrawListTimings latestDrawListTimings;
+  CullingStats latestCullingStats;
+  CpuCullingStats latestCpuCullingStats;
+  DescriptorCache::Stats latestDescriptorStats;
+  TextureStreamer::Stats latestStreamingStats;
 
   std::unique_ptr<QuadRenderer> quadRenderer;
-  bool drawDebugFSQuad = false;
+
+  // GUI-only state
+  GpuTimings shownTimings;
+  DrawListTimings shownDrawListTimings;
+  CullingStats shownCullingStats;
+  CpuCullingStats shownCpuCullingStats;
+  DescriptorCache::Stats shownDescriptorStats;
+  TextureStreamer::Stats shownStreamingStats;
+  double shownStreamingBandwidth = 0;
+  float shownFramerate = 0;
+  double shownFramerateTime = 0;
 
   glm::uvec2 resolution;
 };
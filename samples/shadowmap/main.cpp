@@ -1,11 +1,35 @@
 #include "App.hpp"
 
+#include <string_view>
 
-int main()
+#include <spdlog/spdlog.h>
+
+
+int main(int argc, char** argv)
 {
+  // Usage: shadowmap [--record <file> | --replay <file>]
+  const std::string_view mode = argc > 1 ? argv[1] : "";
+  if (argc == 2 || argc > 3 || (argc == 3 && mode != "--record" && mode != "--replay"))
+  {
+    spdlog::error("Usage: shadowmap [--record <file> | --replay <file>]");
+    return 1;
+  }
+
+  int result = 0;
+
   {
     App app;
-    app.run();
+
+    bool started = true;
+    if (mode == "--record")
+      started = app.recordInput(argv[2]);
+    else if (mode == "--replay")
+      started = app.replayInput(argv[2]);
+
+    if (started)
+      app.run();
+    else
+      result = 1;
   }
 
   // Etna needs to be de-initialized after all resources allocated by app
@@ -13,5 +37,5 @@ int main()
   if (etna::is_initilized())
     etna::shutdown();
 
-  return 0;
+  return result;
 }
@@ -0,0 +1,37 @@
+#ifndef CULLING_PARAMS_H_INCLUDED
+#define CULLING_PARAMS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define DEPTH_PYRAMID_WORKGROUP_SIZE 8
+#define CULLING_WORKGROUP_SIZE 64
+
+struct DepthPyramidParams
+{
+  shader_uvec2 srcSize;
+  shader_uvec2 dstSize;
+};
+
+// Counters of the culling, in draws (relems of instances)
+#define CULLING_STAT_DRAWS 0
+#define CULLING_STAT_FRUSTUM_CULLED 1
+#define CULLING_STAT_PHASE1_DRAWN 2
+#define CULLING_STAT_PHASE2_DRAWN 3
+#define CULLING_STAT_OCCLUDED 4
+#define CULLING_STAT_COUNT 5
+
+struct CullingParams
+{
+  // Previous frame's for phase 1, the current one for phase 2
+  shader_mat4 viewProj;
+  // Size of mainViewDepth, mip 0 of the pyramid is half of it
+  shader_uvec2 depthSize;
+  shader_uint drawCount;
+  shader_uint phase;
+  // Phase 1 draws nothing without the previous frame's depth
+  shader_uint hasHistory;
+};
+
+
+#endif // CULLING_PARAMS_H_INCLUDED
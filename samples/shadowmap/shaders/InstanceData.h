@@ -0,0 +1,18 @@
+#ifndef INSTANCE_DATA_H_INCLUDED
+#define INSTANCE_DATA_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Per-instance data of the scene, indexed with gl_InstanceIndex in vertex shaders,
+// so draws of an instance pass its index as firstInstance
+struct InstanceData
+{
+  shader_mat4 model;
+  // World-space bounding box, w is unused
+  shader_vec4 boundsMin;
+  shader_vec4 boundsMax;
+};
+
+
+#endif // INSTANCE_DATA_H_INCLUDED
@@ -0,0 +1,28 @@
+#ifndef MATERIAL_DATA_H_INCLUDED
+#define MATERIAL_DATA_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+// Size of the texture array all materials index into, textures past it are never sampled
+#define MAX_SCENE_TEXTURES 512
+
+// A glTF metallic-roughness material, indexed with the material index of the vertex.
+// Textures are indices into the texture array, materials without some texture refer
+// to a neutral default one instead, so that shaders never have to check for it.
+struct MaterialData
+{
+  shader_vec4 baseColorFactor;
+  shader_float metallicFactor;
+  shader_float roughnessFactor;
+  shader_float normalScale;
+  shader_uint baseColorTexture;
+  shader_uint normalTexture;
+  shader_uint metallicRoughnessTexture;
+  // NOTE: pads the struct to a multiple of 16 bytes, which is its array stride in GLSL
+  shader_uint padding0;
+  shader_uint padding1;
+};
+
+
+#endif // MATERIAL_DATA_H_INCLUDED
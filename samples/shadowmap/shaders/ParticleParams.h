@@ -0,0 +1,19 @@
+#ifndef PARTICLE_PARAMS_H_INCLUDED
+#define PARTICLE_PARAMS_H_INCLUDED
+
+#include "cpp_glsl_compat.h"
+
+
+#define PARTICLES_WORKGROUP_SIZE 256
+
+struct ParticleSimParams
+{
+  shader_float dt;
+  shader_float time;
+  shader_uint count;
+  // Integration steps per frame, a knob for how heavy the simulation is
+  shader_uint substeps;
+};
+
+
+#endif // PARTICLE_PARAMS_H_INCLUDED
@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : require
+
+#include "InstanceData.h"
+
+
+// Only positions are fetched, the rest of the vertex is of no use for depth
+layout(location = 0) in vec4 vPosNorm;
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+} params;
+
+layout(std430, binding = 2) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
+out gl_PerVertex { vec4 gl_Position; };
+// The forward pass tests for equal depth after a prepass, so positions
+// must come out bit-exact in both, see simple.vert
+invariant gl_Position;
+
+void main(void)
+{
+  const vec3 wPos = (instances[gl_InstanceIndex].model * vec4(vPosNorm.xyz, 1.0f)).xyz;
+  gl_Position = params.mProjView * vec4(wPos, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+
+layout(location = 0) in float vLife;
+
+layout(location = 0) out vec4 out_fragColor;
+
+void main()
+{
+  const vec3 young = vec3(1.0, 0.8, 0.3);
+  const vec3 old = vec3(0.3, 0.05, 0.02);
+  out_fragColor = vec4(mix(old, young, clamp(vLife, 0.0, 1.0)), 1.0);
+}
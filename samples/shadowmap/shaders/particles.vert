@@ -0,0 +1,29 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+
+layout(push_constant) uniform params_t
+{
+  mat4 mProjView;
+} params;
+
+layout(std430, binding = 0) readonly buffer Positions
+{
+  vec4 positions[];
+};
+
+layout(location = 0) out float vLife;
+
+out gl_PerVertex
+{
+  vec4 gl_Position;
+  float gl_PointSize;
+};
+
+void main()
+{
+  const vec4 particle = positions[gl_VertexIndex];
+  vLife = particle.w;
+  gl_Position = params.mProjView * vec4(particle.xyz, 1.0);
+  gl_PointSize = 1.0;
+}
@@ -3,6 +3,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "unpack_attributes.glsl"
+#include "InstanceData.h"
 
 
 layout(location = 0) in vec4 vPosNorm;
@@ -11,9 +12,14 @@ layout(location = 1) in vec4 vTexCoordAndTang;
 layout(push_constant) uniform params_t
 {
   mat4 mProjView;
-  mat4 mModel;
 } params;
 
+// Bindings 0, 1 and 3 are taken by simple_shadow.frag
+layout(std430, binding = 2) readonly buffer Instances
+{
+  InstanceData instances[];
+};
+
 
 layout (location = 0 ) out VS_OUT
 {
@@ -21,18 +27,26 @@ layout (location = 0 ) out VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  // Index into the material table, the same for the whole relem
+  flat uint material;
 } vOut;
 
 out gl_PerVertex { vec4 gl_Position; };
+// Must match depth_only.vert bit-exact for the depth prepass
+invariant gl_Position;
+
 void main(void)
 {
   const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
   const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
 
-  vOut.wPos = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
-  vOut.wNorm = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
-  vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
+  const mat4 model = instances[gl_InstanceIndex].model;
+
+  vOut.wPos = (model * vec4(vPosNorm.xyz, 1.0f)).xyz;
+  vOut.wNorm = normalize(mat3(transpose(inverse(model))) * wNorm.xyz);
+  vOut.wTangent = normalize(mat3(transpose(inverse(model))) * wTang.xyz);
   vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.material = floatBitsToUint(vTexCoordAndTang.w);
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }
@@ -1,8 +1,10 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_nonuniform_qualifier : require
 
 #include "UniformParams.h"
+#include "MaterialData.h"
 
 
 layout(location = 0) out vec4 out_fragColor;
@@ -13,6 +15,7 @@ layout(location = 0) in VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  flat uint material;
 } surf;
 
 layout(binding = 0, set = 0) uniform AppData
@@ -22,18 +25,69 @@ layout(binding = 0, set = 0) uniform AppData
 
 layout(binding = 1) uniform sampler2D shadowMap;
 
+// Binding 2 is taken by simple.vert
+layout(std430, binding = 3) readonly buffer Materials
+{
+  MaterialData materials[];
+};
+
+// All textures of the scene, bound once for all draws, so that materials never change
+// any bindings or pipelines. Draws of a multi-draw call may use different materials.
+layout(set = 1, binding = 0) uniform sampler2D sceneTextures[MAX_SCENE_TEXTURES];
+
+// Permutations of this shader are compiled for every combination of these features:
+// PERSPECTIVE_SHADOWS -- the light matrix is a perspective one
+// SOFT_SHADOWS -- shadows are filtered with 3x3 PCF
+
+float sample_shadow(vec2 uv, float depth)
+{
+  return depth < textureLod(shadowMap, uv, 0).x + 0.001f ? 1.0f : 0.0f;
+}
+
 void main()
 {
   const vec4 posLightClipSpace = params.lightMatrix*vec4(surf.wPos, 1.0f);
 
-  // for orto matrix, we don't need perspective division, you can remove it if you want; this is general case;
+#ifdef PERSPECTIVE_SHADOWS
   const vec3 posLightSpaceNDC = posLightClipSpace.xyz/posLightClipSpace.w;
+#else
+  // for orto matrix, w is always 1, so there's no need for perspective division
+  const vec3 posLightSpaceNDC = posLightClipSpace.xyz;
+#endif
 
   // just shift coords from [-1,1] to [0,1]
   const vec2 shadowTexCoord = posLightSpaceNDC.xy*0.5f + vec2(0.5f, 0.5f);
 
   const bool  outOfView = (shadowTexCoord.x < 0.0001f || shadowTexCoord.x > 0.9999f || shadowTexCoord.y < 0.0091f || shadowTexCoord.y > 0.9999f);
-  const float shadow    = ((posLightSpaceNDC.z < textureLod(shadowMap, shadowTexCoord, 0).x + 0.001f) || outOfView) ? 1.0f : 0.0f;
+
+#ifdef SOFT_SHADOWS
+  const vec2 texelSize = 1.0f / vec2(textureSize(shadowMap, 0));
+  float lit = 0.0f;
+  for (int y = -1; y <= 1; ++y)
+    for (int x = -1; x <= 1; ++x)
+      lit += sample_shadow(shadowTexCoord + vec2(x, y) * texelSize, posLightSpaceNDC.z);
+  lit /= 9.0f;
+#else
+  const float lit = sample_shadow(shadowTexCoord, posLightSpaceNDC.z);
+#endif
+  const float shadow = outOfView ? 1.0f : lit;
+
+  const MaterialData material = materials[surf.material];
+  const vec4 albedo = material.baseColorFactor *
+    texture(sceneTextures[nonuniformEXT(material.baseColorTexture)], surf.texCoord);
+
+  // NOTE: bitangent signs are lost in vertex packing, glTF assets rarely have mirrored UVs
+  // NOTE: baked normal maps are BC5 and only have xy, z is always restored from them
+  const vec2 tangentNormalXy = texture(
+    sceneTextures[nonuniformEXT(material.normalTexture)], surf.texCoord).xy * 2.0f - 1.0f;
+  const vec3 tangentNormal = vec3(
+    tangentNormalXy, sqrt(max(1.0f - dot(tangentNormalXy, tangentNormalXy), 0.0f)));
+  const vec3 wNorm = normalize(surf.wNorm);
+  const vec3 wTangent = normalize(surf.wTangent - wNorm * dot(surf.wTangent, wNorm));
+  const vec3 normal = any(isnan(wTangent))
+    ? wNorm
+    : normalize(mat3(wTangent, cross(wNorm, wTangent), wNorm)
+        * vec3(tangentNormal.xy * material.normalScale, tangentNormal.z));
 
   const vec4 dark_violet = vec4(0.59f, 0.0f, 0.82f, 1.0f);
   const vec4 chartreuse  = vec4(0.5f, 1.0f, 0.0f, 1.0f);
@@ -42,8 +96,8 @@ void main()
   const vec4 lightColor2 = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 
   const vec3 lightDir   = normalize(params.lightPos - surf.wPos);
-  const vec4 lightColor = max(dot(surf.wNorm, lightDir), 0.0f) * lightColor1;
+  const vec4 lightColor = max(dot(normal, lightDir), 0.0f) * lightColor1;
   const float ambient = 0.05;
   // Light formula is pretty arbitrary and most definitely wrong
-  out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f);
+  out_fragColor = (lightColor * shadow + ambient) * vec4(params.baseColor, 1.0f) * albedo;
 }
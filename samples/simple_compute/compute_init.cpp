@@ -14,10 +14,30 @@ void SimpleCompute::init()
 
   context = &etna::get_context();
 
-  cmdMgr = context->createOneShotCmdMgr();
+  // A single chunk must be addressable as a whole storage buffer by the shader
+  const auto limits = context->getPhysicalDevice().getProperties().limits;
+  params.chunkBytes = std::min<std::uint64_t>(params.chunkBytes, limits.maxStorageBufferRange);
+  chunkLength =
+    std::max<std::uint64_t>(std::min(params.length, params.chunkBytes / sizeof(float)), 1);
+  length = params.length;
 
-  transferHelper =
-    std::make_unique<etna::BlockingTransferHelper>(etna::BlockingTransferHelper::CreateInfo{
-      .stagingSize = static_cast<std::uint32_t>(length * sizeof(float)),
-    });
+  cmdPool = etna::unwrap_vk_result(context->getDevice().createCommandPoolUnique(
+    vk::CommandPoolCreateInfo{
+      .flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+      .queueFamilyIndex = context->getQueueFamilyIdx(),
+    }));
+
+  auto cmdBufs = etna::unwrap_vk_result(
+    context->getDevice().allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo{
+      .commandPool = cmdPool.get(),
+      .level = vk::CommandBufferLevel::ePrimary,
+      .commandBufferCount = static_cast<std::uint32_t>(SLOT_COUNT),
+    }));
+
+  for (std::size_t i = 0; i < SLOT_COUNT; ++i)
+  {
+    slots[i].cmdBuf = std::move(cmdBufs[i]);
+    slots[i].fence = etna::unwrap_vk_result(context->getDevice().createFenceUnique(
+      vk::FenceCreateInfo{.flags = vk::FenceCreateFlagBits::eSignaled}));
+  }
 }
@@ -0,0 +1,34 @@
+#include "cpu_backend.h"
+
+#include <tracy/Tracy.hpp>
+
+#include "cpu_kernels.h"
+
+
+// Big enough for the overhead of picking up a range to be negligible,
+// small enough for threads that got descheduled not to stall everyone.
+static constexpr std::uint64_t GRAIN_ELEMENTS = 64 * 1024;
+
+CpuBackend::CpuBackend()
+  : bestIsa{cpu_supports_avx2() ? Isa::Avx2 : Isa::Scalar}
+  , jobs{get_job_system()}
+{
+}
+
+void CpuBackend::addVectors(
+  const float* a, const float* b, float* result, std::uint64_t length, Isa isa, bool multithreaded)
+{
+  ZoneScoped;
+
+  auto kernel = isa == Isa::Avx2 ? &add_vectors_avx2 : &add_vectors_scalar;
+
+  if (!multithreaded)
+  {
+    kernel(a, b, result, length);
+    return;
+  }
+
+  jobs.parallelFor("Add vectors", length, GRAIN_ELEMENTS, [&](std::size_t begin, std::size_t end) {
+    kernel(a + begin, b + begin, result + begin, end - begin);
+  });
+}
@@ -0,0 +1,41 @@
+#ifndef CPU_BACKEND_H
+#define CPU_BACKEND_H
+
+#include <cstdint>
+
+#include "jobs/JobSystem.hpp"
+
+
+// Runs SimpleCompute kernels on the CPU. The data is split into contiguous ranges
+// which are picked up by the workers of the shared job system plus the calling thread.
+class CpuBackend
+{
+public:
+  enum class Isa
+  {
+    Scalar,
+    Avx2,
+  };
+
+  CpuBackend();
+
+  // Best instruction set available on this machine
+  Isa getBestIsa() const { return bestIsa; }
+  // Including the calling thread
+  std::size_t getThreadCount() const { return jobs.getWorkerCount() + 1; }
+
+  void addVectors(
+    const float* a,
+    const float* b,
+    float* result,
+    std::uint64_t length,
+    Isa isa,
+    bool multithreaded);
+
+private:
+  Isa bestIsa;
+  JobSystem& jobs;
+};
+
+
+#endif // CPU_BACKEND_H
@@ -0,0 +1,37 @@
+#include "cpu_kernels.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+bool cpu_supports_avx2()
+{
+#if !SIMPLE_COMPUTE_HAS_AVX2
+  return false;
+#elif defined(_MSC_VER)
+  // Both the CPU and the OS (saving of YMM registers) must support it
+  int regs[4];
+  __cpuid(regs, 1);
+  const bool osxsave = (regs[2] & (1 << 27)) != 0;
+  if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+    return false;
+  __cpuidex(regs, 7, 0);
+  return (regs[1] & (1 << 5)) != 0;
+#else
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+
+void add_vectors_scalar(const float* a, const float* b, float* result, std::uint64_t length)
+{
+  for (std::uint64_t i = 0; i < length; ++i)
+    result[i] = a[i] + b[i];
+}
+
+#if !SIMPLE_COMPUTE_HAS_AVX2
+void add_vectors_avx2(const float* a, const float* b, float* result, std::uint64_t length)
+{
+  add_vectors_scalar(a, b, result, length);
+}
+#endif
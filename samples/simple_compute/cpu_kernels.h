@@ -0,0 +1,17 @@
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include <cstdint>
+
+
+// CPU versions of the SimpleCompute shaders. Each kernel comes in a plain C++ flavour,
+// which is whatever the compiler makes of it for the baseline ISA, and a hand-written
+// AVX2 one, which must only be called if cpu_supports_avx2() returns true.
+
+bool cpu_supports_avx2();
+
+void add_vectors_scalar(const float* a, const float* b, float* result, std::uint64_t length);
+void add_vectors_avx2(const float* a, const float* b, float* result, std::uint64_t length);
+
+
+#endif // CPU_KERNELS_H
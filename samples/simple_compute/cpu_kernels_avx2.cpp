@@ -0,0 +1,30 @@
+#include "cpu_kernels.h"
+
+#include <immintrin.h>
+
+// NOTE: this file is compiled with AVX2 enabled, see CMakeLists.txt
+
+
+void add_vectors_avx2(const float* a, const float* b, float* result, std::uint64_t length)
+{
+  std::uint64_t i = 0;
+
+  // Unrolled, so that several independent loads are always in flight
+  for (; i + 32 <= length; i += 32)
+  {
+    const __m256 s0 = _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    const __m256 s1 = _mm256_add_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+    const __m256 s2 = _mm256_add_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16));
+    const __m256 s3 = _mm256_add_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24));
+    _mm256_storeu_ps(result + i, s0);
+    _mm256_storeu_ps(result + i + 8, s1);
+    _mm256_storeu_ps(result + i + 16, s2);
+    _mm256_storeu_ps(result + i + 24, s3);
+  }
+
+  for (; i + 8 <= length; i += 8)
+    _mm256_storeu_ps(result + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+  for (; i < length; ++i)
+    result[i] = a[i] + b[i];
+}
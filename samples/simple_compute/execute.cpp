@@ -1,17 +1,213 @@
 #include "simple_compute.h"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <tuple>
+
+#include <fmt/ranges.h> // NOTE: vector and co are only printable with this included
+#include <spdlog/spdlog.h>
 #include <etna/Etna.hpp>
 
 
+double SimpleCompute::runGpu()
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  // While the GPU works on chunk i, we copy chunk i+1 into the staging memory
+  // of the next slot and copy out the result of chunk i+1-SLOT_COUNT.
+  for (std::uint64_t chunk = 0; chunk < chunkCount(); ++chunk)
+  {
+    auto& slot = slots[chunk % SLOT_COUNT];
+    retireChunk(slot);
+    submitChunk(slot, chunk);
+  }
+
+  for (auto& slot : slots)
+    retireChunk(slot);
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double SimpleCompute::runCpu(CpuBackend::Isa isa, bool multithreaded)
+{
+  const auto start = std::chrono::steady_clock::now();
+
+  cpuBackend.addVectors(hostA.data(), hostB.data(), hostResult.data(), length, isa, multithreaded);
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double SimpleCompute::runMemcpyBaseline()
+{
+  // Moves exactly the same amount of host memory as the GPU path does,
+  // through a chunk-sized intermediate buffer, but computes nothing.
+  std::vector<float> staging(2 * chunkLength);
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (std::uint64_t first = 0; first < length; first += chunkLength)
+  {
+    const std::uint64_t count = std::min(chunkLength, length - first);
+    std::memcpy(staging.data(), hostA.data() + first, sizeof(float) * count);
+    std::memcpy(staging.data() + chunkLength, hostB.data() + first, sizeof(float) * count);
+    std::memcpy(hostResult.data() + first, staging.data(), sizeof(float) * count);
+  }
+
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
 void SimpleCompute::execute()
 {
   setup();
 
-  auto cmdBuf = cmdMgr->start();
+  spdlog::info(
+    "Adding two vectors of {} floats in {} chunk(s) of up to {} floats",
+    length,
+    chunkCount(),
+    chunkLength);
+
+  // Inputs and output of each element
+  const double totalGb = 3.0 * sizeof(float) * static_cast<double>(length) / 1e9;
+
+  const double baselineSeconds = runMemcpyBaseline();
+
+  // The first run warms up the driver and the page tables of host memory.
+  runGpu();
+  const double gpuSeconds = runGpu();
+
+  if (!validate())
+  {
+    spdlog::error("GPU result is incorrect!");
+    return;
+  }
+
+  if (length <= 32)
+    spdlog::info("Result on cpu:\n{}", fmt::join(hostResult, ", "));
+
+  spdlog::info("GPU end-to-end: {:.3f} ms, {:.2f} GB/s", gpuSeconds * 1e3, totalGb / gpuSeconds);
+  spdlog::info(
+    "memcpy baseline: {:.3f} ms, {:.2f} GB/s", baselineSeconds * 1e3, totalGb / baselineSeconds);
+  spdlog::info(
+    "GPU path runs at {:.1f}% of memcpy throughput", 100.0 * baselineSeconds / gpuSeconds);
+
+  const bool avx2 = cpuBackend.getBestIsa() == CpuBackend::Isa::Avx2;
+  const std::array<std::tuple<const char*, CpuBackend::Isa, bool>, 3> cpuVariants{{
+    {"CPU scalar, 1 thread", CpuBackend::Isa::Scalar, false},
+    {avx2 ? "CPU AVX2, 1 thread" : "CPU scalar, 1 thread", cpuBackend.getBestIsa(), false},
+    {avx2 ? "CPU AVX2, all threads" : "CPU scalar, all threads", cpuBackend.getBestIsa(), true},
+  }};
+
+  for (const auto& [name, isa, multithreaded] : cpuVariants)
+  {
+    runCpu(isa, multithreaded);
+    const double cpuSeconds = runCpu(isa, multithreaded);
+    if (!validate())
+    {
+      spdlog::error("{} result is incorrect!", name);
+      return;
+    }
+    spdlog::info(
+      "{}: {:.3f} ms, {:.2f} GB/s, GPU end-to-end is {:.2f}x as fast",
+      name,
+      cpuSeconds * 1e3,
+      totalGb / cpuSeconds,
+      cpuSeconds / gpuSeconds);
+  }
+}
+
+void SimpleCompute::sweep()
+{
+  setup();
+
+  const bool avx2 = cpuBackend.getBestIsa() == CpuBackend::Isa::Avx2;
+  spdlog::info(
+    "Sweeping lengths up to {}, CPU backend: {}, {} thread(s), GPU chunks of up to {} floats",
+    params.length,
+    avx2 ? "AVX2" : "scalar",
+    cpuBackend.getThreadCount(),
+    chunkLength);
+  spdlog::info(
+    "{:>12} {:>14} {:>14} {:>14} {:>14}",
+    "length",
+    "GPU e2e ms",
+    "CPU 1T ms",
+    "CPU MT ms",
+    "winner");
+
+  struct Row
+  {
+    std::uint64_t length = 0;
+    double gpu = 0;
+    double cpuSingle = 0;
+    double cpuMulti = 0;
+  };
+  std::vector<Row> rows;
+
+  // Lengths grow 4x at a time, the last step is cut short so that the maximum is measured too
+  for (length = std::min<std::uint64_t>(1024, params.length);;
+       length = std::min(length * 4, params.length))
+  {
+    // Small lengths are over in microseconds, so take the best of many runs
+    const int repeats =
+      static_cast<int>(std::clamp<std::uint64_t>((64ull << 20) / length, 3, 100));
+
+    auto best = [repeats](auto&& run) {
+      double result = std::numeric_limits<double>::max();
+      run(); // Warm-up
+      for (int i = 0; i < repeats; ++i)
+        result = std::min(result, run());
+      return result;
+    };
+
+    Row row{.length = length};
+
+    row.gpu = best([this]() { return runGpu(); });
+    bool valid = validate();
+    row.cpuSingle = best([this]() { return runCpu(cpuBackend.getBestIsa(), false); });
+    valid = valid && validate();
+    row.cpuMulti = best([this]() { return runCpu(cpuBackend.getBestIsa(), true); });
+    valid = valid && validate();
+
+    if (!valid)
+    {
+      spdlog::error("Incorrect results for length {}!", length);
+      return;
+    }
+
+    const double bestCpu = std::min(row.cpuSingle, row.cpuMulti);
+    spdlog::info(
+      "{:>12} {:>14.3f} {:>14.3f} {:>14.3f} {:>14}",
+      length,
+      row.gpu * 1e3,
+      row.cpuSingle * 1e3,
+      row.cpuMulti * 1e3,
+      row.gpu < bestCpu ? "GPU" : "CPU");
+
+    rows.push_back(row);
+
+    if (length == params.length)
+      break;
+  }
 
-  buildCommandBuffer(cmdBuf);
+  // The crossover is the smallest length after which the GPU wins on every measured length
+  auto crossover = [&rows](auto cpu_time) -> std::optional<std::uint64_t> {
+    std::optional<std::uint64_t> result;
+    for (auto it = rows.rbegin(); it != rows.rend() && it->gpu < cpu_time(*it); ++it)
+      result = it->length;
+    return result;
+  };
 
-  cmdMgr->submitAndWait(std::move(cmdBuf));
+  auto report = [](const char* against, std::optional<std::uint64_t> len) {
+    if (len.has_value())
+      spdlog::info("GPU offload beats {} from {} elements on", against, *len);
+    else
+      spdlog::info("GPU offload never beats {} at the largest measured length", against);
+  };
 
-  readback();
+  report("a single CPU thread", crossover([](const Row& row) { return row.cpuSingle; }));
+  report("all CPU threads", crossover([](const Row& row) { return row.cpuMulti; }));
 }
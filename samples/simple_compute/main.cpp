@@ -1,17 +1,72 @@
 #include "simple_compute.h"
+#include "primitives_benchmark.h"
 #include <etna/Etna.hpp>
 
-int main()
+#include <cstdlib>
+#include <string_view>
+
+static int run_primitives_benchmark(int argc, char** argv)
+{
+  // Usage: simple_compute --primitives [max element count]
+  std::uint64_t maxCount = 16u << 20;
+  if (argc > 2)
+    maxCount = std::strtoull(argv[2], nullptr, 10);
+
+  if (maxCount < 1024 || maxCount >= (1u << 30))
+  {
+    spdlog::error("Usage: simple_compute --primitives [max element count in [1024, 2^30)]");
+    return 1;
+  }
+
+  PrimitivesBenchmark benchmark(static_cast<std::uint32_t>(maxCount));
+
+  benchmark.init();
+  benchmark.execute();
+
+  return 0;
+}
+
+int main(int argc, char** argv)
 {
+  int result = 0;
+
+  if (argc > 1 && std::string_view{argv[1]} == "--primitives")
+  {
+    result = run_primitives_benchmark(argc, argv);
+  }
+  else
   {
-    SimpleCompute app;
+    // Usage: simple_compute [--sweep] [element count] [chunk size in MiB]
+    // NOTE: the full sweep up to 1G elements needs about 12 GiB of RAM
+    const bool sweep = argc > 1 && std::string_view{argv[1]} == "--sweep";
+    const int firstArg = sweep ? 2 : 1;
+
+    SimpleCompute::Params params;
+    if (sweep)
+      params.length = 1ull << 30;
+    if (argc > firstArg)
+      params.length = std::strtoull(argv[firstArg], nullptr, 10);
+    if (argc > firstArg + 1)
+      params.chunkBytes = std::strtoull(argv[firstArg + 1], nullptr, 10) << 20;
+
+    if (params.length == 0 || params.chunkBytes == 0)
+    {
+      spdlog::error("Usage: simple_compute [--sweep] [element count] [chunk size in MiB]");
+      spdlog::error("       simple_compute --primitives [max element count]");
+      return 1;
+    }
+
+    SimpleCompute app(params);
 
     app.init();
-    app.execute();
+    if (sweep)
+      app.sweep();
+    else
+      app.execute();
   }
 
   if (etna::is_initilized())
     etna::shutdown();
 
-  return 0;
+  return result;
 }
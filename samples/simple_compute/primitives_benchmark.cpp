@@ -0,0 +1,387 @@
+#include "primitives_benchmark.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+#include <etna/Etna.hpp>
+
+#include "gpu_primitives/CpuReference.hpp"
+
+
+enum StagingRegion : std::uint32_t
+{
+  STAGING_INPUT = 0,
+  STAGING_FLAGS = 1,
+  STAGING_KEYS = 2,
+  STAGING_VALUES = 3,
+  STAGING_REGION_COUNT = 4,
+};
+
+static void memory_barrier(
+  vk::CommandBuffer cmd_buf,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  vk::MemoryBarrier2 barrier{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+  };
+  cmd_buf.pipelineBarrier2(vk::DependencyInfo{
+    .memoryBarrierCount = 1,
+    .pMemoryBarriers = &barrier,
+  });
+}
+
+template <class F>
+static double cpu_ms(F&& func)
+{
+  const auto start = std::chrono::steady_clock::now();
+  func();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+    .count();
+}
+
+PrimitivesBenchmark::PrimitivesBenchmark(std::uint32_t max_count)
+  : maxCount{max_count}
+{
+}
+
+void PrimitivesBenchmark::init()
+{
+  etna::initialize(etna::InitParams{
+    .applicationName = "GpuPrimitivesBenchmark",
+    .applicationVersion = VK_MAKE_VERSION(0, 1, 0),
+  });
+
+  context = &etna::get_context();
+  oneShotCommands = context->createOneShotCmdMgr();
+
+  timestampPool = etna::unwrap_vk_result(
+    context->getDevice().createQueryPoolUnique(vk::QueryPoolCreateInfo{
+      .queryType = vk::QueryType::eTimestamp,
+      .queryCount = 2,
+    }));
+}
+
+void PrimitivesBenchmark::setup()
+{
+  primitives.emplace(maxCount);
+
+  const vk::DeviceSize bytes = sizeof(std::uint32_t) * vk::DeviceSize{maxCount};
+
+  staging = context->createBuffer(etna::Buffer::CreateInfo{
+    .size = STAGING_REGION_COUNT * bytes,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "staging",
+  });
+  staging.map();
+
+  // NOTE: CPU_ONLY is always host-coherent, so results can be read without invalidating
+  readback = context->createBuffer(etna::Buffer::CreateInfo{
+    .size = 2 * bytes,
+    .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+    .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+    .name = "readback",
+  });
+  readback.map();
+
+  const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer |
+    vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eTransferSrc;
+
+  input = context->createBuffer({.size = bytes, .bufferUsage = usage, .name = "input"});
+  flags = context->createBuffer({.size = bytes, .bufferUsage = usage, .name = "flags"});
+  output = context->createBuffer({.size = bytes, .bufferUsage = usage, .name = "output"});
+  keys = context->createBuffer({.size = bytes, .bufferUsage = usage, .name = "keys"});
+  values = context->createBuffer({.size = bytes, .bufferUsage = usage, .name = "values"});
+  scalar = context->createBuffer(
+    {.size = sizeof(std::uint32_t), .bufferUsage = usage, .name = "scalar"});
+}
+
+std::uint32_t* PrimitivesBenchmark::stagingData(std::uint32_t region)
+{
+  return reinterpret_cast<std::uint32_t*>(staging.data()) + std::size_t{region} * maxCount;
+}
+
+const std::uint32_t* PrimitivesBenchmark::readbackData(std::uint32_t region)
+{
+  return reinterpret_cast<const std::uint32_t*>(readback.data()) + std::size_t{region} * maxCount;
+}
+
+void PrimitivesBenchmark::fillInputs(std::uint32_t count)
+{
+  std::mt19937 rng{count};
+
+  // Small values, so that the scan never overflows the 30 bits available to it
+  hostInput.resize(count);
+  for (auto& value : hostInput)
+    value = rng() % 16;
+
+  hostFlags.resize(count);
+  for (auto& flag : hostFlags)
+    flag = rng() % 2;
+
+  // Full-range keys with plenty of duplicates, values track the original position
+  // so that stability is checked too.
+  hostKeys.resize(count);
+  hostValues.resize(count);
+  for (std::uint32_t i = 0; i < count; ++i)
+  {
+    hostKeys[i] = rng() & 0xFFFF00FFu;
+    hostValues[i] = i;
+  }
+
+  const std::size_t bytes = sizeof(std::uint32_t) * count;
+  std::memcpy(stagingData(STAGING_INPUT), hostInput.data(), bytes);
+  std::memcpy(stagingData(STAGING_FLAGS), hostFlags.data(), bytes);
+  std::memcpy(stagingData(STAGING_KEYS), hostKeys.data(), bytes);
+  std::memcpy(stagingData(STAGING_VALUES), hostValues.data(), bytes);
+
+  auto cmdBuf = oneShotCommands->start();
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+  const vk::DeviceSize stride = sizeof(std::uint32_t) * vk::DeviceSize{maxCount};
+  cmdBuf.copyBuffer(
+    staging.get(),
+    input.get(),
+    {vk::BufferCopy{.srcOffset = STAGING_INPUT * stride, .size = bytes}});
+  cmdBuf.copyBuffer(
+    staging.get(),
+    flags.get(),
+    {vk::BufferCopy{.srcOffset = STAGING_FLAGS * stride, .size = bytes}});
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+  oneShotCommands->submitAndWait(cmdBuf);
+}
+
+void PrimitivesBenchmark::copyToReadback(
+  vk::CommandBuffer cmd_buf, const etna::Buffer& src, std::uint32_t region, std::uint32_t count)
+{
+  cmd_buf.copyBuffer(
+    src.get(),
+    readback.get(),
+    {vk::BufferCopy{
+      .dstOffset = sizeof(std::uint32_t) * vk::DeviceSize{region} * maxCount,
+      .size = sizeof(std::uint32_t) * vk::DeviceSize{count},
+    }});
+}
+
+double PrimitivesBenchmark::measure(
+  const std::function<void(vk::CommandBuffer)>& prepare,
+  const std::function<void(vk::CommandBuffer)>& work,
+  const std::function<void(vk::CommandBuffer)>& collect)
+{
+  const double timestampPeriodNs =
+    context->getPhysicalDevice().getProperties().limits.timestampPeriod;
+
+  double bestMs = std::numeric_limits<double>::max();
+  for (int i = 0; i < REPEATS; ++i)
+  {
+    // NOTE: recycles descriptor sets allocated by the primitives
+    etna::begin_frame();
+
+    auto cmdBuf = oneShotCommands->start();
+    ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{}));
+
+    cmdBuf.resetQueryPool(timestampPool.get(), 0, 2);
+
+    prepare(cmdBuf);
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite);
+
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, timestampPool.get(), 0);
+    work(cmdBuf);
+    cmdBuf.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, timestampPool.get(), 1);
+
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead);
+    collect(cmdBuf);
+    memory_barrier(
+      cmdBuf,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eHost,
+      vk::AccessFlagBits2::eHostRead);
+
+    ETNA_CHECK_VK_RESULT(cmdBuf.end());
+    oneShotCommands->submitAndWait(cmdBuf);
+
+    etna::end_frame();
+
+    auto timestamps =
+      etna::unwrap_vk_result(context->getDevice().getQueryPoolResults<std::uint64_t>(
+        timestampPool.get(),
+        0,
+        2,
+        2 * sizeof(std::uint64_t),
+        sizeof(std::uint64_t),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+
+    bestMs = std::min(
+      bestMs, static_cast<double>(timestamps[1] - timestamps[0]) * timestampPeriodNs * 1e-6);
+  }
+
+  return bestMs;
+}
+
+static void no_prepare(vk::CommandBuffer)
+{
+}
+
+PrimitivesBenchmark::Timings PrimitivesBenchmark::benchReduce(std::uint32_t count)
+{
+  Timings result{};
+
+  result.gpuMs = measure(
+    no_prepare,
+    [&](vk::CommandBuffer cmd_buf) { primitives->reduce(cmd_buf, input, count, scalar); },
+    [&](vk::CommandBuffer cmd_buf) { copyToReadback(cmd_buf, scalar, 0, 1); });
+
+  std::uint32_t expected = 0;
+  result.cpuMs = cpu_ms([&]() { expected = reference_reduce(hostInput); });
+
+  result.valid = readbackData(0)[0] == expected;
+  return result;
+}
+
+PrimitivesBenchmark::Timings PrimitivesBenchmark::benchScan(std::uint32_t count)
+{
+  Timings result{};
+
+  result.gpuMs = measure(
+    no_prepare,
+    [&](vk::CommandBuffer cmd_buf) { primitives->exclusiveScan(cmd_buf, input, output, count); },
+    [&](vk::CommandBuffer cmd_buf) { copyToReadback(cmd_buf, output, 0, count); });
+
+  std::vector<std::uint32_t> expected(count);
+  result.cpuMs = cpu_ms([&]() { reference_exclusive_scan(hostInput, expected); });
+
+  result.valid =
+    std::memcmp(readbackData(0), expected.data(), sizeof(std::uint32_t) * count) == 0;
+  return result;
+}
+
+PrimitivesBenchmark::Timings PrimitivesBenchmark::benchCompact(std::uint32_t count)
+{
+  Timings result{};
+
+  result.gpuMs = measure(
+    no_prepare,
+    [&](vk::CommandBuffer cmd_buf) {
+      primitives->compact(cmd_buf, input, flags, count, output, scalar);
+    },
+    [&](vk::CommandBuffer cmd_buf) {
+      copyToReadback(cmd_buf, output, 0, count);
+      copyToReadback(cmd_buf, scalar, 1, 1);
+    });
+
+  std::vector<std::uint32_t> expected(count);
+  std::size_t expectedCount = 0;
+  result.cpuMs =
+    cpu_ms([&]() { expectedCount = reference_compact(hostInput, hostFlags, expected); });
+
+  result.valid = readbackData(1)[0] == expectedCount &&
+    std::memcmp(readbackData(0), expected.data(), sizeof(std::uint32_t) * expectedCount) == 0;
+  return result;
+}
+
+PrimitivesBenchmark::Timings PrimitivesBenchmark::benchSort(std::uint32_t count)
+{
+  Timings result{};
+
+  // Sorting is in place, so the unsorted input is restored before every run
+  const vk::DeviceSize stride = sizeof(std::uint32_t) * vk::DeviceSize{maxCount};
+  const vk::DeviceSize bytes = sizeof(std::uint32_t) * vk::DeviceSize{count};
+
+  result.gpuMs = measure(
+    [&](vk::CommandBuffer cmd_buf) {
+      cmd_buf.copyBuffer(
+        staging.get(),
+        keys.get(),
+        {vk::BufferCopy{.srcOffset = STAGING_KEYS * stride, .size = bytes}});
+      cmd_buf.copyBuffer(
+        staging.get(),
+        values.get(),
+        {vk::BufferCopy{.srcOffset = STAGING_VALUES * stride, .size = bytes}});
+    },
+    [&](vk::CommandBuffer cmd_buf) { primitives->sortPairs(cmd_buf, keys, values, count); },
+    [&](vk::CommandBuffer cmd_buf) {
+      copyToReadback(cmd_buf, keys, 0, count);
+      copyToReadback(cmd_buf, values, 1, count);
+    });
+
+  std::vector<std::uint32_t> expectedKeys = hostKeys;
+  std::vector<std::uint32_t> expectedValues = hostValues;
+  result.cpuMs = cpu_ms([&]() { reference_sort_pairs(expectedKeys, expectedValues); });
+
+  result.valid =
+    std::memcmp(readbackData(0), expectedKeys.data(), bytes) == 0 &&
+    std::memcmp(readbackData(1), expectedValues.data(), bytes) == 0;
+  return result;
+}
+
+void PrimitivesBenchmark::execute()
+{
+  setup();
+
+  spdlog::info(
+    "{:>8} {:>10} {:>12} {:>12} {:>12} {:>9} {:>6}",
+    "prim",
+    "count",
+    "GPU ms",
+    "GPU Melem/s",
+    "CPU ms",
+    "speedup",
+    "valid");
+
+  bool allValid = true;
+  // Counts grow 4x at a time, the last step is cut short so that maxCount is measured too
+  for (std::uint64_t count = 1024;; count = std::min<std::uint64_t>(count * 4, maxCount))
+  {
+    const auto n = static_cast<std::uint32_t>(count);
+    fillInputs(n);
+
+    const std::array<std::pair<const char*, Timings>, 4> results{{
+      {"reduce", benchReduce(n)},
+      {"scan", benchScan(n)},
+      {"compact", benchCompact(n)},
+      {"sort", benchSort(n)},
+    }};
+
+    for (const auto& [name, timings] : results)
+    {
+      spdlog::info(
+        "{:>8} {:>10} {:>12.3f} {:>12.1f} {:>12.3f} {:>8.1f}x {:>6}",
+        name,
+        n,
+        timings.gpuMs,
+        static_cast<double>(n) / (timings.gpuMs * 1e3),
+        timings.cpuMs,
+        timings.cpuMs / timings.gpuMs,
+        timings.valid ? "yes" : "NO");
+      allValid = allValid && timings.valid;
+    }
+
+    if (count == maxCount)
+      break;
+  }
+
+  if (!allValid)
+    spdlog::error("Some GPU primitives produced incorrect results!");
+}
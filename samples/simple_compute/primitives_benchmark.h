@@ -0,0 +1,83 @@
+#ifndef PRIMITIVES_BENCHMARK_H
+#define PRIMITIVES_BENCHMARK_H
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <etna/GlobalContext.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/OneShotCmdMgr.hpp>
+
+#include "gpu_primitives/GpuPrimitives.hpp"
+
+
+// Sweeps GpuPrimitives over problem sizes from 1K up to maxCount elements,
+// validating every result against the scalar CPU references and comparing timings.
+class PrimitivesBenchmark
+{
+public:
+  explicit PrimitivesBenchmark(std::uint32_t max_count);
+
+  void init();
+  void execute();
+
+private:
+  static constexpr int REPEATS = 5;
+
+  struct Timings
+  {
+    double gpuMs;
+    double cpuMs;
+    bool valid;
+  };
+
+  etna::GlobalContext* context;
+  std::uint32_t maxCount;
+
+  std::unique_ptr<etna::OneShotCmdMgr> oneShotCommands;
+  std::optional<GpuPrimitives> primitives;
+  vk::UniqueQueryPool timestampPool;
+
+  // Host-visible, inputs are laid out as [input | flags | keys | values], maxCount elements each
+  etna::Buffer staging;
+  // Host-visible, [first | second], maxCount elements each
+  etna::Buffer readback;
+
+  etna::Buffer input;
+  etna::Buffer flags;
+  etna::Buffer output;
+  etna::Buffer keys;
+  etna::Buffer values;
+  etna::Buffer scalar;
+
+  std::vector<std::uint32_t> hostInput;
+  std::vector<std::uint32_t> hostFlags;
+  std::vector<std::uint32_t> hostKeys;
+  std::vector<std::uint32_t> hostValues;
+
+  void setup();
+  void fillInputs(std::uint32_t count);
+  std::uint32_t* stagingData(std::uint32_t region);
+  const std::uint32_t* readbackData(std::uint32_t region);
+
+  void copyToReadback(
+    vk::CommandBuffer cmd_buf, const etna::Buffer& src, std::uint32_t region, std::uint32_t count);
+
+  // Records `prepare`, `work` and `collect` into a one-shot command buffer and runs it
+  // REPEATS times, only `work` is timed. Returns the best GPU time in milliseconds.
+  // `collect` is supposed to copy results into the readback buffer.
+  double measure(
+    const std::function<void(vk::CommandBuffer)>& prepare,
+    const std::function<void(vk::CommandBuffer)>& work,
+    const std::function<void(vk::CommandBuffer)>& collect);
+
+  Timings benchReduce(std::uint32_t count);
+  Timings benchScan(std::uint32_t count);
+  Timings benchCompact(std::uint32_t count);
+  Timings benchSort(std::uint32_t count);
+};
+
+
+#endif // PRIMITIVES_BENCHMARK_H
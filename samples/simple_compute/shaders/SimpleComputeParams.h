@@ -0,0 +1,8 @@
+#ifndef SIMPLE_COMPUTE_PARAMS_H_INCLUDED
+#define SIMPLE_COMPUTE_PARAMS_H_INCLUDED
+
+// NOTE: included both into C++ and GLSL
+
+#define SIMPLE_COMPUTE_WORKGROUP_SIZE 256
+
+#endif // SIMPLE_COMPUTE_PARAMS_H_INCLUDED
@@ -1,12 +1,13 @@
 #include "simple_compute.h"
 
-#include <fmt/ranges.h> // NOTE: vector and co are only printable with this included
+#include <cstring>
 
+#include <spdlog/spdlog.h>
 #include <etna/Etna.hpp>
 #include <etna/PipelineManager.hpp>
 
-SimpleCompute::SimpleCompute()
-  : length{16}
+SimpleCompute::SimpleCompute(Params params_)
+  : params{params_}
 {
 }
 
@@ -16,83 +17,251 @@ void SimpleCompute::setup()
 
   // Buffer creation
 
-  bufA = context->createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(float) * length,
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
-    .name = "A",
-  });
+  const std::size_t chunkBytes = sizeof(float) * chunkLength;
 
-  bufB = context->createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(float) * length,
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
-    .name = "B",
-  });
+  for (std::size_t i = 0; i < SLOT_COUNT; ++i)
+  {
+    auto& slot = slots[i];
 
-  bufResult = context->createBuffer(etna::Buffer::CreateInfo{
-    .size = sizeof(float) * length,
-    .bufferUsage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
-    .name = "m_sum",
-  });
+    slot.upload = context->createBuffer(etna::Buffer::CreateInfo{
+      .size = 2 * chunkBytes,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferSrc,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = fmt::format("upload{}", i),
+    });
+    slot.upload.map();
 
-  // Filling the buffers
+    // NOTE: GPU_TO_CPU memory may be cached and not coherent, and the results are read
+    // without invalidating it, so CPU_ONLY, which is always host-coherent, is used instead
+    slot.readback = context->createBuffer(etna::Buffer::CreateInfo{
+      .size = chunkBytes,
+      .bufferUsage = vk::BufferUsageFlagBits::eTransferDst,
+      .memoryUsage = VMA_MEMORY_USAGE_CPU_ONLY,
+      .name = fmt::format("readback{}", i),
+    });
+    slot.readback.map();
 
-  {
-    std::vector<float> values(length);
-    for (uint32_t i = 0; i < values.size(); ++i)
-    {
-      values[i] = (float)i;
-    }
-    transferHelper->uploadBuffer<float>(*cmdMgr, bufA, 0, values);
-  }
+    slot.bufA = context->createBuffer(etna::Buffer::CreateInfo{
+      .size = chunkBytes,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .name = fmt::format("A{}", i),
+    });
 
-  {
-    std::vector<float> values(length);
-    for (uint32_t i = 0; i < values.size(); ++i)
-    {
-      values[i] = static_cast<float>(i * i);
-    }
-    transferHelper->uploadBuffer<float>(*cmdMgr, bufB, 0, values);
+    slot.bufB = context->createBuffer(etna::Buffer::CreateInfo{
+      .size = chunkBytes,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+      .name = fmt::format("B{}", i),
+    });
+
+    slot.bufResult = context->createBuffer(etna::Buffer::CreateInfo{
+      .size = chunkBytes,
+      .bufferUsage =
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+      .name = fmt::format("m_sum{}", i),
+    });
   }
 
   // Compute pipeline creation
   pipeline = context->getPipelineManager().createComputePipeline("simple_compute", {});
+
+  // Descriptor sets never change, so we only create them once per slot
+  auto simpleComputeInfo = etna::get_shader_program("simple_compute");
+  for (auto& slot : slots)
+    slot.set = etna::create_descriptor_set(
+      simpleComputeInfo.getDescriptorLayoutId(0),
+      slot.cmdBuf.get(),
+      {
+        etna::Binding{0, slot.bufA.genBinding()},
+        etna::Binding{1, slot.bufB.genBinding()},
+        etna::Binding{2, slot.bufResult.genBinding()},
+      });
+
+  fillInputs();
 }
 
-void SimpleCompute::buildCommandBuffer(vk::CommandBuffer cmd_buf)
+void SimpleCompute::fillInputs()
 {
-  ETNA_CHECK_VK_RESULT(cmd_buf.begin(vk::CommandBufferBeginInfo{}));
+  // Filling the host-side "dataset"
 
-  auto simpleComputeInfo = etna::get_shader_program("simple_compute");
+  // NOTE: sized for the maximum length, shorter runs simply use a prefix
+  hostA.resize(params.length);
+  hostB.resize(params.length);
+  hostResult.resize(params.length);
 
-  auto set = etna::create_descriptor_set(
-    simpleComputeInfo.getDescriptorLayoutId(0),
-    cmd_buf,
-    {
-      etna::Binding{0, bufA.genBinding()},
-      etna::Binding{1, bufB.genBinding()},
-      etna::Binding{2, bufResult.genBinding()},
+  for (std::uint64_t i = 0; i < params.length; ++i)
+  {
+    hostA[i] = static_cast<float>(i % 4096);
+    hostB[i] = static_cast<float>((i % 4096) * (i % 4096));
+  }
+}
+
+// NOTE: etna only tracks image states, buffer barriers are on us.
+static vk::BufferMemoryBarrier2 buffer_barrier(
+  vk::Buffer buffer,
+  vk::PipelineStageFlags2 src_stage,
+  vk::AccessFlags2 src_access,
+  vk::PipelineStageFlags2 dst_stage,
+  vk::AccessFlags2 dst_access)
+{
+  return vk::BufferMemoryBarrier2{
+    .srcStageMask = src_stage,
+    .srcAccessMask = src_access,
+    .dstStageMask = dst_stage,
+    .dstAccessMask = dst_access,
+    .buffer = buffer,
+    .size = vk::WholeSize,
+  };
+}
+
+std::uint64_t SimpleCompute::chunkCount() const
+{
+  return (length + chunkLength - 1) / chunkLength;
+}
+
+void SimpleCompute::buildCommandBuffer(Slot& slot, std::uint32_t chunk_length)
+{
+  auto cmdBuf = slot.cmdBuf.get();
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.begin(vk::CommandBufferBeginInfo{
+    .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+  }));
+
+  const vk::DeviceSize chunkBytes = sizeof(float) * chunk_length;
+
+  cmdBuf.copyBuffer(slot.upload.get(), slot.bufA.get(), {vk::BufferCopy{.size = chunkBytes}});
+  cmdBuf.copyBuffer(
+    slot.upload.get(),
+    slot.bufB.get(),
+    {vk::BufferCopy{.srcOffset = sizeof(float) * chunkLength, .size = chunkBytes}});
+
+  {
+    std::array barriers{
+      buffer_barrier(
+        slot.bufA.get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::PipelineStageFlagBits2::eComputeShader,
+        vk::AccessFlagBits2::eShaderStorageRead),
+      buffer_barrier(
+        slot.bufB.get(),
+        vk::PipelineStageFlagBits2::eTransfer,
+        vk::AccessFlagBits2::eTransferWrite,
+        vk::PipelineStageFlagBits2::eComputeShader,
+        vk::AccessFlagBits2::eShaderStorageRead),
+    };
+    cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+      .bufferMemoryBarrierCount = static_cast<std::uint32_t>(barriers.size()),
+      .pBufferMemoryBarriers = barriers.data(),
     });
+  }
 
-  vk::DescriptorSet vkSet = set.getVkSet();
+  vk::DescriptorSet vkSet = slot.set->getVkSet();
 
-  cmd_buf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
-  cmd_buf.bindDescriptorSets(
+  cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.getVkPipeline());
+  cmdBuf.bindDescriptorSets(
     vk::PipelineBindPoint::eCompute, pipeline.getVkPipelineLayout(), 0, 1, &vkSet, 0, nullptr);
 
-  cmd_buf.pushConstants(
-    pipeline.getVkPipelineLayout(), vk::ShaderStageFlagBits::eCompute, 0, sizeof(length), &length);
+  cmdBuf.pushConstants(
+    pipeline.getVkPipelineLayout(),
+    vk::ShaderStageFlagBits::eCompute,
+    0,
+    sizeof(chunk_length),
+    &chunk_length);
+
+  // Group count along a single dimension is limited (usually by 65535),
+  // so big chunks are dispatched as a 2D grid.
+  {
+    const std::uint32_t maxGroupsX =
+      context->getPhysicalDevice().getProperties().limits.maxComputeWorkGroupCount[0];
+    const std::uint32_t groups =
+      (chunk_length + SIMPLE_COMPUTE_WORKGROUP_SIZE - 1) / SIMPLE_COMPUTE_WORKGROUP_SIZE;
+    const std::uint32_t groupsX = std::min(groups, maxGroupsX);
+    const std::uint32_t groupsY = (groups + groupsX - 1) / groupsX;
+    cmdBuf.dispatch(groupsX, groupsY, 1);
+  }
+
+  {
+    auto barrier = buffer_barrier(
+      slot.bufResult.get(),
+      vk::PipelineStageFlagBits2::eComputeShader,
+      vk::AccessFlagBits2::eShaderStorageWrite,
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferRead);
+    cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+      .bufferMemoryBarrierCount = 1,
+      .pBufferMemoryBarriers = &barrier,
+    });
+  }
+
+  cmdBuf.copyBuffer(
+    slot.bufResult.get(), slot.readback.get(), {vk::BufferCopy{.size = chunkBytes}});
+
+  {
+    auto barrier = buffer_barrier(
+      slot.readback.get(),
+      vk::PipelineStageFlagBits2::eTransfer,
+      vk::AccessFlagBits2::eTransferWrite,
+      vk::PipelineStageFlagBits2::eHost,
+      vk::AccessFlagBits2::eHostRead);
+    cmdBuf.pipelineBarrier2(vk::DependencyInfo{
+      .bufferMemoryBarrierCount = 1,
+      .pBufferMemoryBarriers = &barrier,
+    });
+  }
+
+  ETNA_CHECK_VK_RESULT(cmdBuf.end());
+}
+
+void SimpleCompute::submitChunk(Slot& slot, std::uint64_t chunk)
+{
+  const std::uint64_t first = chunk * chunkLength;
+  const auto count = static_cast<std::uint32_t>(std::min(chunkLength, length - first));
+
+  auto* staging = reinterpret_cast<float*>(slot.upload.data());
+  std::memcpy(staging, hostA.data() + first, sizeof(float) * count);
+  std::memcpy(staging + chunkLength, hostB.data() + first, sizeof(float) * count);
+
+  buildCommandBuffer(slot, count);
 
-  etna::flush_barriers(cmd_buf);
+  auto device = context->getDevice();
+  ETNA_CHECK_VK_RESULT(device.resetFences({slot.fence.get()}));
 
-  cmd_buf.dispatch(1, 1, 1);
+  vk::CommandBufferSubmitInfo cmdInfo{.commandBuffer = slot.cmdBuf.get()};
+  ETNA_CHECK_VK_RESULT(context->getQueue().submit2(
+    {vk::SubmitInfo2{
+      .commandBufferInfoCount = 1,
+      .pCommandBufferInfos = &cmdInfo,
+    }},
+    slot.fence.get()));
 
-  ETNA_CHECK_VK_RESULT(cmd_buf.end());
+  slot.chunk = chunk;
 }
 
-void SimpleCompute::readback()
+void SimpleCompute::retireChunk(Slot& slot)
 {
-  std::vector<float> values(length);
-  transferHelper->readbackBuffer<float>(*cmdMgr, values, bufResult, 0);
+  if (!slot.chunk.has_value())
+    return;
 
-  spdlog::info("Result on cpu:\n{}", values);
+  ETNA_CHECK_VK_RESULT(
+    context->getDevice().waitForFences({slot.fence.get()}, vk::True, ~std::uint64_t{0}));
+
+  const std::uint64_t first = *slot.chunk * chunkLength;
+  const std::uint64_t count = std::min(chunkLength, length - first);
+  std::memcpy(hostResult.data() + first, slot.readback.data(), sizeof(float) * count);
+
+  slot.chunk.reset();
+}
+
+bool SimpleCompute::validate() const
+{
+  for (std::uint64_t i = 0; i < length; ++i)
+    if (hostResult[i] != hostA[i] + hostB[i])
+    {
+      spdlog::error(
+        "Mismatch at element {}: expected {}, got {}", i, hostA[i] + hostB[i], hostResult[i]);
+      return false;
+    }
+  return true;
 }
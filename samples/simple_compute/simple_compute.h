@@ -1,40 +1,90 @@
 #ifndef SIMPLE_COMPUTE_H
 #define SIMPLE_COMPUTE_H
 
+#include <array>
+#include <optional>
 #include <memory>
+#include <vector>
 
 #include <etna/GlobalContext.hpp>
 #include <etna/ComputePipeline.hpp>
-#include <etna/OneShotCmdMgr.hpp>
-#include <etna/BlockingTransferHelper.hpp>
+#include <etna/Buffer.hpp>
+#include <etna/DescriptorSet.hpp>
+
+#include "shaders/SimpleComputeParams.h"
+#include "cpu_backend.h"
 
 
 class SimpleCompute
 {
 public:
-  SimpleCompute();
+  struct Params
+  {
+    // Amount of elements in each of the input vectors, the maximum one for sweeps
+    std::uint64_t length = 16;
+    // Inputs are streamed through the GPU in chunks of at most this many bytes per vector
+    std::uint64_t chunkBytes = 64ull << 20;
+  };
+
+  explicit SimpleCompute(Params params);
 
   void init();
   void execute();
+  // Compares the GPU and CPU backends on lengths from 1K up to params.length
+  void sweep();
 
   //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 private:
-  etna::GlobalContext* context;
+  // Chunks are processed in a ring of slots, so that while the GPU is busy with one chunk,
+  // the CPU fills the staging memory of the next one and reads back the previous one.
+  static constexpr std::size_t SLOT_COUNT = 3;
+
+  struct Slot
+  {
+    etna::Buffer upload;
+    etna::Buffer readback;
+
+    etna::Buffer bufA;
+    etna::Buffer bufB;
+    etna::Buffer bufResult;
+
+    std::optional<etna::DescriptorSet> set;
 
-  std::unique_ptr<etna::OneShotCmdMgr> cmdMgr;
-  std::unique_ptr<etna::BlockingTransferHelper> transferHelper;
+    vk::UniqueCommandBuffer cmdBuf;
+    vk::UniqueFence fence;
 
-  std::uint32_t length;
+    // Chunk currently being processed in this slot, if any
+    std::optional<std::uint64_t> chunk;
+  };
+
+  etna::GlobalContext* context;
+
+  Params params;
+  std::uint64_t chunkLength;
+  // Length of the current run, at most params.length
+  std::uint64_t length;
 
   etna::ComputePipeline pipeline;
 
-  etna::Buffer bufA;
-  etna::Buffer bufB;
-  etna::Buffer bufResult;
+  vk::UniqueCommandPool cmdPool;
+  std::array<Slot, SLOT_COUNT> slots;
+
+  std::vector<float> hostA;
+  std::vector<float> hostB;
+  std::vector<float> hostResult;
+
+  CpuBackend cpuBackend;
 
   void setup();
-  void buildCommandBuffer(vk::CommandBuffer cmd_buf);
-  void readback();
+  void fillInputs();
+  void buildCommandBuffer(Slot& slot, std::uint32_t chunk_length);
+  void submitChunk(Slot& slot, std::uint64_t chunk);
+  void retireChunk(Slot& slot);
+  std::uint64_t chunkCount() const;
+  double runGpu();
+  double runCpu(CpuBackend::Isa isa, bool multithreaded);
+  double runMemcpyBaseline();
+  bool validate() const;
 };
 
 
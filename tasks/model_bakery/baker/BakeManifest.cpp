@@ -0,0 +1,79 @@
+#include "BakeManifest.hpp"
+
+#include <charconv>
+#include <fstream>
+
+#include <spdlog/spdlog.h>
+
+
+static std::string manifest_key(const std::filesystem::path& model)
+{
+  return std::filesystem::weakly_canonical(model).generic_string();
+}
+
+BakeManifest BakeManifest::read(const std::filesystem::path& path)
+{
+  BakeManifest result;
+
+  std::ifstream file(path);
+  if (!file)
+    return result;
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+    const auto space = line.find(' ');
+    if (space == std::string::npos)
+      continue;
+
+    std::uint64_t hash = 0;
+    const auto [end, error] = std::from_chars(line.data(), line.data() + space, hash, 16);
+    if (error != std::errc{} || end != line.data() + space)
+    {
+      spdlog::warn("Bake manifest {}: skipping malformed line '{}'", path.string(), line);
+      continue;
+    }
+    result.entries[line.substr(space + 1)] = hash;
+  }
+
+  return result;
+}
+
+bool BakeManifest::write(const std::filesystem::path& path) const
+{
+  // NOTE: written next to the old one and renamed over it, so that an interrupted run
+  // leaves the previous manifest intact
+  auto temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::trunc);
+    if (!file)
+      return false;
+    for (const auto& [model, hash] : entries)
+      file << fmt::format("{:016x} {}\n", hash, model);
+    if (!file)
+      return false;
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(temporary, path, ec);
+  return !ec;
+}
+
+std::optional<std::uint64_t> BakeManifest::find(const std::filesystem::path& model) const
+{
+  const auto it = entries.find(manifest_key(model));
+  if (it == entries.end())
+    return std::nullopt;
+  return it->second;
+}
+
+void BakeManifest::set(const std::filesystem::path& model, std::uint64_t hash)
+{
+  entries[manifest_key(model)] = hash;
+}
+
+void BakeManifest::erase(const std::filesystem::path& model)
+{
+  entries.erase(manifest_key(model));
+}
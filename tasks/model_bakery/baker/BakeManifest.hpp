@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+
+
+/**
+ * Hashes of whatever each model was baked from during previous runs, so that models which
+ * haven't changed since then are skipped. Stored as text, a "<hash> <model path>" line per
+ * model, with absolute paths so that runs from different directories agree.
+ */
+class BakeManifest
+{
+public:
+  // A missing or unreadable file is an empty manifest, everything is baked then
+  static BakeManifest read(const std::filesystem::path& path);
+  bool write(const std::filesystem::path& path) const;
+
+  std::optional<std::uint64_t> find(const std::filesystem::path& model) const;
+  void set(const std::filesystem::path& model, std::uint64_t hash);
+  void erase(const std::filesystem::path& model);
+
+private:
+  std::map<std::string, std::uint64_t> entries;
+};
@@ -0,0 +1,700 @@
+#include "MeshBaker.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <sstream>
+
+#include <glm/glm.hpp>
+#include <json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "mesh_utils/MeshSimplifier.hpp"
+
+
+// Buffer views of the baked model, images embedded into buffers get ones after these
+static constexpr int VERTEX_VIEW = 0;
+static constexpr int INDEX_VIEW = 1;
+
+// Large enough for writes to be efficient, small enough to not matter next to a primitive
+static constexpr std::size_t WRITE_BUFFER_SIZE = 1 << 20;
+
+// LOD 0 is the primitive itself, every next one aims for half of the triangles of the previous
+static constexpr std::size_t MAX_LOD_COUNT = 4;
+// Relative to the size of the primitive, LODs stop when simplifying further would move
+// the surface by more than this
+static constexpr float MAX_LOD_ERROR = 0.05f;
+// A LOD with more than this share of the triangles of the previous one isn't worth a switch
+static constexpr std::size_t MAX_LOD_SHARE_PERCENT = 80;
+
+// Vertex of a baked model, see the README of the task
+struct BakedVertex
+{
+  glm::vec3 position;
+  // xyz and a byte of padding
+  std::array<std::uint8_t, 4> normal;
+  glm::vec2 texCoord;
+  // xyz and w, which is always 1 as glTF requires it to be there
+  std::array<std::uint8_t, 4> tangent;
+  std::array<std::uint8_t, 4> padding;
+};
+
+static_assert(sizeof(BakedVertex) == 32);
+static_assert(offsetof(BakedVertex, normal) == 12);
+static_assert(offsetof(BakedVertex, texCoord) == 16);
+static_assert(offsetof(BakedVertex, tangent) == 24);
+
+// A uniform grid of 256 points on [-1, 1], the byte is the index of the nearest one
+static std::uint8_t quantize_unit(float value)
+{
+  return static_cast<std::uint8_t>(std::lround(127.5f * (std::clamp(value, -1.0f, 1.0f) + 1.0f)));
+}
+
+/**
+ * Fills a region of a file through a buffer of a fixed size. Several writers can fill
+ * different regions of the same file, each one seeks to where it stopped when flushing.
+ */
+class BufferedWriter
+{
+public:
+  BufferedWriter(std::fstream& file_, std::size_t offset)
+    : file{file_}
+    , position{offset}
+  {
+    buffer.reserve(WRITE_BUFFER_SIZE);
+  }
+
+  void write(std::span<const std::byte> bytes)
+  {
+    while (!bytes.empty())
+    {
+      const std::size_t chunk = std::min(bytes.size(), buffer.capacity() - buffer.size());
+      buffer.insert(buffer.end(), bytes.begin(), bytes.begin() + chunk);
+      bytes = bytes.subspan(chunk);
+      if (buffer.size() == buffer.capacity())
+        flush();
+    }
+  }
+
+  void flush()
+  {
+    if (buffer.empty())
+      return;
+    file.seekp(static_cast<std::streamoff>(position));
+    file.write(
+      reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    position += buffer.size();
+    buffer.clear();
+  }
+
+  std::size_t getPosition() const { return position + buffer.size(); }
+
+private:
+  std::fstream& file;
+  std::size_t position;
+  std::vector<std::byte> buffer;
+};
+
+// Where a primitive goes in the baked model, null if it is left out
+struct PrimitivePlan
+{
+  const tinygltf::Accessor* positions = nullptr;
+  const tinygltf::Accessor* normals = nullptr;
+  const tinygltf::Accessor* tangents = nullptr;
+  const tinygltf::Accessor* texCoords = nullptr;
+  const tinygltf::Accessor* indices = nullptr;
+  std::size_t vertexCount = 0;
+  std::size_t indexCount = 0;
+  std::size_t firstVertex = 0;
+  std::size_t firstIndex = 0;
+};
+
+// Attributes that aren't floats of the expected type are treated as missing
+static const tinygltf::Accessor* find_attribute(
+  const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name, int type)
+{
+  const auto it = primitive.attributes.find(name);
+  if (it == primitive.attributes.end())
+    return nullptr;
+
+  const auto& accessor = model.accessors[it->second];
+  if (
+    accessor.bufferView < 0 || accessor.sparse.isSparse ||
+    accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.type != type)
+  {
+    spdlog::warn("Attribute {} isn't made of plain floats, it is left out", name);
+    return nullptr;
+  }
+  return &accessor;
+}
+
+static std::optional<PrimitivePlan> plan_primitive(
+  const tinygltf::Model& model, const tinygltf::Primitive& primitive)
+{
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES)
+    return std::nullopt;
+
+  PrimitivePlan plan{
+    .positions = find_attribute(model, primitive, "POSITION", TINYGLTF_TYPE_VEC3),
+    .normals = find_attribute(model, primitive, "NORMAL", TINYGLTF_TYPE_VEC3),
+    .tangents = find_attribute(model, primitive, "TANGENT", TINYGLTF_TYPE_VEC4),
+    .texCoords = find_attribute(model, primitive, "TEXCOORD_0", TINYGLTF_TYPE_VEC2),
+  };
+  if (plan.positions == nullptr || plan.positions->count == 0)
+    return std::nullopt;
+  plan.vertexCount = plan.positions->count;
+  plan.indexCount = plan.vertexCount;
+
+  if (primitive.indices >= 0)
+  {
+    const auto& indices = model.accessors[primitive.indices];
+    const bool supported = indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE ||
+      indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ||
+      indices.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT;
+    if (indices.bufferView < 0 || indices.sparse.isSparse || !supported || indices.count == 0)
+      return std::nullopt;
+    plan.indices = &indices;
+    plan.indexCount = indices.count;
+  }
+
+  return plan;
+}
+
+// Scratch memory of a primitive, reused by the next ones
+struct Scratch
+{
+  std::vector<std::uint8_t> strided;
+  std::vector<std::uint8_t> positions;
+  std::vector<std::uint8_t> normals;
+  std::vector<std::uint8_t> tangents;
+  std::vector<std::uint8_t> texCoords;
+  std::vector<std::uint8_t> indices;
+  std::vector<BakedVertex> vertices;
+  std::vector<std::uint32_t> bakedIndices;
+  std::vector<glm::vec3> points;
+  std::vector<std::uint32_t> lodIndices;
+  MeshSimplifier simplifier;
+
+  std::size_t bytes() const
+  {
+    return strided.capacity() + positions.capacity() + normals.capacity() +
+      tangents.capacity() + texCoords.capacity() + indices.capacity() +
+      vertices.capacity() * sizeof(BakedVertex) +
+      (bakedIndices.capacity() + lodIndices.capacity()) * sizeof(std::uint32_t) +
+      points.capacity() * sizeof(glm::vec3) + simplifier.getScratchBytes();
+  }
+};
+
+// Reads the elements of an accessor tightly packed into dst
+static bool read_accessor(
+  BufferReader& reader,
+  const tinygltf::Model& model,
+  const tinygltf::Accessor& accessor,
+  std::vector<std::uint8_t>& strided,
+  std::vector<std::uint8_t>& dst)
+{
+  const auto& view = model.bufferViews[accessor.bufferView];
+  const auto elementSize = static_cast<std::size_t>(
+    tinygltf::GetComponentSizeInBytes(accessor.componentType) *
+    tinygltf::GetNumComponentsInType(accessor.type));
+  const std::size_t stride = view.byteStride != 0 ? view.byteStride : elementSize;
+  const std::size_t offset = view.byteOffset + accessor.byteOffset;
+
+  dst.resize(accessor.count * elementSize);
+  if (stride == elementSize)
+    return reader.read(view.buffer, offset, dst);
+
+  strided.resize(stride * (accessor.count - 1) + elementSize);
+  if (!reader.read(view.buffer, offset, strided))
+    return false;
+  for (std::size_t i = 0; i < accessor.count; ++i)
+    std::memcpy(&dst[i * elementSize], &strided[i * stride], elementSize);
+  return true;
+}
+
+template <class T>
+static T load(const std::vector<std::uint8_t>& data, std::size_t index)
+{
+  T result;
+  std::memcpy(&result, &data[index * sizeof(T)], sizeof(T));
+  return result;
+}
+
+// Converts a primitive into scratch.vertices and scratch.bakedIndices, returns whether all of
+// its data could be read and all of its indices refer to its vertices
+static bool convert_primitive(
+  BufferReader& reader,
+  const tinygltf::Model& model,
+  const PrimitivePlan& plan,
+  Scratch& scratch,
+  glm::vec3& min,
+  glm::vec3& max)
+{
+  if (!read_accessor(reader, model, *plan.positions, scratch.strided, scratch.positions))
+    return false;
+  // NOTE: missing attributes are zeros, same as SceneManager::processMeshes does
+  scratch.normals.clear();
+  scratch.tangents.clear();
+  scratch.texCoords.clear();
+  if (plan.normals != nullptr &&
+    !read_accessor(reader, model, *plan.normals, scratch.strided, scratch.normals))
+    return false;
+  if (plan.tangents != nullptr &&
+    !read_accessor(reader, model, *plan.tangents, scratch.strided, scratch.tangents))
+    return false;
+  if (plan.texCoords != nullptr &&
+    !read_accessor(reader, model, *plan.texCoords, scratch.strided, scratch.texCoords))
+    return false;
+
+  // Attributes of other lengths than positions are broken, they are ignored
+  auto usable = [&plan](const tinygltf::Accessor* accessor) {
+    return accessor != nullptr && accessor->count == plan.vertexCount;
+  };
+  const bool hasNormals = usable(plan.normals);
+  const bool hasTangents = usable(plan.tangents);
+  const bool hasTexCoords = usable(plan.texCoords);
+
+  min = glm::vec3(std::numeric_limits<float>::max());
+  max = glm::vec3(std::numeric_limits<float>::lowest());
+  scratch.vertices.resize(plan.vertexCount);
+  scratch.points.resize(plan.vertexCount);
+  for (std::size_t i = 0; i < plan.vertexCount; ++i)
+  {
+    const auto position = load<glm::vec3>(scratch.positions, i);
+    const auto normal = hasNormals ? load<glm::vec3>(scratch.normals, i) : glm::vec3(0.0f);
+    const auto tangent = hasTangents ? load<glm::vec4>(scratch.tangents, i) : glm::vec4(0.0f);
+    const auto texCoord = hasTexCoords ? load<glm::vec2>(scratch.texCoords, i) : glm::vec2(0.0f);
+    min = glm::min(min, position);
+    max = glm::max(max, position);
+    scratch.points[i] = position;
+
+    scratch.vertices[i] = BakedVertex{
+      .position = position,
+      .normal = {quantize_unit(normal.x), quantize_unit(normal.y), quantize_unit(normal.z), 0},
+      .texCoord = texCoord,
+      .tangent =
+        {
+          quantize_unit(tangent.x),
+          quantize_unit(tangent.y),
+          quantize_unit(tangent.z),
+          quantize_unit(1.0f),
+        },
+      .padding = {},
+    };
+  }
+
+  scratch.bakedIndices.resize(plan.indexCount);
+  if (plan.indices == nullptr)
+  {
+    std::iota(scratch.bakedIndices.begin(), scratch.bakedIndices.end(), 0u);
+    return true;
+  }
+
+  if (!read_accessor(reader, model, *plan.indices, scratch.strided, scratch.indices))
+    return false;
+  for (std::size_t i = 0; i < plan.indexCount; ++i)
+  {
+    switch (plan.indices->componentType)
+    {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      scratch.bakedIndices[i] = scratch.indices[i];
+      break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+      scratch.bakedIndices[i] = load<std::uint16_t>(scratch.indices, i);
+      break;
+    default:
+      scratch.bakedIndices[i] = load<std::uint32_t>(scratch.indices, i);
+      break;
+    }
+  }
+  // NOTE: an index past the vertices would make the simplifier and the GPU read past them
+  return std::ranges::all_of(
+    scratch.bakedIndices, [&plan](std::uint32_t index) { return index < plan.vertexCount; });
+}
+
+static int add_accessor(
+  tinygltf::Model& model,
+  int buffer_view,
+  std::size_t byte_offset,
+  int component_type,
+  int type,
+  std::size_t count,
+  bool normalized)
+{
+  tinygltf::Accessor accessor;
+  accessor.bufferView = buffer_view;
+  accessor.byteOffset = byte_offset;
+  accessor.componentType = component_type;
+  accessor.type = type;
+  accessor.count = count;
+  accessor.normalized = normalized;
+  model.accessors.push_back(std::move(accessor));
+  return static_cast<int>(model.accessors.size() - 1);
+}
+
+// Simplifies a converted primitive into LODs and writes their indices, returns the array of
+// their accessors. Every LOD is simplified from the primitive itself, so that errors don't add up.
+static tinygltf::Value bake_lods(
+  tinygltf::Model& baked,
+  Scratch& scratch,
+  BufferedWriter& writer,
+  std::size_t view_offset,
+  MeshBakeStats& stats)
+{
+  tinygltf::Value::Array accessors;
+  std::size_t previousCount = scratch.bakedIndices.size();
+  for (std::size_t lod = 1; lod < MAX_LOD_COUNT; ++lod)
+  {
+    scratch.simplifier.simplify(
+      scratch.points,
+      scratch.bakedIndices,
+      (scratch.bakedIndices.size() / 3 >> lod) * 3,
+      MAX_LOD_ERROR,
+      scratch.lodIndices);
+    const std::size_t count = scratch.lodIndices.size();
+    if (count == 0 || count * 100 > previousCount * MAX_LOD_SHARE_PERCENT)
+      break;
+
+    accessors.emplace_back(add_accessor(
+      baked,
+      INDEX_VIEW,
+      writer.getPosition() - view_offset,
+      TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+      TINYGLTF_TYPE_SCALAR,
+      count,
+      false));
+    writer.write(std::as_bytes(std::span(scratch.lodIndices)));
+    ++stats.lods;
+    stats.lodIndices += count;
+    previousCount = count;
+  }
+  return tinygltf::Value(std::move(accessors));
+}
+
+// Everything but the geometry is taken over as is, except for what refers to accessors
+// of the source: animations, skins and morph targets aren't supported
+static tinygltf::Model make_baked_model(const tinygltf::Model& source)
+{
+  tinygltf::Model result;
+  result.asset = source.asset;
+  result.scenes = source.scenes;
+  result.defaultScene = source.defaultScene;
+  result.nodes = source.nodes;
+  result.meshes = source.meshes;
+  result.materials = source.materials;
+  result.textures = source.textures;
+  result.samplers = source.samplers;
+  result.cameras = source.cameras;
+  result.lights = source.lights;
+  result.extensionsUsed = source.extensionsUsed;
+  result.extensionsRequired = source.extensionsRequired;
+
+  if (!source.animations.empty() || !source.skins.empty())
+    spdlog::warn("Animations and skins aren't supported, they are left out");
+  for (auto& node : result.nodes)
+    node.skin = -1;
+
+  // Encoded images stay where they are, see below for the ones inside of buffers
+  result.images.reserve(source.images.size());
+  for (const auto& image : source.images)
+  {
+    auto& copy = result.images.emplace_back();
+    copy.name = image.name;
+    copy.uri = image.uri;
+    copy.mimeType = image.mimeType;
+    copy.bufferView = image.bufferView;
+    copy.extras = image.extras;
+  }
+
+  for (const char* extension : {"KHR_mesh_quantization"})
+  {
+    if (std::ranges::find(result.extensionsUsed, extension) == result.extensionsUsed.end())
+      result.extensionsUsed.emplace_back(extension);
+    if (std::ranges::find(result.extensionsRequired, extension) == result.extensionsRequired.end())
+      result.extensionsRequired.emplace_back(extension);
+  }
+
+  return result;
+}
+
+std::filesystem::path baked_model_path(const std::filesystem::path& gltf_path)
+{
+  auto result = gltf_path;
+  result.replace_filename(gltf_path.stem().string() + "_baked.gltf");
+  return result;
+}
+
+std::optional<MeshBakeStats> bake_meshes(const ModelSource& source)
+{
+  const auto& model = source.model;
+  const auto gltfPath = baked_model_path(source.path);
+  auto binPath = gltfPath;
+  binPath.replace_extension(".bin");
+
+  MeshBakeStats stats;
+  tinygltf::Model baked = make_baked_model(model);
+
+  // Offsets of primitives are known from the accessor counts alone, the ones of their LODs
+  // only once they are simplified, so the LODs go after the indices of all primitives
+  std::vector<std::vector<std::optional<PrimitivePlan>>> plans(model.meshes.size());
+  std::size_t vertexCount = 0;
+  std::size_t indexCount = 0;
+  for (std::size_t mesh = 0; mesh < model.meshes.size(); ++mesh)
+    for (const auto& primitive : model.meshes[mesh].primitives)
+    {
+      auto& plan = plans[mesh].emplace_back(plan_primitive(model, primitive));
+      if (!plan.has_value())
+      {
+        ++stats.skippedPrimitives;
+        continue;
+      }
+      plan->firstVertex = vertexCount;
+      plan->firstIndex = indexCount;
+      vertexCount += plan->vertexCount;
+      indexCount += plan->indexCount;
+    }
+  if (stats.skippedPrimitives > 0)
+    spdlog::warn(
+      "{}: {} primitives aren't triangles with float positions, they are left out",
+      source.path.string(),
+      stats.skippedPrimitives);
+
+  const std::size_t vertexBytes = vertexCount * sizeof(BakedVertex);
+  const std::size_t indexBytes = indexCount * sizeof(std::uint32_t);
+
+  {
+    std::ofstream create(binPath, std::ios::binary | std::ios::trunc);
+    if (!create)
+    {
+      spdlog::error("{} can't be written", binPath.string());
+      return std::nullopt;
+    }
+  }
+  // NOTE: the file is allocated whole, so that writers can fill it in any order
+  std::error_code ec;
+  std::filesystem::resize_file(binPath, vertexBytes + indexBytes, ec);
+  std::fstream bin(binPath, std::ios::binary | std::ios::in | std::ios::out);
+
+  BufferReader reader{source};
+  Scratch scratch;
+  BufferedWriter vertexWriter{bin, 0};
+  BufferedWriter indexWriter{bin, vertexBytes};
+  BufferedWriter lodWriter{bin, vertexBytes + indexBytes};
+  bool success = !ec && static_cast<bool>(bin);
+
+  for (std::size_t mesh = 0; mesh < model.meshes.size() && success; ++mesh)
+  {
+    auto& primitives = baked.meshes[mesh].primitives;
+    std::vector<tinygltf::Primitive> bakedPrimitives;
+    for (std::size_t i = 0; i < primitives.size(); ++i)
+    {
+      const auto& plan = plans[mesh][i];
+      if (!plan.has_value())
+        continue;
+
+      glm::vec3 min;
+      glm::vec3 max;
+      if (!convert_primitive(reader, model, *plan, scratch, min, max))
+      {
+        spdlog::error(
+          "{}: mesh {} has data outside of its buffers or indices past its vertices",
+          source.path.string(),
+          mesh);
+        success = false;
+        break;
+      }
+      vertexWriter.write(std::as_bytes(std::span(scratch.vertices)));
+      indexWriter.write(std::as_bytes(std::span(scratch.bakedIndices)));
+      auto lods = bake_lods(baked, scratch, lodWriter, vertexBytes, stats);
+      stats.workingBytes = std::max(stats.workingBytes, scratch.bytes());
+
+      const std::size_t vertexOffset = plan->firstVertex * sizeof(BakedVertex);
+      auto& primitive = bakedPrimitives.emplace_back(primitives[i]);
+      primitive.targets.clear();
+      primitive.attributes = {
+        {"POSITION",
+         add_accessor(
+           baked,
+           VERTEX_VIEW,
+           vertexOffset + offsetof(BakedVertex, position),
+           TINYGLTF_COMPONENT_TYPE_FLOAT,
+           TINYGLTF_TYPE_VEC3,
+           plan->vertexCount,
+           false)},
+        // NOTE: KHR_mesh_quantization only lists signed normalized normals and tangents,
+        // the README asks for unsigned ones, so viewers see them remapped to [0, 1]
+        {"NORMAL",
+         add_accessor(
+           baked,
+           VERTEX_VIEW,
+           vertexOffset + offsetof(BakedVertex, normal),
+           TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+           TINYGLTF_TYPE_VEC3,
+           plan->vertexCount,
+           true)},
+        {"TEXCOORD_0",
+         add_accessor(
+           baked,
+           VERTEX_VIEW,
+           vertexOffset + offsetof(BakedVertex, texCoord),
+           TINYGLTF_COMPONENT_TYPE_FLOAT,
+           TINYGLTF_TYPE_VEC2,
+           plan->vertexCount,
+           false)},
+        {"TANGENT",
+         add_accessor(
+           baked,
+           VERTEX_VIEW,
+           vertexOffset + offsetof(BakedVertex, tangent),
+           TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE,
+           TINYGLTF_TYPE_VEC4,
+           plan->vertexCount,
+           true)},
+      };
+      auto& positions = baked.accessors[primitive.attributes["POSITION"]];
+      positions.minValues = {min.x, min.y, min.z};
+      positions.maxValues = {max.x, max.y, max.z};
+
+      primitive.indices = add_accessor(
+        baked,
+        INDEX_VIEW,
+        plan->firstIndex * sizeof(std::uint32_t),
+        TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT,
+        TINYGLTF_TYPE_SCALAR,
+        plan->indexCount,
+        false);
+      if (lods.ArrayLen() > 0)
+      {
+        tinygltf::Value::Object extras;
+        if (primitive.extras.IsObject())
+          extras = primitive.extras.Get<tinygltf::Value::Object>();
+        extras["lods"] = std::move(lods);
+        primitive.extras = tinygltf::Value(std::move(extras));
+      }
+
+      ++stats.primitives;
+      stats.vertices += plan->vertexCount;
+      stats.indices += plan->indexCount;
+    }
+    primitives = std::move(bakedPrimitives);
+  }
+
+  // glTF doesn't allow meshes without primitives, so the ones which lost all of them are
+  // dropped along with the references of nodes to them
+  std::vector<int> meshIndices(baked.meshes.size(), -1);
+  std::vector<tinygltf::Mesh> keptMeshes;
+  for (std::size_t mesh = 0; mesh < baked.meshes.size(); ++mesh)
+    if (!baked.meshes[mesh].primitives.empty())
+    {
+      meshIndices[mesh] = static_cast<int>(keptMeshes.size());
+      keptMeshes.push_back(std::move(baked.meshes[mesh]));
+    }
+  stats.skippedMeshes = baked.meshes.size() - keptMeshes.size();
+  baked.meshes = std::move(keptMeshes);
+  for (auto& node : baked.nodes)
+    if (node.mesh >= 0)
+    {
+      const auto mesh = static_cast<std::size_t>(node.mesh);
+      node.mesh = mesh < meshIndices.size() ? meshIndices[mesh] : -1;
+    }
+  if (stats.skippedMeshes > 0)
+    spdlog::warn(
+      "{}: {} meshes have none of their primitives left, they are left out",
+      source.path.string(),
+      stats.skippedMeshes);
+
+  const std::size_t lodBytes = lodWriter.getPosition() - vertexBytes - indexBytes;
+  baked.bufferViews.resize(2);
+  auto& vertexView = baked.bufferViews[VERTEX_VIEW];
+  vertexView.name = "vertices";
+  vertexView.buffer = 0;
+  vertexView.byteOffset = 0;
+  vertexView.byteLength = vertexBytes;
+  vertexView.byteStride = sizeof(BakedVertex);
+  vertexView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
+  auto& indexView = baked.bufferViews[INDEX_VIEW];
+  indexView.name = "indices";
+  indexView.buffer = 0;
+  indexView.byteOffset = vertexBytes;
+  indexView.byteLength = indexBytes + lodBytes;
+  indexView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER;
+
+  vertexWriter.flush();
+  indexWriter.flush();
+  lodWriter.flush();
+
+  // Images embedded into buffers go after the LODs
+  std::size_t binBytes = vertexBytes + indexBytes + lodBytes;
+
+  for (std::size_t i = 0; i < model.images.size() && success; ++i)
+  {
+    const int view = model.images[i].bufferView;
+    if (view < 0)
+      continue;
+
+    const auto& sourceView = model.bufferViews[view];
+    binBytes = (binBytes + 3) & ~std::size_t{3};
+    BufferedWriter imageWriter{bin, binBytes};
+    for (std::size_t done = 0; done < sourceView.byteLength && success;)
+    {
+      const std::size_t chunk = std::min(WRITE_BUFFER_SIZE, sourceView.byteLength - done);
+      scratch.strided.resize(chunk);
+      success = reader.read(sourceView.buffer, sourceView.byteOffset + done, scratch.strided);
+      imageWriter.write(std::as_bytes(std::span(scratch.strided)));
+      done += chunk;
+    }
+    imageWriter.flush();
+
+    auto& bakedView = baked.bufferViews.emplace_back();
+    bakedView.buffer = 0;
+    bakedView.byteOffset = binBytes;
+    bakedView.byteLength = sourceView.byteLength;
+    binBytes += sourceView.byteLength;
+    baked.images[i].bufferView = static_cast<int>(baked.bufferViews.size() - 1);
+  }
+
+  bin.close();
+  success = success && !bin.fail();
+
+  std::string json;
+  if (success)
+  {
+    // NOTE: tinygltf can only write buffers it holds the data of, so the JSON is written
+    // without any and the one that is already on disk is added afterwards
+    std::ostringstream out;
+    tinygltf::TinyGLTF writer;
+    const bool serialized = writer.WriteGltfSceneToStream(&baked, out, true, false);
+
+    auto document = nlohmann::json::parse(out.str(), nullptr, false);
+    success = serialized && document.is_object();
+    if (success)
+    {
+      document["buffers"] = nlohmann::json::array({{
+        {"byteLength", binBytes},
+        {"uri", binPath.filename().string()},
+      }});
+      json = document.dump(2);
+
+      std::ofstream file(gltfPath, std::ios::trunc);
+      file << json;
+      success = static_cast<bool>(file);
+    }
+  }
+
+  if (!success)
+  {
+    spdlog::error("{}: failed to write the baked model", source.path.string());
+    std::filesystem::remove(binPath);
+    std::filesystem::remove(gltfPath);
+    return std::nullopt;
+  }
+
+  stats.binBytes = binBytes;
+  stats.jsonBytes = json.size();
+  stats.workingBytes += 3 * WRITE_BUFFER_SIZE;
+  return stats;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+
+#include "ModelSource.hpp"
+
+
+struct MeshBakeStats
+{
+  std::size_t primitives = 0;
+  // Primitives which aren't triangles with float positions, they are left out
+  std::size_t skippedPrimitives = 0;
+  // Meshes with only such primitives, nodes which refer to them are left without a mesh
+  std::size_t skippedMeshes = 0;
+  std::size_t vertices = 0;
+  std::size_t indices = 0;
+  // Simplified LODs of all primitives, not counting the primitives themselves
+  std::size_t lods = 0;
+  std::size_t lodIndices = 0;
+  std::size_t binBytes = 0;
+  std::size_t jsonBytes = 0;
+  // Most memory converting a single primitive took, write buffers included
+  std::size_t workingBytes = 0;
+};
+
+// scene.gltf is baked into scene_baked.gltf and scene_baked.bin next to it
+std::filesystem::path baked_model_path(const std::filesystem::path& gltf_path);
+
+// Converts meshes into the format of the task README: 32-byte vertices with 8-bit normals
+// and tangents, described with KHR_mesh_quantization, followed by 32-bit indices. All the
+// vertices of the model come first and all the indices after them, so that each half can be
+// uploaded into a buffer of its own as is.
+//
+// Every primitive also gets up to 3 LODs, simplified with MeshSimplifier down to about half of
+// the triangles of the previous one. They index the vertices of the primitive, their indices
+// follow the ones of all primitives in the same half, and the "lods" array in the extras of
+// a primitive lists their accessors, coarser ones last.
+//
+// Primitives are converted one at a time and streamed into the .bin through buffered writers,
+// their offsets are known beforehand from the accessor counts and LODs are appended as they
+// come. The .gltf is written once all of them are done. Nothing is written if any of the
+// files can't be.
+std::optional<MeshBakeStats> bake_meshes(const ModelSource& source);
@@ -0,0 +1,116 @@
+#include "ModelBaker.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "hashing/Hasher.hpp"
+#include "jobs/JobSystem.hpp"
+#include "textures/BakedTexture.hpp"
+
+
+static constexpr std::size_t HASH_CHUNK_SIZE = 1 << 20;
+
+// Files are hashed in chunks, so that this takes as little memory as baking does
+static bool hash_file(Hasher& hasher, const std::filesystem::path& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  std::vector<char> chunk(HASH_CHUNK_SIZE);
+  std::size_t total = 0;
+  while (file)
+  {
+    file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    const auto read = static_cast<std::size_t>(file.gcount());
+    hasher.bytes(chunk.data(), read);
+    total += read;
+  }
+  hasher.mix(total);
+  return true;
+}
+
+// Whatever is embedded into the model is hashed from memory, the rest from the files
+static std::optional<std::uint64_t> hash_sources(const ModelSource& source)
+{
+  Hasher hasher;
+  hasher.mix(BAKER_VERSION);
+  hasher.mix(BAKED_TEXTURE_VERSION);
+  hasher.string(source.gltfText);
+
+  const auto& model = source.model;
+  for (std::size_t i = 0; i < model.buffers.size(); ++i)
+    if (source.bufferFiles[i].empty())
+      hasher.bytes(model.buffers[i].data.data(), model.buffers[i].data.size());
+    else if (!hash_file(hasher, source.bufferFiles[i]))
+      return std::nullopt;
+  for (std::size_t i = 0; i < model.images.size(); ++i)
+    if (source.imageFiles[i].empty())
+      hasher.bytes(model.images[i].image.data(), model.images[i].image.size());
+    else if (!hash_file(hasher, source.imageFiles[i]))
+      return std::nullopt;
+
+  return hasher.state;
+}
+
+static bool outputs_exist(const ModelSource& source)
+{
+  auto bin = baked_model_path(source.path);
+  bin.replace_extension(".bin");
+  return std::filesystem::exists(baked_model_path(source.path)) &&
+    std::filesystem::exists(bin) &&
+    (source.model.images.empty() ||
+     std::filesystem::is_directory(baked_texture_path(source.path, 0).parent_path()));
+}
+
+ModelBakeResult bake_model(
+  const std::filesystem::path& gltf_path,
+  std::optional<std::uint64_t> previous_hash,
+  JobSystem& jobs)
+{
+  using Clock = std::chrono::steady_clock;
+  const auto ms = [](Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  };
+
+  ModelBakeResult result;
+  const auto start = Clock::now();
+
+  auto source = load_model_source(gltf_path);
+  if (!source.has_value())
+    return result;
+
+  const auto hash = hash_sources(*source);
+  if (!hash.has_value())
+  {
+    spdlog::error("{}: some of the files it refers to can't be read", gltf_path.string());
+    return result;
+  }
+  result.hash = *hash;
+  const auto loadedAt = Clock::now();
+  result.loadMs = ms(start, loadedAt);
+
+  if (previous_hash == result.hash && outputs_exist(*source))
+  {
+    result.status = ModelBakeResult::Status::UpToDate;
+    return result;
+  }
+
+  const auto meshes = bake_meshes(*source);
+  result.textures = bake_textures(*source, jobs);
+  result.bakeMs = ms(loadedAt, Clock::now());
+  if (meshes.has_value())
+  {
+    result.meshes = *meshes;
+    result.trackedBytes = source->residentBytes() + meshes->workingBytes + meshes->jsonBytes;
+  }
+  result.status = meshes.has_value() && result.textures.failed == 0
+    ? ModelBakeResult::Status::Baked
+    : ModelBakeResult::Status::Failed;
+
+  return result;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "MeshBaker.hpp"
+#include "TextureBaker.hpp"
+
+
+class JobSystem;
+
+// Part of the hash of every model, bump it whenever the baker starts producing something
+// different from the same sources, so that everything gets rebaked
+inline constexpr std::uint32_t BAKER_VERSION = 3;
+
+struct ModelBakeResult
+{
+  enum class Status
+  {
+    Baked,
+    // Sources hash to what the previous run baked them from and the outputs are there
+    UpToDate,
+    Failed,
+  };
+
+  Status status = Status::Failed;
+  // Of the gltf, its buffers, its images and the baker version, 0 if loading failed
+  std::uint64_t hash = 0;
+  MeshBakeStats meshes;
+  TextureBakeStats textures;
+  // Estimate of the peak from the buffers the baker tracks itself: the source buffers and
+  // images, mesh scratch and write buffers and the output JSON. Parsed tinygltf models and
+  // JSON copies made while parsing aren't counted. Images are baked separately and aren't
+  // included either.
+  std::size_t trackedBytes = 0;
+  double loadMs = 0;
+  double bakeMs = 0;
+};
+
+// Loads a .gltf model and bakes it unless its sources hash to previous_hash
+ModelBakeResult bake_model(
+  const std::filesystem::path& gltf_path,
+  std::optional<std::uint64_t> previous_hash,
+  JobSystem& jobs);
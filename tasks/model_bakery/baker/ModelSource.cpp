@@ -0,0 +1,177 @@
+#include "ModelSource.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+#include <json.hpp>
+#include <spdlog/spdlog.h>
+
+#include "textures/EncodedImages.hpp"
+
+
+// A single zero byte, tinygltf refuses empty buffers
+static constexpr std::string_view PLACEHOLDER_URI = "data:application/octet-stream;base64,AA==";
+
+// URIs of glTF files are percent-encoded, "my%20texture.png" is "my texture.png"
+static std::string decode_uri(std::string_view uri)
+{
+  std::string result;
+  result.reserve(uri.size());
+  for (std::size_t i = 0; i < uri.size(); ++i)
+  {
+    if (uri[i] == '%' && i + 2 < uri.size())
+    {
+      const std::string hex{uri.substr(i + 1, 2)};
+      char* end = nullptr;
+      const auto value = std::strtol(hex.c_str(), &end, 16);
+      if (end == hex.c_str() + 2)
+      {
+        result.push_back(static_cast<char>(value));
+        i += 2;
+        continue;
+      }
+    }
+    result.push_back(uri[i]);
+  }
+  return result;
+}
+
+static bool is_data_uri(std::string_view uri)
+{
+  return uri.starts_with("data:");
+}
+
+std::size_t ModelSource::residentBytes() const
+{
+  std::size_t result = gltfText.size();
+  for (const auto& buffer : model.buffers)
+    result += buffer.data.size();
+  for (const auto& image : model.images)
+    result += image.image.size();
+  return result;
+}
+
+std::optional<ModelSource> load_model_source(const std::filesystem::path& gltf_path)
+{
+  ModelSource result;
+  result.path = gltf_path;
+
+  {
+    std::ifstream file(gltf_path, std::ios::binary);
+    result.gltfText.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!file)
+    {
+      spdlog::error("{}: can't be read", gltf_path.string());
+      return std::nullopt;
+    }
+  }
+
+  const auto directory = gltf_path.parent_path();
+  std::string text;
+  try
+  {
+    auto json = nlohmann::json::parse(result.gltfText);
+
+    // Images can be embedded into buffers, tinygltf needs the data of those
+    std::vector<bool> holdsImages;
+    if (json.contains("buffers"))
+      holdsImages.resize(json["buffers"].size(), false);
+    if (json.contains("images"))
+      for (const auto& image : json["images"])
+        if (image.contains("bufferView"))
+        {
+          const auto& view = json.at("bufferViews").at(image["bufferView"].get<std::size_t>());
+          holdsImages.at(view.at("buffer").get<std::size_t>()) = true;
+        }
+
+    result.bufferFiles.resize(holdsImages.size());
+    for (std::size_t i = 0; i < holdsImages.size(); ++i)
+    {
+      auto& buffer = json["buffers"][i];
+      if (holdsImages[i] || !buffer.contains("uri"))
+        continue;
+      const auto uri = buffer["uri"].get<std::string>();
+      if (is_data_uri(uri))
+        continue;
+
+      result.bufferFiles[i] = directory / decode_uri(uri);
+      buffer["uri"] = PLACEHOLDER_URI;
+      buffer["byteLength"] = 1;
+    }
+
+    text = json.dump();
+  }
+  catch (const nlohmann::json::exception& e)
+  {
+    spdlog::error("{}: malformed glTF: {}", gltf_path.string(), e.what());
+    return std::nullopt;
+  }
+
+  tinygltf::TinyGLTF loader;
+  // NOTE: images from files are read again with read_image when they are baked
+  keep_images_encoded(loader, KeptImages::Embedded);
+
+  std::string error;
+  std::string warning;
+  const bool success = loader.LoadASCIIFromString(
+    &result.model,
+    &error,
+    &warning,
+    text.data(),
+    static_cast<unsigned int>(text.size()),
+    directory.string());
+  if (!warning.empty())
+    spdlog::warn("{}: {}", gltf_path.string(), warning);
+  if (!success)
+  {
+    spdlog::error("{}: failed to load: {}", gltf_path.string(), error);
+    return std::nullopt;
+  }
+
+  result.imageFiles.resize(result.model.images.size());
+  for (std::size_t i = 0; i < result.model.images.size(); ++i)
+    if (const auto& uri = result.model.images[i].uri; !uri.empty() && !is_data_uri(uri))
+      result.imageFiles[i] = directory / decode_uri(uri);
+
+  return result;
+}
+
+std::vector<std::uint8_t> read_image(const ModelSource& source, std::size_t image)
+{
+  if (source.imageFiles[image].empty())
+    return source.model.images[image].image;
+
+  std::ifstream file(source.imageFiles[image], std::ios::binary);
+  return std::vector<std::uint8_t>(
+    std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+BufferReader::BufferReader(const ModelSource& source_)
+  : source{source_}
+  , files(source_.model.buffers.size())
+{
+}
+
+bool BufferReader::read(std::size_t buffer, std::size_t offset, std::span<std::uint8_t> dst)
+{
+  if (buffer >= source.model.buffers.size())
+    return false;
+
+  if (source.bufferFiles[buffer].empty())
+  {
+    const auto& data = source.model.buffers[buffer].data;
+    if (offset > data.size() || dst.size() > data.size() - offset)
+      return false;
+    std::memcpy(dst.data(), data.data() + offset, dst.size());
+    return true;
+  }
+
+  auto& file = files[buffer];
+  if (!file.has_value())
+    file.emplace(source.bufferFiles[buffer], std::ios::binary);
+  file->clear();
+  file->seekg(static_cast<std::streamoff>(offset));
+  file->read(reinterpret_cast<char*>(dst.data()), static_cast<std::streamsize>(dst.size()));
+  return static_cast<bool>(*file);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <tiny_gltf.h>
+
+
+/**
+ * A source glTF model that is loaded without its external buffers and images, so that
+ * baking it takes memory proportional to the part being baked rather than to the model.
+ *
+ * tinygltf always reads buffers whole, so external ones are swapped for tiny placeholders
+ * before it parses the JSON and are read back range by range with BufferReader. External
+ * images are dropped right after tinygltf reads them and are read again with read_image.
+ * Buffers that images are embedded into and data URIs stay in memory as usual.
+ */
+struct ModelSource
+{
+  std::filesystem::path path;
+  // The JSON as it is on disk, placeholders aside
+  std::string gltfText;
+  tinygltf::Model model;
+  // Per buffer and per image, empty for the ones that are in the model itself
+  std::vector<std::filesystem::path> bufferFiles;
+  std::vector<std::filesystem::path> imageFiles;
+
+  // Bytes of the model which are held in memory: the JSON, embedded buffers and images
+  std::size_t residentBytes() const;
+};
+
+std::optional<ModelSource> load_model_source(const std::filesystem::path& gltf_path);
+
+// Encoded image, from the file it is in or from the model
+std::vector<std::uint8_t> read_image(const ModelSource& source, std::size_t image);
+
+class BufferReader
+{
+public:
+  explicit BufferReader(const ModelSource& source);
+
+  // Fails if the range is outside of the buffer or the file can't be read
+  bool read(std::size_t buffer, std::size_t offset, std::span<std::uint8_t> dst);
+
+private:
+  const ModelSource& source;
+  // Opened on first use
+  std::vector<std::optional<std::ifstream>> files;
+};
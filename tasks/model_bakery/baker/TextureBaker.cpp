@@ -0,0 +1,140 @@
+#include "TextureBaker.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#include "jobs/JobSystem.hpp"
+#include "textures/BakedTexture.hpp"
+#include "textures/BlockCompression.hpp"
+#include "textures/EncodedImages.hpp"
+#include "textures/TextureMips.hpp"
+
+
+// What an image is used as decides its format. Usages are ordered by how much of the image
+// has to survive: an image that is both a normal map and a metallic-roughness map keeps all
+// of its channels, and base colors always stay sRGB.
+enum class ImageUsage
+{
+  None,
+  Normal,
+  MetallicRoughness,
+  BaseColor,
+};
+
+static std::vector<ImageUsage> find_image_usages(const tinygltf::Model& model)
+{
+  std::vector<ImageUsage> result(model.images.size(), ImageUsage::None);
+
+  auto use = [&](int texture, ImageUsage usage) {
+    if (texture < 0 || model.textures[texture].source < 0)
+      return;
+    auto& current = result[model.textures[texture].source];
+    current = std::max(current, usage);
+  };
+
+  for (const auto& material : model.materials)
+  {
+    use(material.pbrMetallicRoughness.baseColorTexture.index, ImageUsage::BaseColor);
+    use(material.normalTexture.index, ImageUsage::Normal);
+    use(
+      material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+      ImageUsage::MetallicRoughness);
+  }
+
+  return result;
+}
+
+static std::optional<BakedTexture> bake_image(
+  const ModelSource& source, std::size_t index, ImageUsage usage, JobSystem& jobs)
+{
+  std::uint64_t sourceHash = 0;
+  DecodedImage decoded;
+  {
+    const auto encoded = read_image(source, index);
+    sourceHash = hash_source_image(encoded);
+    decoded = decode_image_mips(encoded);
+  }
+  if (decoded.mips.empty())
+  {
+    spdlog::warn(
+      "Failed to decode image {} '{}': {}, it is left as is",
+      index,
+      source.model.images[index].uri,
+      decoded.error);
+    return std::nullopt;
+  }
+
+  TextureFormat format = TextureFormat::BC5_UNORM;
+  BlockFormat blockFormat = BlockFormat::BC5;
+  if (usage == ImageUsage::BaseColor)
+  {
+    format = TextureFormat::BC7_SRGB;
+    blockFormat = BlockFormat::BC7;
+  }
+  else if (usage == ImageUsage::MetallicRoughness)
+  {
+    format = TextureFormat::BC1_UNORM;
+    blockFormat = BlockFormat::BC1;
+  }
+
+  BakedTexture result{
+    .format = format, .size = decoded.size, .sourceHash = sourceHash, .mips = {}};
+  result.mips.reserve(decoded.mips.size());
+  for (std::uint32_t mip = 0; mip < decoded.mips.size(); ++mip)
+    result.mips.push_back(
+      compress_blocks(blockFormat, decoded.mips[mip], mip_size(decoded.size, mip), &jobs));
+
+  return result;
+}
+
+TextureBakeStats bake_textures(const ModelSource& source, JobSystem& jobs)
+{
+  const auto& model = source.model;
+  const auto usages = find_image_usages(model);
+  if (!model.images.empty())
+    std::filesystem::create_directories(baked_texture_path(source.path, 0).parent_path());
+
+  std::vector<TextureBakeStats> imageStats(model.images.size());
+  // NOTE: images differ in size a lot, so each one is a job of its own,
+  // rows of blocks of large ones are spread over the pool too
+  jobs.parallelFor("bakeTextures", model.images.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+    {
+      if (usages[i] == ImageUsage::None)
+        continue;
+
+      auto& stats = imageStats[i];
+      const auto baked = bake_image(source, i, usages[i], jobs);
+      const auto path = baked_texture_path(source.path, static_cast<std::uint32_t>(i));
+      if (!baked.has_value() || !write_baked_texture(path, *baked))
+      {
+        // A stale file from an earlier bake would be loaded instead of the image otherwise
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        ++stats.failed;
+        continue;
+      }
+
+      ++stats.baked;
+      for (std::uint32_t mip = 0; mip < baked->mips.size(); ++mip)
+      {
+        const glm::uvec2 size = mip_size(baked->size, mip);
+        stats.rawBytes += std::size_t{size.x} * size.y * 4;
+        stats.bakedBytes += baked->mips[mip].size();
+      }
+    }
+  });
+
+  TextureBakeStats result;
+  for (const auto& stats : imageStats)
+  {
+    result.baked += stats.baked;
+    result.failed += stats.failed;
+    result.rawBytes += stats.rawBytes;
+    result.bakedBytes += stats.bakedBytes;
+  }
+  return result;
+}
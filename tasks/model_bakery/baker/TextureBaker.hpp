@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ModelSource.hpp"
+
+
+class JobSystem;
+
+struct TextureBakeStats
+{
+  std::size_t baked = 0;
+  std::size_t failed = 0;
+  // What all mips would take in RGBA8 and what they take baked
+  std::size_t rawBytes = 0;
+  std::size_t bakedBytes = 0;
+};
+
+// Bakes every image the materials of the model use into a .btex next to it, see
+// baked_texture_path. Base colors become BC7 (sRGB), normal maps BC5 and metallic-roughness
+// maps BC1. Every image is written as soon as it is baked, so only the ones being baked at
+// the moment are in memory.
+TextureBakeStats bake_textures(const ModelSource& source, JobSystem& jobs);
@@ -1,4 +1,277 @@
-int main()
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "jobs/JobSystem.hpp"
+
+#include "BakeManifest.hpp"
+#include "ModelBaker.hpp"
+
+
+// Usage: model_bakery_baker [--force] [--manifest <file>] <model>...
+// where every model is a .gltf file, a directory to search for them recursively or a glob
+// such as "scenes/*/scene.gltf" or "scenes/**/*.gltf". Models are baked concurrently, the ones
+// that haven't changed since the previous run are skipped unless --force is given.
+
+static constexpr std::string_view DEFAULT_MANIFEST = "model_bakery_manifest.txt";
+
+// Peak resident memory of the whole process so far
+static std::size_t process_peak_bytes()
 {
-  return 0;
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+  // NOTE: ru_maxrss is in bytes on macOS and in kilobytes everywhere else
+#if defined(__APPLE__)
+  return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+static bool is_source_model(const std::filesystem::path& path)
+{
+  return path.extension() == ".gltf" && !path.stem().string().ends_with("_baked");
+}
+
+static bool has_wildcards(std::string_view str)
+{
+  return str.find_first_of("*?") != std::string_view::npos;
+}
+
+// '*' is any amount of characters and '?' is any single one
+static bool matches_wildcard(std::string_view pattern, std::string_view name)
+{
+  if (pattern.empty())
+    return name.empty();
+  if (pattern.front() == '*')
+    return matches_wildcard(pattern.substr(1), name) ||
+      (!name.empty() && matches_wildcard(pattern, name.substr(1)));
+  if (name.empty() || (pattern.front() != '?' && pattern.front() != name.front()))
+    return false;
+  return matches_wildcard(pattern.substr(1), name.substr(1));
+}
+
+static void find_models(
+  const std::filesystem::path& directory, std::vector<std::filesystem::path>& out)
+{
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec))
+    if (entry.is_regular_file() && is_source_model(entry.path()))
+      out.push_back(entry.path());
+}
+
+// Expands the remaining components of a glob relative to base, "**" is any amount of
+// directories
+static void expand_glob(
+  const std::filesystem::path& base,
+  std::span<const std::string> components,
+  std::vector<std::filesystem::path>& out)
+{
+  if (components.empty())
+  {
+    if (std::filesystem::is_directory(base))
+      find_models(base, out);
+    else if (is_source_model(base))
+      out.push_back(base);
+    return;
+  }
+
+  const auto& component = components.front();
+  if (!has_wildcards(component))
+  {
+    if (std::filesystem::exists(base / component))
+      expand_glob(base / component, components.subspan(1), out);
+    return;
+  }
+
+  std::error_code ec;
+  if (component == "**")
+  {
+    expand_glob(base, components.subspan(1), out);
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(base, ec))
+      if (entry.is_directory())
+        expand_glob(entry.path(), components.subspan(1), out);
+    return;
+  }
+
+  for (const auto& entry : std::filesystem::directory_iterator(base, ec))
+    if (matches_wildcard(component, entry.path().filename().string()))
+      expand_glob(entry.path(), components.subspan(1), out);
+}
+
+static std::vector<std::filesystem::path> collect_models(std::span<const std::string> args)
+{
+  std::vector<std::filesystem::path> result;
+  for (const auto& arg : args)
+  {
+    const std::filesystem::path path = arg;
+    const std::size_t before = result.size();
+
+    if (!has_wildcards(arg))
+    {
+      // An explicitly named file is baked even if it doesn't look like a source model
+      if (std::filesystem::is_regular_file(path))
+        result.push_back(path);
+      else
+        find_models(path, result);
+    }
+    else
+    {
+      std::vector<std::string> components;
+      for (const auto& component : path.relative_path())
+        components.push_back(component.string());
+      expand_glob(path.has_root_path() ? path.root_path() : ".", components, result);
+    }
+
+    if (result.size() == before)
+      spdlog::warn("'{}' matches no models", arg);
+  }
+
+  for (auto& path : result)
+    path = std::filesystem::weakly_canonical(path);
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  bool force = false;
+  std::filesystem::path manifestPath = DEFAULT_MANIFEST;
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string_view arg = argv[i];
+    if (arg == "--force")
+      force = true;
+    else if (arg == "--manifest" && i + 1 < argc)
+      manifestPath = argv[++i];
+    else
+      inputs.emplace_back(arg);
+  }
+
+  if (inputs.empty())
+  {
+    spdlog::error("Usage: model_bakery_baker [--force] [--manifest <file>] <model>...");
+    return 1;
+  }
+
+  const auto models = collect_models(inputs);
+  if (models.empty())
+    return 1;
+
+  auto manifest = BakeManifest::read(manifestPath);
+  std::vector<ModelBakeResult> results(models.size());
+  std::atomic<std::size_t> finished{0};
+
+  JobSystem& jobs = get_job_system();
+  const auto start = std::chrono::steady_clock::now();
+
+  // NOTE: every model is a job of its own, and so is every image of it and every row of
+  // blocks of a large image, which keeps the pool busy no matter how the work is spread
+  jobs.parallelFor("bakeModels", models.size(), 1, [&](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i)
+    {
+      const auto previousHash = force ? std::nullopt : manifest.find(models[i]);
+      const auto& result = results[i] = bake_model(models[i], previousHash, jobs);
+
+      const std::size_t done = ++finished;
+      switch (result.status)
+      {
+      case ModelBakeResult::Status::Baked:
+        spdlog::info(
+          "[{}/{}] {}: {} primitives with {} vertices and {} LODs of {} triangles on top of {}, "
+          "{} textures of {:.1f} MB instead of {:.1f} MB, loaded in {:.1f} ms, baked in {:.1f} ms "
+          "with {:.1f} MB of tracked buffers (estimate)",
+          done,
+          models.size(),
+          models[i].string(),
+          result.meshes.primitives,
+          result.meshes.vertices,
+          result.meshes.lods,
+          result.meshes.lodIndices / 3,
+          result.meshes.indices / 3,
+          result.textures.baked,
+          static_cast<double>(result.textures.bakedBytes) / (1 << 20),
+          static_cast<double>(result.textures.rawBytes) / (1 << 20),
+          result.loadMs,
+          result.bakeMs,
+          static_cast<double>(result.trackedBytes) / (1 << 20));
+        break;
+      case ModelBakeResult::Status::UpToDate:
+        spdlog::info(
+          "[{}/{}] {}: up to date, checked in {:.1f} ms",
+          done,
+          models.size(),
+          models[i].string(),
+          result.loadMs);
+        break;
+      case ModelBakeResult::Status::Failed:
+        spdlog::error("[{}/{}] {}: failed", done, models.size(), models[i].string());
+        break;
+      }
+    }
+  });
+
+  std::size_t baked = 0;
+  std::size_t upToDate = 0;
+  std::size_t failed = 0;
+  std::size_t trackedBytes = 0;
+  for (std::size_t i = 0; i < models.size(); ++i)
+    switch (results[i].status)
+    {
+    case ModelBakeResult::Status::Baked:
+      ++baked;
+      trackedBytes = std::max(trackedBytes, results[i].trackedBytes);
+      manifest.set(models[i], results[i].hash);
+      break;
+    case ModelBakeResult::Status::UpToDate:
+      ++upToDate;
+      break;
+    case ModelBakeResult::Status::Failed:
+      ++failed;
+      manifest.erase(models[i]);
+      break;
+    }
+
+  if (!manifest.write(manifestPath))
+    spdlog::warn("Failed to write the bake manifest {}", manifestPath.string());
+
+  // NOTE: models are baked concurrently, so the process peak covers all of them at once
+  spdlog::info(
+    "{} models: {} baked, {} up to date, {} failed in {:.1f} s on {} threads, the largest "
+    "one tracked {:.1f} MB of buffers, the process peaked at {:.1f} MB resident",
+    models.size(),
+    baked,
+    upToDate,
+    failed,
+    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+    jobs.getWorkerCount() + 1,
+    static_cast<double>(trackedBytes) / (1 << 20),
+    static_cast<double>(process_peak_bytes()) / (1 << 20));
+
+  return failed == 0 ? 0 : 1;
 }
@@ -2,6 +2,8 @@
 
 #include <tracy/Tracy.hpp>
 
+#include "gui/ImGuiRenderer.hpp"
+
 
 App::App()
 {
@@ -19,9 +21,13 @@ App::App()
 
   renderer->initFrameDelivery(std::move(surface), [this]() { return mainWindow->getResolution(); });
 
+  // NOTE: depends on the ImGui context the renderer has just created
+  ImGuiRenderer::enableImGuiForWindow(mainWindow->native());
+
   mainCam.lookAt({0, 10, 10}, {0, 0, 0}, {0, 1, 0});
 
-  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/low_poly_dark_town/scene.gltf");
+  // NOTE: bake it with model_bakery_baker first
+  renderer->loadScene(GRAPHICS_COURSE_RESOURCES_ROOT "/scenes/lovely_town/scene_baked.gltf");
 }
 
 void App::run()
@@ -5,6 +5,9 @@
 #include <etna/RenderTargetStates.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/Profiling.hpp>
+#include <imgui.h>
+
+#include <gui/ImGuiRenderer.hpp>
 
 
 Renderer::Renderer(glm::uvec2 res)
@@ -58,6 +61,8 @@ void Renderer::initFrameDelivery(vk::UniqueSurfaceKHR a_surface, ResolutionProvi
   worldRenderer->allocateResources(resolution);
   worldRenderer->loadShaders();
   worldRenderer->setupPipelines(window->getCurrentFormat());
+
+  guiRenderer = std::make_unique<ImGuiRenderer>(window->getCurrentFormat());
 }
 
 void Renderer::loadScene(std::filesystem::path path)
@@ -93,6 +98,14 @@ void Renderer::drawFrame()
 {
   ZoneScoped;
 
+  {
+    ZoneScopedN("drawGui");
+    guiRenderer->nextFrame();
+    ImGui::NewFrame();
+    worldRenderer->drawGui();
+    ImGui::Render();
+  }
+
   auto currentCmdBuf = commandManager->acquireNext();
 
   etna::begin_frame();
@@ -109,6 +122,12 @@ void Renderer::drawFrame()
 
       worldRenderer->renderWorld(currentCmdBuf, image, view);
 
+      {
+        ImDrawData* pDrawData = ImGui::GetDrawData();
+        guiRenderer->render(
+          currentCmdBuf, {{0, 0}, {resolution.x, resolution.y}}, image, view, pDrawData);
+      }
+
       etna::set_state(
         currentCmdBuf,
         image,
@@ -11,6 +11,9 @@
 #include "WorldRenderer.hpp"
 
 
+class ImGuiRenderer;
+
+
 using ResolutionProvider = fu2::unique_function<glm::uvec2() const>;
 
 class Renderer
@@ -38,4 +41,5 @@ private:
   bool useVsync = true;
 
   std::unique_ptr<WorldRenderer> worldRenderer;
+  std::unique_ptr<ImGuiRenderer> guiRenderer;
 };
@@ -1,10 +1,14 @@
 #include "WorldRenderer.hpp"
 
+#include <cmath>
+#include <limits>
+
 #include <etna/GlobalContext.hpp>
 #include <etna/PipelineManager.hpp>
 #include <etna/RenderTargetStates.hpp>
 #include <etna/Profiling.hpp>
 #include <glm/ext.hpp>
+#include <imgui.h>
 
 
 WorldRenderer::WorldRenderer()
@@ -28,7 +32,9 @@ void WorldRenderer::allocateResources(glm::uvec2 swapchain_resolution)
 
 void WorldRenderer::loadScene(std::filesystem::path path)
 {
-  sceneMgr->selectScene(path);
+  sceneMgr->selectBakedScene(path);
+  instanceLods.assign(sceneMgr->getInstanceMeshes().size(), 0);
+  clusterProxied.assign(sceneMgr->getHlodClusters().size(), 0);
 }
 
 void WorldRenderer::loadShaders()
@@ -44,7 +50,7 @@ void WorldRenderer::setupPipelines(vk::Format swapchain_format)
 {
   etna::VertexShaderInputDescription sceneVertexInputDesc{
     .bindings = {etna::VertexShaderInputDescription::Binding{
-      .byteStreamDescription = sceneMgr->getVertexFormatDescription(),
+      .byteStreamDescription = sceneMgr->getBakedVertexFormatDescription(),
     }},
   };
 
@@ -79,7 +85,87 @@ void WorldRenderer::update(const FramePacket& packet)
   // calc camera matrix
   {
     const float aspect = float(resolution.x) / float(resolution.y);
-    worldViewProj = packet.mainCam.projTm(aspect) * packet.mainCam.viewTm();
+    const auto proj = packet.mainCam.projTm(aspect);
+    worldViewProj = proj * packet.mainCam.viewTm();
+    cameraPosition = packet.mainCam.position;
+    // NOTE: the projection is flipped for Vulkan
+    projectionScale = std::abs(proj[1][1]);
+  }
+}
+
+// Of the bounding sphere of the box: its diameter over the height of the screen. The height
+// is 2 in NDC and the diameter projects to 2 * radius * projection_scale / distance.
+// The camera may also be inside of the sphere.
+static float screen_size(const BoundingBox& bounds, glm::vec3 camera, float projection_scale)
+{
+  const glm::vec3 center = 0.5f * (bounds.min + bounds.max);
+  const float radius = 0.5f * glm::length(bounds.max - bounds.min);
+  const float distance = glm::length(center - camera);
+  return distance > radius ? radius * projection_scale / distance
+                           : std::numeric_limits<float>::infinity();
+}
+
+// LOD l is used while the screen size is below the l-th threshold, and a switch only happens
+// once the size is hysteresis past one
+static std::uint32_t select_lod(
+  float screen_size,
+  std::uint32_t current,
+  std::uint32_t lod_count,
+  float first_size,
+  float size_ratio,
+  float hysteresis)
+{
+  auto threshold = [&](std::uint32_t lod) {
+    return first_size * std::pow(size_ratio, static_cast<float>(lod - 1));
+  };
+
+  std::uint32_t lod = std::min(current, lod_count - 1);
+  while (lod + 1 < lod_count && screen_size < threshold(lod + 1) * (1.0f - hysteresis))
+    ++lod;
+  while (lod > 0 && screen_size > threshold(lod) * (1.0f + hysteresis))
+    --lod;
+  return lod;
+}
+
+void WorldRenderer::selectLods()
+{
+  ZoneScoped;
+
+  auto instanceMeshes = sceneMgr->getInstanceMeshes();
+  auto instanceBounds = sceneMgr->getInstanceBounds();
+  auto meshes = sceneMgr->getMeshes();
+
+  for (std::size_t i = 0; i < instanceMeshes.size(); ++i)
+  {
+    const auto lodCount = meshes[instanceMeshes[i]].lodCount;
+    if (forcedLod >= 0)
+    {
+      instanceLods[i] = std::min(static_cast<std::uint32_t>(forcedLod), lodCount - 1);
+      continue;
+    }
+
+    const float screenSize = screen_size(instanceBounds[i], cameraPosition, projectionScale);
+    instanceLods[i] = select_lod(
+      screenSize, instanceLods[i], lodCount, lodScreenSize, lodSizeRatio, lodHysteresis);
+  }
+}
+
+void WorldRenderer::selectProxies()
+{
+  ZoneScoped;
+
+  auto clusters = sceneMgr->getHlodClusters();
+  for (std::size_t i = 0; i < clusters.size(); ++i)
+  {
+    if (!useHlods)
+    {
+      clusterProxied[i] = 0;
+      continue;
+    }
+
+    const float screenSize = screen_size(clusters[i].bounds, cameraPosition, projectionScale);
+    const float hysteresis = clusterProxied[i] != 0 ? lodHysteresis : -lodHysteresis;
+    clusterProxied[i] = screenSize < hlodScreenSize * (1.0f + hysteresis) ? 1 : 0;
   }
 }
 
@@ -94,28 +180,137 @@ void WorldRenderer::renderScene(
 
   pushConst2M.projView = glob_tm;
 
+  selectLods();
+  selectProxies();
+
   auto instanceMeshes = sceneMgr->getInstanceMeshes();
   auto instanceMatrices = sceneMgr->getInstanceMatrices();
 
   auto meshes = sceneMgr->getMeshes();
   auto relems = sceneMgr->getRenderElements();
 
-  for (std::size_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
-  {
-    pushConst2M.model = instanceMatrices[instIdx];
+  lodStats.clear();
+  fullDetailTriangles = 0;
+  proxies = 0;
+  proxyTriangles = 0;
+  drawCalls = 0;
+  instanceDrawCalls = 0;
+
+  auto drawMesh = [&](const glm::mat4x4& model, const Mesh& mesh, std::uint32_t lod) {
+    pushConst2M.model = model;
 
     cmd_buf.pushConstants<PushConstants>(
       pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, {pushConst2M});
 
-    const auto meshIdx = instanceMeshes[instIdx];
-
-    for (std::size_t j = 0; j < meshes[meshIdx].relemCount; ++j)
+    std::size_t triangles = 0;
+    for (std::size_t j = 0; j < mesh.relemCount; ++j)
     {
-      const auto relemIdx = meshes[meshIdx].firstRelem + j;
+      const auto relemIdx = mesh.firstRelem + lod * mesh.relemCount + j;
       const auto& relem = relems[relemIdx];
       cmd_buf.drawIndexed(relem.indexCount, 1, relem.indexOffset, relem.vertexOffset, 0);
+      triangles += relem.indexCount / 3;
+    }
+    drawCalls += mesh.relemCount;
+    return triangles;
+  };
+
+  // Stats of an instance are counted even when its cluster is drawn as a proxy instead
+  auto countInstance = [&](std::uint32_t inst_idx) {
+    const auto& mesh = meshes[instanceMeshes[inst_idx]];
+    for (std::size_t j = 0; j < mesh.relemCount; ++j)
+      fullDetailTriangles += relems[mesh.firstRelem + j].indexCount / 3;
+    instanceDrawCalls += mesh.relemCount;
+  };
+
+  auto drawInstance = [&](std::uint32_t inst_idx) {
+    countInstance(inst_idx);
+
+    const auto lod = instanceLods[inst_idx];
+    if (lodStats.size() <= lod)
+      lodStats.resize(lod + 1);
+    auto& stats = lodStats[lod];
+    ++stats.instances;
+    stats.triangles += drawMesh(instanceMatrices[inst_idx], meshes[instanceMeshes[inst_idx]], lod);
+  };
+
+  auto clusters = sceneMgr->getHlodClusters();
+  if (clusters.empty())
+  {
+    for (std::uint32_t instIdx = 0; instIdx < instanceMeshes.size(); ++instIdx)
+      drawInstance(instIdx);
+    return;
+  }
+
+  // From the root down, the first cluster small enough on the screen is drawn as its proxy
+  // and the leaves which aren't are drawn as their instances
+  auto clusterInstances = sceneMgr->getHlodInstances();
+  std::vector<std::uint32_t> pending = {0};
+  while (!pending.empty())
+  {
+    const auto& cluster = clusters[pending.back()];
+    const bool proxied = clusterProxied[pending.back()] != 0;
+    pending.pop_back();
+
+    const auto instances = clusterInstances.subspan(cluster.firstInstance, cluster.instanceCount);
+    if (proxied)
+    {
+      for (const auto instIdx : instances)
+        countInstance(instIdx);
+      // NOTE: proxies are in world space already
+      ++proxies;
+      proxyTriangles += drawMesh(glm::mat4x4(1.0f), meshes[cluster.proxyMesh], 0);
     }
+    else if (cluster.childCount == 0)
+      for (const auto instIdx : instances)
+        drawInstance(instIdx);
+    else
+      for (std::uint32_t i = 0; i < cluster.childCount; ++i)
+        pending.push_back(cluster.firstChild + i);
+  }
+}
+
+void WorldRenderer::drawGui()
+{
+  ImGui::Begin("Simple render settings");
+
+  if (ImGui::CollapsingHeader("LODs", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::SliderFloat("LOD 1 below screen size", &lodScreenSize, 0.01f, 1.0f);
+    ImGui::SliderFloat("Next LODs at size ratio", &lodSizeRatio, 0.1f, 0.9f);
+    ImGui::SliderFloat("Hysteresis", &lodHysteresis, 0.0f, 0.5f);
+    ImGui::SliderInt("Forced LOD, -1 is off", &forcedLod, -1, 3);
+
+    std::size_t triangles = proxyTriangles;
+    for (const auto& stats : lodStats)
+      triangles += stats.triangles;
+    ImGui::Text("Triangles: %zu out of %zu at full detail", triangles, fullDetailTriangles);
+    for (std::size_t lod = 0; lod < lodStats.size(); ++lod)
+      ImGui::Text(
+        "LOD %zu: %zu instances, %zu triangles",
+        lod,
+        lodStats[lod].instances,
+        lodStats[lod].triangles);
+  }
+
+  if (ImGui::CollapsingHeader("HLOD", ImGuiTreeNodeFlags_DefaultOpen))
+  {
+    ImGui::Checkbox("Draw far clusters as proxies", &useHlods);
+    ImGui::SliderFloat("Proxies below screen size", &hlodScreenSize, 0.01f, 1.0f);
+
+    ImGui::Text(
+      "Proxies: %zu out of %zu clusters, %zu triangles",
+      proxies,
+      clusterProxied.size(),
+      proxyTriangles);
+    ImGui::Text("Draw calls: %zu, %zu without proxies", drawCalls, instanceDrawCalls);
   }
+
+  ImGui::Text(
+    "Application average %.3f ms/frame (%.1f FPS)",
+    1000.0f / ImGui::GetIO().Framerate,
+    ImGui::GetIO().Framerate);
+
+  ImGui::End();
 }
 
 void WorldRenderer::renderWorld(
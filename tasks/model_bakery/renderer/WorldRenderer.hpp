@@ -30,6 +30,10 @@ public:
     vk::CommandBuffer cmd_buf, vk::Image target_image, vk::ImageView target_image_view);
 
 private:
+  // Picks an LOD for every instance from the size of its bounding sphere on the screen
+  void selectLods();
+  // Picks HLOD clusters to draw as proxies the same way, from the sizes of their bounds
+  void selectProxies();
   void renderScene(
     vk::CommandBuffer cmd_buf, const glm::mat4x4& glob_tm, vk::PipelineLayout pipeline_layout);
 
@@ -48,6 +52,41 @@ private:
 
   glm::mat4x4 worldViewProj;
   glm::mat4x4 lightMatrix;
+  glm::vec3 cameraPosition{};
+  // Element [1][1] of the projection, the cotangent of half of the vertical FOV
+  float projectionScale = 1.0f;
+
+  // Instances switch to LOD 1 once their bounding spheres take less than this share of
+  // the height of the screen, every next LOD kicks in at lodSizeRatio of the previous size.
+  // An instance only switches once it is lodHysteresis past a threshold, so that the ones
+  // sitting right at it don't flicker.
+  float lodScreenSize = 0.25f;
+  float lodSizeRatio = 0.5f;
+  float lodHysteresis = 0.1f;
+  // All instances use this LOD or the coarsest they have if it isn't negative
+  int forcedLod = -1;
+  std::vector<std::uint32_t> instanceLods;
+
+  // Clusters of the scene are drawn as single proxy meshes instead of their instances once
+  // they take less than hlodScreenSize of the height of the screen, with the same hysteresis.
+  // A cluster which is drawn as a proxy also stands for all of the clusters under it.
+  bool useHlods = true;
+  float hlodScreenSize = 0.1f;
+  std::vector<std::uint8_t> clusterProxied;
+
+  struct LodStats
+  {
+    std::size_t instances = 0;
+    std::size_t triangles = 0;
+  };
+  // Of the last rendered frame
+  std::vector<LodStats> lodStats;
+  std::size_t fullDetailTriangles = 0;
+  std::size_t proxies = 0;
+  std::size_t proxyTriangles = 0;
+  std::size_t drawCalls = 0;
+  // What drawing every instance on its own would take
+  std::size_t instanceDrawCalls = 0;
 
   etna::GraphicsPipeline staticMeshPipeline{};
 
@@ -2,11 +2,14 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_GOOGLE_include_directive : require
 
-#include "unpack_attributes.glsl"
 
-
-layout(location = 0) in vec4 vPosNorm;
-layout(location = 1) in vec4 vTexCoordAndTang;
+// Baked vertex format, see the README of the task
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec4 vNorm;
+layout(location = 2) in vec2 vTexCoord;
+layout(location = 3) in vec4 vTang;
+// Written into the padding by SceneManager, merged HLOD proxies have many materials
+layout(location = 4) in uint vMaterial;
 
 layout(push_constant) uniform params_t
 {
@@ -21,19 +24,23 @@ layout (location = 0 ) out VS_OUT
   vec3 wNorm;
   vec3 wTangent;
   vec2 texCoord;
+  // Index into the material table
+  flat uint material;
 } vOut;
 
 out gl_PerVertex { vec4 gl_Position; };
 
 void main(void)
 {
-  const vec4 wNorm = vec4(decode_normal(floatBitsToInt(vPosNorm.w)),     0.0f);
-  const vec4 wTang = vec4(decode_normal(floatBitsToInt(vTexCoordAndTang.z)), 0.0f);
+  // Normals and tangents are quantized to a uniform grid on [-1, 1] stored as unorm bytes
+  const vec4 wNorm = vec4(vNorm.xyz * 2.0f - 1.0f, 0.0f);
+  const vec4 wTang = vec4(vTang.xyz * 2.0f - 1.0f, 0.0f);
 
-  vOut.wPos   = (params.mModel * vec4(vPosNorm.xyz, 1.0f)).xyz;
+  vOut.wPos   = (params.mModel * vec4(vPos, 1.0f)).xyz;
   vOut.wNorm  = normalize(mat3(transpose(inverse(params.mModel))) * wNorm.xyz);
   vOut.wTangent = normalize(mat3(transpose(inverse(params.mModel))) * wTang.xyz);
-  vOut.texCoord = vTexCoordAndTang.xy;
+  vOut.texCoord = vTexCoord;
+  vOut.material = vMaterial;
 
   gl_Position   = params.mProjView * vec4(vOut.wPos, 1.0);
 }